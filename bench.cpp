@@ -0,0 +1,539 @@
+/*
+    Benchmark harness for file I/O and conversion throughput. Build with optimizations
+    (make bench) for meaningful numbers.
+
+    usage: bench.out [--frames N] [--channels 1,2,8] [--repeats N] [--output table|csv|json] [--dir DIR] [--filter TEXT]
+                     [--voices N] [--budget FRACTION]
+
+    Synthetic files are generated for every supported format (8/16/24/32-bit int, 32/64-bit float)
+    and each channel count. Every benchmark is run --repeats times and the fastest run is reported,
+    with throughput in MB/s of PCM data and in million frames per second. Resampling also reports the
+    realtime factor of one core, seconds of audio converted per second. For the playback engine the
+    realtime factor is the number of voices one core can render, and the table also shows how many
+    voices fit in --budget of one core. The csv and json outputs are meant for tracking regressions
+    between versions.
+*/
+
+#include "wav_handler.h"
+#include "wav_handler_cpp.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct Format
+{
+    const char *name;
+    unsigned bit_depth;
+    int is_float;
+};
+
+static const Format formats[] = {
+    {"pcm8", 8, 0},
+    {"pcm16", 16, 0},
+    {"pcm24", 24, 0},
+    {"pcm32", 32, 0},
+    {"float32", 32, 1},
+    {"float64", 64, 1},
+};
+
+static const char *isa_names[] = {"scalar", "sse2", "avx2"};
+
+struct Options
+{
+    unsigned frames = 1 << 20;
+    std::vector<unsigned> channels = {1, 2, 8};
+    int repeats = 3;
+    std::string output = "table";
+    std::string dir = ".";
+    std::string filter;
+    unsigned voices = 128;
+    // Fraction of one core available to the audio thread
+    double budget = 0.5;
+};
+
+struct Result
+{
+    std::string benchmark;
+    std::string format;
+    unsigned channels;
+    std::string variant;
+    unsigned long long frames;
+    unsigned long long bytes;
+    double seconds;
+    // Input sample rate for the realtime factor, 0 if not applicable
+    unsigned sample_rate;
+
+    double realtime() const
+    {
+        return sample_rate ? frames / static_cast<double>(sample_rate) / seconds : 0;
+    }
+};
+
+template <typename F>
+static double time_seconds(F &&f)
+{
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+class Harness
+{
+    const Options &options;
+    std::vector<Result> results;
+
+public:
+    explicit Harness(const Options &options) : options(options) {}
+
+    /**
+     * @brief Returns false if the benchmark is excluded by --filter.
+     */
+    bool enabled(const std::string &benchmark, const Format &fmt, unsigned channels, const std::string &variant) const
+    {
+        const std::string name = benchmark + "/" + fmt.name + "/" + std::to_string(channels) + "/" + variant;
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    /**
+     * @brief Run f options.repeats times (after setup each time, which is not timed) and record the fastest run.
+     * frames and bytes are the amount of data processed by one run, sample_rate the rate of the frames
+     * if the realtime factor should be reported.
+     */
+    void run(const std::string &benchmark, const Format &fmt, unsigned channels, const std::string &variant,
+             unsigned long long frames, unsigned long long bytes, const std::function<void()> &f,
+             const std::function<void()> &setup = nullptr, unsigned sample_rate = 0)
+    {
+        run_measured(benchmark, fmt, channels, variant, frames, bytes, [&]
+                     {
+                         if (setup)
+                             setup();
+                         return time_seconds(f); },
+                     sample_rate);
+    }
+
+    /**
+     * @brief Like run, but f measures itself and returns the seconds to record, for benchmarks where only
+     * part of a run should be timed. Returns the fastest run in seconds, or 0 if the benchmark is filtered out.
+     */
+    double run_measured(const std::string &benchmark, const Format &fmt, unsigned channels, const std::string &variant,
+                        unsigned long long frames, unsigned long long bytes, const std::function<double()> &f,
+                        unsigned sample_rate = 0)
+    {
+        if (!enabled(benchmark, fmt, channels, variant))
+            return 0;
+        double best = 0;
+        for (int r = 0; r < options.repeats; r++)
+        {
+            const double seconds = f();
+            best = r ? std::min(best, seconds) : seconds;
+        }
+        results.push_back({benchmark, fmt.name, channels, variant, frames, bytes, best, sample_rate});
+        if (options.output == "table")
+            print_table_row(results.back());
+        return best;
+    }
+
+    static void print_table_row(const Result &r)
+    {
+        printf("%-34s %-8s %3u %-10s %10.1f MB/s %9.1f MF/s", r.benchmark.c_str(), r.format.c_str(), r.channels,
+               r.variant.c_str(), r.bytes / 1e6 / r.seconds, r.frames / 1e6 / r.seconds);
+        if (r.sample_rate)
+            printf(" %9.1fx realtime", r.realtime());
+        printf("\n");
+    }
+
+    void print() const
+    {
+        if (options.output == "csv")
+        {
+            printf("benchmark,format,channels,variant,frames,bytes,seconds,mb_per_s,mframes_per_s,realtime\n");
+            for (const auto &r : results)
+                printf("%s,%s,%u,%s,%llu,%llu,%.9f,%.3f,%.3f,%.3f\n", r.benchmark.c_str(), r.format.c_str(), r.channels,
+                       r.variant.c_str(), r.frames, r.bytes, r.seconds, r.bytes / 1e6 / r.seconds, r.frames / 1e6 / r.seconds,
+                       r.realtime());
+        }
+        else if (options.output == "json")
+        {
+            printf("[\n");
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                const auto &r = results[i];
+                printf("  {\"benchmark\": \"%s\", \"format\": \"%s\", \"channels\": %u, \"variant\": \"%s\", "
+                       "\"frames\": %llu, \"bytes\": %llu, \"seconds\": %.9f, \"mb_per_s\": %.3f, \"mframes_per_s\": %.3f, "
+                       "\"realtime\": %.3f}%s\n",
+                       r.benchmark.c_str(), r.format.c_str(), r.channels, r.variant.c_str(), r.frames, r.bytes, r.seconds,
+                       r.bytes / 1e6 / r.seconds, r.frames / 1e6 / r.seconds, r.realtime(), i + 1 < results.size() ? "," : "");
+            }
+            printf("]\n");
+        }
+    }
+};
+
+// File I/O: whole-file reads and writes, memory mapping and streaming
+static void bench_io(Harness &harness, const Options &options, const Format &fmt, unsigned channels,
+                     wav_file &wav, const std::vector<float> &samples)
+{
+    const std::string file_name = options.dir + "/bench_" + fmt.name + "_" + std::to_string(channels) + ".wav";
+    const unsigned long long frames = wav.num_frames, bytes = wav.num_bytes;
+    const std::pair<const char *, int> write_modes[] = {
+        {"stdio", 0}, {"vectored", WAV_WRITE_VECTORED}, {"direct", WAV_WRITE_DIRECT}};
+    for (const auto &mode : write_modes)
+    {
+        harness.run("write_wav_file", fmt, channels, mode.first, frames, bytes, [&]
+                    { write_wav_file_ex(file_name.c_str(), &wav, nullptr, mode.second); },
+                    [&]
+                    {
+                        // Truncating the previous file would be timed otherwise
+                        remove(file_name.c_str());
+                    });
+    }
+    harness.run("read_wav_file", fmt, channels, "stdio", frames, bytes, [&]
+                {
+                    wav_file loaded;
+                    if (!read_wav_file(file_name.c_str(), &loaded))
+                        free_wav_file(&loaded); });
+    harness.run("read_wav_file_mmap", fmt, channels, "decode", frames, bytes, [&]
+                {
+                    // Mapping alone is lazy, so the samples are decoded to include the page-ins
+                    wav_file mapped;
+                    if (read_wav_file_mmap(file_name.c_str(), &mapped, nullptr, WAV_MMAP_READ_ONLY))
+                        return;
+                    std::vector<float> out(4096 * channels);
+                    for (unsigned long long i = 0; i < mapped.num_frames; i += 4096)
+                        wav_get_normalized_range(&mapped, i, std::min<unsigned long long>(4096, mapped.num_frames - i), out.data());
+                    free_wav_file(&mapped); });
+    // In-memory serialization and parsing, compared with the file round trip above
+    std::vector<char> buffer(bytes + 4096);
+    size_t size = 0;
+    harness.run("write_wav_memory", fmt, channels, "buffer", frames, bytes, [&]
+                { write_wav_memory(&wav, nullptr, 0, buffer.data(), buffer.size(), &size); });
+    const std::pair<const char *, int> memory_modes[] = {{"copy", 0}, {"zero_copy", WAV_MEMORY_ZERO_COPY}};
+    for (const auto &mode : memory_modes)
+    {
+        harness.run("read_wav_memory", fmt, channels, mode.first, frames, bytes, [&]
+                    {
+                        wav_file parsed;
+                        if (!read_wav_memory(buffer.data(), size, &parsed, nullptr, mode.second))
+                            free_wav_file(&parsed); });
+    }
+    for (const bool prefetch : {false, true})
+    {
+        harness.run("wav_reader_read", fmt, channels, prefetch ? "prefetch" : "stream", frames, bytes, [&]
+                    {
+                        wav_reader *reader;
+                        if (wav_reader_open(&reader, file_name.c_str(), nullptr, 0))
+                            return;
+                        if (prefetch)
+                            wav_reader_prefetch(reader, 0);
+                        std::vector<float> out(4096 * channels);
+                        while (wav_reader_read(reader, out.data(), 4096) > 0)
+                            ;
+                        wav_reader_close(reader); });
+    }
+    // Random-access reads through the block cache, with a cache that is empty (setup) and one that holds the file
+    wav_cache *cache = nullptr;
+    for (const bool warm : {false, true})
+    {
+        harness.run("wav_cache_file_read", fmt, channels, warm ? "warm" : "cold", frames, bytes, [&]
+                    {
+                        wav_cache_file *file;
+                        if (!cache || wav_cache_file_open(&file, cache, file_name.c_str()))
+                            return;
+                        std::vector<float> out(4096 * channels);
+                        for (unsigned long long i = 0; i < frames; i += 4096)
+                            wav_cache_file_read(file, i, 4096, out.data());
+                        wav_cache_file_close(file); },
+                    [&]
+                    {
+                        if (cache && warm)
+                            return;
+                        wav_cache_free(cache);
+                        // Room for the whole decoded file in every shard
+                        wav_cache_create(&cache, frames * channels * sizeof(float) * 16, 0, 0);
+                    });
+    }
+    wav_cache_free(cache);
+    harness.run("wav_writer_write", fmt, channels, "stream", frames, bytes, [&]
+                {
+                    wav_writer *writer;
+                    if (wav_writer_open(&writer, file_name.c_str(), &wav, nullptr, 0, 0))
+                        return;
+                    for (unsigned long long i = 0; i < frames; i += 4096)
+                        wav_writer_write(writer, &samples[i * channels], std::min<unsigned long long>(4096, frames - i));
+                    wav_writer_close(writer); },
+                [&]
+                { remove(file_name.c_str()); });
+    remove(file_name.c_str());
+}
+
+// Conversion: per-frame vs. bulk functions, every instruction set, planar and parallel conversion
+static void bench_convert(Harness &harness, const Format &fmt, unsigned channels, wav_file &wav, std::vector<float> &samples)
+{
+    const unsigned frames = wav.num_frames;
+    const unsigned long long bytes = wav.num_bytes;
+    harness.run("wav_get_normalized", fmt, channels, "per_frame", frames, bytes, [&]
+                {
+                    for (unsigned i = 0; i < frames; i++)
+                        wav_get_normalized(&wav, i, &samples[static_cast<size_t>(i) * channels]); });
+    harness.run("wav_set_normalized", fmt, channels, "per_frame", frames, bytes, [&]
+                {
+                    for (unsigned i = 0; i < frames; i++)
+                        wav_set_normalized(&wav, i, &samples[static_cast<size_t>(i) * channels]); });
+    for (int isa = WAV_ISA_SCALAR; isa <= WAV_ISA_AVX2; isa++)
+    {
+        if (wav_set_conversion_isa(isa))
+            continue;
+        harness.run("wav_get_normalized_range", fmt, channels, isa_names[isa], frames, bytes, [&]
+                    { wav_get_normalized_range(&wav, 0, frames, samples.data()); });
+        harness.run("wav_set_normalized_range", fmt, channels, isa_names[isa], frames, bytes, [&]
+                    { wav_set_normalized_range(&wav, 0, frames, samples.data()); });
+    }
+    wav_set_conversion_isa(WAV_ISA_AUTO);
+
+    std::vector<float> planar_data(samples.size());
+    std::vector<float *> planar;
+    for (unsigned c = 0; c < channels; c++)
+        planar.push_back(&planar_data[static_cast<size_t>(c) * frames]);
+    harness.run("wav_get_normalized_range", fmt, channels, "transpose", frames, bytes, [&]
+                {
+                    // Interleaved conversion followed by a separate transpose, for comparison with the planar function
+                    wav_get_normalized_range(&wav, 0, frames, samples.data());
+                    for (unsigned i = 0; i < frames; i++)
+                        for (unsigned c = 0; c < channels; c++)
+                            planar[c][i] = samples[static_cast<size_t>(i) * channels + c]; });
+    harness.run("wav_get_normalized_planar", fmt, channels, "planar", frames, bytes, [&]
+                { wav_get_normalized_planar(&wav, 0, frames, planar.data()); });
+
+    wav_stats stats;
+    harness.run("wav_compute_stats", fmt, channels, "block", frames, bytes, [&]
+                { wav_compute_stats(&wav, &stats); });
+    harness.run("wav_overview_from_wav", fmt, channels, "pyramid", frames, bytes, [&]
+                {
+                    wav_overview *overview;
+                    if (!wav_overview_from_wav(&overview, &wav))
+                        wav_overview_free(overview); });
+
+    const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads))
+    {
+        const std::string variant = "threads_" + std::to_string(threads);
+        harness.run("wav_get_normalized_range_parallel", fmt, channels, variant, frames, bytes, [&]
+                    { wav_get_normalized_range_parallel(&wav, 0, frames, samples.data(), threads, nullptr); });
+        harness.run("wav_set_normalized_range_parallel", fmt, channels, variant, frames, bytes, [&]
+                    { wav_set_normalized_range_parallel(&wav, 0, frames, samples.data(), threads, nullptr); });
+        if (threads == max_threads)
+            break;
+    }
+}
+
+// Sample rate conversion of the whole file on one core, for the common rate pairs
+static void bench_resample(Harness &harness, const Format &fmt, unsigned channels, const wav_file &wav)
+{
+    const std::pair<unsigned, unsigned> rates[] = {{44100, 48000}, {48000, 44100}, {96000, 48000}};
+    for (const auto &rate : rates)
+    {
+        // Shares the data of wav, only the rate differs
+        wav_file in = wav;
+        in.sample_rate = rate.first;
+        const std::string variant = std::to_string(rate.first / 1000) + "k_" + std::to_string(rate.second / 1000) + "k";
+        harness.run("wav_resample", fmt, channels, variant, in.num_frames, in.num_bytes, [&]
+                    {
+                        wav_file out;
+                        if (!wav_resample(&in, &out, rate.second))
+                            free_wav_file(&out); },
+                    nullptr, rate.first);
+    }
+}
+
+// Playback engine: options.voices voices of one file streamed from disk. Rendering is paced in real time
+// so that the disk workers keep up like in a real audio thread, and only the time spent rendering is counted.
+static void bench_playback(Harness &harness, const Options &options, const Format &fmt, unsigned channels, const wav_file &wav)
+{
+    const std::string variant = "voices_" + std::to_string(options.voices);
+    if (!harness.enabled("wav_player_render", fmt, channels, variant))
+        return;
+    const std::string file_name = options.dir + "/bench_player_" + fmt.name + "_" + std::to_string(channels) + ".wav";
+    if (write_wav_file(file_name.c_str(), &wav))
+        return;
+    // Half a second in blocks of a typical audio callback, short enough to stay within the file
+    const unsigned block = 256, rate = 44100, blocks = std::min<unsigned long long>(rate / 2, wav.num_frames) / block;
+    const unsigned long long frames = static_cast<unsigned long long>(blocks) * block * options.voices;
+    const unsigned long long bytes = frames * channels * fmt.bit_depth / 8;
+    std::vector<float> out(2 * block);
+    unsigned long long underrun_frames = 0;
+    const double seconds = harness.run_measured("wav_player_render", fmt, channels, variant, frames, bytes, [&]
+                                                {
+                                                    // A short head, so that most frames are streamed through the rings
+                                                    wav_player_config config = {options.voices, 1, 4096, 0, 0, 0};
+                                                    wav_player *player;
+                                                    if (wav_player_create(&player, &config))
+                                                        return 0.0;
+                                                    const int sample = wav_player_load(player, file_name.c_str());
+                                                    for (unsigned v = 0; v < options.voices; v++)
+                                                        wav_player_start(player, sample, 1.0f / options.voices);
+                                                    double render = 0;
+                                                    const auto start = std::chrono::steady_clock::now();
+                                                    for (unsigned b = 0; b < blocks; b++)
+                                                    {
+                                                        std::this_thread::sleep_until(start + std::chrono::microseconds(1000000ull * b * block / rate));
+                                                        render += time_seconds([&]
+                                                                               { wav_player_render(player, out.data(), block); });
+                                                    }
+                                                    wav_player_stats stats;
+                                                    wav_player_get_stats(player, &stats);
+                                                    underrun_frames = std::max(underrun_frames, stats.underrun_frames);
+                                                    wav_player_free(player);
+                                                    return render; },
+                                                rate);
+    if (seconds > 0 && options.output == "table")
+        printf("%-34s %u voices fit in %.0f%% of one core, %llu underrun frames\n", "", static_cast<unsigned>(
+               frames / static_cast<double>(rate) / seconds * options.budget), options.budget * 100, underrun_frames);
+}
+
+// Mixdown of many sources streamed from one file, on one thread and on all processors
+static void bench_mix(Harness &harness, const Options &options, const Format &fmt, unsigned channels, const wav_file &wav)
+{
+    const std::string file_name = options.dir + "/bench_mix_" + fmt.name + "_" + std::to_string(channels) + ".wav";
+    const std::string out_name = options.dir + "/bench_mix_out.wav";
+    const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    bool written = false;
+    for (const unsigned num_sources : {8u, 32u})
+    {
+        std::vector<wav_mix_source> sources(num_sources, {file_name.c_str(), 1.0f / num_sources, 0, 0, 0});
+        const unsigned long long frames = wav.num_frames * num_sources, bytes = wav.num_bytes * num_sources;
+        for (const unsigned threads : {1u, max_threads})
+        {
+            const std::string variant = "src" + std::to_string(num_sources) + "_t" + std::to_string(threads);
+            if (!harness.enabled("wav_mix", fmt, channels, variant))
+                continue;
+            if (!written && write_wav_file(file_name.c_str(), &wav))
+                return;
+            written = true;
+            harness.run("wav_mix", fmt, channels, variant, frames, bytes, [&]
+                        { wav_mix(sources.data(), num_sources, out_name.c_str(), &wav, threads); });
+            if (max_threads == 1)
+                break;
+        }
+    }
+}
+
+// The C++ wrapper: runtime dispatched per-sample accessors vs. typed views vs. bulk access.
+// The sums keep the loops from being optimized away.
+static void bench_cpp(Harness &harness, const Format &fmt, unsigned channels, wav_file &wav)
+{
+    const unsigned frames = wav.num_frames;
+    const unsigned long long bytes = wav.num_bytes;
+    // Borrows the data of wav, no copy
+    const wav_handler::WaveFile f = wav_handler::WaveFile::borrow(const_cast<const char *>(wav.data), wav.num_bytes,
+                                                                  channels, fmt.bit_depth, 44100, fmt.is_float);
+    volatile float sink = 0;
+    if (channels <= 2)
+    {
+        harness.run("WaveFile::get_sample_stereo", fmt, channels, "per_frame", frames, bytes, [&]
+                    {
+                        float sum = 0;
+                        for (unsigned i = 0; i < frames; i++)
+                        {
+                            const auto s = f.get_sample_stereo(i);
+                            sum += s.ch0 + s.ch1;
+                        }
+                        sink = sum; });
+    }
+    harness.run("WaveView::get", fmt, channels, "per_sample", frames, bytes, [&]
+                { sink = f.with_view([](const auto &v)
+                                     {
+                                         float sum = 0;
+                                         for (unsigned long long i = 0; i < v.get_length(); i++)
+                                             for (unsigned c = 0; c < v.get_channels(); c++)
+                                                 sum += v.get(i, c);
+                                         return sum; }); });
+    std::vector<float> out(static_cast<size_t>(frames) * channels);
+    harness.run("WaveFile::get_samples", fmt, channels, "range", frames, bytes, [&]
+                { f.get_samples(0, frames, out.data()); });
+    (void)sink;
+}
+
+static bool parse_options(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+        if (arg == "--frames")
+            options.frames = strtoul(value, nullptr, 10);
+        else if (arg == "--repeats")
+            options.repeats = std::max(1, atoi(value));
+        else if (arg == "--output")
+            options.output = value;
+        else if (arg == "--dir")
+            options.dir = value;
+        else if (arg == "--filter")
+            options.filter = value;
+        else if (arg == "--voices")
+            options.voices = strtoul(value, nullptr, 10);
+        else if (arg == "--budget")
+            options.budget = atof(value);
+        else if (arg == "--channels")
+        {
+            options.channels.clear();
+            for (const char *p = value; *p; p++)
+            {
+                const unsigned c = strtoul(p, const_cast<char **>(&p), 10);
+                if (c < 1 || c > WAV_PLANAR_MAX_CHANNELS)
+                    return false;
+                options.channels.push_back(c);
+                if (!*p)
+                    break;
+            }
+        }
+        else
+            return false;
+    }
+    return options.frames && !options.channels.empty() && options.voices && options.budget > 0 &&
+           (options.output == "table" || options.output == "csv" || options.output == "json");
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        fprintf(stderr, "usage: bench.out [--frames N] [--channels 1,2,8] [--repeats N] [--output table|csv|json] [--dir DIR] [--filter TEXT]\n"
+                        "                 [--voices N] [--budget FRACTION]\n");
+        return 2;
+    }
+    Harness harness(options);
+    for (const unsigned channels : options.channels)
+    {
+        std::vector<float> samples(static_cast<size_t>(options.frames) * channels);
+        for (size_t i = 0; i < samples.size(); i++)
+            samples[i] = sinf(i / 30.0f);
+        for (const auto &fmt : formats)
+        {
+            wav_file wav;
+            if (create_wav_file(&wav, options.frames, channels, fmt.bit_depth, 44100))
+                return 1;
+            wav.is_float = fmt.is_float;
+            wav_set_normalized_range(&wav, 0, options.frames, samples.data());
+            bench_io(harness, options, fmt, channels, wav, samples);
+            bench_convert(harness, fmt, channels, wav, samples);
+            bench_resample(harness, fmt, channels, wav);
+            bench_playback(harness, options, fmt, channels, wav);
+            bench_mix(harness, options, fmt, channels, wav);
+            bench_cpp(harness, fmt, channels, wav);
+            free_wav_file(&wav);
+        }
+    }
+    harness.print();
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include "wav_handler_cpp.h"
 #include <iostream>
 #include <cmath>
+#include <thread>
 
 using namespace wav_handler;
 
@@ -79,6 +80,782 @@ void test_write_read_headers()
     assert_that(f2.get_header("MyH2") == "another header");
 }
 
+void test_bulk_samples()
+{
+    WaveFile f;
+    f.create(1000, true, 24, 44100, false);
+    std::vector<float> values(2000);
+    for (int i = 0; i < 1000; i++)
+    {
+        values[2 * i] = sinf(i / 30.0);
+        values[2 * i + 1] = -sinf(i / 30.0);
+    }
+    f.set_samples(0, values);
+    const auto out = f.get_samples(0, 1000);
+    assert_that(out.size() == 2000);
+    for (int i = 0; i < 1000; i++)
+    {
+        const auto s = f.get_sample_stereo(i);
+        if (!assert_that(s.ch0 == out[2 * i] && s.ch1 == out[2 * i + 1]) ||
+            !assert_that(fabs(s.ch0 - values[2 * i]) < 1e-6))
+            break;
+    }
+    bool thrown = false;
+    try
+    {
+        f.get_samples(999, 2);
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+}
+
+void test_map_file()
+{
+    WaveFile f, f2;
+    f.load_file("cpp_16bit_44100Hz_int_stereo.wav");
+    f2.map_file("cpp_16bit_44100Hz_int_stereo.wav", {}, true);
+    assert_that(f2.get_length() == f.get_length());
+    assert_that(f2.get_samples(0, f.get_length()) == f.get_samples(0, f.get_length()));
+    bool thrown = false;
+    try
+    {
+        f2.set_sample(0, 0);
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+
+    WaveFile f3;
+    f3.map_file("sine.dat", {"PEAK"});
+    f3.set_sample(0, 0.5f);
+    assert_that(f3.get_sample(0) == 0.5f);
+    assert_that(f3.get_header("PEAK").size() == 16);
+}
+
+void test_stream_file()
+{
+    WaveFile f;
+    f.load_file("cpp_16bit_44100Hz_int_stereo.wav");
+    WaveReader r("cpp_16bit_44100Hz_int_stereo.wav", {}, 1000);
+    assert_that(r.get_length() == f.get_length() && r.get_channels() == 2 && r.get_sample_rate() == 44100);
+    unsigned pos = 0;
+    for (auto block = r.read(4096); !block.empty(); block = r.read(4096))
+    {
+        if (!assert_that(block == f.get_samples(pos, block.size() / 2)))
+            break;
+        pos += block.size() / 2;
+    }
+    assert_that(pos == f.get_length());
+    r.seek(100);
+    assert_that(r.read(1)[1] == f.get_sample_stereo(100).ch1);
+}
+
+void test_prefetch_file()
+{
+    WaveFile f;
+    f.load_file("cpp_16bit_44100Hz_int_stereo.wav");
+    WaveReader r("cpp_16bit_44100Hz_int_stereo.wav", {}, 1000);
+    bool thrown = false;
+    try
+    {
+        r.get_prefetch_stats();
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+    r.prefetch(4);
+    unsigned pos = 0;
+    for (auto block = r.read(3000); !block.empty(); block = r.read(3000))
+    {
+        if (!assert_that(block == f.get_samples(pos, block.size() / 2)))
+            break;
+        pos += block.size() / 2;
+    }
+    assert_that(pos == f.get_length());
+    assert_that(r.get_prefetch_stats().blocks > 0);
+    r.seek(100);
+    assert_that(r.read(1)[1] == f.get_sample_stereo(100).ch1);
+}
+
+void test_stream_write_file()
+{
+    {
+        WaveWriter w("cpp_streamed_float_stereo.wav", 2, 32, 48000, true, {{"MyH1", "hello world"}});
+        for (int block = 0; block < 10; block++)
+        {
+            std::vector<float> values;
+            for (int i = 0; i < 1000; i++)
+            {
+                values.push_back(sinf((block * 1000 + i) / 30.0));
+                values.push_back(2.0f);
+            }
+            w.write(values);
+        }
+        assert_that(w.get_length() == 10000);
+        w.close();
+    }
+    WaveFile f;
+    f.load_file("cpp_streamed_float_stereo.wav", {"MyH1"});
+    assert_that(f.get_length() == 10000);
+    assert_that(f.get_header("MyH1") == "hello world");
+    for (int i = 0; i < 10000; i++)
+    {
+        const auto s = f.get_sample_stereo(i);
+        if (!assert_that(s.ch0 == sinf(i / 30.0)) || !assert_that(s.ch1 == 1.0f))
+            break;
+    }
+}
+
+void test_rf64_file()
+{
+    WaveFile f;
+    f.create(1000, true, 24, 96000, false);
+    f.set_sample_stereo(500, {0.5f, -0.5f});
+    f.write_file("cpp_rf64_24bit_stereo.wav", {{"MyH1", "hello world"}}, true);
+    WaveFile f2;
+    f2.load_file("cpp_rf64_24bit_stereo.wav", {"MyH1"});
+    assert_that(f2.get_length() == 1000);
+    assert_that(f2.get_header("MyH1") == "hello world");
+    assert_that(f2.get_samples(0, 1000) == f.get_samples(0, 1000));
+}
+
+void test_lazy_headers()
+{
+    WaveFile f;
+    f.load_file("sine.dat");
+    const std::vector<std::string> chunks = {"fmt ", "fact", "PEAK", "data", "LIST", "id3 "};
+    assert_that(f.get_chunks() == chunks);
+    assert_that(f.get_header("PEAK").size() == 16);
+    WaveReader r("sine.dat");
+    assert_that(r.get_chunks() == chunks);
+    assert_that(r.get_header("fact") == f.get_header("fact"));
+    bool not_found = false;
+    try
+    {
+        r.get_header("abcd");
+    }
+    catch (const std::invalid_argument &)
+    {
+        not_found = true;
+    }
+    assert_that(not_found);
+}
+
+void test_probe()
+{
+    WaveFile f;
+    f.load_file("sine.dat");
+    const auto info = WaveFile::probe("sine.dat");
+    assert_that(info.valid && info.length == f.get_length() && info.channels == f.get_channels());
+    assert_that(info.sample_rate == 44100 && info.bit_depth == 32 && info.is_float);
+    const auto infos = WaveFile::probe({"cpp_16bit_44100Hz_int_stereo.wav", "does_not_exist.wav", "sine.dat"});
+    assert_that(infos.size() == 3);
+    assert_that(infos[0].valid && infos[0].channels == 2 && infos[0].bit_depth == 16);
+    assert_that(!infos[1].valid && infos[1].length == 0);
+    assert_that(infos[2].valid && infos[2].length == info.length);
+}
+
+WaveFile make_ramp_file()
+{
+    WaveFile f;
+    f.create(100, false, 16, 48000, false);
+    for (int i = 0; i < 100; i++)
+        f.set_sample(i, i / 100.0f);
+    return f;
+}
+
+void test_move_and_adopt()
+{
+    std::vector<WaveFile> files;
+    files.push_back(make_ramp_file());
+    files.emplace_back();
+    files[1].load_file("sine.dat", {"fact"});
+    WaveFile moved = std::move(files[1]);
+    assert_that(moved.get_header("fact").size() == 4 && moved.get_length() == 820);
+    bool empty = false;
+    try
+    {
+        files[1].get_length();
+    }
+    catch (const std::runtime_error &)
+    {
+        empty = true;
+    }
+    assert_that(empty);
+    files[1] = std::move(moved);
+    assert_that(files[1].get_length() == 820 && files[0].get_length() == 100);
+
+    // Adopting a malloc'd buffer
+    std::vector<float> ramp;
+    for (int i = 0; i < 100; i++)
+        ramp.push_back(i / 100.0f);
+    char *raw = static_cast<char *>(malloc(200));
+    {
+        WaveFile adopted(raw, 200, 1, 16, 48000, false, free);
+        adopted.set_samples(0, ramp);
+        assert_that(adopted.get_samples(0, 100) == files[0].get_samples(0, 100));
+    }
+
+    // Adopting a vector keeps the buffer in place
+    std::vector<char> bytes(400);
+    const char *bytes_ptr = bytes.data();
+    WaveFile from_vector(std::move(bytes), 2, 16, 48000, false);
+    from_vector.set_sample_stereo(99, {0.5f, -0.5f});
+    assert_that(from_vector.get_length() == 100);
+    assert_that(reinterpret_cast<const short *>(bytes_ptr)[198] == 16383);
+
+    // Borrowing a caller-owned buffer
+    short pcm[4] = {0, 0x4000, 0, 0};
+    {
+        WaveFile borrowed = WaveFile::borrow(reinterpret_cast<char *>(pcm), sizeof(pcm), 2, 16, 44100, false);
+        borrowed.set_sample(1, -1.0f);
+        WaveFile read_only = WaveFile::borrow(reinterpret_cast<const char *>(pcm), sizeof(pcm), 2, 16, 44100, false);
+        assert_that(read_only.get_sample_stereo(1).ch0 == -1.0f);
+        bool thrown = false;
+        try
+        {
+            read_only.set_sample(0, 0.5f);
+        }
+        catch (const std::runtime_error &)
+        {
+            thrown = true;
+        }
+        assert_that(thrown);
+    }
+    assert_that(pcm[1] == 0x4000 && pcm[2] == -0x7FFF && pcm[3] == -0x7FFF);
+
+    bool invalid = false;
+    try
+    {
+        WaveFile::borrow(reinterpret_cast<char *>(pcm), 3, 2, 16, 44100, false);
+    }
+    catch (const std::invalid_argument &)
+    {
+        invalid = true;
+    }
+    assert_that(invalid);
+
+    std::vector<WaveReader> readers;
+    readers.emplace_back("sine.dat");
+    readers.push_back(WaveReader("cpp_16bit_44100Hz_int_stereo.wav"));
+    assert_that(readers[0].get_length() == 820 && readers[1].get_channels() == 2);
+}
+
+void test_arena()
+{
+    WaveArena arena;
+    WaveFile reference;
+    reference.load_file("sine.dat", {"PEAK"});
+    for (int i = 0; i < 5; i++)
+    {
+        {
+            WaveFile f;
+            f.load_file("sine.dat", {"PEAK"}, arena.allocator());
+            assert_that(f.get_header("PEAK") == reference.get_header("PEAK"));
+            assert_that(f.get_samples(0, 820) == reference.get_samples(0, 820));
+            WaveFile created;
+            created.create(1000, true, 24, 48000, false, arena.allocator());
+            created.set_sample_stereo(999, {0.5f, 0.5f});
+            created.write_file("cpp_arena_24bit_stereo.wav", {{"MyH1", "hello"}});
+        }
+        arena.reset();
+    }
+    WaveFile f;
+    f.load_file("cpp_arena_24bit_stereo.wav", {"MyH1"});
+    assert_that(f.get_header("MyH1") == "hello" && f.get_sample_stereo(999).ch1 > 0.49f);
+}
+
+void test_typed_views()
+{
+    const unsigned formats[][2] = {{8, 0}, {16, 0}, {24, 0}, {32, 0}, {32, 1}, {64, 1}};
+    for (auto &format : formats)
+    {
+        for (unsigned channels = 1; channels <= 3; channels++)
+        {
+            const unsigned frames = 1000;
+            std::vector<float> values;
+            for (unsigned i = 0; i < frames * channels; i++)
+                values.push_back(sinf(i * 0.37f) * 1.1f);
+            WaveFile reference(std::vector<char>(frames * channels * format[0] / 8), channels, format[0], 48000, format[1]);
+            reference.set_samples(0, values);
+            WaveFile f(std::vector<char>(frames * channels * format[0] / 8), channels, format[0], 48000, format[1]);
+            // Setting through the view must produce the same data as the C API
+            const unsigned view_channels = f.with_view([&](auto &view)
+                                                       {
+                for (unsigned long long i = 0; i < view.get_length(); i++)
+                    for (unsigned ch = 0; ch < view.get_channels(); ch++)
+                        view.set(i, ch, values[i * view.get_channels() + ch]);
+                return view.get_channels(); });
+            assert_that(view_channels == channels);
+            const auto expected = reference.get_samples(0, frames);
+            assert_that(f.get_samples(0, frames) == expected);
+            const WaveFile &const_ref = reference;
+            const bool same = const_ref.with_view([&](const auto &view)
+                                                  {
+                for (unsigned long long i = 0; i < view.get_length(); i++)
+                    for (unsigned ch = 0; ch < view.get_channels(); ch++)
+                        if (view.get(i, ch) != expected[i * view.get_channels() + ch])
+                            return false;
+                return true; });
+            if (!assert_that(same))
+                std::cout << "format " << format[0] << (format[1] ? " float" : " int") << ", " << channels << " channels\n";
+        }
+    }
+
+    // Every 16-bit value decodes exactly like wav_get_normalized
+    std::vector<char> all16(65536 * 2);
+    for (int i = 0; i < 65536; i++)
+    {
+        const short s = i - 32768;
+        memcpy(&all16[i * 2], &s, 2);
+    }
+    WaveFile f16(std::move(all16), 1, 16, 44100, false);
+    auto view = f16.view<Pcm16, 1>();
+    const auto expected = f16.get_samples(0, 65536);
+    int mismatches = 0;
+    for (unsigned i = 0; i < 65536; i++)
+        mismatches += view.get(i, 0) != expected[i];
+    assert_that(mismatches == 0);
+
+    bool thrown = false;
+    try
+    {
+        f16.view<Pcm24, 1>();
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+}
+
+void test_planar()
+{
+    WaveFile f;
+    f.load_file("cpp_16bit_44100Hz_int_stereo.wav");
+    const unsigned count = 5000;
+    PlanarBuffer planar = f.get_planar(100, count);
+    assert_that(planar.get_channels() == 2 && planar.get_length() == count);
+    for (unsigned c = 0; c < 2; c++)
+        assert_that(reinterpret_cast<uintptr_t>(planar.channel(c)) % 64 == 0);
+    const auto interleaved = f.get_samples(100, count);
+    bool same = true;
+    for (unsigned i = 0; i < count; i++)
+        same = same && planar.channel(0)[i] == interleaved[2 * i] && planar.channel(1)[i] == interleaved[2 * i + 1];
+    assert_that(same);
+
+    // Eight channels through the planar buffer, the streaming writer and reader
+    PlanarBuffer eight(8, 1000);
+    for (unsigned c = 0; c < 8; c++)
+        for (unsigned i = 0; i < 1000; i++)
+            eight.channel(c)[i] = sinf(i * (c + 1) / 100.0f);
+    {
+        WaveWriter w("cpp_planar_float_8ch.wav", 8, 32, 48000, true);
+        w.write_planar(eight, 1000);
+        w.close();
+    }
+    WaveReader r("cpp_planar_float_8ch.wav");
+    PlanarBuffer read_back(8, 1000);
+    assert_that(r.read_planar(read_back, 1000) == 1000);
+    for (unsigned c = 0; c < 8; c++)
+        assert_that(memcmp(read_back.channel(c), eight.channel(c), 1000 * sizeof(float)) == 0);
+
+    // Copies own their storage, so they stay valid and independent of the original
+    PlanarBuffer copy(read_back);
+    PlanarBuffer assigned(1, 1);
+    assigned = copy;
+    read_back = PlanarBuffer(1, 1);
+    assert_that(copy.get_channels() == 8 && assigned.get_channels() == 8 && copy.channel(7) != assigned.channel(7));
+    copy.channel(7)[999] = 2.0f;
+    assert_that(assigned.channel(7)[999] == eight.channel(7)[999]);
+    for (unsigned c = 0; c < 8; c++)
+        assert_that(reinterpret_cast<uintptr_t>(assigned.data()[c]) % 64 == 0 &&
+                    memcmp(assigned.channel(c), eight.channel(c), 999 * sizeof(float)) == 0);
+
+    WaveFile g(std::vector<char>(8 * 1000 * 3), 8, 24, 48000, false);
+    g.set_planar(0, 1000, eight);
+    assert_that(g.get_planar(0, 1000).channel(7)[999] == g.get_samples(999, 1)[7]);
+    bool thrown = false;
+    try
+    {
+        f.set_planar(0, 1000, eight);
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+}
+
+void test_parallel_samples()
+{
+    WaveFile f;
+    f.create(300000, true, 24, 48000, false);
+    std::vector<float> values(600000);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = sinf(i / 7.0f);
+    f.set_samples_parallel(0, 300000, values.data(), 4);
+    std::vector<float> serial(600000), parallel(600000);
+    f.get_samples(0, 300000, serial.data());
+    f.get_samples_parallel(0, 300000, parallel.data());
+    assert_that(serial == parallel);
+    WaveFile g;
+    g.create(300000, true, 24, 48000, false);
+    g.set_samples(0, values);
+    assert_that(g.get_samples(0, 300000) == serial);
+}
+
+void test_convert()
+{
+    std::vector<float> values(2000);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = sinf(i / 7.0f);
+    WaveFile f;
+    f.create(1000, true, 24, 48000, false);
+    f.set_samples(0, values);
+    const auto decoded = f.get_samples(0, 1000);
+    // 24 bit samples are exact in float
+    f.convert(32, true);
+    assert_that((f.view<Float32, 2>().get_length() == 1000));
+    assert_that(f.get_samples(0, 1000) == decoded);
+    f.convert(16, false);
+    WaveFile g;
+    g.create(1000, true, 16, 48000, false);
+    g.set_samples(0, decoded);
+    assert_that(f.get_samples(0, 1000) == g.get_samples(0, 1000));
+
+    // Adopted data is replaced when growing
+    WaveFile h(std::vector<char>(2 * 1000 * 2), 2, 16, 48000, false);
+    h.set_samples(0, decoded);
+    h.convert(64, true);
+    assert_that(h.get_samples(0, 1000) == g.get_samples(0, 1000));
+
+    bool thrown = false;
+    try
+    {
+        h.convert(24, true);
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+    const std::vector<char> data(100);
+    WaveFile read_only = WaveFile::borrow(data.data(), data.size(), 1, 8, 8000, false);
+    thrown = false;
+    try
+    {
+        read_only.convert(16, false);
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+}
+
+void test_stats()
+{
+    std::vector<float> values(2000);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = 0.1f + 0.5f * sinf(i / 7.0f);
+    WaveFile f;
+    f.create(1000, true, 16, 48000, false);
+    f.track_stats(true);
+    f.set_samples(0, values);
+    WaveFile g;
+    g.create(1000, true, 16, 48000, false);
+    g.set_samples(0, values);
+    const wav_stats tracked = f.get_stats(), computed = g.get_stats();
+    assert_that(tracked.channels == 2 && tracked.num_frames == 1000);
+    assert_that(tracked.channel[1].peak == computed.channel[1].peak && tracked.channel[1].peak_frame == computed.channel[1].peak_frame);
+    assert_that(fabs(wav_stats_dc_offset(&tracked, 0) - wav_stats_dc_offset(&computed, 0)) < 1e-9);
+    assert_that(fabs(wav_stats_dc_offset(&tracked, 0) - 0.1) < 0.01);
+
+    f.write_file("cpp_stats_16bit_stereo.wav", {{"PEAK", "stale"}});
+    wav_stats stored;
+    assert_that(WaveFile::read_stats("cpp_stats_16bit_stereo.wav", stored));
+    assert_that(stored.channel[0].peak == tracked.channel[0].peak && stored.channel[0].sum == tracked.channel[0].sum);
+    assert_that(!WaveFile::read_stats("cpp_16bit_44100Hz_int_stereo.wav", stored));
+    WaveFile h;
+    h.load_file("cpp_stats_16bit_stereo.wav", {"PEAK"});
+    assert_that(h.get_header("PEAK").size() == 24);
+
+    // Copied statistics chunks are kept while they match the data and left out once a sample in the middle changes
+    const std::map<std::string, std::string> headers = {{"PEAK", h.get_header("PEAK")}, {WAV_STATS_CHUNK_ID, h.get_header(WAV_STATS_CHUNK_ID)}};
+    h.write_file("cpp_stats_16bit_stereo.wav", headers);
+    assert_that(WaveFile::read_stats("cpp_stats_16bit_stereo.wav", stored));
+    h.set_samples(500, {0.25f, -0.25f});
+    h.write_file("cpp_stats_16bit_stereo.wav", headers);
+    assert_that(!WaveFile::read_stats("cpp_stats_16bit_stereo.wav", stored));
+    WaveFile k;
+    k.load_file("cpp_stats_16bit_stereo.wav");
+    bool thrown = false;
+    try
+    {
+        k.get_header("PEAK");
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+}
+
+void test_overview()
+{
+    std::vector<float> values(200000);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = 0.9f * sinf(i / 500.0f) * (i % 2 ? 0.5f : 1.0f);
+    WaveFile f;
+    f.create(100000, true, 32, 48000, true);
+    f.set_samples(0, values);
+    f.write_file("cpp_overview_float_stereo.wav");
+
+    WaveOverview overview = WaveOverview::build("cpp_overview_float_stereo.wav");
+    assert_that(overview.get_length() == 100000 && overview.get_channels() == 2);
+    const auto pixels = overview.query(1, 0, 100000, 10);
+    assert_that(pixels.size() == 10);
+    // Pixel 0 covers frames 0 ... 9999, rounded to 10240 frames
+    float min = 1, max = -1;
+    for (size_t i = 0; i < 10240; i++)
+    {
+        min = std::min(min, values[2 * i + 1]);
+        max = std::max(max, values[2 * i + 1]);
+    }
+    assert_that(pixels[0].first == min && pixels[0].second == max);
+    bool thrown = false;
+    try
+    {
+        overview.query(2, 0, 100000, 10);
+    }
+    catch (const std::out_of_range &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+
+    f.write_file("cpp_overview_float_stereo.wav", {{WAV_OVERVIEW_CHUNK_ID, overview.to_chunk()}});
+    WaveFile g;
+    g.load_file("cpp_overview_float_stereo.wav");
+    WaveOverview stored = WaveOverview::from_chunk(g.get_header(WAV_OVERVIEW_CHUNK_ID));
+    assert_that(stored.query(1, 0, 100000, 10) == pixels);
+    overview.save("cpp_overview_float_stereo.wov");
+    stored = WaveOverview::load("cpp_overview_float_stereo.wov");
+    assert_that(stored.query(1, 0, 100000, 10) == pixels);
+    thrown = false;
+    try
+    {
+        WaveOverview::from_chunk("WOVR");
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+}
+
+void test_resample()
+{
+    std::vector<float> values(2 * 44100);
+    for (size_t i = 0; i < 44100; i++)
+        values[2 * i] = values[2 * i + 1] = 0.5f * sinf(2 * M_PI * 440 * i / 44100);
+    WaveFile f;
+    f.create(44100, true, 16, 44100, false);
+    f.set_samples(0, values);
+    f.track_stats(true);
+    f.resample(48000);
+    assert_that(f.get_sample_rate() == 48000 && f.get_length() == 48000);
+    const auto s = f.get_sample_stereo(1000);
+    assert_that(fabs(s.ch0 - 0.5 * sin(2 * M_PI * 440 * 1000 / 48000)) < 1e-3 && s.ch0 == s.ch1);
+    assert_that(f.get_stats().num_frames == 48000);
+
+    bool thrown = false;
+    try
+    {
+        f.resample(48001);
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown && f.get_sample_rate() == 48000);
+}
+
+void test_player()
+{
+    WaveFile f;
+    f.create(20000, true, 32, 44100, true);
+    for (unsigned i = 0; i < 20000; i++)
+        f.set_sample_stereo(i, {0.25f + 0.1f * sinf(i / 10.0f), -0.5f});
+    f.write_file("cpp_player_float_stereo.wav");
+    WavePlayer player({4, 0, 2000, 8192, 1024, 1});
+    const int sample = player.load("cpp_player_float_stereo.wav");
+    bool thrown = false;
+    try
+    {
+        player.load("does_not_exist.wav");
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+    assert_that(player.start(sample, 2.0f) >= 0);
+    std::vector<float> out(2 * 512);
+    unsigned pos = 0;
+    for (unsigned playing = 1, iteration = 0; playing && iteration < 100000000; iteration++)
+    {
+        playing = player.render(out.data(), 512);
+        for (unsigned i = 0; i < 512 && pos < 20000; i++)
+        {
+            // Underruns render silence
+            if (out[2 * i] == 0)
+                continue;
+            const auto s = f.get_sample_stereo(pos++);
+            if (!assert_that(out[2 * i] == 2 * s.ch0 && out[2 * i + 1] == 2 * s.ch1))
+                break;
+        }
+    }
+    assert_that(pos == 20000);
+    assert_that(player.get_stats().voices == 0 && player.get_stats().blocks >= 18);
+    assert_that(!player.stop(0));
+}
+
+void test_cache()
+{
+    WaveFile f;
+    f.create(50000, true, 16, 44100, false);
+    for (unsigned i = 0; i < 50000; i++)
+        f.set_sample_stereo(i, {sinf(i / 10.0f), cosf(i / 17.0f)});
+    f.write_file("cpp_cache_16bit_stereo.wav");
+    const auto expected = f.get_samples(0, 50000);
+
+    // Concurrent random reads through separate handles on a cache too small for the whole file
+    WaveCache cache(64 * 1024, 1024, 4);
+    std::vector<std::thread> threads;
+    std::vector<int> ok(4, 1);
+    for (unsigned t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&, t]
+                             {
+                                 WaveCacheFile file("cpp_cache_16bit_stereo.wav", cache);
+                                 unsigned seed = t + 1;
+                                 for (int i = 0; i < 300 && ok[t]; i++)
+                                 {
+                                     seed = seed * 1103515245u + 12345u;
+                                     const unsigned first = seed % 49000, count = seed / 7 % 1000 + 1;
+                                     const auto samples = file.get_samples(first, count);
+                                     ok[t] = std::equal(samples.begin(), samples.end(), expected.begin() + 2 * first);
+                                 } });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    assert_that(ok == std::vector<int>(4, 1));
+    const auto stats = cache.get_stats();
+    assert_that(stats.hits > 0 && stats.misses > 0 && stats.evictions > 0 && stats.bytes <= 64 * 1024);
+
+    WaveCacheFile file("cpp_cache_16bit_stereo.wav");
+    assert_that(file.get_length() == 50000 && file.get_channels() == 2 && file.get_sample_rate() == 44100);
+    assert_that(file.get_samples(49990, 10) == f.get_samples(49990, 10));
+    bool thrown = false;
+    try
+    {
+        file.get_samples(49990, 11);
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+}
+
+void test_mix()
+{
+    WaveFile f;
+    f.create(20000, true, 24, 44100, false);
+    for (unsigned i = 0; i < 20000; i++)
+        f.set_sample_stereo(i, {0.5f * sinf(i / 10.0f), 0.25f});
+    f.write_file("cpp_mix_24bit_stereo.wav");
+    mix({{"cpp_mix_24bit_stereo.wav", 0.5f}, {"cpp_mix_24bit_stereo.wav", 1.0f, 0.0f, 20000, 10000}},
+        "cpp_mix_float_stereo.wav", 2, 32, 44100, true);
+    WaveFile out;
+    out.load_file("cpp_mix_float_stereo.wav");
+    assert_that(out.get_length() == 30000);
+    assert_that(fabsf(out.get_sample_stereo(5000).ch1 - 0.125f) < 1e-6f);
+    assert_that(fabsf(out.get_sample_stereo(15000).ch1 - (0.125f + 0.75f * 0.25f)) < 1e-6f);
+    assert_that(fabsf(out.get_sample_stereo(25000).ch1 - 0.25f * 0.25f) < 1e-6f);
+    bool thrown = false;
+    try
+    {
+        mix({{"cpp_mix_24bit_stereo.wav"}}, "cpp_mix_float_stereo.wav", 2, 32, 48000, true);
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+}
+
+void test_memory()
+{
+    std::vector<float> values(2000);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = sinf(i / 10.0f);
+    WaveFile f;
+    f.create(1000, true, 24, 48000, false);
+    f.set_samples(0, values);
+    std::vector<char> buffer;
+    f.write_memory(buffer, {{"LIST", "memory"}});
+    const size_t size = buffer.size();
+    assert_that(size == 44 + 8 + 6 + 6000 && !memcmp(buffer.data(), "RIFF", 4));
+    // Reusing the buffer doesn't shrink its capacity
+    f.write_memory(buffer);
+    assert_that(buffer.size() == size - 14 && buffer.capacity() >= size);
+    f.write_memory(buffer, {{"LIST", "memory"}});
+    char small[100];
+    assert_that(f.write_memory(small, sizeof(small), {{"LIST", "memory"}}) == size);
+
+    WaveFile copy;
+    copy.load_memory(buffer.data(), buffer.size(), {"LIST"});
+    assert_that(copy.get_header("LIST") == "memory" && copy.get_length() == 1000);
+    assert_that(copy.get_samples(0, 1000) == f.get_samples(0, 1000));
+    copy.set_sample(0, 0.5f);
+
+    WaveFile borrowed;
+    borrowed.load_memory(buffer.data(), buffer.size(), {}, true);
+    assert_that(borrowed.get_samples(0, 1000) == f.get_samples(0, 1000));
+    bool thrown = false;
+    try
+    {
+        borrowed.set_sample(0, 0.5f);
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+
+    thrown = false;
+    try
+    {
+        WaveFile truncated;
+        truncated.load_memory(buffer.data(), buffer.size() - 1);
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    assert_that(thrown);
+}
+
 #define RUN(test)                \
     std::cout << "Running test " << #test << '\n'; \
     test()
@@ -91,4 +868,25 @@ int main(int argc, char **argv)
     RUN(test_read_mono_file);
     RUN(test_read_stereo_file);
     RUN(test_write_read_headers);
+    RUN(test_bulk_samples);
+    RUN(test_map_file);
+    RUN(test_stream_file);
+    RUN(test_prefetch_file);
+    RUN(test_stream_write_file);
+    RUN(test_rf64_file);
+    RUN(test_lazy_headers);
+    RUN(test_probe);
+    RUN(test_move_and_adopt);
+    RUN(test_arena);
+    RUN(test_typed_views);
+    RUN(test_planar);
+    RUN(test_parallel_samples);
+    RUN(test_convert);
+    RUN(test_stats);
+    RUN(test_overview);
+    RUN(test_resample);
+    RUN(test_memory);
+    RUN(test_player);
+    RUN(test_cache);
+    RUN(test_mix);
 }
\ No newline at end of file
@@ -8,7 +8,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 #include "wav_handler.h"
+#include "wav_pool.h"
 
 #define print_field(f) printf(#f " = %u\n", (unsigned)wav->f)
 
@@ -34,6 +36,115 @@ void print_wav(struct wav_file *wav)
     if (expression)              \
     printf(#expression ": ERROR\n")
 
+// Executor that runs the tasks in reverse order in the calling thread and counts them in ctx
+static int reverse_executor(void *ctx, unsigned long long num_tasks, wav_task_fn task, void *task_ctx)
+{
+    for (unsigned long long i = num_tasks; i > 0; i--)
+        task(task_ctx, i - 1);
+    *(unsigned long long *)ctx += num_tasks;
+    return 0;
+}
+
+// Adds task index + 1 to the counter in ctx
+static void count_task(void *ctx, unsigned long long idx)
+{
+    __atomic_fetch_add((unsigned long long *)ctx, idx + 1, __ATOMIC_RELAXED);
+}
+
+// Counts 100 tasks run on the pool from inside a task
+static void nested_task(void *ctx, unsigned long long idx)
+{
+    (void)idx;
+    wav_parallel_for(4, 100, count_task, ctx);
+}
+
+// Runs nested tasks on the pool concurrently with other threads
+static void *pool_caller(void *ctx)
+{
+    for (int i = 0; i < 20; i++)
+        wav_parallel_for(3, 8, nested_task, ctx);
+    return NULL;
+}
+
+// Allocator that counts the live allocations in ctx
+static void *counting_alloc(void *ctx, size_t size)
+{
+    (*(int *)ctx)++;
+    return malloc(size);
+}
+
+static void counting_free(void *ctx, void *ptr)
+{
+    (*(int *)ctx)--;
+    free(ptr);
+}
+
+// Returns 0 if the files have the same contents
+static int compare_files(const char *file_name1, const char *file_name2)
+{
+    FILE *f1 = fopen(file_name1, "rb");
+    FILE *f2 = fopen(file_name2, "rb");
+    int c1 = 0, c2 = 0;
+    while (f1 && f2 && c1 == c2 && c1 != EOF)
+    {
+        c1 = fgetc(f1);
+        c2 = fgetc(f2);
+    }
+    if (f1)
+        fclose(f1);
+    if (f2)
+        fclose(f2);
+    return !f1 || !f2 || c1 != c2;
+}
+
+// Returns 0 if the statistics are equal, allowing for the rounding of sums accumulated in a different order
+static int compare_stats(const struct wav_stats *a, const struct wav_stats *b)
+{
+    if (a->channels != b->channels || a->num_frames != b->num_frames)
+        return 1;
+    for (unsigned c = 0; c < a->channels; c++)
+    {
+        const struct wav_channel_stats *x = &a->channel[c], *y = &b->channel[c];
+        if (x->peak != y->peak || x->peak_frame != y->peak_frame || x->peak_stale != y->peak_stale ||
+            fabs(x->sum - y->sum) > 1e-6 || fabs(x->sum_squares - y->sum_squares) > 1e-6)
+            return 1;
+    }
+    return 0;
+}
+
+// Returns 0 if the overview query of frames first ... end - 1 of interleaved samples matches the min and max
+// of each pixel's range rounded to whole buckets
+static int compare_overview(const struct wav_overview *overview, const float *samples, unsigned channel,
+                            unsigned long long first, unsigned long long end, unsigned width)
+{
+    const unsigned channels = wav_overview_channels(overview);
+    const unsigned long long num_frames = wav_overview_frames(overview);
+    float *min = (float *)malloc(sizeof(float) * width);
+    float *max = (float *)malloc(sizeof(float) * width);
+    int err = wav_overview_query(overview, channel, first, end, width, min, max);
+    for (unsigned p = 0; !err && p < width; p++)
+    {
+        unsigned long long start = first + (end - first) * p / width;
+        unsigned long long stop = first + (end - first) * (p + 1) / width;
+        start = start < end - 1 ? start : end - 1;
+        stop = stop > start ? stop : start + 1;
+        start -= start % WAV_OVERVIEW_BUCKET_FRAMES;
+        stop = (stop + WAV_OVERVIEW_BUCKET_FRAMES - 1) / WAV_OVERVIEW_BUCKET_FRAMES * WAV_OVERVIEW_BUCKET_FRAMES;
+        stop = stop < num_frames ? stop : num_frames;
+        float expected_min = samples[start * channels + channel], expected_max = expected_min;
+        for (unsigned long long i = start; i < stop; i++)
+        {
+            const float v = samples[i * channels + channel];
+            expected_min = v < expected_min ? v : expected_min;
+            expected_max = v > expected_max ? v : expected_max;
+        }
+        err = min[p] != expected_min || max[p] != expected_max;
+    }
+    free(min);
+    free(max);
+    return err;
+}
+
 int main(int argc, char **argv)
 {
     struct wav_file wav;
@@ -247,5 +358,1079 @@ int main(int argc, char **argv)
     free(custom_headers[1].data);
     free(custom_headers[2].data);
 
+    printf("Memory mapped read test\n");
+    PRINT_ON_ERR(read_wav_file("sine.dat", &wav));
+    PRINT_ON_ERR(read_wav_file_mmap("sine.dat", &wav2, custom_headers, WAV_MMAP_READ_ONLY));
+    PRINT_ON_ERR(wav.num_bytes != wav2.num_bytes || wav.num_frames != wav2.num_frames);
+    PRINT_ON_ERR(memcmp(wav.data, wav2.data, wav.num_bytes));
+    PRINT_ON_ERR(custom_headers[1].num_bytes != 16);
+    PRINT_ON_ERR(free_wav_file(&wav));
+    PRINT_ON_ERR(free_wav_file(&wav2));
+    PRINT_ON_ERR(read_wav_file_mmap("16bit_44100Hz_int_stereo.wav", &wav, NULL, 0));
+    {
+        // Private mappings can be modified without affecting the file
+        float val[] = {0.5f, -0.5f};
+        PRINT_ON_ERR(wav_set_normalized(&wav, 0, val));
+    }
+    PRINT_ON_ERR(free_wav_file(&wav));
+    PRINT_ON_ERR(read_wav_file("16bit_44100Hz_int_stereo.wav", &wav));
+    PRINT_ON_ERR(wav.data[0] || wav.data[1]);
+    PRINT_ON_ERR(free_wav_file(&wav));
+    PRINT_ON_ERR(!read_wav_file_mmap("does_not_exist.wav", &wav, NULL, 0));
+
+    printf("Streaming read test\n");
+    {
+        struct wav_reader *reader;
+        float streamed[333], loaded[333];
+        PRINT_ON_ERR(read_wav_file("sine.dat", &wav));
+        PRINT_ON_ERR(wav_reader_open(&reader, "sine.dat", custom_headers, 100));
+        PRINT_ON_ERR(wav_reader_format(reader)->num_frames != wav.num_frames || wav_reader_format(reader)->data);
+        PRINT_ON_ERR(custom_headers[2].num_bytes != 108);
+        unsigned pos = 0;
+        int frames;
+        while ((frames = wav_reader_read(reader, streamed, 333)) > 0)
+        {
+            PRINT_ON_ERR(wav_get_normalized_range(&wav, pos, frames, loaded));
+            PRINT_ON_ERR(memcmp(streamed, loaded, frames * sizeof(float)));
+            pos += frames;
+        }
+        PRINT_ON_ERR(frames < 0 || pos != wav.num_frames);
+        PRINT_ON_ERR(wav_reader_seek(reader, 10));
+        PRINT_ON_ERR(wav_reader_read(reader, streamed, 1) != 1 || wav_reader_position(reader) != 11);
+        PRINT_ON_ERR(wav_get_normalized(&wav, 10, loaded));
+        PRINT_ON_ERR(streamed[0] != loaded[0]);
+        PRINT_ON_ERR(!wav_reader_seek(reader, wav.num_frames + 1));
+        PRINT_ON_ERR(wav_reader_close(reader));
+        PRINT_ON_ERR(free_wav_file(&wav));
+    }
+
+    printf("Chunk index test\n");
+    {
+        struct wav_reader *reader;
+        PRINT_ON_ERR(wav_reader_open(&reader, "sine.dat", NULL, 0));
+        const struct wav_chunk_index *index = wav_reader_chunks(reader);
+        const char *ids[] = {"fmt ", "fact", "PEAK", "data", "LIST", "id3 "};
+        PRINT_ON_ERR(index->num_chunks != 6);
+        for (unsigned i = 0; i < index->num_chunks && i < 6; i++)
+            PRINT_ON_ERR(strcmp(index->chunks[i].id, ids[i]));
+        PRINT_ON_ERR(index->chunks[0].offset != 20 || index->chunks[0].size != 16);
+        // Any chunk can be fetched after opening without affecting the read position
+        float before[2], after[2];
+        PRINT_ON_ERR(wav_reader_read(reader, before, 1) != 1);
+        struct wav_file_custom_header_data chdr = {"PEAK", 0, NULL};
+        PRINT_ON_ERR(wav_reader_read_chunk(reader, &chdr));
+        PRINT_ON_ERR(chdr.num_bytes != 16 || (unsigned char)chdr.data[12] != 0xaa);
+        free(chdr.data);
+        struct wav_file_custom_header_data missing = {"abcd", 0, NULL};
+        PRINT_ON_ERR(!wav_reader_read_chunk(reader, &missing) || missing.data);
+        PRINT_ON_ERR(wav_reader_read(reader, after, 1) != 1);
+        PRINT_ON_ERR(wav_reader_position(reader) != 2);
+        PRINT_ON_ERR(read_wav_file("sine.dat", &wav));
+        PRINT_ON_ERR(wav_get_normalized(&wav, 1, before));
+        PRINT_ON_ERR(before[0] != after[0]);
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(wav_reader_close(reader));
+    }
+
+    printf("Prefetch read test\n");
+    {
+        struct wav_reader *reader;
+        struct wav_prefetch_stats stats;
+        float streamed[333], loaded[333];
+        PRINT_ON_ERR(read_wav_file("sine.dat", &wav));
+        PRINT_ON_ERR(wav_reader_open(&reader, "sine.dat", NULL, 100));
+        PRINT_ON_ERR(!wav_reader_prefetch_stats(reader, &stats));
+        // Read-ahead continues from the current position
+        PRINT_ON_ERR(wav_reader_read(reader, streamed, 7) != 7);
+        PRINT_ON_ERR(wav_reader_prefetch(reader, 3));
+        PRINT_ON_ERR(!wav_reader_prefetch(reader, 3));
+        unsigned pos = 7;
+        int frames;
+        while ((frames = wav_reader_read(reader, streamed, 333)) > 0)
+        {
+            PRINT_ON_ERR(wav_get_normalized_range(&wav, pos, frames, loaded));
+            PRINT_ON_ERR(memcmp(streamed, loaded, frames * sizeof(float)));
+            pos += frames;
+        }
+        PRINT_ON_ERR(frames < 0 || pos != wav.num_frames || wav_reader_position(reader) != pos);
+        PRINT_ON_ERR(wav_reader_prefetch_stats(reader, &stats));
+        PRINT_ON_ERR(!stats.blocks || stats.stalls > stats.blocks + 1);
+        // Seeking discards the blocks read ahead, and reading a chunk doesn't move the read position
+        PRINT_ON_ERR(wav_reader_seek(reader, 10));
+        PRINT_ON_ERR(wav_reader_read(reader, streamed, 250) != 250 || wav_reader_position(reader) != 260);
+        struct wav_file_custom_header_data chdr = {"PEAK", 0, NULL};
+        PRINT_ON_ERR(wav_reader_read_chunk(reader, &chdr));
+        PRINT_ON_ERR(chdr.num_bytes != 16);
+        free(chdr.data);
+        PRINT_ON_ERR(wav_reader_read(reader, streamed + 250, 83) != 83);
+        PRINT_ON_ERR(wav_get_normalized_range(&wav, 10, 333, loaded));
+        PRINT_ON_ERR(memcmp(streamed, loaded, 333 * sizeof(float)));
+        PRINT_ON_ERR(wav_reader_seek(reader, wav.num_frames));
+        PRINT_ON_ERR(wav_reader_read(reader, streamed, 1) != 0);
+        PRINT_ON_ERR(wav_reader_close(reader));
+        PRINT_ON_ERR(free_wav_file(&wav));
+
+        // Closing with a full ring stops the thread
+        PRINT_ON_ERR(wav_reader_open(&reader, "sine.dat", NULL, 10));
+        PRINT_ON_ERR(wav_reader_prefetch(reader, 0));
+        PRINT_ON_ERR(wav_reader_close(reader));
+    }
+
+    printf("Probe test\n");
+    {
+        PRINT_ON_ERR(read_wav_file("sine.dat", &wav));
+        struct wav_file_custom_header_data fact[] = {{"fact", 0, NULL}, {{0}, 0, NULL}};
+        PRINT_ON_ERR(wav_probe("sine.dat", &wav2, fact));
+        PRINT_ON_ERR(wav2.data || wav2.num_frames != wav.num_frames || wav2.num_bytes != wav.num_bytes);
+        PRINT_ON_ERR(wav2.channels != wav.channels || wav2.sample_rate != wav.sample_rate);
+        PRINT_ON_ERR(wav2.bit_depth != wav.bit_depth || wav2.is_float != wav.is_float);
+        PRINT_ON_ERR(fact[0].num_bytes != 4 || !fact[0].data);
+        free(fact[0].data);
+        PRINT_ON_ERR(!wav_probe("does_not_exist.wav", &wav2, NULL));
+
+        const char *files[] = {"sine.dat", "does_not_exist.wav", "16bit_44100Hz_int_stereo.wav", "sine.dat"};
+        struct wav_file wavs[4];
+        int results[4];
+        PRINT_ON_ERR(!wav_probe_batch(files, 4, wavs, results, 2));
+        PRINT_ON_ERR(results[0] || !results[1] || results[2] || results[3]);
+        PRINT_ON_ERR(wavs[0].num_frames != wav.num_frames || wavs[3].num_frames != wav.num_frames);
+        PRINT_ON_ERR(wavs[2].channels != 2 || wavs[2].bit_depth != 16 || wavs[2].sample_rate != 44100);
+        PRINT_ON_ERR(free_wav_file(&wav));
+    }
+
+    printf("Thread pool test\n");
+    {
+        // Concurrent and nested calls share the workers and all finish
+        unsigned long long count = 0;
+        pthread_t callers[3];
+        for (int i = 0; i < 3; i++)
+            PRINT_ON_ERR(pthread_create(&callers[i], NULL, pool_caller, &count));
+        pool_caller(&count);
+        for (int i = 0; i < 3; i++)
+            pthread_join(callers[i], NULL);
+        PRINT_ON_ERR(count != 4ull * 20 * 8 * 5050);
+    }
+
+    printf("Allocator test\n");
+    {
+        int live_allocations = 0;
+        struct wav_allocator counting = {counting_alloc, counting_free, &live_allocations};
+        struct wav_file_custom_header_data fact[] = {{"fact", 0, NULL}, {{0}, 0, NULL}};
+        PRINT_ON_ERR(read_wav_file("sine.dat", &wav));
+        PRINT_ON_ERR(read_wav_file_alloc("sine.dat", &wav2, fact, &counting));
+        PRINT_ON_ERR(live_allocations != 2 || fact[0].num_bytes != 4);
+        PRINT_ON_ERR(wav2.num_bytes != wav.num_bytes || memcmp(wav.data, wav2.data, wav.num_bytes));
+        counting.free(counting.ctx, fact[0].data);
+        PRINT_ON_ERR(free_wav_file(&wav2));
+        PRINT_ON_ERR(live_allocations != 0);
+        PRINT_ON_ERR(create_wav_file_alloc(&wav2, 10, 2, 24, 48000, &counting));
+        PRINT_ON_ERR(live_allocations != 1 || wav2.num_bytes != 60 || wav2.data[59]);
+        PRINT_ON_ERR(free_wav_file(&wav2));
+        PRINT_ON_ERR(live_allocations != 0);
+        // Data allocated by the caller, in a struct that held garbage before
+        memset(&wav2, 0xAB, sizeof(wav2));
+        PRINT_ON_ERR(init_wav_file(&wav2, (char *)calloc(40, 1), 10, 2, 16, 48000, 0));
+        PRINT_ON_ERR(wav2.num_bytes != 40 || wav2.release || wav2.stats);
+        float half[] = {0.5f, -0.5f};
+        PRINT_ON_ERR(wav_set_normalized(&wav2, 9, half));
+        PRINT_ON_ERR(free_wav_file(&wav2));
+        PRINT_ON_ERR(!init_wav_file(&wav2, NULL, 10, 2, 16, 48000, 0) || wav2.data);
+
+        struct wav_arena *arena;
+        PRINT_ON_ERR(wav_arena_create(&arena, 4096));
+        for (int round = 0; round < 3; round++)
+        {
+            // sine.dat data is smaller than the block, the created file needs a block of its own
+            for (int i = 0; i < 10; i++)
+            {
+                PRINT_ON_ERR(read_wav_file_alloc("sine.dat", &wav2, fact, wav_arena_allocator(arena)));
+                PRINT_ON_ERR(((size_t)wav2.data & 63) || ((size_t)fact[0].data & 63));
+                PRINT_ON_ERR(memcmp(wav.data, wav2.data, wav.num_bytes));
+                PRINT_ON_ERR(memcmp(fact[0].data, "\x34\x03\0\0", 4));
+                PRINT_ON_ERR(free_wav_file(&wav2));
+            }
+            PRINT_ON_ERR(create_wav_file_alloc(&wav2, 10000, 2, 16, 48000, wav_arena_allocator(arena)));
+            PRINT_ON_ERR(wav2.data[0] || wav2.data[39999]);
+            PRINT_ON_ERR(wav_arena_reset(arena));
+        }
+        PRINT_ON_ERR(wav_arena_destroy(arena));
+        PRINT_ON_ERR(free_wav_file(&wav));
+    }
+
+    printf("RF64 write and read test\n");
+    {
+        struct wav_writer *writer;
+        char riff_id[5] = {0};
+        float val[] = {0.25f, -0.25f};
+        PRINT_ON_ERR(create_wav_file(&wav, 1000, 2, 16, 96000));
+        PRINT_ON_ERR(wav_set_normalized(&wav, 999, val));
+        PRINT_ON_ERR(write_wav_file_ex("rf64_16bit_stereo.wav", &wav, custom_headers, WAV_WRITE_RF64));
+        PRINT_ON_ERR(wav_writer_open(&writer, "rf64_streamed_16bit_stereo.wav", &wav, NULL, 0, WAV_WRITE_RF64));
+        PRINT_ON_ERR(wav_writer_write_raw(writer, wav.data, wav.num_frames));
+        PRINT_ON_ERR(wav_writer_close(writer));
+        const char *rf64_files[] = {"rf64_16bit_stereo.wav", "rf64_streamed_16bit_stereo.wav"};
+        for (int i = 0; i < 2; i++)
+        {
+            FILE *f = fopen(rf64_files[i], "rb");
+            PRINT_ON_ERR(!f || fread(riff_id, 1, 4, f) != 4 || strcmp(riff_id, "RF64"));
+            if (f)
+                fclose(f);
+            PRINT_ON_ERR(read_wav_file(rf64_files[i], &wav2));
+            PRINT_ON_ERR(wav2.num_frames != 1000 || wav2.num_bytes != wav.num_bytes || memcmp(wav.data, wav2.data, wav.num_bytes));
+            PRINT_ON_ERR(free_wav_file(&wav2));
+        }
+        PRINT_ON_ERR(free_wav_file(&wav));
+    }
+
+    printf("Vectored and direct write test\n");
+    {
+        // The fd based write modes must produce the same files as stdio, also for data that doesn't end
+        // on a direct I/O block boundary
+        const int modes[] = {WAV_WRITE_VECTORED, WAV_WRITE_DIRECT, WAV_WRITE_DIRECT | WAV_WRITE_RF64};
+        const char *names[] = {"vectored_24bit_stereo.wav", "direct_24bit_stereo.wav", "direct_rf64_24bit_stereo.wav"};
+        float val[] = {0.5f, -0.5f};
+        PRINT_ON_ERR(create_wav_file(&wav, 300001, 2, 24, 48000));
+        PRINT_ON_ERR(wav_set_normalized(&wav, 300000, val));
+        for (int i = 0; i < 3; i++)
+        {
+            const char *stdio_name = modes[i] & WAV_WRITE_RF64 ? "stdio_rf64_24bit_stereo.wav" : "stdio_24bit_stereo.wav";
+            PRINT_ON_ERR(write_wav_file_ex(stdio_name, &wav, custom_headers, modes[i] & WAV_WRITE_RF64));
+            PRINT_ON_ERR(write_wav_file_ex(names[i], &wav, custom_headers, modes[i]));
+            PRINT_ON_ERR(compare_files(stdio_name, names[i]));
+        }
+        PRINT_ON_ERR(read_wav_file("direct_24bit_stereo.wav", &wav2));
+        PRINT_ON_ERR(wav2.num_frames != 300001 || memcmp(wav.data, wav2.data, wav.num_bytes));
+        PRINT_ON_ERR(free_wav_file(&wav2));
+        PRINT_ON_ERR(free_wav_file(&wav));
+    }
+
+    printf("Memory read and write test\n");
+    {
+        // Serializing to memory gives the same bytes as writing the file
+        char *buffer = NULL, file_data[1000];
+        size_t capacity = 0, size = 0;
+        PRINT_ON_ERR(create_wav_file(&wav, 100, 2, 24, 48000));
+        for (unsigned i = 0; i < wav.num_bytes; i++)
+            wav.data[i] = (char)(i * 7);
+        PRINT_ON_ERR(write_wav_file_chdr("memory_24bit_stereo.wav", &wav, custom_headers));
+        FILE *f = fopen("memory_24bit_stereo.wav", "rb");
+        const size_t file_size = f ? fread(file_data, 1, sizeof(file_data), f) : 0;
+        if (f)
+            fclose(f);
+        PRINT_ON_ERR(!write_wav_memory(&wav, custom_headers, 0, NULL, 0, &size));
+        PRINT_ON_ERR(size != file_size);
+        PRINT_ON_ERR(write_wav_memory_alloc(&wav, custom_headers, 0, &buffer, &capacity, &size));
+        PRINT_ON_ERR(size != file_size || capacity < size || memcmp(buffer, file_data, size));
+        PRINT_ON_ERR(write_wav_memory(&wav, NULL, WAV_WRITE_RF64, file_data, sizeof(file_data), &size));
+        PRINT_ON_ERR(memcmp(file_data, "RF64", 4));
+
+        // Copying and zero-copy parsing, with the custom headers and RF64
+        struct wav_file_custom_header_data memory_headers[] = {{"LIST", 0, NULL}, {"", 0, NULL}};
+        PRINT_ON_ERR(read_wav_memory(buffer, capacity, &wav2, memory_headers, 0));
+        PRINT_ON_ERR(wav2.num_frames != 100 || wav2.bit_depth != 24 || memcmp(wav.data, wav2.data, wav.num_bytes));
+        PRINT_ON_ERR(memory_headers[0].num_bytes != custom_headers[2].num_bytes ||
+                     memcmp(memory_headers[0].data, custom_headers[2].data, memory_headers[0].num_bytes));
+        PRINT_ON_ERR(free_wav_file(&wav2));
+        PRINT_ON_ERR(read_wav_memory(file_data, size, &wav2, NULL, WAV_MEMORY_ZERO_COPY));
+        PRINT_ON_ERR(wav2.data != file_data + size - wav.num_bytes || memcmp(wav.data, wav2.data, wav.num_bytes));
+        // Converting never writes to the caller's buffer
+        PRINT_ON_ERR(wav_convert_in_place(&wav2, 16, 0));
+        PRINT_ON_ERR(wav2.data == file_data + size - wav.num_bytes || memcmp(wav.data, file_data + size - wav.num_bytes, wav.num_bytes));
+        PRINT_ON_ERR(free_wav_file(&wav2));
+        PRINT_ON_ERR(read_wav_memory(file_data, size, &wav2, NULL, WAV_MEMORY_ZERO_COPY));
+        PRINT_ON_ERR(free_wav_file(&wav2));
+        PRINT_ON_ERR(!read_wav_memory(file_data, size - 1, &wav2, NULL, 0));
+        PRINT_ON_ERR(!read_wav_memory(file_data, 30, &wav2, NULL, WAV_MEMORY_ZERO_COPY));
+        PRINT_ON_ERR(!read_wav_memory("RIFF", 4, &wav2, NULL, 0));
+        // Sizes in ds64 past the end of the file are rejected instead of wrapping the chunk walk around
+        const unsigned long long riff_size64 = 1ull << 62, data_size64 = ~0ull - 67;
+        PRINT_ON_ERR(memcmp(file_data + 12, "ds64", 4));
+        memcpy(file_data + 20, &riff_size64, 8);
+        memcpy(file_data + 28, &data_size64, 8);
+        PRINT_ON_ERR(!read_wav_memory(file_data, size, &wav2, NULL, 0));
+        PRINT_ON_ERR(!read_wav_memory(file_data, size, &wav2, NULL, WAV_MEMORY_ZERO_COPY));
+        f = fopen("malformed_ds64.wav", "wb");
+        PRINT_ON_ERR(!f || fwrite(file_data, 1, size, f) != size);
+        if (f)
+            fclose(f);
+        PRINT_ON_ERR(!wav_probe("malformed_ds64.wav", &wav2, NULL));
+        PRINT_ON_ERR(!read_wav_file("malformed_ds64.wav", &wav2));
+        free(memory_headers[0].data);
+        free(buffer);
+        PRINT_ON_ERR(free_wav_file(&wav));
+    }
+
+    printf("Streaming write test\n");
+    {
+        // A file written in blocks must have the same contents as the same file written at once
+        struct wav_writer *writer;
+        float block[2 * 300];
+        PRINT_ON_ERR(create_wav_file(&wav, 1000, 2, 24, 48000));
+        PRINT_ON_ERR(wav_writer_open(&writer, "streamed_24bit_stereo.wav", &wav, custom_headers, 128, 0));
+        for (int i = 0; i < 1000; i += 300)
+        {
+            const int frames = i + 300 > 1000 ? 1000 - i : 300;
+            for (int j = 0; j < frames; j++)
+                block[2 * j] = block[2 * j + 1] = sin((i + j) / 30.0);
+            PRINT_ON_ERR(wav_set_normalized_range(&wav, i, frames, block));
+            PRINT_ON_ERR(wav_writer_write(writer, block, frames));
+        }
+        PRINT_ON_ERR(wav_writer_format(writer)->num_frames != 1000);
+        PRINT_ON_ERR(wav_writer_close(writer));
+        struct wav_file_custom_header_data streamed_headers[] = {{"PEAK", 0, NULL}, {"", 0, NULL}};
+        PRINT_ON_ERR(read_wav_file_chdr("streamed_24bit_stereo.wav", &wav2, streamed_headers));
+        PRINT_ON_ERR(wav2.num_bytes != wav.num_bytes || memcmp(wav.data, wav2.data, wav.num_bytes));
+        PRINT_ON_ERR(streamed_headers[0].num_bytes != 16 || memcmp(streamed_headers[0].data, custom_headers[1].data, 16));
+        free(streamed_headers[0].data);
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(free_wav_file(&wav2));
+    }
+
+    free(custom_headers[0].data);
+    free(custom_headers[1].data);
+    free(custom_headers[2].data);
+
+    // Bulk conversion test: range functions must match the per-frame functions exactly with every instruction set
+
+    const unsigned bulk_formats[][2] = {{8, 0}, {16, 0}, {24, 0}, {32, 0}, {32, 1}, {64, 1}};
+    const char *isa_names[] = {"scalar", "SSE2", "AVX2"};
+    for (int isa = WAV_ISA_SCALAR; isa <= WAV_ISA_AVX2; isa++)
+    {
+        if (wav_set_conversion_isa(isa))
+        {
+            printf("Skipping bulk tests for %s: not supported\n", isa_names[isa]);
+            continue;
+        }
+        for (int f = 0; f < sizeof(bulk_formats) / sizeof(bulk_formats[0]); f++)
+        {
+            printf("Bulk test (%s) %u bit %s stereo audio\n", isa_names[isa], bulk_formats[f][0], bulk_formats[f][1] ? "float" : "int");
+            // Odd length to exercise the scalar tail handling
+            const unsigned frames = 1001;
+            float in[2 * 1001], out[2 * 1001];
+            srand(f);
+            for (int i = 0; i < 2 * frames; i++)
+            {
+                // Overshoot the range a bit to test clipping
+                in[i] = 3.0f * rand() / RAND_MAX - 1.5f;
+            }
+            in[0] = 1;
+            in[1] = -1;
+            PRINT_ON_ERR(create_wav_file(&wav, frames, 2, bulk_formats[f][0], 44100));
+            PRINT_ON_ERR(create_wav_file(&wav2, frames, 2, bulk_formats[f][0], 44100));
+            wav.is_float = wav2.is_float = bulk_formats[f][1];
+            PRINT_ON_ERR(wav_set_normalized_range(&wav, 0, frames, in));
+            for (int i = 0; i < frames; i++)
+                PRINT_ON_ERR(wav_set_normalized(&wav2, i, &in[2 * i]));
+            PRINT_ON_ERR(memcmp(wav.data, wav2.data, wav.num_bytes));
+            if (!bulk_formats[f][1])
+            {
+                // Arbitrary integer data for decoding
+                for (int i = 0; i < wav.num_bytes; i++)
+                    wav.data[i] = rand();
+            }
+            PRINT_ON_ERR(wav_get_normalized_range(&wav, 0, frames, out));
+            for (int i = 0; i < frames; i++)
+            {
+                float val[2];
+                PRINT_ON_ERR(wav_get_normalized(&wav, i, val));
+                PRINT_ON_ERR(memcmp(val, &out[2 * i], sizeof(val)));
+            }
+            PRINT_ON_ERR(!wav_get_normalized_range(&wav, frames - 1, 2, out));
+            PRINT_ON_ERR(free_wav_file(&wav));
+            PRINT_ON_ERR(free_wav_file(&wav2));
+        }
+    }
+    wav_set_conversion_isa(WAV_ISA_AUTO);
+
+    // Planar test: planar functions must match the interleaved range functions for any channel count
+    const unsigned planar_channels[] = {1, 2, 3, 8, 16};
+    for (int f = 0; f < sizeof(bulk_formats) / sizeof(bulk_formats[0]); f++)
+    {
+        for (int c = 0; c < sizeof(planar_channels) / sizeof(planar_channels[0]); c++)
+        {
+            printf("Planar test %u bit %s %u channel audio\n", bulk_formats[f][0], bulk_formats[f][1] ? "float" : "int", planar_channels[c]);
+            const unsigned channels = planar_channels[c];
+            // Longer than the internal block size and not a multiple of it
+            const unsigned frames = 601;
+            float *interleaved = (float *)malloc(sizeof(float) * frames * channels);
+            float *planar_data = (float *)malloc(sizeof(float) * frames * channels);
+            float *planar[16];
+            for (unsigned ch = 0; ch < channels; ch++)
+            {
+                planar[ch] = planar_data + ch * frames;
+                for (unsigned i = 0; i < frames; i++)
+                    planar[ch][i] = 3.0f * rand() / RAND_MAX - 1.5f;
+            }
+            PRINT_ON_ERR(create_wav_file(&wav, frames, channels, bulk_formats[f][0], 44100));
+            PRINT_ON_ERR(create_wav_file(&wav2, frames, channels, bulk_formats[f][0], 44100));
+            wav.is_float = wav2.is_float = bulk_formats[f][1];
+            for (unsigned i = 0; i < frames; i++)
+                for (unsigned ch = 0; ch < channels; ch++)
+                    interleaved[i * channels + ch] = planar[ch][i];
+            PRINT_ON_ERR(wav_set_normalized_planar(&wav, 0, frames, (const float *const *)planar));
+            PRINT_ON_ERR(wav_set_normalized_range(&wav2, 0, frames, interleaved));
+            PRINT_ON_ERR(memcmp(wav.data, wav2.data, wav.num_bytes));
+            PRINT_ON_ERR(wav_get_normalized_planar(&wav, 1, frames - 1, planar));
+            PRINT_ON_ERR(wav_get_normalized_range(&wav, 1, frames - 1, interleaved));
+            int mismatches = 0;
+            for (unsigned i = 0; i < frames - 1; i++)
+                for (unsigned ch = 0; ch < channels; ch++)
+                    mismatches += planar[ch][i] != interleaved[i * channels + ch];
+            PRINT_ON_ERR(mismatches);
+            PRINT_ON_ERR(!wav_get_normalized_planar(&wav, 1, frames, planar));
+            free(interleaved);
+            free(planar_data);
+            PRINT_ON_ERR(free_wav_file(&wav));
+            PRINT_ON_ERR(free_wav_file(&wav2));
+        }
+    }
+
+    // Parallel test: the parallel range functions must match the serial ones
+    for (int f = 0; f < sizeof(bulk_formats) / sizeof(bulk_formats[0]); f++)
+    {
+        printf("Parallel test %u bit %s stereo audio\n", bulk_formats[f][0], bulk_formats[f][1] ? "float" : "int");
+        const unsigned frames = 200001;
+        float *in = (float *)malloc(sizeof(float) * 2 * frames);
+        float *out = (float *)malloc(sizeof(float) * 2 * frames);
+        float *out_parallel = (float *)malloc(sizeof(float) * 2 * frames);
+        for (unsigned i = 0; i < 2 * frames; i++)
+            in[i] = 3.0f * rand() / RAND_MAX - 1.5f;
+        PRINT_ON_ERR(create_wav_file(&wav, frames, 2, bulk_formats[f][0], 44100));
+        PRINT_ON_ERR(create_wav_file(&wav2, frames, 2, bulk_formats[f][0], 44100));
+        wav.is_float = wav2.is_float = bulk_formats[f][1];
+        PRINT_ON_ERR(wav_set_normalized_range(&wav, 0, frames, in));
+        PRINT_ON_ERR(wav_set_normalized_range_parallel(&wav2, 0, frames, in, 3, NULL));
+        PRINT_ON_ERR(memcmp(wav.data, wav2.data, wav.num_bytes));
+        PRINT_ON_ERR(wav_get_normalized_range(&wav, 1, frames - 1, out));
+        PRINT_ON_ERR(wav_get_normalized_range_parallel(&wav, 1, frames - 1, out_parallel, 0, NULL));
+        PRINT_ON_ERR(memcmp(out, out_parallel, sizeof(float) * 2 * (frames - 1)));
+        unsigned long long tasks = 0;
+        struct wav_executor executor = {reverse_executor, &tasks};
+        memset(wav2.data, 0, wav2.num_bytes);
+        PRINT_ON_ERR(wav_set_normalized_range_parallel(&wav2, 0, frames, in, 0, &executor));
+        PRINT_ON_ERR(memcmp(wav.data, wav2.data, wav.num_bytes));
+        PRINT_ON_ERR(wav_get_normalized_range_parallel(&wav, 1, frames - 1, out_parallel, 0, &executor));
+        PRINT_ON_ERR(memcmp(out, out_parallel, sizeof(float) * 2 * (frames - 1)));
+        PRINT_ON_ERR(tasks != 2 * 7);
+        PRINT_ON_ERR(!wav_get_normalized_range_parallel(&wav, 1, frames, out_parallel, 0, NULL));
+        free(in);
+        free(out);
+        free(out_parallel);
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(free_wav_file(&wav2));
+    }
+
+    printf("Planar streaming test\n");
+    {
+        struct wav_reader *reader;
+        struct wav_writer *writer, *interleaved_writer;
+        float left[300], right[300], streamed[600];
+        float *planar[] = {left, right};
+        PRINT_ON_ERR(read_wav_file("streamed_24bit_stereo.wav", &wav));
+        // Writing planar and interleaved samples must produce the same file
+        PRINT_ON_ERR(wav_writer_open(&writer, "planar_24bit_stereo.wav", &wav, NULL, 128, 0));
+        PRINT_ON_ERR(wav_writer_open(&interleaved_writer, "interleaved_24bit_stereo.wav", &wav, NULL, 128, 0));
+        PRINT_ON_ERR(wav_reader_open(&reader, "streamed_24bit_stereo.wav", NULL, 128));
+        int frames;
+        unsigned pos = 0;
+        while ((frames = wav_reader_read_planar(reader, planar, 300)) > 0)
+        {
+            PRINT_ON_ERR(wav_get_normalized_range(&wav, pos, frames, streamed));
+            for (int i = 0; i < frames; i++)
+                PRINT_ON_ERR(left[i] != streamed[2 * i] || right[i] != streamed[2 * i + 1]);
+            PRINT_ON_ERR(wav_writer_write_planar(writer, (const float *const *)planar, frames));
+            PRINT_ON_ERR(wav_writer_write(interleaved_writer, streamed, frames));
+            pos += frames;
+        }
+        PRINT_ON_ERR(frames < 0 || pos != wav.num_frames);
+        PRINT_ON_ERR(wav_reader_close(reader));
+        PRINT_ON_ERR(wav_writer_close(writer));
+        PRINT_ON_ERR(wav_writer_close(interleaved_writer));
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(read_wav_file("planar_24bit_stereo.wav", &wav));
+        PRINT_ON_ERR(read_wav_file("interleaved_24bit_stereo.wav", &wav2));
+        PRINT_ON_ERR(wav2.num_bytes != wav.num_bytes || memcmp(wav.data, wav2.data, wav.num_bytes));
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(free_wav_file(&wav2));
+    }
+
+    // In-place conversion test: converting must give the same data as setting the decoded samples to a new file
+    for (int f = 0; f < sizeof(bulk_formats) / sizeof(bulk_formats[0]); f++)
+    {
+        printf("In-place conversion test from %u bit %s stereo audio\n", bulk_formats[f][0], bulk_formats[f][1] ? "float" : "int");
+        // Not a multiple of the conversion block size
+        const unsigned frames = 3001;
+        float *in = (float *)malloc(sizeof(float) * 2 * frames);
+        for (unsigned i = 0; i < 2 * frames; i++)
+            in[i] = 3.0f * rand() / RAND_MAX - 1.5f;
+        for (int t = 0; t < sizeof(bulk_formats) / sizeof(bulk_formats[0]); t++)
+        {
+            PRINT_ON_ERR(create_wav_file(&wav, frames, 2, bulk_formats[f][0], 44100));
+            PRINT_ON_ERR(create_wav_file(&wav2, frames, 2, bulk_formats[t][0], 44100));
+            wav.is_float = bulk_formats[f][1];
+            wav2.is_float = bulk_formats[t][1];
+            PRINT_ON_ERR(wav_set_normalized_range(&wav, 0, frames, in));
+            PRINT_ON_ERR(wav_get_normalized_range(&wav, 0, frames, in));
+            // Converting to the same format must leave the data as is, decoding and encoding integers isn't lossless
+            if (t == f)
+                memcpy(wav2.data, wav.data, wav.num_bytes);
+            else
+                PRINT_ON_ERR(wav_set_normalized_range(&wav2, 0, frames, in));
+            PRINT_ON_ERR(wav_convert_in_place(&wav, bulk_formats[t][0], bulk_formats[t][1]));
+            PRINT_ON_ERR(wav.bit_depth != wav2.bit_depth || wav.is_float != wav2.is_float || wav.num_frames != frames);
+            PRINT_ON_ERR(wav.num_bytes != wav2.num_bytes || memcmp(wav.data, wav2.data, wav.num_bytes));
+            PRINT_ON_ERR(free_wav_file(&wav));
+            PRINT_ON_ERR(free_wav_file(&wav2));
+        }
+        free(in);
+    }
+
+    printf("In-place conversion test with allocator and mapped data\n");
+    {
+        int live_allocations = 0;
+        struct wav_allocator counting = {counting_alloc, counting_free, &live_allocations};
+        PRINT_ON_ERR(create_wav_file_alloc(&wav, 1000, 2, 16, 48000, &counting));
+        PRINT_ON_ERR(!wav_convert_in_place(&wav, 12, 0) || !wav_convert_in_place(&wav, 16, 1));
+        PRINT_ON_ERR(wav_convert_in_place(&wav, 64, 1));
+        PRINT_ON_ERR(live_allocations != 1 || wav.num_bytes != 16000 || wav.data[15999]);
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(live_allocations != 0);
+        // Growing the samples of an empty file keeps a valid buffer
+        PRINT_ON_ERR(create_wav_file(&wav, 0, 2, 16, 48000));
+        PRINT_ON_ERR(wav_convert_in_place(&wav, 64, 1));
+        PRINT_ON_ERR(!wav.data || wav.num_bytes != 0 || wav.bit_depth != 64 || !wav.is_float);
+        PRINT_ON_ERR(free_wav_file(&wav));
+        // A read-only mapping is never written, the converted data goes to a new buffer
+        PRINT_ON_ERR(read_wav_file("streamed_24bit_stereo.wav", &wav2));
+        PRINT_ON_ERR(read_wav_file_mmap("streamed_24bit_stereo.wav", &wav, NULL, WAV_MMAP_READ_ONLY));
+        PRINT_ON_ERR(wav_convert_in_place(&wav, 16, 0));
+        PRINT_ON_ERR(wav_convert_in_place(&wav2, 16, 0));
+        PRINT_ON_ERR(wav.num_bytes != wav2.num_bytes || memcmp(wav.data, wav2.data, wav.num_bytes));
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(free_wav_file(&wav2));
+    }
+
+    printf("Statistics test\n");
+    {
+        const unsigned frames = 10000;
+        struct wav_stats stats, expected, tracked;
+        float *in = (float *)malloc(sizeof(float) * 3 * frames);
+        for (unsigned i = 0; i < frames; i++)
+        {
+            in[3 * i] = 0.5f;
+            in[3 * i + 1] = 0.8f * sin(i / 30.0);
+            in[3 * i + 2] = 0.5f * rand() / RAND_MAX - 0.25f;
+        }
+        in[3 * 7777 + 2] = -0.9f;
+        PRINT_ON_ERR(create_wav_file(&wav, frames, 3, 24, 48000));
+        PRINT_ON_ERR(wav_track_stats(&wav, &tracked));
+        PRINT_ON_ERR(tracked.channel[1].peak != 0 || tracked.channel[1].sum_squares != 0);
+        PRINT_ON_ERR(wav_set_normalized_range(&wav, 0, frames, in));
+        PRINT_ON_ERR(wav_get_normalized_range(&wav, 0, frames, in));
+        // Reference statistics computed directly from the decoded samples
+        memset(&expected, 0, sizeof(expected));
+        expected.channels = 3;
+        expected.num_frames = frames;
+        for (unsigned i = 0; i < frames; i++)
+        {
+            for (unsigned c = 0; c < 3; c++)
+            {
+                const float v = in[3 * i + c];
+                if (fabs(v) > expected.channel[c].peak)
+                {
+                    expected.channel[c].peak = fabs(v);
+                    expected.channel[c].peak_frame = i;
+                }
+                expected.channel[c].sum += v;
+                expected.channel[c].sum_squares += (double)v * v;
+            }
+        }
+        PRINT_ON_ERR(expected.channel[2].peak_frame != 7777);
+        for (int isa = WAV_ISA_SCALAR; isa <= WAV_ISA_AVX2; isa++)
+        {
+            if (!wav_set_conversion_isa(isa))
+            {
+                PRINT_ON_ERR(wav_compute_stats(&wav, &stats));
+                PRINT_ON_ERR(compare_stats(&stats, &expected));
+            }
+        }
+        wav_set_conversion_isa(WAV_ISA_AUTO);
+        PRINT_ON_ERR(compare_stats(&tracked, &expected));
+        PRINT_ON_ERR(fabs(wav_stats_dc_offset(&stats, 0) - 0.5) > 1e-6 || fabs(wav_stats_rms(&stats, 0) - 0.5) > 1e-6);
+        PRINT_ON_ERR(fabs(wav_stats_rms(&stats, 1) - 0.8 / sqrt(2)) > 1e-3);
+
+        // Every set function keeps the tracked statistics up to date
+        float frame[] = {0.95f, 0.0f, 0.1f};
+        float left[100], middle[100], right[100];
+        float *planar[] = {left, middle, right};
+        for (int i = 0; i < 100; i++)
+            left[i] = middle[i] = right[i] = -0.3f;
+        PRINT_ON_ERR(wav_set_normalized(&wav, 5000, frame));
+        PRINT_ON_ERR(wav_set_normalized_planar(&wav, 100, 100, (const float *const *)planar));
+        PRINT_ON_ERR(wav_set_normalized_range_parallel(&wav, 2000, 1000, in, 2, NULL));
+        PRINT_ON_ERR(wav_compute_stats(&wav, &expected));
+        PRINT_ON_ERR(compare_stats(&tracked, &expected));
+        PRINT_ON_ERR(tracked.channel[0].peak_frame != 5000);
+        // Overwriting the peak with a smaller value leaves an upper bound until refreshed
+        frame[0] = 0.5f;
+        PRINT_ON_ERR(wav_set_normalized(&wav, 5000, frame));
+        PRINT_ON_ERR(!tracked.channel[0].peak_stale || tracked.channel[1].peak_stale);
+        struct wav_file_custom_header_data stats_headers[3];
+        PRINT_ON_ERR(!wav_stats_chunks(&wav, &tracked, stats_headers));
+        PRINT_ON_ERR(wav_refresh_stats(&wav));
+        PRINT_ON_ERR(wav_compute_stats(&wav, &expected));
+        PRINT_ON_ERR(compare_stats(&tracked, &expected));
+
+        // Stored statistics are read back without reading the data
+        PRINT_ON_ERR(wav_stats_chunks(&wav, &tracked, stats_headers));
+        PRINT_ON_ERR(write_wav_file_chdr("stats_24bit_3ch.wav", &wav, stats_headers));
+        PRINT_ON_ERR(wav_read_stats("stats_24bit_3ch.wav", &stats));
+        PRINT_ON_ERR(compare_stats(&stats, &tracked));
+        PRINT_ON_ERR(wav_read_stats_ex("stats_24bit_3ch.wav", &stats, WAV_STATS_VERIFY_DATA));
+        struct wav_file_custom_header_data read_headers[] = {{"PEAK", 0, NULL}, {WAV_STATS_CHUNK_ID, 0, NULL}, {"", 0, NULL}};
+        PRINT_ON_ERR(read_wav_file_chdr("stats_24bit_3ch.wav", &wav2, read_headers));
+        PRINT_ON_ERR(read_headers[0].num_bytes != 32 || memcmp(read_headers[0].data + 8, &tracked.channel[0].peak, 4));
+        PRINT_ON_ERR(wav_stats_from_chunk(&wav2, &read_headers[1], &stats, 0));
+        PRINT_ON_ERR(compare_stats(&stats, &tracked));
+        // A changed frame in the middle is only detected by checking the hash
+        PRINT_ON_ERR(wav_set_normalized(&wav2, frames / 2 + 1, frame));
+        PRINT_ON_ERR(wav_stats_from_chunk(&wav2, &read_headers[1], &stats, 0));
+        PRINT_ON_ERR(!wav_stats_from_chunk(&wav2, &read_headers[1], &stats, WAV_STATS_VERIFY_DATA));
+        PRINT_ON_ERR(write_wav_file_chdr("stats_24bit_3ch.wav", &wav2, stats_headers));
+        PRINT_ON_ERR(wav_read_stats("stats_24bit_3ch.wav", &stats));
+        PRINT_ON_ERR(!wav_read_stats_ex("stats_24bit_3ch.wav", &stats, WAV_STATS_VERIFY_DATA));
+        // so stale statistics are kept out of the file when it's written
+        PRINT_ON_ERR(write_wav_file_stats("stats_24bit_3ch.wav", &wav2, read_headers, 0));
+        PRINT_ON_ERR(!wav_read_stats("stats_24bit_3ch.wav", &stats));
+        PRINT_ON_ERR(write_wav_file_stats("stats_24bit_3ch.wav", &wav, read_headers, WAV_WRITE_RF64));
+        PRINT_ON_ERR(wav_read_stats("stats_24bit_3ch.wav", &stats));
+        PRINT_ON_ERR(compare_stats(&stats, &tracked));
+        PRINT_ON_ERR(wav_track_stats(&wav, NULL));
+        PRINT_ON_ERR(write_wav_file_stats("stats_24bit_3ch.wav", &wav, read_headers, 0));
+        PRINT_ON_ERR(wav_read_stats("stats_24bit_3ch.wav", &stats));
+        PRINT_ON_ERR(!wav_read_stats("sine.dat", &stats));
+        for (int i = 0; i < 2; i++)
+        {
+            free(stats_headers[i].data);
+            free(read_headers[i].data);
+        }
+        free(in);
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(free_wav_file(&wav2));
+    }
+
+    printf("Overview test\n");
+    {
+        const unsigned frames = 1234567;
+        struct wav_overview *overview, *loaded;
+        float *in = (float *)malloc(sizeof(float) * 2 * frames);
+        for (unsigned i = 0; i < frames; i++)
+        {
+            in[2 * i] = 0.9f * sin(i / 1000.0) * rand() / RAND_MAX;
+            in[2 * i + 1] = (float)i / frames - 0.5f;
+        }
+        in[2 * 1000000] = 1.0f;
+        PRINT_ON_ERR(create_wav_file(&wav, frames, 2, 32, 44100));
+        wav.is_float = 1;
+        PRINT_ON_ERR(wav_set_normalized_range(&wav, 0, frames, in));
+        PRINT_ON_ERR(write_wav_file("overview_float_stereo.wav", &wav));
+        PRINT_ON_ERR(wav_overview_from_wav(&overview, &wav));
+        PRINT_ON_ERR(wav_overview_frames(overview) != frames || wav_overview_channels(overview) != 2);
+        // Whole file, zoomed in, unaligned and single bucket ranges, and more pixels than frames
+        for (unsigned c = 0; c < 2; c++)
+        {
+            PRINT_ON_ERR(compare_overview(overview, in, c, 0, frames, 1));
+            PRINT_ON_ERR(compare_overview(overview, in, c, 0, frames, 1000));
+            PRINT_ON_ERR(compare_overview(overview, in, c, 12345, 1100001, 777));
+            PRINT_ON_ERR(compare_overview(overview, in, c, 999999, 1000001, 3));
+            PRINT_ON_ERR(compare_overview(overview, in, c, frames - 100, frames, 300));
+        }
+        float min, max;
+        PRINT_ON_ERR(!wav_overview_query(overview, 2, 0, frames, 1, &min, &max));
+        PRINT_ON_ERR(!wav_overview_query(overview, 0, 0, frames + 1, 1, &min, &max));
+        PRINT_ON_ERR(!wav_overview_query(overview, 0, 10, 10, 1, &min, &max));
+
+        // Building block by block while streaming gives the same overview
+        struct wav_file_custom_header_data chunk, streamed_chunk;
+        PRINT_ON_ERR(wav_overview_build(&loaded, "overview_float_stereo.wav"));
+        PRINT_ON_ERR(wav_overview_chunk(overview, &chunk));
+        PRINT_ON_ERR(wav_overview_chunk(loaded, &streamed_chunk));
+        PRINT_ON_ERR(chunk.num_bytes != streamed_chunk.num_bytes || memcmp(chunk.data, streamed_chunk.data, chunk.num_bytes));
+        PRINT_ON_ERR(wav_overview_free(loaded));
+        free(streamed_chunk.data);
+
+        // Stored as a chunk and as a sidecar file, which are read only
+        PRINT_ON_ERR(wav_overview_from_chunk(&loaded, &chunk));
+        PRINT_ON_ERR(compare_overview(loaded, in, 0, 12345, 1100001, 777));
+        PRINT_ON_ERR(!wav_overview_add(loaded, NULL, 0));
+        PRINT_ON_ERR(wav_overview_free(loaded));
+        PRINT_ON_ERR(wav_overview_save(overview, "overview_float_stereo.wov"));
+        PRINT_ON_ERR(wav_overview_load(&loaded, "overview_float_stereo.wov"));
+        PRINT_ON_ERR(compare_overview(loaded, in, 1, 0, frames, 1000));
+        PRINT_ON_ERR(wav_overview_free(loaded));
+        chunk.num_bytes -= 8;
+        PRINT_ON_ERR(!wav_overview_from_chunk(&loaded, &chunk));
+        PRINT_ON_ERR(!wav_overview_load(&loaded, "overview_float_stereo.wav"));
+        free(chunk.data);
+        PRINT_ON_ERR(wav_overview_free(overview));
+        free(in);
+        PRINT_ON_ERR(free_wav_file(&wav));
+    }
+
+    printf("Resampling test\n");
+    {
+        const unsigned frames = 44100;
+        float *in = (float *)malloc(sizeof(float) * 2 * frames);
+        for (unsigned i = 0; i < frames; i++)
+        {
+            in[2 * i] = 0.5f * sin(2 * M_PI * 1000 * i / 44100);
+            in[2 * i + 1] = 0.5f * sin(2 * M_PI * 15000 * i / 44100);
+        }
+        PRINT_ON_ERR(create_wav_file(&wav, frames, 2, 32, 44100));
+        wav.is_float = 1;
+        PRINT_ON_ERR(wav_set_normalized_range(&wav, 0, frames, in));
+        PRINT_ON_ERR(write_wav_file("resample_float_stereo.wav", &wav));
+        struct wav_file resampled;
+        PRINT_ON_ERR(wav_resample(&wav, &resampled, 48000));
+        PRINT_ON_ERR(resampled.num_frames != 48000 || resampled.sample_rate != 48000 || !resampled.is_float);
+        // Tones in the passband are preserved apart from the edges
+        float *out = (float *)malloc(sizeof(float) * 2 * 48000);
+        PRINT_ON_ERR(wav_get_normalized_range(&resampled, 0, 48000, out));
+        double max_error = 0;
+        for (unsigned i = 100; i < 47900; i++)
+        {
+            max_error = fmax(max_error, fabs(out[2 * i] - 0.5 * sin(2 * M_PI * 1000 * i / 48000)));
+            max_error = fmax(max_error, fabs(out[2 * i + 1] - 0.5 * sin(2 * M_PI * 15000 * i / 48000)));
+        }
+        PRINT_ON_ERR(max_error > 1e-3);
+        // The inner product kernels of every instruction set agree up to rounding
+        for (int isa = WAV_ISA_SCALAR; isa <= WAV_ISA_AVX2; isa++)
+        {
+            struct wav_file other;
+            if (wav_set_conversion_isa(isa) || wav_resample(&wav, &other, 48000))
+                continue;
+            float sample[2];
+            PRINT_ON_ERR(wav_get_normalized(&other, 12345, sample));
+            PRINT_ON_ERR(fabs(sample[0] - out[2 * 12345]) > 1e-6 || fabs(sample[1] - out[2 * 12345 + 1]) > 1e-6);
+            PRINT_ON_ERR(free_wav_file(&other));
+        }
+        wav_set_conversion_isa(WAV_ISA_AUTO);
+
+        // Streaming in uneven blocks into small output buffers gives the same samples
+        struct wav_resampler *resampler;
+        float *streamed = (float *)malloc(sizeof(float) * 2 * 48000);
+        unsigned written = 0;
+        PRINT_ON_ERR(wav_resampler_create(&resampler, 2, 44100, 48000));
+        for (unsigned done = 0, n = 1; done < frames; done += n, n = n * 3 % 1000 + 1)
+        {
+            n = n < frames - done ? n : frames - done;
+            int result = wav_resampler_process(resampler, in + 2 * done, n, streamed + 2 * written, 50);
+            for (; result > 0; result = wav_resampler_process(resampler, NULL, 0, streamed + 2 * written, 50))
+                written += result;
+        }
+        for (int result; (result = wav_resampler_flush(resampler, streamed + 2 * written, 7)) > 0;)
+            written += result;
+        PRINT_ON_ERR(written != 48000 || memcmp(streamed, out, sizeof(float) * 2 * 48000));
+        PRINT_ON_ERR(wav_resampler_process(resampler, in, 1, streamed, 1) != -1);
+
+        // As a stage on top of the streaming reader
+        struct wav_reader *reader;
+        PRINT_ON_ERR(wav_reader_open(&reader, "resample_float_stereo.wav", NULL, 1000));
+        wav_resampler_reset(resampler);
+        written = 0;
+        for (int result; (result = wav_resampler_read(resampler, reader, streamed + 2 * written, 1234)) > 0;)
+            written += result;
+        PRINT_ON_ERR(written != 48000 || memcmp(streamed, out, sizeof(float) * 2 * 48000));
+        PRINT_ON_ERR(wav_reader_close(reader));
+        PRINT_ON_ERR(wav_resampler_free(resampler));
+        PRINT_ON_ERR(free_wav_file(&resampled));
+
+        // Downsampling removes content above the new Nyquist frequency and keeps DC
+        PRINT_ON_ERR(create_wav_file(&resampled, 9600, 2, 24, 96000));
+        for (unsigned i = 0; i < 9600; i++)
+        {
+            in[2 * i] = 0.8f * sin(2 * M_PI * 30000 * i / 96000);
+            in[2 * i + 1] = 0.5f;
+        }
+        PRINT_ON_ERR(wav_set_normalized_range(&resampled, 0, 9600, in));
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(wav_resample(&resampled, &wav, 48000));
+        PRINT_ON_ERR(wav.num_frames != 4800 || wav.bit_depth != 24);
+        PRINT_ON_ERR(wav_get_normalized_range(&wav, 0, 4800, out));
+        max_error = 0;
+        for (unsigned i = 100; i < 4700; i++)
+            max_error = fmax(max_error, fmax(fabs(out[2 * i]), fabs(out[2 * i + 1] - 0.5)));
+        PRINT_ON_ERR(max_error > 1e-3);
+        PRINT_ON_ERR(!wav_resampler_create(&resampler, 2, 44100, 48001));
+        PRINT_ON_ERR(!wav_resampler_create(&resampler, 2, 0, 48000));
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(free_wav_file(&resampled));
+        free(in);
+        free(out);
+        free(streamed);
+    }
+
+    printf("Playback test\n");
+    {
+        // No frame is silent, so the frames rendered during underruns can be told apart
+        const unsigned frames = 50000;
+        float *samples = (float *)malloc(sizeof(float) * 2 * frames);
+        float out[2 * 256];
+        PRINT_ON_ERR(create_wav_file(&wav, frames, 2, 16, 44100));
+        for (unsigned i = 0; i < frames; i++)
+        {
+            samples[2 * i] = 0.5 + 0.25 * sin(i / 30.0);
+            samples[2 * i + 1] = -0.3 - 0.2 * cos(i / 7.0);
+        }
+        PRINT_ON_ERR(wav_set_normalized_range(&wav, 0, frames, samples));
+        PRINT_ON_ERR(wav_get_normalized_range(&wav, 0, frames, samples));
+        PRINT_ON_ERR(write_wav_file("player_16bit_stereo.wav", &wav));
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(create_wav_file(&wav, 100, 1, 16, 44100));
+        for (unsigned i = 0; i < 100; i++)
+            PRINT_ON_ERR(wav_set_normalized(&wav, i, &samples[2 * i]));
+        PRINT_ON_ERR(write_wav_file("player_16bit_mono.wav", &wav));
+        PRINT_ON_ERR(free_wav_file(&wav));
+
+        struct wav_player *player;
+        struct wav_player_stats stats;
+        struct wav_player_config config = {2, 4, 1000, 4096, 512, 2};
+        PRINT_ON_ERR(wav_player_create(&player, &config));
+        const int stereo = wav_player_load(player, "player_16bit_stereo.wav");
+        const int mono = wav_player_load(player, "player_16bit_mono.wav");
+        PRINT_ON_ERR(stereo != 0 || mono != 1);
+        PRINT_ON_ERR(wav_player_load(player, "does_not_exist.wav") != -1);
+        PRINT_ON_ERR(wav_player_start(player, 2, 1.0f) != -1);
+
+        // The streamed frames match the file apart from the silence of underruns
+        const int voice = wav_player_start(player, stereo, 0.5f);
+        PRINT_ON_ERR(voice < 0);
+        unsigned pos = 0;
+        int playing = 1;
+        for (unsigned iteration = 0; playing && iteration < 100000000; iteration++)
+        {
+            playing = wav_player_render(player, out, 256);
+            for (unsigned i = 0; i < 256; i++)
+            {
+                if (out[2 * i] == 0 && out[2 * i + 1] == 0)
+                    continue;
+                if (pos < frames && (out[2 * i] != 0.5f * samples[2 * pos] || out[2 * i + 1] != 0.5f * samples[2 * pos + 1]))
+                    break;
+                pos++;
+            }
+        }
+        wav_player_get_stats(player, &stats);
+        PRINT_ON_ERR(playing || pos != frames || stats.voices || !stats.blocks);
+        PRINT_ON_ERR(wav_player_stop(player, voice) != -1);
+
+        // A sample shorter than the head is played from memory on both channels
+        const int short_voice = wav_player_start(player, mono, 1.0f);
+        PRINT_ON_ERR(wav_player_render(player, out, 256) != 0);
+        for (unsigned i = 0; i < 256; i++)
+        {
+            const float expected = i < 100 ? samples[2 * i] : 0;
+            PRINT_ON_ERR(fabs(out[2 * i] - expected) > 1e-4 || out[2 * i] != out[2 * i + 1]);
+        }
+        PRINT_ON_ERR(wav_player_stop(player, short_voice) != -1);
+
+        // Stopped voices are reused once their worker has released the file
+        int first = -1, second = -1, third = -1;
+        for (unsigned iteration = 0; first < 0 && iteration < 100000000; iteration++)
+            first = wav_player_start(player, stereo, 1.0f);
+        for (unsigned iteration = 0; second < 0 && iteration < 100000000; iteration++)
+            second = wav_player_start(player, stereo, 1.0f);
+        PRINT_ON_ERR(first < 0 || second < 0 || wav_player_start(player, mono, 1.0f) != -1);
+        PRINT_ON_ERR(wav_player_stop(player, first) || wav_player_stop(player, first) != -1);
+        for (unsigned iteration = 0; third < 0 && iteration < 100000000; iteration++)
+            third = wav_player_start(player, mono, 1.0f);
+        PRINT_ON_ERR(third < 0 || third == first);
+        PRINT_ON_ERR(wav_player_render(player, out, 256) != 1);
+        PRINT_ON_ERR(wav_player_free(player));
+        free(samples);
+    }
+
+    printf("Block cache test\n");
+    {
+        const unsigned frames = 3000;
+        float *samples = (float *)malloc(sizeof(float) * 2 * frames);
+        float *out = (float *)malloc(sizeof(float) * 2 * frames);
+        PRINT_ON_ERR(create_wav_file(&wav, frames, 2, 24, 44100));
+        for (unsigned i = 0; i < 2 * frames; i++)
+            samples[i] = sin(i / 13.0);
+        PRINT_ON_ERR(wav_set_normalized_range(&wav, 0, frames, samples));
+        PRINT_ON_ERR(wav_get_normalized_range(&wav, 0, frames, samples));
+        PRINT_ON_ERR(write_wav_file("cache_24bit_stereo.wav", &wav));
+        PRINT_ON_ERR(free_wav_file(&wav));
+
+        // One shard of four 256 frame blocks, so that the eviction order is exact
+        struct wav_cache *cache;
+        struct wav_cache_file *file, *file2;
+        struct wav_cache_stats stats;
+        PRINT_ON_ERR(wav_cache_create(&cache, 4 * 256 * 2 * sizeof(float), 256, 1));
+        PRINT_ON_ERR(wav_cache_file_open(&file, cache, "cache_24bit_stereo.wav"));
+        PRINT_ON_ERR(wav_cache_file_open(&file2, cache, "cache_24bit_stereo.wav"));
+        PRINT_ON_ERR(wav_cache_file_format(file)->num_frames != frames || wav_cache_file_format(file)->data);
+        PRINT_ON_ERR(wav_cache_file_read(file, 100, 600, out) != 600);
+        PRINT_ON_ERR(memcmp(out, samples + 2 * 100, sizeof(float) * 2 * 600));
+        PRINT_ON_ERR(wav_cache_file_read(file, 100, 600, out) != 600);
+        PRINT_ON_ERR(memcmp(out, samples + 2 * 100, sizeof(float) * 2 * 600));
+        wav_cache_get_stats(cache, &stats);
+        PRINT_ON_ERR(stats.misses != 3 || stats.hits != 3 || stats.blocks != 3 || stats.bytes != 3 * 256 * 2 * sizeof(float));
+        // Handles of the same file share its blocks
+        PRINT_ON_ERR(wav_cache_file_read(file2, 0, 256, out) != 256);
+        PRINT_ON_ERR(memcmp(out, samples, sizeof(float) * 2 * 256));
+        wav_cache_get_stats(cache, &stats);
+        PRINT_ON_ERR(stats.misses != 3 || stats.hits != 4);
+        // Blocks 1, 2 and 0 are the least recently used
+        PRINT_ON_ERR(wav_cache_file_read(file, 1000, 600, out) != 600);
+        PRINT_ON_ERR(memcmp(out, samples + 2 * 1000, sizeof(float) * 2 * 600));
+        wav_cache_get_stats(cache, &stats);
+        PRINT_ON_ERR(stats.misses != 7 || stats.evictions != 3 || stats.blocks != 4);
+        PRINT_ON_ERR(wav_cache_file_read(file, 768, 1, out) != 1);
+        wav_cache_get_stats(cache, &stats);
+        PRINT_ON_ERR(stats.hits != 5);
+
+        // The last block is shorter
+        PRINT_ON_ERR(wav_cache_file_read(file, 2900, 500, out) != 100);
+        PRINT_ON_ERR(memcmp(out, samples + 2 * 2900, sizeof(float) * 2 * 100));
+        PRINT_ON_ERR(wav_cache_file_read(file, frames, 1, out) != 0);
+        PRINT_ON_ERR(wav_cache_file_read(file, frames + 1, 1, out) != -1);
+        for (unsigned i = 0; i < 200; i++)
+        {
+            const unsigned first = rand() % frames, count = rand() % (frames - first) + 1;
+            struct wav_cache_file *handle = i & 1 ? file : file2;
+            PRINT_ON_ERR(wav_cache_file_read(handle, first, count, out) != (int)count);
+            PRINT_ON_ERR(memcmp(out, samples + 2 * first, sizeof(float) * 2 * count));
+        }
+
+        // Lowering the budget evicts on the next insertion
+        wav_cache_set_budget(cache, 0);
+        PRINT_ON_ERR(wav_cache_file_read(file, 0, frames, out) != (int)frames);
+        PRINT_ON_ERR(memcmp(out, samples, sizeof(float) * 2 * frames));
+        wav_cache_get_stats(cache, &stats);
+        PRINT_ON_ERR(stats.blocks || stats.bytes);
+        PRINT_ON_ERR(wav_cache_file_close(file));
+        PRINT_ON_ERR(wav_cache_file_close(file2));
+        PRINT_ON_ERR(!wav_cache_file_open(&file, cache, "does_not_exist.wav") || file);
+        PRINT_ON_ERR(wav_cache_free(cache));
+
+        PRINT_ON_ERR(!wav_cache_global() || wav_cache_global() != wav_cache_global());
+        PRINT_ON_ERR(wav_cache_file_open(&file, NULL, "cache_24bit_stereo.wav"));
+        PRINT_ON_ERR(wav_cache_file_read(file, 5, 10, out) != 10);
+        PRINT_ON_ERR(memcmp(out, samples + 2 * 5, sizeof(float) * 2 * 10));
+        wav_cache_get_stats(wav_cache_global(), &stats);
+        PRINT_ON_ERR(stats.misses != 1 || stats.blocks != 1);
+        PRINT_ON_ERR(wav_cache_file_close(file));
+        free(samples);
+        free(out);
+    }
+
+    printf("Mix test\n");
+    {
+        // Stereo, mono and stereo sources in different formats, longer than a block in total
+        const char *names[] = {"mix_16bit_stereo.wav", "mix_24bit_mono.wav", "mix_float_stereo.wav"};
+        const unsigned lengths[] = {30000, 20000, 10000}, channels[] = {2, 1, 2}, depths[] = {16, 24, 32};
+        float *sources[3];
+        for (unsigned s = 0; s < 3; s++)
+        {
+            sources[s] = (float *)malloc(sizeof(float) * channels[s] * lengths[s]);
+            PRINT_ON_ERR(create_wav_file(&wav, lengths[s], channels[s], depths[s], 48000));
+            wav.is_float = s == 2;
+            for (unsigned i = 0; i < channels[s] * lengths[s]; i++)
+                sources[s][i] = 0.3 * sin(i / (5.0 + s));
+            PRINT_ON_ERR(wav_set_normalized_range(&wav, 0, lengths[s], sources[s]));
+            PRINT_ON_ERR(wav_get_normalized_range(&wav, 0, lengths[s], sources[s]));
+            PRINT_ON_ERR(write_wav_file(names[s], &wav));
+            PRINT_ON_ERR(free_wav_file(&wav));
+        }
+        struct wav_mix_source mix[] = {
+            {names[0], 0.5f, 0, 0, 0},
+            {names[1], 0.0f, 1.0f, 5000, 12000},
+            {names[2], -0.25f, 0, 0, 25000},
+        };
+        struct wav_file format = {0};
+        format.channels = 2;
+        format.sample_rate = 48000;
+        format.bit_depth = 32;
+        format.is_float = 1;
+        PRINT_ON_ERR(wav_mix(mix, 3, "mix_float_stereo_out.wav", &format, 0));
+        PRINT_ON_ERR(read_wav_file("mix_float_stereo_out.wav", &wav));
+        PRINT_ON_ERR(wav.num_frames != 35000 || wav.channels != 2 || !wav.is_float);
+        float max_error = 0;
+        for (unsigned i = 0; i < 35000; i++)
+        {
+            float frame[2], expected[2] = {0, 0};
+            PRINT_ON_ERR(wav_get_normalized(&wav, i, frame));
+            for (unsigned c = 0; c < 2; c++)
+            {
+                if (i < 30000)
+                    expected[c] += 0.5f * sources[0][2 * i + c];
+                if (i >= 12000 && i < 32000)
+                    expected[c] += (i - 12000 < 5000 ? (i - 12000) / 5000.0f : 1.0f) * sources[1][i - 12000];
+                if (i >= 25000)
+                    expected[c] -= 0.25f * sources[2][2 * (i - 25000) + c];
+                max_error = fmax(max_error, fabs(frame[c] - expected[c]));
+            }
+        }
+        PRINT_ON_ERR(max_error > 1e-6);
+
+        // Every instruction set and number of threads gives the same bits
+        struct wav_mix_source many[24];
+        for (unsigned s = 0; s < 24; s++)
+        {
+            many[s] = mix[s % 3];
+            many[s].gain = (s + 1) / 100.0f;
+            many[s].offset = s * 500;
+        }
+        PRINT_ON_ERR(wav_mix(many, 24, "mix_float_stereo_out.wav", &format, 1));
+        PRINT_ON_ERR(free_wav_file(&wav));
+        PRINT_ON_ERR(read_wav_file("mix_float_stereo_out.wav", &wav));
+        for (int isa = WAV_ISA_SCALAR; isa <= WAV_ISA_AVX2; isa++)
+        {
+            if (wav_set_conversion_isa(isa))
+                continue;
+            PRINT_ON_ERR(wav_mix(many, 24, "mix_float_stereo_isa.wav", &format, 1));
+            PRINT_ON_ERR(read_wav_file("mix_float_stereo_isa.wav", &wav2));
+            PRINT_ON_ERR(wav2.num_bytes != wav.num_bytes || memcmp(wav2.data, wav.data, wav.num_bytes));
+            PRINT_ON_ERR(free_wav_file(&wav2));
+        }
+        wav_set_conversion_isa(WAV_ISA_AUTO);
+        for (unsigned threads = 2; threads <= 4; threads++)
+        {
+            PRINT_ON_ERR(wav_mix(many, 24, "mix_float_stereo_isa.wav", &format, threads));
+            PRINT_ON_ERR(read_wav_file("mix_float_stereo_isa.wav", &wav2));
+            PRINT_ON_ERR(wav2.num_bytes != wav.num_bytes || memcmp(wav2.data, wav.data, wav.num_bytes));
+            PRINT_ON_ERR(free_wav_file(&wav2));
+        }
+        PRINT_ON_ERR(free_wav_file(&wav));
+
+        // The bus is clipped when encoded
+        mix[0].gain = 10.0f;
+        format.bit_depth = 16;
+        format.is_float = 0;
+        PRINT_ON_ERR(wav_mix(mix, 1, "mix_16bit_stereo_out.wav", &format, 0));
+        PRINT_ON_ERR(read_wav_file("mix_16bit_stereo_out.wav", &wav));
+        float peak = 0;
+        for (unsigned i = 0; i < wav.num_frames; i++)
+        {
+            float frame[2];
+            PRINT_ON_ERR(wav_get_normalized(&wav, i, frame));
+            peak = fmax(peak, fmax(frame[0], frame[1]));
+        }
+        PRINT_ON_ERR(peak > 1.0f || peak < 0.99f);
+        PRINT_ON_ERR(free_wav_file(&wav));
+
+        format.sample_rate = 44100;
+        PRINT_ON_ERR(!wav_mix(mix, 3, "mix_16bit_stereo_out.wav", &format, 0));
+        format.sample_rate = 48000;
+        format.channels = 1;
+        PRINT_ON_ERR(!wav_mix(mix, 3, "mix_16bit_stereo_out.wav", &format, 0));
+        format.channels = 2;
+        mix[2].file_name = "does_not_exist.wav";
+        PRINT_ON_ERR(!wav_mix(mix, 3, "mix_16bit_stereo_out.wav", &format, 0));
+        for (unsigned s = 0; s < 3; s++)
+            free(sources[s]);
+    }
+
     return 0;
 }
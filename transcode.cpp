@@ -0,0 +1,287 @@
+/*
+    Batch transcoder: converts wave files to another sample format.
+
+    usage: transcode.out -t FORMAT -o OUT_DIR [-j THREADS] [-r RATE] [--rf64] INPUT...
+
+    Inputs can be files or directories, which are searched recursively for .wav files.
+    The converted files are written to OUT_DIR keeping the paths relative to the input directories.
+    Files are converted concurrently on the library's work-stealing pool through the streaming
+    reader and writer, so each worker holds only one block of samples in memory. Custom chunks
+    are copied in file order. With -r the files are resampled to RATE Hz by a resampler stage on
+    top of the reader.
+*/
+
+#include "wav_handler.h"
+#include "wav_pool.h"
+#include <algorithm>
+#include <cctype>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct TargetFormat
+{
+    const char *name;
+    unsigned bit_depth;
+    int is_float;
+};
+
+static const TargetFormat target_formats[] = {
+    {"pcm8", 8, 0},
+    {"pcm16", 16, 0},
+    {"pcm24", 24, 0},
+    {"pcm32", 32, 0},
+    {"float32", 32, 1},
+    {"float64", 64, 1},
+};
+
+// Chunks written by the writer itself, the rest are copied
+static const char *const format_chunks[] = {"fmt ", "data", "ds64", "JUNK"};
+
+struct Job
+{
+    fs::path input;
+    fs::path output;
+};
+
+struct Transcoder
+{
+    const TargetFormat *format;
+    unsigned sample_rate;
+    int flags;
+    std::vector<Job> jobs;
+    std::atomic<unsigned long long> bytes_in{0};
+    std::atomic<unsigned long long> bytes_out{0};
+    std::atomic<unsigned> failed{0};
+    std::mutex log_lock;
+
+    void log_error(const Job &job, const char *message)
+    {
+        std::lock_guard<std::mutex> lock(log_lock);
+        fprintf(stderr, "%s: %s\n", job.input.string().c_str(), message);
+    }
+};
+
+static bool is_format_chunk(const char *id)
+{
+    for (const char *format_chunk : format_chunks)
+    {
+        if (!strcmp(id, format_chunk))
+            return true;
+    }
+    return false;
+}
+
+// Converts one file. Returns an error message or nullptr on success.
+static const char *transcode_file(Transcoder &transcoder, const Job &job)
+{
+    // Opening the writer would truncate the input before it is read
+    std::error_code ec;
+    if (fs::equivalent(job.input, job.output, ec))
+        return "output file is the input file";
+    wav_reader *reader;
+    if (wav_reader_open(&reader, job.input.string().c_str(), nullptr, 0))
+        return "cannot open file";
+    std::vector<wav_file_custom_header_data> chdr;
+    const wav_chunk_index *index = wav_reader_chunks(reader);
+    for (unsigned i = 0; i < index->num_chunks; i++)
+    {
+        if (is_format_chunk(index->chunks[i].id))
+            continue;
+        wav_file_custom_header_data hdr = {{0}, 0, nullptr};
+        strcpy(hdr.header_name, index->chunks[i].id);
+        if (!wav_reader_read_chunk(reader, &hdr))
+            chdr.push_back(hdr);
+    }
+    chdr.push_back({{0}, 0, nullptr});
+
+    const wav_file *in_format = wav_reader_format(reader);
+    wav_file out_format = *in_format;
+    out_format.bit_depth = transcoder.format->bit_depth;
+    out_format.is_float = transcoder.format->is_float;
+    if (transcoder.sample_rate)
+        out_format.sample_rate = transcoder.sample_rate;
+    const bool same_format = in_format->bit_depth == out_format.bit_depth && in_format->is_float == out_format.is_float;
+    const bool same_rate = in_format->sample_rate == out_format.sample_rate;
+
+    const char *error = nullptr;
+    wav_writer *writer = nullptr;
+    fs::create_directories(job.output.parent_path(), ec);
+    if (wav_writer_open(&writer, job.output.string().c_str(), &out_format, chdr.data(), 0, transcoder.flags))
+        error = "cannot create output file";
+    for (auto &hdr : chdr)
+        free(hdr.data);
+
+    const unsigned block_frames = 4096;
+    wav_resampler *resampler = nullptr;
+    if (!error && !same_rate && wav_resampler_create(&resampler, in_format->channels, in_format->sample_rate, out_format.sample_rate))
+        error = "unsupported sample rate";
+    if (resampler)
+    {
+        std::vector<float> block(static_cast<size_t>(block_frames) * in_format->channels);
+        int frames;
+        while (!error && (frames = wav_resampler_read(resampler, reader, block.data(), block_frames)) > 0)
+        {
+            if (wav_writer_write(writer, block.data(), frames))
+                error = "write failed";
+        }
+        if (!error && frames < 0)
+            error = "read failed or unsupported format";
+        wav_resampler_free(resampler);
+    }
+    else if (same_format)
+    {
+        // Copied as is, converting to float and back would not be lossless for integer formats
+        std::vector<char> block(static_cast<size_t>(block_frames) * in_format->channels * in_format->bit_depth / 8);
+        int frames;
+        while (!error && (frames = wav_reader_read_raw(reader, block.data(), block_frames)) > 0)
+        {
+            if (wav_writer_write_raw(writer, block.data(), frames))
+                error = "write failed";
+        }
+        if (!error && frames < 0)
+            error = "read failed";
+    }
+    else
+    {
+        std::vector<float> block(static_cast<size_t>(block_frames) * in_format->channels);
+        int frames;
+        while (!error && (frames = wav_reader_read(reader, block.data(), block_frames)) > 0)
+        {
+            if (wav_writer_write(writer, block.data(), frames))
+                error = "write failed";
+        }
+        if (!error && frames < 0)
+            error = "read failed or unsupported format";
+    }
+    // The reader stops early when the data chunk is cut off
+    if (!error && wav_reader_position(reader) < in_format->num_frames)
+        error = "file is truncated";
+    const unsigned long long data_in = in_format->num_bytes;
+    const unsigned long long data_out = writer ? wav_writer_format(writer)->num_bytes : 0;
+    wav_reader_close(reader);
+    if (writer && wav_writer_close(writer) && !error)
+        error = "write failed";
+    if (!error)
+    {
+        transcoder.bytes_in += data_in;
+        transcoder.bytes_out += data_out;
+    }
+    return error;
+}
+
+static void transcode_task(void *ctx, unsigned long long idx)
+{
+    Transcoder &transcoder = *static_cast<Transcoder *>(ctx);
+    const Job &job = transcoder.jobs[idx];
+    if (const char *error = transcode_file(transcoder, job))
+    {
+        transcoder.log_error(job, error);
+        transcoder.failed++;
+    }
+}
+
+static bool is_wav_file(const fs::path &path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+    return ext == ".wav";
+}
+
+static int usage()
+{
+    fprintf(stderr, "usage: transcode.out -t FORMAT -o OUT_DIR [-j THREADS] [-r RATE] [--rf64] INPUT...\n");
+    fprintf(stderr, "FORMAT is one of:");
+    for (const auto &format : target_formats)
+        fprintf(stderr, " %s", format.name);
+    fprintf(stderr, "\nINPUT is a file or a directory that is searched recursively for .wav files.\n");
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    Transcoder transcoder;
+    transcoder.format = nullptr;
+    transcoder.sample_rate = 0;
+    transcoder.flags = 0;
+    unsigned num_threads = 0;
+    fs::path out_dir;
+    std::vector<fs::path> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc)
+        {
+            const std::string name = argv[++i];
+            for (const auto &format : target_formats)
+            {
+                if (name == format.name)
+                    transcoder.format = &format;
+            }
+            if (!transcoder.format)
+                return usage();
+        }
+        else if (arg == "-o" && i + 1 < argc)
+            out_dir = argv[++i];
+        else if (arg == "-j" && i + 1 < argc)
+            num_threads = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-r" && i + 1 < argc)
+        {
+            transcoder.sample_rate = strtoul(argv[++i], nullptr, 10);
+            if (!transcoder.sample_rate)
+                return usage();
+        }
+        else if (arg == "--rf64")
+            transcoder.flags |= WAV_WRITE_RF64;
+        else if (!arg.empty() && arg[0] == '-')
+            return usage();
+        else
+            inputs.push_back(arg);
+    }
+    if (!transcoder.format || out_dir.empty() || inputs.empty())
+        return usage();
+
+    for (const auto &input : inputs)
+    {
+        std::error_code ec;
+        if (fs::is_directory(input, ec))
+        {
+            for (const auto &entry : fs::recursive_directory_iterator(input, ec))
+            {
+                if (entry.is_regular_file() && is_wav_file(entry.path()))
+                    transcoder.jobs.push_back({entry.path(), out_dir / fs::relative(entry.path(), input)});
+            }
+        }
+        else
+            transcoder.jobs.push_back({input, out_dir / input.filename()});
+        if (ec)
+            fprintf(stderr, "%s: %s\n", input.string().c_str(), ec.message().c_str());
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    if (wav_parallel_for(num_threads, transcoder.jobs.size(), transcode_task, &transcoder))
+    {
+        fprintf(stderr, "cannot start worker threads\n");
+        return 1;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const unsigned converted = transcoder.jobs.size() - transcoder.failed;
+    printf("%u files converted to %s, %u failed, in %.3f s\n", converted, transcoder.format->name,
+           transcoder.failed.load(), seconds);
+    if (seconds > 0)
+    {
+        printf("%.1f files/s, %.1f MB/s read, %.1f MB/s written\n", converted / seconds,
+               transcoder.bytes_in / 1e6 / seconds, transcoder.bytes_out / 1e6 / seconds);
+    }
+    return transcoder.failed ? 1 : 0;
+}
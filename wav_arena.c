@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "wav_handler.h"
+
+#define WAV_ARENA_DEFAULT_BLOCK_SIZE (1024 * 1024)
+// Allocations are cache line aligned so that the sample data can be processed efficiently with SIMD
+#define WAV_ARENA_ALIGNMENT 64
+
+struct arena_block
+{
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+};
+
+struct wav_arena
+{
+    struct wav_allocator allocator;
+    size_t block_size;
+    // The first block is the one allocations are made from
+    struct arena_block *blocks;
+    // Blocks of block_size released by wav_arena_reset, reused before allocating new ones
+    struct arena_block *free_blocks;
+};
+
+static char *block_data(struct arena_block *block)
+{
+    return (char *)(block + 1);
+}
+
+static struct arena_block *new_block(size_t size)
+{
+    struct arena_block *block = (struct arena_block *)malloc(sizeof(struct arena_block) + size);
+    if (!block)
+        return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+// Returns aligned memory of size bytes from block or NULL if it doesn't fit
+static void *block_alloc(struct arena_block *block, size_t size)
+{
+    if (!block)
+        return NULL;
+    const uintptr_t base = (uintptr_t)block_data(block);
+    const uintptr_t start = (base + block->used + WAV_ARENA_ALIGNMENT - 1) & ~(uintptr_t)(WAV_ARENA_ALIGNMENT - 1);
+    if (start + size > base + block->size)
+        return NULL;
+    block->used = start + size - base;
+    return (void *)start;
+}
+
+static void *arena_alloc(void *ctx, size_t size)
+{
+    struct wav_arena *arena = (struct wav_arena *)ctx;
+    void *ptr = block_alloc(arena->blocks, size);
+    if (ptr)
+        return ptr;
+    struct arena_block *block;
+    if (size + WAV_ARENA_ALIGNMENT > arena->block_size / 2)
+    {
+        // Large allocations get a block of their own, which is linked after the current block
+        // so that the space left in the current block can still be used
+        block = new_block(size + WAV_ARENA_ALIGNMENT);
+        if (!block)
+            return NULL;
+        if (arena->blocks)
+        {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        }
+        else
+            arena->blocks = block;
+        return block_alloc(block, size);
+    }
+    if (arena->free_blocks)
+    {
+        block = arena->free_blocks;
+        arena->free_blocks = block->next;
+    }
+    else if (!(block = new_block(arena->block_size)))
+        return NULL;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    return block_alloc(block, size);
+}
+
+static void arena_free(void *ctx, void *ptr)
+{
+    // Memory is released all at once by wav_arena_reset and wav_arena_destroy
+}
+
+int wav_arena_create(struct wav_arena **arena, size_t block_size)
+{
+    *arena = (struct wav_arena *)calloc(1, sizeof(struct wav_arena));
+    if (!*arena)
+        return -1;
+    (*arena)->allocator.alloc = arena_alloc;
+    (*arena)->allocator.free = arena_free;
+    (*arena)->allocator.ctx = *arena;
+    (*arena)->block_size = block_size ? block_size : WAV_ARENA_DEFAULT_BLOCK_SIZE;
+    return 0;
+}
+
+const struct wav_allocator *wav_arena_allocator(struct wav_arena *arena)
+{
+    return &arena->allocator;
+}
+
+int wav_arena_reset(struct wav_arena *arena)
+{
+    if (!arena)
+        return -1;
+    struct arena_block *block = arena->blocks;
+    while (block)
+    {
+        struct arena_block *next = block->next;
+        if (block->size == arena->block_size)
+        {
+            block->used = 0;
+            block->next = arena->free_blocks;
+            arena->free_blocks = block;
+        }
+        else
+            free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+    return 0;
+}
+
+int wav_arena_destroy(struct wav_arena *arena)
+{
+    if (wav_arena_reset(arena))
+        return -1;
+    while (arena->free_blocks)
+    {
+        struct arena_block *next = arena->free_blocks->next;
+        free(arena->free_blocks);
+        arena->free_blocks = next;
+    }
+    free(arena);
+    return 0;
+}
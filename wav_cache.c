@@ -0,0 +1,394 @@
+// 64 bit file sizes on 32 bit POSIX systems
+#define _FILE_OFFSET_BITS 64
+// st_mtim
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "wav_handler.h"
+
+#define CACHE_DEFAULT_BLOCK_FRAMES 4096
+#define CACHE_DEFAULT_SHARDS 16
+#define CACHE_MIN_BUCKETS 64
+
+// Identifies the contents of a file. Where there are no inodes, the file name stands in for them.
+struct wav_cache_key
+{
+    unsigned long long device;
+    unsigned long long inode;
+    unsigned long long size;
+    // Modification time in nanoseconds where the system has them
+    unsigned long long mtime;
+};
+
+struct wav_cache_entry
+{
+    struct wav_cache_key key;
+    unsigned long long block;
+    struct wav_cache_entry *hash_next;
+    // Most recently used first
+    struct wav_cache_entry *lru_prev;
+    struct wav_cache_entry *lru_next;
+    size_t bytes;
+    // Interleaved samples, allocated after the entry
+    float *data;
+};
+
+// Padded to a cache line so that the locks of neighboring shards don't share one
+struct wav_cache_shard
+{
+    pthread_mutex_t lock;
+    struct wav_cache_entry **buckets;
+    unsigned num_buckets;
+    unsigned long long num_blocks;
+    size_t bytes;
+    struct wav_cache_entry *lru_head;
+    struct wav_cache_entry *lru_tail;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    char padding[64];
+};
+
+struct wav_cache
+{
+    size_t budget;
+    unsigned block_frames;
+    unsigned num_shards;
+    struct wav_cache_shard *shards;
+};
+
+struct wav_cache_file
+{
+    struct wav_cache *cache;
+    struct wav_cache_key key;
+    struct wav_file format;
+    // Decodes the misses
+    struct wav_reader *reader;
+};
+
+static unsigned long long mix_hash(unsigned long long h, unsigned long long value)
+{
+    // splitmix64 finalizer
+    h ^= value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+static unsigned long long hash_entry(const struct wav_cache_key *key, unsigned long long block)
+{
+    unsigned long long h = mix_hash(0, key->device);
+    h = mix_hash(h, key->inode);
+    h = mix_hash(h, key->size);
+    h = mix_hash(h, key->mtime);
+    return mix_hash(h, block);
+}
+
+static int same_entry(const struct wav_cache_entry *e, const struct wav_cache_key *key, unsigned long long block)
+{
+    return e->block == block && !memcmp(&e->key, key, sizeof(struct wav_cache_key));
+}
+
+static int file_key(const char *file_name, struct wav_cache_key *key)
+{
+    struct stat st;
+    if (stat(file_name, &st))
+        return -1;
+    memset(key, 0, sizeof(struct wav_cache_key));
+    key->size = st.st_size;
+    // Seconds alone would miss a file rewritten with the same size within a second
+#if defined(__APPLE__)
+    key->mtime = st.st_mtimespec.tv_sec * 1000000000ull + st.st_mtimespec.tv_nsec;
+#elif defined(__unix__)
+    key->mtime = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+#else
+    key->mtime = st.st_mtime;
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+    key->device = st.st_dev;
+    key->inode = st.st_ino;
+#else
+    // FNV-1a of the file name
+    key->inode = 0xcbf29ce484222325ull;
+    for (const char *c = file_name; *c; c++)
+        key->inode = (key->inode ^ (unsigned char)*c) * 0x100000001b3ull;
+#endif
+    return 0;
+}
+
+static void lru_unlink(struct wav_cache_shard *s, struct wav_cache_entry *e)
+{
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        s->lru_head = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        s->lru_tail = e->lru_prev;
+}
+
+static void lru_push_front(struct wav_cache_shard *s, struct wav_cache_entry *e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = s->lru_head;
+    if (s->lru_head)
+        s->lru_head->lru_prev = e;
+    else
+        s->lru_tail = e;
+    s->lru_head = e;
+}
+
+static void remove_entry(struct wav_cache_shard *s, struct wav_cache_entry *e)
+{
+    struct wav_cache_entry **link = &s->buckets[hash_entry(&e->key, e->block) & (s->num_buckets - 1)];
+    while (*link != e)
+        link = &(*link)->hash_next;
+    *link = e->hash_next;
+    lru_unlink(s, e);
+    s->num_blocks--;
+    s->bytes -= e->bytes;
+    free(e);
+}
+
+// Doubles the buckets of a shard when it holds more blocks than buckets. Growing is best effort.
+static void grow_buckets(struct wav_cache_shard *s)
+{
+    if (s->num_blocks < s->num_buckets)
+        return;
+    const unsigned num_buckets = s->num_buckets * 2;
+    struct wav_cache_entry **buckets = (struct wav_cache_entry **)calloc(num_buckets, sizeof(struct wav_cache_entry *));
+    if (!buckets)
+        return;
+    for (unsigned b = 0; b < s->num_buckets; b++)
+    {
+        for (struct wav_cache_entry *e = s->buckets[b], *next; e; e = next)
+        {
+            next = e->hash_next;
+            struct wav_cache_entry **bucket = &buckets[hash_entry(&e->key, e->block) & (num_buckets - 1)];
+            e->hash_next = *bucket;
+            *bucket = e;
+        }
+    }
+    free(s->buckets);
+    s->buckets = buckets;
+    s->num_buckets = num_buckets;
+}
+
+int wav_cache_free(struct wav_cache *cache)
+{
+    if (!cache)
+        return -1;
+    for (unsigned i = 0; cache->shards && i < cache->num_shards; i++)
+    {
+        struct wav_cache_shard *s = &cache->shards[i];
+        while (s->lru_head)
+            remove_entry(s, s->lru_head);
+        free(s->buckets);
+        pthread_mutex_destroy(&s->lock);
+    }
+    free(cache->shards);
+    free(cache);
+    return 0;
+}
+
+int wav_cache_create(struct wav_cache **cache, size_t budget_bytes, unsigned block_frames, unsigned num_shards)
+{
+    *cache = NULL;
+    struct wav_cache *c = (struct wav_cache *)calloc(1, sizeof(struct wav_cache));
+    if (!c)
+        return -1;
+    c->budget = budget_bytes;
+    c->block_frames = block_frames ? block_frames : CACHE_DEFAULT_BLOCK_FRAMES;
+    c->num_shards = num_shards ? num_shards : CACHE_DEFAULT_SHARDS;
+    c->shards = (struct wav_cache_shard *)calloc(c->num_shards, sizeof(struct wav_cache_shard));
+    if (!c->shards)
+    {
+        free(c);
+        return -1;
+    }
+    for (unsigned i = 0; i < c->num_shards; i++)
+    {
+        struct wav_cache_shard *s = &c->shards[i];
+        s->num_buckets = CACHE_MIN_BUCKETS;
+        s->buckets = (struct wav_cache_entry **)calloc(s->num_buckets, sizeof(struct wav_cache_entry *));
+        pthread_mutex_init(&s->lock, NULL);
+        if (!s->buckets)
+        {
+            c->num_shards = i + 1;
+            wav_cache_free(c);
+            return -1;
+        }
+    }
+    *cache = c;
+    return 0;
+}
+
+static struct wav_cache *global_cache;
+static pthread_once_t global_cache_once = PTHREAD_ONCE_INIT;
+
+static void create_global_cache(void)
+{
+    wav_cache_create(&global_cache, WAV_CACHE_DEFAULT_BUDGET, 0, 0);
+}
+
+struct wav_cache *wav_cache_global(void)
+{
+    pthread_once(&global_cache_once, create_global_cache);
+    return global_cache;
+}
+
+void wav_cache_set_budget(struct wav_cache *cache, size_t budget_bytes)
+{
+    __atomic_store_n(&cache->budget, budget_bytes, __ATOMIC_RELAXED);
+}
+
+void wav_cache_get_stats(struct wav_cache *cache, struct wav_cache_stats *stats)
+{
+    memset(stats, 0, sizeof(struct wav_cache_stats));
+    for (unsigned i = 0; i < cache->num_shards; i++)
+    {
+        struct wav_cache_shard *s = &cache->shards[i];
+        pthread_mutex_lock(&s->lock);
+        stats->hits += s->hits;
+        stats->misses += s->misses;
+        stats->evictions += s->evictions;
+        stats->blocks += s->num_blocks;
+        stats->bytes += s->bytes;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+// Copies count frames from offset of a cached block to value. Returns 0 on a miss.
+static int lookup(struct wav_cache_shard *s, const struct wav_cache_key *key, unsigned long long block, unsigned long long hash,
+                  unsigned offset, unsigned count, unsigned channels, float *value)
+{
+    pthread_mutex_lock(&s->lock);
+    struct wav_cache_entry *e = s->buckets[hash & (s->num_buckets - 1)];
+    while (e && !same_entry(e, key, block))
+        e = e->hash_next;
+    if (e)
+    {
+        memcpy(value, e->data + (size_t)offset * channels, sizeof(float) * count * channels);
+        lru_unlink(s, e);
+        lru_push_front(s, e);
+        s->hits++;
+    }
+    else
+        s->misses++;
+    pthread_mutex_unlock(&s->lock);
+    return e != NULL;
+}
+
+// Adds a decoded block to the cache, or frees it if another reader has added the block meanwhile, and
+// evicts the least recently used blocks over the budget of the shard
+static void insert(struct wav_cache *c, struct wav_cache_shard *s, struct wav_cache_entry *entry, unsigned long long hash)
+{
+    const size_t budget = __atomic_load_n(&c->budget, __ATOMIC_RELAXED) / c->num_shards;
+    pthread_mutex_lock(&s->lock);
+    struct wav_cache_entry **bucket = &s->buckets[hash & (s->num_buckets - 1)];
+    struct wav_cache_entry *e = *bucket;
+    while (e && !same_entry(e, &entry->key, entry->block))
+        e = e->hash_next;
+    if (e || entry->bytes > budget)
+        free(entry);
+    else
+    {
+        entry->hash_next = *bucket;
+        *bucket = entry;
+        lru_push_front(s, entry);
+        s->num_blocks++;
+        s->bytes += entry->bytes;
+        grow_buckets(s);
+    }
+    while (s->bytes > budget)
+    {
+        remove_entry(s, s->lru_tail);
+        s->evictions++;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+int wav_cache_file_open(struct wav_cache_file **file, struct wav_cache *cache, const char *file_name)
+{
+    *file = NULL;
+    if (!cache && !(cache = wav_cache_global()))
+        return -1;
+    struct wav_cache_file *f = (struct wav_cache_file *)calloc(1, sizeof(struct wav_cache_file));
+    if (!f)
+        return -1;
+    f->cache = cache;
+    if (file_key(file_name, &f->key) || wav_reader_open(&f->reader, file_name, NULL, cache->block_frames))
+    {
+        free(f);
+        return -1;
+    }
+    f->format = *wav_reader_format(f->reader);
+    *file = f;
+    return 0;
+}
+
+const struct wav_file *wav_cache_file_format(const struct wav_cache_file *file)
+{
+    return &file->format;
+}
+
+int wav_cache_file_read(struct wav_cache_file *file, unsigned long long frame, unsigned num_frames, float *value)
+{
+    struct wav_cache *c = file->cache;
+    const unsigned channels = file->format.channels;
+    if (frame > file->format.num_frames)
+        return -1;
+    if (num_frames > file->format.num_frames - frame)
+        num_frames = file->format.num_frames - frame;
+    unsigned done = 0;
+    while (done < num_frames)
+    {
+        const unsigned long long block = (frame + done) / c->block_frames;
+        const unsigned offset = (frame + done) % c->block_frames;
+        const unsigned long long block_start = block * c->block_frames;
+        const unsigned block_length = file->format.num_frames - block_start < c->block_frames ? file->format.num_frames - block_start
+                                                                                              : c->block_frames;
+        const unsigned count = block_length - offset < num_frames - done ? block_length - offset : num_frames - done;
+        float *dst = value + (size_t)done * channels;
+        const unsigned long long hash = hash_entry(&file->key, block);
+        // The low bits select the bucket within the shard
+        struct wav_cache_shard *s = &c->shards[(hash >> 32) % c->num_shards];
+        if (!lookup(s, &file->key, block, hash, offset, count, channels, dst))
+        {
+            // Decoded outside the lock of the shard
+            const size_t bytes = sizeof(float) * block_length * channels;
+            struct wav_cache_entry *entry = (struct wav_cache_entry *)malloc(sizeof(struct wav_cache_entry) + bytes);
+            if (!entry)
+                return -1;
+            entry->key = file->key;
+            entry->block = block;
+            entry->bytes = bytes;
+            entry->data = (float *)(entry + 1);
+            if (wav_reader_seek(file->reader, block_start) ||
+                wav_reader_read(file->reader, entry->data, block_length) != (int)block_length)
+            {
+                free(entry);
+                return -1;
+            }
+            memcpy(dst, entry->data + (size_t)offset * channels, sizeof(float) * count * channels);
+            insert(c, s, entry, hash);
+        }
+        done += count;
+    }
+    return done;
+}
+
+int wav_cache_file_close(struct wav_cache_file *file)
+{
+    if (!file)
+        return -1;
+    wav_reader_close(file->reader);
+    free(file);
+    return 0;
+}
@@ -0,0 +1,888 @@
+#include <string.h>
+#include "wav_handler.h"
+#include "wav_convert.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WAV_X86_SIMD
+#include <immintrin.h>
+#endif
+
+int wav_sample_format(const struct wav_file *wav)
+{
+    switch (wav->bit_depth)
+    {
+    case 8:
+        return wav->is_float ? SAMPLE_FORMAT_UNSUPPORTED : SAMPLE_FORMAT_PCM8;
+    case 16:
+        return wav->is_float ? SAMPLE_FORMAT_UNSUPPORTED : SAMPLE_FORMAT_PCM16;
+    case 24:
+        return wav->is_float ? SAMPLE_FORMAT_UNSUPPORTED : SAMPLE_FORMAT_PCM24;
+    case 32:
+        return wav->is_float ? SAMPLE_FORMAT_FLOAT32 : SAMPLE_FORMAT_PCM32;
+    case 64:
+        return wav->is_float ? SAMPLE_FORMAT_FLOAT64 : SAMPLE_FORMAT_UNSUPPORTED;
+    }
+    return SAMPLE_FORMAT_UNSUPPORTED;
+}
+
+/*
+    The conversion loops below must produce exactly the same values as wav_get_normalized
+    and wav_set_normalized, so the arithmetic is kept identical to the per-frame versions.
+    Channels are interleaved and share the same format so the loops just run over
+    num_frames * channels samples.
+
+    The SIMD versions use the same operations in the same precision (divisions are not replaced
+    by multiplications with the reciprocal, encoding is done in double precision) so they are
+    bit-exact with the scalar versions. Each SIMD kernel handles the tail using the scalar kernel.
+*/
+
+static void decode_pcm8(const char *src, float *dst, size_t n)
+{
+    const unsigned char *p = (const unsigned char *)src;
+    for (size_t i = 0; i < n; i++)
+    {
+        float val = p[i];
+        val /= 0xFF;
+        dst[i] = val * 2 - 1;
+    }
+}
+
+static void decode_pcm16(const char *src, float *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        short s;
+        memcpy(&s, src + 2 * i, 2);
+        float val = s;
+        dst[i] = val / (0x8000 - 1);
+    }
+}
+
+static void decode_pcm24(const char *src, float *dst, size_t n)
+{
+    const unsigned char *p = (const unsigned char *)src;
+    for (size_t i = 0; i < n; i++, p += 3)
+    {
+        int val32b = p[0] | (p[1] << 8) | ((signed char)p[2] * 0x10000);
+        float val = val32b;
+        dst[i] = val / (0x800000 - 1);
+    }
+}
+
+static void decode_pcm32(const char *src, float *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        int s;
+        memcpy(&s, src + 4 * i, 4);
+        float val = s;
+        dst[i] = val / (0x80000000 - 1);
+    }
+}
+
+static void decode_float32(const char *src, float *dst, size_t n)
+{
+    memcpy(dst, src, n * sizeof(float));
+}
+
+static void decode_float64(const char *src, float *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        double d;
+        memcpy(&d, src + 8 * i, 8);
+        dst[i] = d;
+    }
+}
+
+#define clip_normalized(val) ((val) > 1 ? 1 : ((val) < -1 ? -1 : (val)))
+
+static void encode_pcm8(const float *src, char *dst, size_t n)
+{
+    unsigned char *p = (unsigned char *)dst;
+    for (size_t i = 0; i < n; i++)
+    {
+        double val = src[i];
+        val = clip_normalized(val);
+        val = (val + 1) / 2;
+        val *= 0xFF;
+        p[i] = val;
+    }
+}
+
+static void encode_pcm16(const float *src, char *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        double val = src[i];
+        val = clip_normalized(val);
+        val *= 0x8000 - 1;
+        short s = val;
+        memcpy(dst + 2 * i, &s, 2);
+    }
+}
+
+static void encode_pcm24(const float *src, char *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++, dst += 3)
+    {
+        double val = src[i];
+        val = clip_normalized(val);
+        val *= 0x800000 - 1;
+        int val32b = val;
+        dst[0] = 0xFF & val32b;
+        dst[1] = 0xFF & (val32b >> 8);
+        dst[2] = 0xFF & (val32b >> 16);
+    }
+}
+
+static void encode_pcm32(const float *src, char *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        double val = src[i];
+        val = clip_normalized(val);
+        val *= 0x80000000 - 1;
+        int s = val;
+        memcpy(dst + 4 * i, &s, 4);
+    }
+}
+
+static void encode_float32(const float *src, char *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        double val = src[i];
+        float f = clip_normalized(val);
+        memcpy(dst + 4 * i, &f, 4);
+    }
+}
+
+static void encode_float64(const float *src, char *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        double val = src[i];
+        val = clip_normalized(val);
+        memcpy(dst + 8 * i, &val, 8);
+    }
+}
+
+#ifdef WAV_X86_SIMD
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+// _mm_min_pd(a, b) returns b if either operand is NaN, so with the constant as the first operand
+// these behave exactly like clip_normalized.
+#define sse2_clip_pd(v) _mm_max_pd(_mm_set1_pd(-1), _mm_min_pd(_mm_set1_pd(1), v))
+#define sse2_clip_ps(v) _mm_max_ps(_mm_set1_ps(-1), _mm_min_ps(_mm_set1_ps(1), v))
+#define avx2_clip_pd(v) _mm256_max_pd(_mm256_set1_pd(-1), _mm256_min_pd(_mm256_set1_pd(1), v))
+#define avx2_clip_ps(v) _mm256_max_ps(_mm256_set1_ps(-1), _mm256_min_ps(_mm256_set1_ps(1), v))
+
+SSE2 static void decode_pcm8_sse2(const char *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i w[2] = {_mm_unpacklo_epi8(b, zero), _mm_unpackhi_epi8(b, zero)};
+        for (int j = 0; j < 2; j++)
+        {
+            const __m128i d[2] = {_mm_unpacklo_epi16(w[j], zero), _mm_unpackhi_epi16(w[j], zero)};
+            for (int k = 0; k < 2; k++)
+            {
+                __m128 val = _mm_div_ps(_mm_cvtepi32_ps(d[k]), _mm_set1_ps(0xFF));
+                val = _mm_sub_ps(_mm_mul_ps(val, _mm_set1_ps(2)), _mm_set1_ps(1));
+                _mm_storeu_ps(dst + i + 8 * j + 4 * k, val);
+            }
+        }
+    }
+    decode_pcm8(src + i, dst + i, n - i);
+}
+
+SSE2 static void decode_pcm16_sse2(const char *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i s = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        // Move the 16 bit values to the upper halves and shift back to sign extend
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        _mm_storeu_ps(dst + i, _mm_div_ps(_mm_cvtepi32_ps(lo), _mm_set1_ps(0x8000 - 1)));
+        _mm_storeu_ps(dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps(hi), _mm_set1_ps(0x8000 - 1)));
+    }
+    decode_pcm16(src + 2 * i, dst + i, n - i);
+}
+
+SSE2 static void decode_pcm24_sse2(const char *src, float *dst, size_t n)
+{
+    // Shifting the whole register left by j + 1 bytes moves sample j into the upper 3 bytes of 32 bit lane j
+    const __m128i lane0 = _mm_setr_epi32(-1, 0, 0, 0);
+    const __m128i lane1 = _mm_setr_epi32(0, -1, 0, 0);
+    const __m128i lane2 = _mm_setr_epi32(0, 0, -1, 0);
+    const __m128i lane3 = _mm_setr_epi32(0, 0, 0, -1);
+    size_t i = 0;
+    // 16 bytes are loaded for 4 samples (12 bytes) so there must be 2 extra samples after the block
+    for (; i + 6 <= n; i += 4)
+    {
+        const __m128i b = _mm_loadu_si128((const __m128i *)(src + 3 * i));
+        __m128i s = _mm_or_si128(_mm_and_si128(_mm_slli_si128(b, 1), lane0), _mm_and_si128(_mm_slli_si128(b, 2), lane1));
+        s = _mm_or_si128(s, _mm_and_si128(_mm_slli_si128(b, 3), lane2));
+        s = _mm_or_si128(s, _mm_and_si128(_mm_slli_si128(b, 4), lane3));
+        s = _mm_srai_epi32(s, 8);
+        _mm_storeu_ps(dst + i, _mm_div_ps(_mm_cvtepi32_ps(s), _mm_set1_ps(0x800000 - 1)));
+    }
+    decode_pcm24(src + 3 * i, dst + i, n - i);
+}
+
+SSE2 static void decode_pcm32_sse2(const char *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128i s = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+        _mm_storeu_ps(dst + i, _mm_div_ps(_mm_cvtepi32_ps(s), _mm_set1_ps(0x80000000 - 1)));
+    }
+    decode_pcm32(src + 4 * i, dst + i, n - i);
+}
+
+SSE2 static void decode_float64_sse2(const char *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd((const double *)(src + 8 * i)));
+        const __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd((const double *)(src + 8 * i + 16)));
+        _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+    }
+    decode_float64(src + 8 * i, dst + i, n - i);
+}
+
+// Converts 4 floats to clipped doubles, multiplies by scale and truncates to int32 like the scalar cast does.
+SSE2 static inline __m128i sse2_scale_truncate(const float *src, double scale)
+{
+    const __m128 f = _mm_loadu_ps(src);
+    const __m128d lo = _mm_mul_pd(sse2_clip_pd(_mm_cvtps_pd(f)), _mm_set1_pd(scale));
+    const __m128d hi = _mm_mul_pd(sse2_clip_pd(_mm_cvtps_pd(_mm_movehl_ps(f, f))), _mm_set1_pd(scale));
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+SSE2 static void encode_pcm8_sse2(const float *src, char *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v[2];
+        for (int j = 0; j < 2; j++)
+        {
+            const __m128 f = _mm_loadu_ps(src + i + 4 * j);
+            __m128d lo = sse2_clip_pd(_mm_cvtps_pd(f));
+            __m128d hi = sse2_clip_pd(_mm_cvtps_pd(_mm_movehl_ps(f, f)));
+            lo = _mm_mul_pd(_mm_div_pd(_mm_add_pd(lo, _mm_set1_pd(1)), _mm_set1_pd(2)), _mm_set1_pd(0xFF));
+            hi = _mm_mul_pd(_mm_div_pd(_mm_add_pd(hi, _mm_set1_pd(1)), _mm_set1_pd(2)), _mm_set1_pd(0xFF));
+            v[j] = _mm_and_si128(_mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi)), _mm_set1_epi32(0xFF));
+        }
+        const __m128i b = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_setzero_si128());
+        _mm_storel_epi64((__m128i *)(dst + i), b);
+    }
+    encode_pcm8(src + i, dst + i, n - i);
+}
+
+SSE2 static void encode_pcm16_sse2(const float *src, char *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        // Sign extend the low 16 bits before packing so that the result matches a truncating cast
+        const __m128i lo = _mm_srai_epi32(_mm_slli_epi32(sse2_scale_truncate(src + i, 0x8000 - 1), 16), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_slli_epi32(sse2_scale_truncate(src + i + 4, 0x8000 - 1), 16), 16);
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_packs_epi32(lo, hi));
+    }
+    encode_pcm16(src + i, dst + 2 * i, n - i);
+}
+
+SSE2 static void encode_pcm24_sse2(const float *src, char *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        int v[4];
+        _mm_storeu_si128((__m128i *)v, sse2_scale_truncate(src + i, 0x800000 - 1));
+        for (int j = 0; j < 4; j++)
+        {
+            char *p = dst + 3 * (i + j);
+            p[0] = 0xFF & v[j];
+            p[1] = 0xFF & (v[j] >> 8);
+            p[2] = 0xFF & (v[j] >> 16);
+        }
+    }
+    encode_pcm24(src + i, dst + 3 * i, n - i);
+}
+
+SSE2 static void encode_pcm32_sse2(const float *src, char *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i *)(dst + 4 * i), sse2_scale_truncate(src + i, 0x80000000 - 1));
+    encode_pcm32(src + i, dst + 4 * i, n - i);
+}
+
+SSE2 static void encode_float32_sse2(const float *src, char *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps((float *)(dst + 4 * i), sse2_clip_ps(_mm_loadu_ps(src + i)));
+    encode_float32(src + i, dst + 4 * i, n - i);
+}
+
+SSE2 static void encode_float64_sse2(const float *src, char *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 f = _mm_loadu_ps(src + i);
+        _mm_storeu_pd((double *)(dst + 8 * i), sse2_clip_pd(_mm_cvtps_pd(f)));
+        _mm_storeu_pd((double *)(dst + 8 * i + 16), sse2_clip_pd(_mm_cvtps_pd(_mm_movehl_ps(f, f))));
+    }
+    encode_float64(src + i, dst + 8 * i, n - i);
+}
+
+AVX2 static void decode_pcm8_avx2(const char *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i d = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i)));
+        __m256 val = _mm256_div_ps(_mm256_cvtepi32_ps(d), _mm256_set1_ps(0xFF));
+        val = _mm256_sub_ps(_mm256_mul_ps(val, _mm256_set1_ps(2)), _mm256_set1_ps(1));
+        _mm256_storeu_ps(dst + i, val);
+    }
+    decode_pcm8(src + i, dst + i, n - i);
+}
+
+AVX2 static void decode_pcm16_avx2(const char *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i d = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + 2 * i)));
+        _mm256_storeu_ps(dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(d), _mm256_set1_ps(0x8000 - 1)));
+    }
+    decode_pcm16(src + 2 * i, dst + i, n - i);
+}
+
+AVX2 static void decode_pcm24_avx2(const char *src, float *dst, size_t n)
+{
+    // Places each 3 byte sample into the upper 3 bytes of a 32 bit lane. Both 128 bit lanes
+    // hold 4 samples (12 bytes) so the same pattern is used for both.
+    const __m256i shuffle = _mm256_setr_epi8(
+        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    size_t i = 0;
+    // The upper lane is loaded from offset 12 with a 16 byte load, so 28 bytes must be readable
+    for (; i + 10 <= n; i += 8)
+    {
+        const char *p = src + 3 * i;
+        __m256i s = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                                            _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+        s = _mm256_srai_epi32(_mm256_shuffle_epi8(s, shuffle), 8);
+        _mm256_storeu_ps(dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(s), _mm256_set1_ps(0x800000 - 1)));
+    }
+    decode_pcm24(src + 3 * i, dst + i, n - i);
+}
+
+AVX2 static void decode_pcm32_avx2(const char *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i s = _mm256_loadu_si256((const __m256i *)(src + 4 * i));
+        _mm256_storeu_ps(dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(s), _mm256_set1_ps(0x80000000 - 1)));
+    }
+    decode_pcm32(src + 4 * i, dst + i, n - i);
+}
+
+AVX2 static void decode_float64_avx2(const char *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(dst + i, _mm256_cvtpd_ps(_mm256_loadu_pd((const double *)(src + 8 * i))));
+    decode_float64(src + 8 * i, dst + i, n - i);
+}
+
+// Converts 8 floats to clipped doubles, multiplies by scale and truncates to int32 like the scalar cast does.
+AVX2 static inline __m256i avx2_scale_truncate(const float *src, double scale)
+{
+    const __m256d lo = _mm256_mul_pd(avx2_clip_pd(_mm256_cvtps_pd(_mm_loadu_ps(src))), _mm256_set1_pd(scale));
+    const __m256d hi = _mm256_mul_pd(avx2_clip_pd(_mm256_cvtps_pd(_mm_loadu_ps(src + 4))), _mm256_set1_pd(scale));
+    return _mm256_setr_m128i(_mm256_cvttpd_epi32(lo), _mm256_cvttpd_epi32(hi));
+}
+
+AVX2 static void encode_pcm8_avx2(const float *src, char *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v[2];
+        for (int j = 0; j < 2; j++)
+        {
+            __m256d d = avx2_clip_pd(_mm256_cvtps_pd(_mm_loadu_ps(src + i + 4 * j)));
+            d = _mm256_mul_pd(_mm256_div_pd(_mm256_add_pd(d, _mm256_set1_pd(1)), _mm256_set1_pd(2)), _mm256_set1_pd(0xFF));
+            v[j] = _mm_and_si128(_mm256_cvttpd_epi32(d), _mm_set1_epi32(0xFF));
+        }
+        const __m128i b = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_setzero_si128());
+        _mm_storel_epi64((__m128i *)(dst + i), b);
+    }
+    encode_pcm8(src + i, dst + i, n - i);
+}
+
+AVX2 static void encode_pcm16_avx2(const float *src, char *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        // Sign extend the low 16 bits before packing so that the result matches a truncating cast
+        const __m256i v = _mm256_srai_epi32(_mm256_slli_epi32(avx2_scale_truncate(src + i, 0x8000 - 1), 16), 16);
+        const __m128i s = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), s);
+    }
+    encode_pcm16(src + i, dst + 2 * i, n - i);
+}
+
+AVX2 static void encode_pcm24_avx2(const float *src, char *dst, size_t n)
+{
+    // Inverse of the decode shuffle: drops the upper byte of each 32 bit lane
+    const __m256i shuffle = _mm256_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i v = _mm256_shuffle_epi8(avx2_scale_truncate(src + i, 0x800000 - 1), shuffle);
+        char packed[32];
+        _mm256_storeu_si256((__m256i *)packed, v);
+        memcpy(dst + 3 * i, packed, 12);
+        memcpy(dst + 3 * i + 12, packed + 16, 12);
+    }
+    encode_pcm24(src + i, dst + 3 * i, n - i);
+}
+
+AVX2 static void encode_pcm32_avx2(const float *src, char *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i), avx2_scale_truncate(src + i, 0x80000000 - 1));
+    encode_pcm32(src + i, dst + 4 * i, n - i);
+}
+
+AVX2 static void encode_float32_avx2(const float *src, char *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps((float *)(dst + 4 * i), avx2_clip_ps(_mm256_loadu_ps(src + i)));
+    encode_float32(src + i, dst + 4 * i, n - i);
+}
+
+AVX2 static void encode_float64_avx2(const float *src, char *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd((double *)(dst + 8 * i), avx2_clip_pd(_mm256_cvtps_pd(_mm_loadu_ps(src + i))));
+    encode_float64(src + i, dst + 8 * i, n - i);
+}
+
+#endif
+
+typedef void (*decode_func)(const char *src, float *dst, size_t n);
+typedef void (*encode_func)(const float *src, char *dst, size_t n);
+
+struct conversion_kernels
+{
+    decode_func decode[6];
+    encode_func encode[6];
+};
+
+// Indexed by WAV_ISA_*, then by SAMPLE_FORMAT_*
+static const struct conversion_kernels kernels_by_isa[] = {
+    {
+        {decode_pcm8, decode_pcm16, decode_pcm24, decode_pcm32, decode_float32, decode_float64},
+        {encode_pcm8, encode_pcm16, encode_pcm24, encode_pcm32, encode_float32, encode_float64},
+    },
+#ifdef WAV_X86_SIMD
+    {
+        {decode_pcm8_sse2, decode_pcm16_sse2, decode_pcm24_sse2, decode_pcm32_sse2, decode_float32, decode_float64_sse2},
+        {encode_pcm8_sse2, encode_pcm16_sse2, encode_pcm24_sse2, encode_pcm32_sse2, encode_float32_sse2, encode_float64_sse2},
+    },
+    {
+        {decode_pcm8_avx2, decode_pcm16_avx2, decode_pcm24_avx2, decode_pcm32_avx2, decode_float32, decode_float64_avx2},
+        {encode_pcm8_avx2, encode_pcm16_avx2, encode_pcm24_avx2, encode_pcm32_avx2, encode_float32_avx2, encode_float64_avx2},
+    },
+#endif
+};
+
+static int selected_isa = WAV_ISA_SCALAR;
+
+static int isa_supported(int isa)
+{
+    switch (isa)
+    {
+    case WAV_ISA_SCALAR:
+        return 1;
+#ifdef WAV_X86_SIMD
+    case WAV_ISA_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case WAV_ISA_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+    return 0;
+}
+
+#ifdef WAV_X86_SIMD
+// Pick the best kernels once when the library is loaded
+__attribute__((constructor)) static void select_conversion_isa(void)
+{
+    __builtin_cpu_init();
+    wav_set_conversion_isa(WAV_ISA_AUTO);
+}
+#endif
+
+int wav_set_conversion_isa(int isa)
+{
+    if (isa == WAV_ISA_AUTO)
+    {
+        for (isa = WAV_ISA_AVX2; !isa_supported(isa); isa--)
+            ;
+    }
+    if (isa < WAV_ISA_SCALAR || isa > WAV_ISA_AVX2 || !isa_supported(isa))
+        return -1;
+    selected_isa = isa;
+    return 0;
+}
+
+int wav_get_conversion_isa(void)
+{
+    return selected_isa;
+}
+
+void wav_decode_samples(int format, const char *src, float *dst, size_t n)
+{
+    kernels_by_isa[selected_isa].decode[format](src, dst, n);
+}
+
+void wav_encode_samples(int format, const float *src, char *dst, size_t n)
+{
+    kernels_by_isa[selected_isa].encode[format](src, dst, n);
+}
+
+// Number of samples converted at a time by the planar functions. The interleaved samples of a block
+// fit in the L1 cache, so the data is converted and (de)interleaved in one pass over memory.
+#define PLANAR_BLOCK_SAMPLES 4096
+
+static const unsigned bytes_per_sample[] = {1, 2, 3, 4, 4, 8};
+
+#ifdef WAV_X86_SIMD
+// Stereo is by far the most common case, so it gets SSE2 shuffles; these return the number of frames handled
+SSE2 static size_t deinterleave_stereo_sse2(const float *block, float *left, float *right, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 a = _mm_loadu_ps(block + 2 * i);
+        const __m128 b = _mm_loadu_ps(block + 2 * i + 4);
+        _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    return i;
+}
+
+SSE2 static size_t interleave_stereo_sse2(const float *left, const float *right, float *block, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 l = _mm_loadu_ps(left + i);
+        const __m128 r = _mm_loadu_ps(right + i);
+        _mm_storeu_ps(block + 2 * i, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(block + 2 * i + 4, _mm_unpackhi_ps(l, r));
+    }
+    return i;
+}
+#endif
+
+static void deinterleave_block(const float *block, unsigned channels, float *const *dst, size_t offset, size_t n)
+{
+    if (channels == 2)
+    {
+        float *left = dst[0] + offset, *right = dst[1] + offset;
+        size_t i = 0;
+#ifdef WAV_X86_SIMD
+        i = deinterleave_stereo_sse2(block, left, right, n);
+#endif
+        for (; i < n; i++)
+        {
+            left[i] = block[2 * i];
+            right[i] = block[2 * i + 1];
+        }
+        return;
+    }
+    for (unsigned c = 0; c < channels; c++)
+    {
+        float *out = dst[c] + offset;
+        for (size_t i = 0; i < n; i++)
+            out[i] = block[i * channels + c];
+    }
+}
+
+static void interleave_block(const float *const *src, size_t offset, unsigned channels, float *block, size_t n)
+{
+    if (channels == 2)
+    {
+        const float *left = src[0] + offset, *right = src[1] + offset;
+        size_t i = 0;
+#ifdef WAV_X86_SIMD
+        i = interleave_stereo_sse2(left, right, block, n);
+#endif
+        for (; i < n; i++)
+        {
+            block[2 * i] = left[i];
+            block[2 * i + 1] = right[i];
+        }
+        return;
+    }
+    for (unsigned c = 0; c < channels; c++)
+    {
+        const float *in = src[c] + offset;
+        for (size_t i = 0; i < n; i++)
+            block[i * channels + c] = in[i];
+    }
+}
+
+void wav_decode_planar(int format, const char *src, unsigned channels, float *const *dst, size_t dst_offset, size_t num_frames)
+{
+    if (channels == 1)
+    {
+        wav_decode_samples(format, src, dst[0] + dst_offset, num_frames);
+        return;
+    }
+    float block[PLANAR_BLOCK_SAMPLES];
+    const size_t block_frames = PLANAR_BLOCK_SAMPLES / channels;
+    const size_t bytes_per_frame = (size_t)bytes_per_sample[format] * channels;
+    for (size_t done = 0; done < num_frames; done += block_frames)
+    {
+        const size_t n = num_frames - done < block_frames ? num_frames - done : block_frames;
+        wav_decode_samples(format, src + done * bytes_per_frame, block, n * channels);
+        deinterleave_block(block, channels, dst, dst_offset + done, n);
+    }
+}
+
+void wav_encode_planar(int format, const float *const *src, size_t src_offset, unsigned channels, char *dst, size_t num_frames)
+{
+    if (channels == 1)
+    {
+        wav_encode_samples(format, src[0] + src_offset, dst, num_frames);
+        return;
+    }
+    float block[PLANAR_BLOCK_SAMPLES];
+    const size_t block_frames = PLANAR_BLOCK_SAMPLES / channels;
+    const size_t bytes_per_frame = (size_t)bytes_per_sample[format] * channels;
+    for (size_t done = 0; done < num_frames; done += block_frames)
+    {
+        const size_t n = num_frames - done < block_frames ? num_frames - done : block_frames;
+        interleave_block(src, src_offset + done, channels, block, n);
+        wav_encode_samples(format, block, dst + done * bytes_per_frame, n * channels);
+    }
+}
+
+#ifdef WAV_X86_SIMD
+// Four lanes of maxima and two double accumulators each for the sums; returns the number of samples handled
+SSE2 static size_t accumulate_stats_sse2(const float *x, size_t n, float *max_abs, double *sum, double *sum_squares)
+{
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 vmax = _mm_set1_ps(*max_abs);
+    __m128d sum_lo = _mm_setzero_pd(), sum_hi = _mm_setzero_pd();
+    __m128d squares_lo = _mm_setzero_pd(), squares_hi = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 v = _mm_loadu_ps(x + i);
+        vmax = _mm_max_ps(vmax, _mm_and_ps(v, abs_mask));
+        const __m128d lo = _mm_cvtps_pd(v);
+        const __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+        sum_lo = _mm_add_pd(sum_lo, lo);
+        sum_hi = _mm_add_pd(sum_hi, hi);
+        squares_lo = _mm_add_pd(squares_lo, _mm_mul_pd(lo, lo));
+        squares_hi = _mm_add_pd(squares_hi, _mm_mul_pd(hi, hi));
+    }
+    float lanes[4];
+    double sums[2], squares[2];
+    _mm_storeu_ps(lanes, vmax);
+    _mm_storeu_pd(sums, _mm_add_pd(sum_lo, sum_hi));
+    _mm_storeu_pd(squares, _mm_add_pd(squares_lo, squares_hi));
+    for (int k = 0; k < 4; k++)
+        *max_abs = lanes[k] > *max_abs ? lanes[k] : *max_abs;
+    *sum += sums[0] + sums[1];
+    *sum_squares += squares[0] + squares[1];
+    return i;
+}
+#endif
+
+void wav_accumulate_stats(const float *x, size_t n, float *max_abs, double *sum, double *sum_squares)
+{
+    size_t i = 0;
+#ifdef WAV_X86_SIMD
+    if (selected_isa != WAV_ISA_SCALAR)
+        i = accumulate_stats_sse2(x, n, max_abs, sum, sum_squares);
+#endif
+    for (; i < n; i++)
+    {
+        const float a = x[i] < 0 ? -x[i] : x[i];
+        *max_abs = a > *max_abs ? a : *max_abs;
+        *sum += x[i];
+        *sum_squares += (double)x[i] * x[i];
+    }
+}
+
+#ifdef WAV_X86_SIMD
+SSE2 static size_t min_max_sse2(const float *x, size_t n, float *min, float *max)
+{
+    __m128 vmin = _mm_set1_ps(*min), vmax = _mm_set1_ps(*max);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 v = _mm_loadu_ps(x + i);
+        vmin = _mm_min_ps(vmin, v);
+        vmax = _mm_max_ps(vmax, v);
+    }
+    float mins[4], maxs[4];
+    _mm_storeu_ps(mins, vmin);
+    _mm_storeu_ps(maxs, vmax);
+    for (int k = 0; k < 4; k++)
+    {
+        *min = mins[k] < *min ? mins[k] : *min;
+        *max = maxs[k] > *max ? maxs[k] : *max;
+    }
+    return i;
+}
+#endif
+
+void wav_min_max(const float *x, size_t n, float *min, float *max)
+{
+    size_t i = 0;
+#ifdef WAV_X86_SIMD
+    if (selected_isa != WAV_ISA_SCALAR)
+        i = min_max_sse2(x, n, min, max);
+#endif
+    for (; i < n; i++)
+    {
+        *min = x[i] < *min ? x[i] : *min;
+        *max = x[i] > *max ? x[i] : *max;
+    }
+}
+
+#ifdef WAV_X86_SIMD
+// Two accumulators hide the latency of the additions; returns the number of products handled
+SSE2 static size_t dot_sse2(const float *a, const float *b, size_t n, float *sum)
+{
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    *sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    return i;
+}
+
+AVX2 static size_t dot_avx2(const float *a, const float *b, size_t n, float *sum)
+{
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    if (i + 8 <= n)
+    {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        i += 8;
+    }
+    const __m256 acc = _mm256_add_ps(acc0, acc1);
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+    *sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    return i;
+}
+#endif
+
+float wav_dot(const float *a, const float *b, size_t n)
+{
+    float sum = 0;
+    size_t i = 0;
+#ifdef WAV_X86_SIMD
+    if (selected_isa == WAV_ISA_AVX2)
+        i = dot_avx2(a, b, n, &sum);
+    else if (selected_isa == WAV_ISA_SSE2)
+        i = dot_sse2(a, b, n, &sum);
+#endif
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+#ifdef WAV_X86_SIMD
+// Multiplies and adds separately like the scalar loop, so that the results are bit-exact
+SSE2 static size_t mix_add_sse2(float *bus, const float *x, size_t n, float gain)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm_storeu_ps(bus + i, _mm_add_ps(_mm_loadu_ps(bus + i), _mm_mul_ps(_mm_loadu_ps(x + i), g)));
+        _mm_storeu_ps(bus + i + 4, _mm_add_ps(_mm_loadu_ps(bus + i + 4), _mm_mul_ps(_mm_loadu_ps(x + i + 4), g)));
+    }
+    return i;
+}
+
+AVX2 static size_t mix_add_avx2(float *bus, const float *x, size_t n, float gain)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm256_storeu_ps(bus + i, _mm256_add_ps(_mm256_loadu_ps(bus + i), _mm256_mul_ps(_mm256_loadu_ps(x + i), g)));
+        _mm256_storeu_ps(bus + i + 8, _mm256_add_ps(_mm256_loadu_ps(bus + i + 8), _mm256_mul_ps(_mm256_loadu_ps(x + i + 8), g)));
+    }
+    return i;
+}
+#endif
+
+void wav_mix_add(float *bus, const float *x, size_t n, float gain)
+{
+    size_t i = 0;
+#ifdef WAV_X86_SIMD
+    if (selected_isa == WAV_ISA_AVX2)
+        i = mix_add_avx2(bus, x, n, gain);
+    else if (selected_isa == WAV_ISA_SSE2)
+        i = mix_add_sse2(bus, x, n, gain);
+#endif
+    for (; i < n; i++)
+        bus[i] += x[i] * gain;
+}
+
+void wav_mix_add_ramp(float *bus, const float *x, unsigned num_frames, unsigned channels, float gain, float step)
+{
+    for (unsigned k = 0; k < num_frames; k++)
+    {
+        const float g = gain + step * k;
+        for (unsigned c = 0; c < channels; c++)
+            bus[(size_t)k * channels + c] += x[(size_t)k * channels + c] * g;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef WAV_CONVERT_H
+#define WAV_CONVERT_H
+
+/*
+    Internal sample conversion kernels shared by the library modules.
+    Not part of the public API.
+*/
+
+#include <stddef.h>
+#include "wav_handler.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SAMPLE_FORMAT_UNSUPPORTED -1
+#define SAMPLE_FORMAT_PCM8 0
+#define SAMPLE_FORMAT_PCM16 1
+#define SAMPLE_FORMAT_PCM24 2
+#define SAMPLE_FORMAT_PCM32 3
+#define SAMPLE_FORMAT_FLOAT32 4
+#define SAMPLE_FORMAT_FLOAT64 5
+
+/**
+ * @brief Returns the SAMPLE_FORMAT_* constant matching the format of wav.
+ */
+int wav_sample_format(const struct wav_file *wav);
+
+/**
+ * @brief Decode n samples in the given SAMPLE_FORMAT_* format from src into normalized floats in dst.
+ */
+void wav_decode_samples(int format, const char *src, float *dst, size_t n);
+
+/**
+ * @brief Encode n normalized floats from src into the given SAMPLE_FORMAT_* format in dst. Values are clipped.
+ */
+void wav_encode_samples(int format, const float *src, char *dst, size_t n);
+
+/**
+ * @brief Decode num_frames interleaved frames of channels channels from src into the planar channel
+ * arrays dst[0] ... dst[channels - 1], starting at index dst_offset of each array. channels must be at most
+ * WAV_PLANAR_MAX_CHANNELS.
+ * The conversion and deinterleaving are done in one pass in cache-sized blocks.
+ */
+void wav_decode_planar(int format, const char *src, unsigned channels, float *const *dst, size_t dst_offset, size_t num_frames);
+
+/**
+ * @brief Encode num_frames frames from the planar channel arrays src[0] ... src[channels - 1], starting at index
+ * src_offset of each array, into interleaved frames in dst. Values are clipped.
+ */
+void wav_encode_planar(int format, const float *const *src, size_t src_offset, unsigned channels, char *dst, size_t num_frames);
+
+/**
+ * @brief Add the n samples of x to *sum and their squares to *sum_squares, and raise *max_abs to the largest
+ * absolute value. Vectorized with SSE2 unless the scalar kernels are selected.
+ */
+void wav_accumulate_stats(const float *x, size_t n, float *max_abs, double *sum, double *sum_squares);
+
+/**
+ * @brief Lower *min and raise *max to the smallest and largest of the n samples of x. Vectorized with SSE2
+ * unless the scalar kernels are selected.
+ */
+void wav_min_max(const float *x, size_t n, float *min, float *max);
+
+/**
+ * @brief Returns the inner product of the n elements of a and b. Vectorized with SSE2 or AVX2 depending on the
+ * selected instruction set, so the rounding of the result differs slightly between instruction sets.
+ */
+float wav_dot(const float *a, const float *b, size_t n);
+
+/**
+ * @brief Add the n samples of x multiplied by gain to bus. Vectorized with SSE2 or AVX2 depending on the
+ * selected instruction set. All instruction sets produce bit-exact results.
+ */
+void wav_mix_add(float *bus, const float *x, size_t n, float gain);
+
+/**
+ * @brief Add num_frames interleaved frames of x to bus with a gain ramp: frame k is multiplied by
+ * gain + step * k.
+ */
+void wav_mix_add_ramp(float *bus, const float *x, unsigned num_frames, unsigned channels, float gain, float step);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,46 +1,289 @@
+// 64 bit file offsets on 32 bit POSIX systems
+#define _FILE_OFFSET_BITS 64
+// O_DIRECT
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
 #include "wav_handler.h"
+#include "wav_convert.h"
+#include "wav_pool.h"
+#include "wav_stats.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define WAV_HAVE_MMAP
+#define WAV_HAVE_WRITEV
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#define wav_fseek _fseeki64
+#define wav_ftell _ftelli64
+#else
+#define wav_fseek fseeko
+#define wav_ftell ftello
+#endif
+
+// Chunk sizes larger than this are stored in the ds64 chunk of an RF64 file
+#define RIFF_MAX_SIZE 0xFFFFFFFFull
+// Size of the ds64 chunk data written by this library: RIFF size, data size, sample count and table length
+#define DS64_SIZE 28
+
+// Returns the chunk with the given id from the index or NULL if not found
+static const struct wav_chunk_info *find_chunk(const struct wav_chunk_index *index, const char *id)
+{
+    for (unsigned i = 0; i < index->num_chunks; i++)
+    {
+        if (!strcmp(index->chunks[i].id, id))
+            return &index->chunks[i];
+    }
+    return NULL;
+}
+
+static int add_chunk(struct wav_chunk_index *index, unsigned *capacity, const char *id, unsigned long long offset, unsigned long long size)
+{
+    if (index->num_chunks == *capacity)
+    {
+        const unsigned new_capacity = *capacity ? *capacity * 2 : 8;
+        struct wav_chunk_info *chunks = (struct wav_chunk_info *)realloc(index->chunks, new_capacity * sizeof(struct wav_chunk_info));
+        if (!chunks)
+            return -1;
+        index->chunks = chunks;
+        *capacity = new_capacity;
+    }
+    struct wav_chunk_info *chunk = &index->chunks[index->num_chunks++];
+    memcpy(chunk->id, id, 5);
+    chunk->offset = offset;
+    chunk->size = size;
+    return 0;
+}
+
+// Input of the header parser: a file, or a memory buffer if f is NULL
+struct wav_source
+{
+    FILE *f;
+    const char *buffer;
+    size_t size;
+    size_t pos;
+};
+
+static struct wav_source file_source(FILE *f)
+{
+    struct wav_source src = {f, NULL, 0, 0};
+    return src;
+}
+
+static struct wav_source memory_source(const void *buffer, size_t size)
+{
+    struct wav_source src = {NULL, (const char *)buffer, size, 0};
+    return src;
+}
+
+// Reads up to num_bytes bytes like fread, returns the number of bytes read
+static size_t source_read(struct wav_source *src, void *dst, size_t num_bytes)
+{
+    if (src->f)
+        return fread(dst, 1, num_bytes, src->f);
+    const size_t available = src->size - src->pos < num_bytes ? src->size - src->pos : num_bytes;
+    memcpy(dst, src->buffer + src->pos, available);
+    src->pos += available;
+    return available;
+}
+
+// Seeks to absolute position pos. Returns 0 on success, buffers can't be seeked past their end.
+static int source_seek(struct wav_source *src, unsigned long long pos)
+{
+    if (src->f)
+        return wav_fseek(src->f, pos, SEEK_SET);
+    if (pos > src->size)
+        return -1;
+    src->pos = pos;
+    return 0;
+}
+
+// Returns the length of the source in bytes
+static unsigned long long source_length(struct wav_source *src)
+{
+    if (!src->f)
+        return src->size;
+    const long long pos = wav_ftell(src->f);
+    if (pos < 0 || wav_fseek(src->f, 0, SEEK_END))
+        return 0;
+    const long long length = wav_ftell(src->f);
+    wav_fseek(src->f, pos, SEEK_SET);
+    return length < 0 ? 0 : length;
+}
 
-int read_until_header(FILE *f, unsigned file_total_size, const char *hdr, unsigned *data_length, struct wav_file_custom_header_data *chdr)
+// Walks through all the chunks of the file once, recording their ids, offsets and sizes to index.
+// The contents of the fmt chunk (and the ds64 chunk of RF64/BW64 files) are read on the way and
+// stored to wav. All fields of wav except data are populated.
+static int index_wav_file(struct wav_source *src, struct wav_file *wav, struct wav_chunk_index *index)
 {
-    int found = 0;
-    char temp_data[5];
-    temp_data[4] = 0;
-    while (!found &&
-           // feof doesn't seem to work here for some reason
-           ftell(f) < file_total_size)
+    unsigned capacity = 0;
+    index->num_chunks = 0;
+    index->chunks = NULL;
+    const unsigned long long length = source_length(src);
+    char temp_data[5] = "abcd";
+    source_read(src, temp_data, 4);
+    const int is_rf64 = !strcmp(temp_data, "RF64") || !strcmp(temp_data, "BW64");
+    if (strcmp(temp_data, "RIFF") && !is_rf64)
+        return -1;
+    unsigned riff_size = 0;
+    source_read(src, &riff_size, sizeof(unsigned));
+    unsigned long long f_size = riff_size + 8ull;
+    source_read(src, temp_data, 4);
+    if (strcmp(temp_data, "WAVE"))
+        return -1;
+    const struct wav_chunk_info *data_chunk;
+    unsigned long long data_size64 = 0;
+    unsigned short fmt_type = 0, num_channels = 0, bit_depth = 0;
+    unsigned sample_rate = 0;
+    unsigned long long pos = 12;
+    // feof is not reliable here because the file might have data after the RIFF chunk
+    while (pos + 8 <= f_size)
     {
-        fread(temp_data, 1, 4, f);
-        if (!strcmp(temp_data, hdr))
-            found = 1;
-        fread(data_length, sizeof(unsigned), 1, f);
-        if (!found)
+        unsigned len;
+        if (source_read(src, temp_data, 4) != 4 || source_read(src, &len, sizeof(unsigned)) != sizeof(unsigned))
+            break;
+        pos += 8;
+        unsigned long long size = len;
+        if (!strcmp(temp_data, "ds64") && is_rf64 && !index->num_chunks && len >= 16)
         {
-            int custom_header_found = 0;
-            if (chdr)
+            unsigned long long riff_size64 = 0;
+            source_read(src, &riff_size64, sizeof(unsigned long long));
+            source_read(src, &data_size64, sizeof(unsigned long long));
+            f_size = riff_size64 + 8;
+        }
+        else if (!strcmp(temp_data, "fmt "))
+        {
+            char fmt[16];
+            if (len != 16 || source_read(src, fmt, 16) != 16)
+                goto error;
+            memcpy(&fmt_type, fmt, sizeof(unsigned short));
+            memcpy(&num_channels, fmt + 2, sizeof(unsigned short));
+            memcpy(&sample_rate, fmt + 4, sizeof(unsigned));
+            // Byte rate and block align are derived from the other fields
+            memcpy(&bit_depth, fmt + 14, sizeof(unsigned short));
+        }
+        else if (!strcmp(temp_data, "data") && is_rf64 && len == RIFF_MAX_SIZE)
+            size = data_size64;
+        // Sizes past the end of the RIFF chunk or the file would wrap pos around or point past the data
+        if (size > f_size - pos || size > length - pos)
+            goto error;
+        if (add_chunk(index, &capacity, temp_data, pos, size))
+            goto error;
+        pos += size;
+        if (source_seek(src, pos))
+            break;
+    }
+    data_chunk = find_chunk(index, "data");
+    if (!find_chunk(index, "fmt ") || !data_chunk)
+        goto error;
+    if ((fmt_type != 1 && fmt_type != 3) || !num_channels || bit_depth < 8)
+        goto error;
+    wav->num_bytes = data_chunk->size;
+    wav->channels = num_channels;
+    wav->num_frames = wav->num_bytes / (num_channels * bit_depth / 8); // num_bytes / (channels * byte_per_sample)
+    wav->bit_depth = bit_depth;
+    wav->sample_rate = sample_rate;
+    wav->is_float = fmt_type == 3;
+    wav->stats = NULL;
+    return 0;
+error:
+    wav_free_chunk_index(index);
+    return -1;
+}
+
+// Allocates size bytes using allocator or malloc if allocator is NULL
+static void *wav_alloc(const struct wav_allocator *allocator, size_t size)
+{
+    return allocator ? allocator->alloc(allocator->ctx, size) : malloc(size);
+}
+
+// wav_file release function for data allocated with the allocator in ctx
+static void release_allocated(void *ctx, char *data)
+{
+    const struct wav_allocator *allocator = (const struct wav_allocator *)ctx;
+    allocator->free(allocator->ctx, data);
+}
+
+// Sets data and the matching release function of wav
+static void set_allocated_data(struct wav_file *wav, char *data, const struct wav_allocator *allocator)
+{
+    wav->data = data;
+    wav->release = allocator ? release_allocated : NULL;
+    // The allocator is only read through the context
+    wav->release_ctx = (void *)allocator;
+}
+
+// Reads the contents of the chunk to chdr. The header name of chdr is not modified.
+static int read_chunk(struct wav_source *src, const struct wav_chunk_info *chunk, struct wav_file_custom_header_data *chdr,
+                      const struct wav_allocator *allocator)
+{
+    if (chunk->size > 0xFFFFFFFFu || source_seek(src, chunk->offset))
+        return -1;
+    chdr->num_bytes = chunk->size;
+    chdr->data = (char *)wav_alloc(allocator, chunk->size);
+    if (!chdr->data)
+        return -1;
+    source_read(src, chdr->data, chunk->size);
+    return 0;
+}
+
+// Indexes the file and reads the custom headers listed in chdr. All fields of wav except data are populated.
+// The index is stored to index if it's not NULL, otherwise it's freed. The custom header data is allocated using
+// allocator or malloc if allocator is NULL.
+static int read_wav_header(struct wav_source *src, struct wav_file *wav, struct wav_chunk_index *index, struct wav_file_custom_header_data *chdr,
+                           const struct wav_allocator *allocator)
+{
+    struct wav_chunk_index temp_index;
+    if (!index)
+        index = &temp_index;
+    if (index_wav_file(src, wav, index))
+        return -1;
+    if (chdr)
+    {
+        for (struct wav_file_custom_header_data *chdr_item = chdr; chdr_item->header_name[0]; chdr_item++)
+        {
+            const struct wav_chunk_info *chunk = find_chunk(index, chdr_item->header_name);
+            // The format and data chunks are not custom headers
+            if (!chunk || !strcmp(chunk->id, "fmt ") || !strcmp(chunk->id, "data"))
+                continue;
+            if (read_chunk(src, chunk, chdr_item, allocator))
             {
-                for (struct wav_file_custom_header_data *chdr_item = chdr; chdr_item->header_name[0]; chdr_item++)
-                {
-                    if (!strcmp(chdr_item->header_name, temp_data))
-                    {
-                        custom_header_found = 1;
-                        chdr_item->num_bytes = *data_length;
-                        chdr_item->data = (char *)malloc(*data_length);
-                        if (!chdr_item->data)
-                            return -1;
-                        fread(chdr_item->data, 1, *data_length, f);
-                        break;
-                    }
-                }
+                wav_free_chunk_index(index);
+                return -1;
             }
-            if (!custom_header_found)
-                fseek(f, *data_length, SEEK_CUR);
         }
     }
-    return found ? 0 : -1;
+    if (index == &temp_index)
+        wav_free_chunk_index(index);
+    return 0;
+}
+
+int wav_free_chunk_index(struct wav_chunk_index *index)
+{
+    free(index->chunks);
+    index->chunks = NULL;
+    index->num_chunks = 0;
+    return 0;
+}
+
+// Returns the offset of the data chunk contents
+static unsigned long long get_data_offset(const struct wav_chunk_index *index)
+{
+    return find_chunk(index, "data")->offset;
 }
 
 int read_wav_file(const char *file_name, struct wav_file *wav)
@@ -52,71 +295,212 @@ int read_wav_file(const char *file_name, struct wav_file *wav)
     {                          \
         if (f)                 \
             fclose(f);         \
+        wav->data = NULL;      \
         return -1;             \
     }
 
 int read_wav_file_chdr(const char *file_name, struct wav_file *wav, struct wav_file_custom_header_data *chdr)
+{
+    return read_wav_file_alloc(file_name, wav, chdr, NULL);
+}
+
+int read_wav_file_alloc(const char *file_name, struct wav_file *wav, struct wav_file_custom_header_data *chdr,
+                        const struct wav_allocator *allocator)
 {
     wav->data = NULL;
-    char temp_data[5] = "abcd";
+    wav->release = NULL;
+    wav->release_ctx = NULL;
+    char *data;
     FILE *f = fopen(file_name, "rb");
     if (!f)
         read_wav_file_chdr_err;
-    fread(temp_data, 1, 4, f);
-    if (strcmp(temp_data, "RIFF"))
-        read_wav_file_chdr_err;
-    unsigned f_size;
-    fread(&f_size, sizeof(unsigned), 1, f);
-    f_size += 8;
-    fread(temp_data, 1, 4, f);
-    if (strcmp(temp_data, "WAVE"))
-        read_wav_file_chdr_err;
-    unsigned len_fmt_data;
-    if (read_until_header(f, f_size, "fmt ", &len_fmt_data, chdr))
+    struct wav_chunk_index index;
+    struct wav_source src = file_source(f);
+    if (read_wav_header(&src, wav, &index, chdr, allocator))
         read_wav_file_chdr_err;
-    if (len_fmt_data != 16)
+    const unsigned long long data_offset = get_data_offset(&index);
+    wav_free_chunk_index(&index);
+    if (wav->num_bytes > SIZE_MAX || wav_fseek(f, data_offset, SEEK_SET))
         read_wav_file_chdr_err;
-    unsigned short fmt_type;
-    fread(&fmt_type, sizeof(unsigned short), 1, f);
-    if (fmt_type != 1 && fmt_type != 3)
+    data = (char *)wav_alloc(allocator, wav->num_bytes);
+    if (!data)
         read_wav_file_chdr_err;
-    unsigned short num_channels;
-    fread(&num_channels, sizeof(unsigned short), 1, f);
-    unsigned sample_rate;
-    fread(&sample_rate, sizeof(unsigned), 1, f);
-    // Just discard next two fields for now
-    fseek(f, 4 + 2, SEEK_CUR);
-    unsigned short bit_depth;
-    fread(&bit_depth, sizeof(unsigned short), 1, f);
-    unsigned num_bytes = 0;
-    if (read_until_header(f, f_size, "data", &num_bytes, chdr))
-        read_wav_file_chdr_err;
-    wav->data = (char *)malloc(num_bytes);
-    if (!wav->data)
-        read_wav_file_chdr_err;
-    fread(wav->data, 1, num_bytes, f);
-    // read headers that are after data header
-    if (chdr)
+    fread(data, 1, wav->num_bytes, f);
+    fclose(f);
+    set_allocated_data(wav, data, allocator);
+    return 0;
+}
+
+int wav_probe(const char *file_name, struct wav_file *wav, struct wav_file_custom_header_data *chdr)
+{
+    wav->data = NULL;
+    wav->release = NULL;
+    wav->release_ctx = NULL;
+    FILE *f = fopen(file_name, "rb");
+    if (!f)
+        return -1;
+    // Only the chunk headers and the requested chunks are read, so a small buffer is enough
+    setvbuf(f, NULL, _IOFBF, 512);
+    struct wav_source src = file_source(f);
+    const int err = read_wav_header(&src, wav, NULL, chdr, NULL);
+    fclose(f);
+    return err;
+}
+
+struct probe_batch
+{
+    const char *const *file_names;
+    struct wav_file *wavs;
+    int *results;
+    int error;
+};
+
+static void probe_task(void *ctx, unsigned long long idx)
+{
+    struct probe_batch *batch = (struct probe_batch *)ctx;
+    const int err = wav_probe(batch->file_names[idx], &batch->wavs[idx], NULL);
+    if (batch->results)
+        batch->results[idx] = err;
+    if (err)
+        __atomic_store_n(&batch->error, 1, __ATOMIC_RELAXED);
+}
+
+int wav_probe_batch(const char *const *file_names, unsigned num_files, struct wav_file *wavs, int *results, unsigned num_threads)
+{
+    struct probe_batch batch = {file_names, wavs, results, 0};
+    if (wav_parallel_for(num_threads, num_files, probe_task, &batch))
+        return -1;
+    return batch.error ? -1 : 0;
+}
+
+// wav_file release function for data pointing into a caller-owned buffer
+static void release_borrowed(void *ctx, char *data)
+{
+}
+
+int read_wav_memory(const void *buffer, size_t size, struct wav_file *wav, struct wav_file_custom_header_data *chdr, int flags)
+{
+    wav->data = NULL;
+    wav->release = NULL;
+    wav->release_ctx = NULL;
+    struct wav_chunk_index index;
+    struct wav_source src = memory_source(buffer, size);
+    if (read_wav_header(&src, wav, &index, chdr, NULL))
+        return -1;
+    const unsigned long long data_offset = get_data_offset(&index);
+    wav_free_chunk_index(&index);
+    // The data would point past the buffer
+    if (data_offset > size || wav->num_bytes > size - data_offset)
+        return -1;
+    if (flags & WAV_MEMORY_ZERO_COPY)
     {
-        unsigned x;
-        read_until_header(f, f_size, "", &x, chdr);
+        // The buffer is only written through the set functions, which the caller must not use if it's const
+        wav->data = (char *)buffer + data_offset;
+        wav->release = release_borrowed;
+        return 0;
     }
+    char *data = (char *)malloc(wav->num_bytes ? wav->num_bytes : 1);
+    if (!data)
+        return -1;
+    memcpy(data, (const char *)buffer + data_offset, wav->num_bytes);
+    wav->data = data;
+    return 0;
+}
+
+#ifdef WAV_HAVE_MMAP
+
+struct wav_mapping
+{
+    void *base;
+    size_t length;
+    int read_only;
+};
+
+static void release_mapping(void *ctx, char *data)
+{
+    struct wav_mapping *mapping = (struct wav_mapping *)ctx;
+    munmap(mapping->base, mapping->length);
+    free(mapping);
+}
+
+int read_wav_file_mmap(const char *file_name, struct wav_file *wav, struct wav_file_custom_header_data *chdr, int flags)
+{
+    wav->data = NULL;
+    wav->release = NULL;
+    wav->release_ctx = NULL;
+    struct wav_mapping *mapping = NULL;
+    struct wav_chunk_index index;
+    unsigned long long data_offset;
+    struct stat st;
+    struct wav_source src;
+    FILE *f = fopen(file_name, "rb");
+    if (!f)
+        return -1;
+    src = file_source(f);
+    if (read_wav_header(&src, wav, &index, chdr, NULL))
+        goto error;
+    data_offset = get_data_offset(&index);
+    wav_free_chunk_index(&index);
+    // Mapping past the end of the file would cause SIGBUS on access
+    if (fstat(fileno(f), &st) || data_offset + wav->num_bytes > (unsigned long long)st.st_size ||
+        data_offset + wav->num_bytes > SIZE_MAX)
+        goto error;
+    mapping = (struct wav_mapping *)malloc(sizeof(struct wav_mapping));
+    if (!mapping)
+        goto error;
+    // The whole file from the beginning is mapped because mmap offsets must be page aligned
+    mapping->length = data_offset + wav->num_bytes;
+    mapping->read_only = flags & WAV_MMAP_READ_ONLY;
+    if (flags & WAV_MMAP_READ_ONLY)
+        mapping->base = mmap(NULL, mapping->length, PROT_READ, MAP_SHARED, fileno(f), 0);
+    else
+        mapping->base = mmap(NULL, mapping->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+    if (mapping->base == MAP_FAILED)
+        goto error;
     fclose(f);
-    wav->num_bytes = num_bytes;
-    wav->channels = num_channels;
-    wav->num_frames = num_bytes / (num_channels * bit_depth / 8); // num_bytes / (channels * byte_per_sample)
-    wav->bit_depth = bit_depth;
-    wav->sample_rate = sample_rate;
-    wav->is_float = fmt_type == 3;
+    wav->data = (char *)mapping->base + data_offset;
+    wav->release = release_mapping;
+    wav->release_ctx = mapping;
+    return 0;
+error:
+    free(mapping);
+    fclose(f);
+    return -1;
+}
+
+// Returns nonzero if the data of wav is a read-only mapping
+static int is_read_only_mapping(const struct wav_file *wav)
+{
+    return wav->release == release_mapping && ((struct wav_mapping *)wav->release_ctx)->read_only;
+}
+
+#else
+
+int read_wav_file_mmap(const char *file_name, struct wav_file *wav, struct wav_file_custom_header_data *chdr, int flags)
+{
+    wav->data = NULL;
+    return -1;
+}
+
+static int is_read_only_mapping(const struct wav_file *wav)
+{
     return 0;
 }
 
+#endif
+
 int free_wav_file(struct wav_file *wav)
 {
     if (wav->data)
     {
-        free(wav->data);
+        if (wav->release)
+            wav->release(wav->release_ctx, wav->data);
+        else
+            free(wav->data);
         wav->data = NULL;
+        wav->release = NULL;
+        wav->release_ctx = NULL;
+        wav->stats = NULL;
         return 0;
     }
     return -1;
@@ -127,52 +511,361 @@ int write_wav_file(const char *file_name, const struct wav_file *wav)
     return write_wav_file_chdr(file_name, wav, NULL);
 }
 
-int write_wav_file_chdr(const char *file_name, const struct wav_file *wav, const struct wav_file_custom_header_data *chdr)
+#define HEADER_RIFF 0
+// RIFF header with a JUNK chunk reserving space for a ds64 chunk, so that the header can be converted
+// to RF64 afterwards if the data grows too large
+#define HEADER_RIFF_RESERVE_DS64 1
+#define HEADER_RF64 2
+
+static char *put_bytes(char *p, const void *src, size_t num_bytes)
 {
-    if (!wav->data)
-        return -1;
-    FILE *f = fopen(file_name, "wb");
-    if (!f)
-        return -1;
-    fwrite("RIFF", 1, 4, f);
-    unsigned total_length = 36 + wav->num_bytes;
-    fwrite(&total_length, sizeof(unsigned), 1, f);
-    fwrite("WAVEfmt ", 1, 8, f);
-    unsigned fmt_len = 16;
-    fwrite(&fmt_len, sizeof(unsigned), 1, f);
-    unsigned short fmt_type = wav->is_float ? 3 : 1;
-    fwrite(&fmt_type, sizeof(unsigned short), 1, f);
-    unsigned short num_channels = (unsigned short)wav->channels;
-    fwrite(&num_channels, sizeof(unsigned short), 1, f);
-    fwrite(&wav->sample_rate, sizeof(unsigned), 1, f);
-    unsigned bytes_per_sec = wav->sample_rate * wav->bit_depth / 8 * wav->channels;
-    fwrite(&bytes_per_sec, sizeof(unsigned), 1, f);
-    unsigned short bytes_per_frame = wav->bit_depth / 8 * wav->channels;
-    fwrite(&bytes_per_frame, sizeof(unsigned short), 1, f);
-    unsigned short bit_depth = (unsigned short)wav->bit_depth;
-    fwrite(&bit_depth, sizeof(unsigned short), 1, f);
+    memcpy(p, src, num_bytes);
+    return p + num_bytes;
+}
+
+static char *put_u16(char *p, unsigned short value)
+{
+    return put_bytes(p, &value, sizeof(value));
+}
+
+static char *put_u32(char *p, unsigned value)
+{
+    return put_bytes(p, &value, sizeof(value));
+}
+
+static char *put_u64(char *p, unsigned long long value)
+{
+    return put_bytes(p, &value, sizeof(value));
+}
+
+// Stores the 64 bit sizes of a ds64 chunk without the chunk header, DS64_SIZE bytes
+static char *put_ds64_data(char *p, unsigned long long riff_size, unsigned long long data_size, unsigned long long num_frames)
+{
+    p = put_u64(p, riff_size);
+    p = put_u64(p, data_size);
+    p = put_u64(p, num_frames);
+    return put_u32(p, 0);
+}
+
+// Size of the header stored by build_wav_header
+static size_t get_wav_header_size(const struct wav_file_custom_header_data *chdr, int header_type)
+{
+    size_t size = 44;
+    if (header_type != HEADER_RIFF)
+        size += 8 + DS64_SIZE;
+    if (chdr)
+    {
+        for (const struct wav_file_custom_header_data *hdr = chdr; hdr->header_name[0]; hdr++)
+            size += 8 + hdr->num_bytes;
+    }
+    return size;
+}
+
+// Stores the RIFF and fmt headers, the custom headers and the data chunk header for num_bytes of data
+// to buf, which must hold get_wav_header_size bytes.
+static void build_wav_header(char *buf, const struct wav_file *wav, unsigned long long num_bytes,
+                             const struct wav_file_custom_header_data *chdr, int header_type)
+{
+    const unsigned long long total_length = get_wav_header_size(chdr, header_type) - 8 + num_bytes;
+    const unsigned bytes_per_frame = wav->bit_depth / 8 * wav->channels;
+    char *p = buf;
+    p = put_bytes(p, header_type == HEADER_RF64 ? "RF64" : "RIFF", 4);
+    p = put_u32(p, header_type == HEADER_RF64 ? RIFF_MAX_SIZE : total_length);
+    p = put_bytes(p, "WAVE", 4);
+    if (header_type != HEADER_RIFF)
+    {
+        p = put_bytes(p, header_type == HEADER_RF64 ? "ds64" : "JUNK", 4);
+        p = put_u32(p, DS64_SIZE);
+        if (header_type == HEADER_RF64)
+            p = put_ds64_data(p, total_length, num_bytes, bytes_per_frame ? num_bytes / bytes_per_frame : 0);
+        else
+            p = put_ds64_data(p, 0, 0, 0);
+    }
+    p = put_bytes(p, "fmt ", 4);
+    p = put_u32(p, 16);
+    p = put_u16(p, wav->is_float ? 3 : 1);
+    p = put_u16(p, (unsigned short)wav->channels);
+    p = put_u32(p, wav->sample_rate);
+    p = put_u32(p, wav->sample_rate * bytes_per_frame);
+    p = put_u16(p, (unsigned short)bytes_per_frame);
+    p = put_u16(p, (unsigned short)wav->bit_depth);
     if (chdr)
     {
         for (const struct wav_file_custom_header_data *hdr = chdr; hdr->header_name[0]; hdr++)
         {
-            fwrite(hdr->header_name, 1, 4, f);
-            fwrite(&hdr->num_bytes, sizeof(unsigned), 1, f);
-            fwrite(hdr->data, 1, hdr->num_bytes, f);
+            p = put_bytes(p, hdr->header_name, 4);
+            p = put_u32(p, hdr->num_bytes);
+            p = put_bytes(p, hdr->data, hdr->num_bytes);
         }
     }
-    fwrite("data", 1, 4, f);
-    fwrite(&wav->num_bytes, sizeof(unsigned), 1, f);
-    fwrite(wav->data, 1, wav->num_bytes, f);
-    fclose(f);
+    p = put_bytes(p, "data", 4);
+    put_u32(p, header_type == HEADER_RF64 ? RIFF_MAX_SIZE : num_bytes);
+}
+
+// Builds the header in memory and writes it with one fwrite. Returns 0 on success.
+static int write_wav_header(FILE *f, const struct wav_file *wav, unsigned long long num_bytes,
+                            const struct wav_file_custom_header_data *chdr, int header_type)
+{
+    char small_header[128];
+    const size_t header_size = get_wav_header_size(chdr, header_type);
+    char *header = header_size <= sizeof(small_header) ? small_header : (char *)malloc(header_size);
+    if (!header)
+        return -1;
+    build_wav_header(header, wav, num_bytes, chdr, header_type);
+    const size_t written = fwrite(header, 1, header_size, f);
+    if (header != small_header)
+        free(header);
+    return written == header_size ? 0 : -1;
+}
+
+#ifdef WAV_HAVE_WRITEV
+
+// Limit for the bytes passed to one writev or pwrite call, the total must fit into ssize_t
+#define FD_WRITE_MAX_BYTES (1u << 30)
+// O_DIRECT transfers must be aligned to the logical block size of the device in memory, file offset and length
+#define DIRECT_ALIGNMENT 4096
+#define DIRECT_BLOCK_SIZE (1 << 20)
+
+// Writes all the buffers, retrying after partial writes. iov is modified. Returns 0 on success.
+static int writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static int pwrite_all(int fd, const char *data, unsigned long long num_bytes, unsigned long long offset)
+{
+    while (num_bytes > 0)
+    {
+        const size_t len = num_bytes < FD_WRITE_MAX_BYTES ? num_bytes : FD_WRITE_MAX_BYTES;
+        const ssize_t n = pwrite(fd, data, len, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        num_bytes -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Copies num_bytes bytes starting at offset of the file consisting of header followed by data
+static void copy_file_range_to(char *dst, unsigned long long offset, size_t num_bytes, const char *header, size_t header_size,
+                               const char *data)
+{
+    if (offset < header_size)
+    {
+        const size_t len = header_size - offset < num_bytes ? header_size - offset : num_bytes;
+        memcpy(dst, header + offset, len);
+        dst += len;
+        offset += len;
+        num_bytes -= len;
+    }
+    memcpy(dst, data + (offset - header_size), num_bytes);
+}
+
+#ifdef O_DIRECT
+
+// Writes whole DIRECT_BLOCK_SIZE blocks of the file with O_DIRECT through an aligned bounce buffer.
+// Returns the number of bytes written, the rest of the file is left to buffered writes. The count is
+// smaller than expected if the file system doesn't support direct I/O. Returns -1 on error.
+static long long write_direct_blocks(int fd, const char *header, size_t header_size, const char *data, unsigned long long num_bytes)
+{
+    const unsigned long long total = header_size + num_bytes;
+    const int fl = fcntl(fd, F_GETFL);
+    void *block;
+    if (fl < 0 || fcntl(fd, F_SETFL, fl | O_DIRECT))
+        return 0;
+    if (posix_memalign(&block, DIRECT_ALIGNMENT, DIRECT_BLOCK_SIZE))
+    {
+        fcntl(fd, F_SETFL, fl);
+        return 0;
+    }
+    unsigned long long offset = 0;
+    while (offset + DIRECT_BLOCK_SIZE <= total)
+    {
+        copy_file_range_to((char *)block, offset, DIRECT_BLOCK_SIZE, header, header_size, data);
+        const ssize_t n = pwrite(fd, block, DIRECT_BLOCK_SIZE, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno != EINVAL)
+        {
+            offset = -1;
+            break;
+        }
+        // EINVAL means direct I/O is not supported after all, a short write leaves the offset unaligned
+        if (n > 0)
+            offset += n;
+        if (n != DIRECT_BLOCK_SIZE)
+            break;
+    }
+    free(block);
+    if (fcntl(fd, F_SETFL, fl))
+        return -1;
+    return offset;
+}
+
+#else
+
+static long long write_direct_blocks(int fd, const char *header, size_t header_size, const char *data, unsigned long long num_bytes)
+{
+    return 0;
+}
+
+#endif
+
+// write_wav_file_ex for WAV_WRITE_VECTORED and WAV_WRITE_DIRECT
+static int write_wav_file_fd(const char *file_name, const struct wav_file *wav, const struct wav_file_custom_header_data *chdr,
+                             int header_type, int flags)
+{
+    const size_t header_size = get_wav_header_size(chdr, header_type);
+    char *header = (char *)malloc(header_size);
+    if (!header)
+        return -1;
+    build_wav_header(header, wav, wav->num_bytes, chdr, header_type);
+    const int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        free(header);
+        return -1;
+    }
+    int err = 0;
+    if ((flags & WAV_WRITE_DIRECT) && wav->num_bytes >= DIRECT_BLOCK_SIZE)
+    {
+        long long offset = write_direct_blocks(fd, header, header_size, wav->data, wav->num_bytes);
+        err = offset < 0;
+        if (!err && (unsigned long long)offset < header_size)
+        {
+            err = pwrite_all(fd, header + offset, header_size - offset, offset);
+            offset = header_size;
+        }
+        if (!err)
+            err = pwrite_all(fd, wav->data + (offset - header_size), wav->num_bytes - (offset - header_size), offset);
+    }
+    else
+    {
+        // Header and the first part of the data in one system call, the data is split only if it's very large
+        size_t done = wav->num_bytes < FD_WRITE_MAX_BYTES ? wav->num_bytes : FD_WRITE_MAX_BYTES;
+        struct iovec iov[2];
+        iov[0].iov_base = header;
+        iov[0].iov_len = header_size;
+        iov[1].iov_base = wav->data;
+        iov[1].iov_len = done;
+        err = writev_all(fd, iov, 2);
+        if (!err && done < wav->num_bytes)
+            err = pwrite_all(fd, wav->data + done, wav->num_bytes - done, header_size + done);
+    }
+    free(header);
+    if (close(fd))
+        err = 1;
+    return err ? -1 : 0;
+}
+
+#endif
+
+int write_wav_file_chdr(const char *file_name, const struct wav_file *wav, const struct wav_file_custom_header_data *chdr)
+{
+    return write_wav_file_ex(file_name, wav, chdr, 0);
+}
+
+// The header type for writing wav with chdr and WAV_WRITE_* flags
+static int get_header_type(const struct wav_file *wav, const struct wav_file_custom_header_data *chdr, int flags)
+{
+    unsigned long long riff_size = 36 + wav->num_bytes;
+    if (chdr)
+    {
+        for (const struct wav_file_custom_header_data *hdr = chdr; hdr->header_name[0]; hdr++)
+            riff_size += 8 + hdr->num_bytes;
+    }
+    return (flags & WAV_WRITE_RF64) || riff_size > RIFF_MAX_SIZE ? HEADER_RF64 : HEADER_RIFF;
+}
+
+int write_wav_file_ex(const char *file_name, const struct wav_file *wav, const struct wav_file_custom_header_data *chdr, int flags)
+{
+    if (!wav->data)
+        return -1;
+    const int header_type = get_header_type(wav, chdr, flags);
+#ifdef WAV_HAVE_WRITEV
+    if (flags & (WAV_WRITE_VECTORED | WAV_WRITE_DIRECT))
+        return write_wav_file_fd(file_name, wav, chdr, header_type, flags);
+#endif
+    FILE *f = fopen(file_name, "wb");
+    if (!f)
+        return -1;
+    const int header_err = write_wav_header(f, wav, wav->num_bytes, chdr, header_type);
+    const size_t written = header_err ? 0 : fwrite(wav->data, 1, wav->num_bytes, f);
+    if (fclose(f) || header_err || written != wav->num_bytes)
+        return -1;
+    return 0;
+}
+
+int write_wav_memory(const struct wav_file *wav, const struct wav_file_custom_header_data *chdr, int flags, char *buffer,
+                     size_t capacity, size_t *size)
+{
+    if (!wav->data)
+        return -1;
+    const int header_type = get_header_type(wav, chdr, flags);
+    const size_t header_size = get_wav_header_size(chdr, header_type);
+    if (wav->num_bytes > SIZE_MAX - header_size)
+        return -1;
+    *size = header_size + wav->num_bytes;
+    if (*size > capacity)
+        return -1;
+    build_wav_header(buffer, wav, wav->num_bytes, chdr, header_type);
+    memcpy(buffer + header_size, wav->data, wav->num_bytes);
     return 0;
 }
 
-int create_wav_file(struct wav_file *wav, unsigned num_frames, unsigned channels, unsigned bit_depth, unsigned sample_rate)
+int write_wav_memory_alloc(const struct wav_file *wav, const struct wav_file_custom_header_data *chdr, int flags, char **buffer,
+                           size_t *capacity, size_t *size)
 {
-    unsigned num_bytes = bit_depth / 8 * num_frames * channels;
-    wav->data = (char *)malloc(num_bytes);
-    if (!wav->data)
+    if (!write_wav_memory(wav, chdr, flags, *buffer, *capacity, size))
+        return 0;
+    // Failed for a reason other than the capacity
+    if (!wav->data || *size <= *capacity)
+        return -1;
+    char *grown = (char *)realloc(*buffer, *size);
+    if (!grown)
+        return -1;
+    *buffer = grown;
+    *capacity = *size;
+    return write_wav_memory(wav, chdr, flags, *buffer, *capacity, size);
+}
+
+int create_wav_file(struct wav_file *wav, unsigned long long num_frames, unsigned channels, unsigned bit_depth, unsigned sample_rate)
+{
+    return create_wav_file_alloc(wav, num_frames, channels, bit_depth, sample_rate, NULL);
+}
+
+int create_wav_file_alloc(struct wav_file *wav, unsigned long long num_frames, unsigned channels, unsigned bit_depth,
+                          unsigned sample_rate, const struct wav_allocator *allocator)
+{
+    unsigned long long num_bytes = bit_depth / 8 * num_frames * channels;
+    if (num_bytes > SIZE_MAX)
         return -1;
+    char *data = (char *)wav_alloc(allocator, num_bytes);
+    if (!data)
+        return -1;
+    set_allocated_data(wav, data, allocator);
     memset(wav->data, 0, num_bytes);
     wav->channels = channels;
     wav->num_bytes = num_bytes;
@@ -180,17 +873,34 @@ int create_wav_file(struct wav_file *wav, unsigned num_frames, unsigned channels
     wav->bit_depth = bit_depth;
     wav->sample_rate = sample_rate;
     wav->is_float = 0;
+    wav->stats = NULL;
+    return 0;
+}
+
+int init_wav_file(struct wav_file *wav, char *data, unsigned long long num_frames, unsigned channels, unsigned bit_depth,
+                  unsigned sample_rate, int is_float)
+{
+    memset(wav, 0, sizeof(struct wav_file));
+    if (!data)
+        return -1;
+    wav->data = data;
+    wav->channels = channels;
+    wav->num_bytes = bit_depth / 8 * num_frames * channels;
+    wav->num_frames = num_frames;
+    wav->bit_depth = bit_depth;
+    wav->sample_rate = sample_rate;
+    wav->is_float = is_float;
     return 0;
 }
 
-int wav_get_normalized(const struct wav_file *wav, unsigned sample_idx, float *value)
+int wav_get_normalized(const struct wav_file *wav, unsigned long long sample_idx, float *value)
 {
     if (!wav->data)
         return -1;
     unsigned byte_depth = wav->bit_depth / 8;
     unsigned bytes_per_sample = byte_depth * wav->channels;
-    unsigned data_idx = bytes_per_sample * sample_idx;
-    if (data_idx > wav->num_bytes - bytes_per_sample)
+    unsigned long long data_idx = bytes_per_sample * sample_idx;
+    if (sample_idx >= wav->num_frames || data_idx > wav->num_bytes - bytes_per_sample)
         return -1;
     unsigned i;
     for (i = 0; i < wav->channels; i++)
@@ -244,15 +954,17 @@ int wav_get_normalized(const struct wav_file *wav, unsigned sample_idx, float *v
     return 0;
 }
 
-int wav_set_normalized(struct wav_file *wav, unsigned sample_idx, float *value)
+int wav_set_normalized(struct wav_file *wav, unsigned long long sample_idx, float *value)
 {
     if (!wav->data)
         return -1;
     unsigned byte_depth = wav->bit_depth / 8;
     unsigned bytes_per_sample = byte_depth * wav->channels;
-    unsigned data_idx = bytes_per_sample * sample_idx;
-    if (data_idx > wav->num_bytes - bytes_per_sample)
+    unsigned long long data_idx = bytes_per_sample * sample_idx;
+    if (sample_idx >= wav->num_frames || data_idx > wav->num_bytes - bytes_per_sample)
         return -1;
+    if (wav->stats)
+        wav_stats_remove_range(wav, sample_idx, 1);
     unsigned i;
     for (i = 0; i < wav->channels; i++)
     {
@@ -293,5 +1005,779 @@ int wav_set_normalized(struct wav_file *wav, unsigned sample_idx, float *value)
             *(double *)data_p = val;
         }
     }
+    if (wav->stats)
+        wav_stats_add_range(wav, sample_idx, 1);
+    return 0;
+}
+
+// Validates the frame range and returns a pointer to the first byte of frame first_frame or NULL on error.
+static char *get_range_data(const struct wav_file *wav, unsigned long long first_frame, unsigned num_frames)
+{
+    if (!wav->data || !wav->channels)
+        return NULL;
+    unsigned long long bytes_per_frame = wav->bit_depth / 8 * wav->channels;
+    if (first_frame > wav->num_frames || num_frames > wav->num_frames - first_frame)
+        return NULL;
+    unsigned long long range_end = (first_frame + num_frames) * bytes_per_frame;
+    if (range_end > wav->num_bytes)
+        return NULL;
+    return wav->data + first_frame * bytes_per_frame;
+}
+
+int wav_get_normalized_range(const struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, float *value)
+{
+    const int format = wav_sample_format(wav);
+    if (format == SAMPLE_FORMAT_UNSUPPORTED)
+        return -1;
+    const char *data_p = get_range_data(wav, first_frame, num_frames);
+    if (!data_p)
+        return -1;
+    wav_decode_samples(format, data_p, value, (size_t)num_frames * wav->channels);
+    return 0;
+}
+
+int wav_set_normalized_range(struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, const float *value)
+{
+    const int format = wav_sample_format(wav);
+    if (format == SAMPLE_FORMAT_UNSUPPORTED)
+        return -1;
+    char *data_p = get_range_data(wav, first_frame, num_frames);
+    if (!data_p)
+        return -1;
+    if (wav->stats)
+        wav_stats_remove_range(wav, first_frame, num_frames);
+    wav_encode_samples(format, value, data_p, (size_t)num_frames * wav->channels);
+    if (wav->stats)
+        wav_stats_add_range(wav, first_frame, num_frames);
+    return 0;
+}
+
+// Number of samples converted by one task of the parallel range functions: 256 KiB of floats stays in the L2 cache
+#define PARALLEL_BLOCK_SAMPLES (64 * 1024)
+
+struct parallel_range
+{
+    int format;
+    char *data;
+    float *value;
+    size_t num_samples;
+    unsigned bytes_per_sample;
+    int encode;
+};
+
+static void convert_range_task(void *ctx, unsigned long long idx)
+{
+    const struct parallel_range *range = (const struct parallel_range *)ctx;
+    const size_t first = idx * PARALLEL_BLOCK_SAMPLES;
+    const size_t n = range->num_samples - first < PARALLEL_BLOCK_SAMPLES ? range->num_samples - first : PARALLEL_BLOCK_SAMPLES;
+    if (range->encode)
+        wav_encode_samples(range->format, range->value + first, range->data + first * range->bytes_per_sample, n);
+    else
+        wav_decode_samples(range->format, range->data + first * range->bytes_per_sample, range->value + first, n);
+}
+
+static int convert_range_parallel(struct parallel_range *range, unsigned num_threads, const struct wav_executor *executor)
+{
+    const unsigned long long num_tasks = (range->num_samples + PARALLEL_BLOCK_SAMPLES - 1) / PARALLEL_BLOCK_SAMPLES;
+    if (num_tasks <= 1)
+    {
+        if (num_tasks)
+            convert_range_task(range, 0);
+        return 0;
+    }
+    if (executor)
+        return executor->run(executor->ctx, num_tasks, convert_range_task, range);
+    return wav_parallel_for(num_threads, num_tasks, convert_range_task, range);
+}
+
+int wav_get_normalized_range_parallel(const struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, float *value,
+                                      unsigned num_threads, const struct wav_executor *executor)
+{
+    const int format = wav_sample_format(wav);
+    if (format == SAMPLE_FORMAT_UNSUPPORTED)
+        return -1;
+    char *data_p = get_range_data(wav, first_frame, num_frames);
+    if (!data_p)
+        return -1;
+    struct parallel_range range = {format, data_p, value, (size_t)num_frames * wav->channels, wav->bit_depth / 8, 0};
+    return convert_range_parallel(&range, num_threads, executor);
+}
+
+int wav_set_normalized_range_parallel(struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, const float *value,
+                                      unsigned num_threads, const struct wav_executor *executor)
+{
+    const int format = wav_sample_format(wav);
+    if (format == SAMPLE_FORMAT_UNSUPPORTED)
+        return -1;
+    char *data_p = get_range_data(wav, first_frame, num_frames);
+    if (!data_p)
+        return -1;
+    // The values are only read when encoding
+    struct parallel_range range = {format, data_p, (float *)value, (size_t)num_frames * wav->channels, wav->bit_depth / 8, 1};
+    // The statistics are updated serially around the parallel conversion
+    if (wav->stats)
+        wav_stats_remove_range(wav, first_frame, num_frames);
+    const int err = convert_range_parallel(&range, num_threads, executor);
+    if (wav->stats)
+        wav_stats_add_range(wav, first_frame, num_frames);
+    return err;
+}
+
+int wav_get_normalized_planar(const struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, float *const *channels)
+{
+    const int format = wav_sample_format(wav);
+    if (format == SAMPLE_FORMAT_UNSUPPORTED || wav->channels > WAV_PLANAR_MAX_CHANNELS)
+        return -1;
+    const char *data_p = get_range_data(wav, first_frame, num_frames);
+    if (!data_p)
+        return -1;
+    wav_decode_planar(format, data_p, wav->channels, channels, 0, num_frames);
+    return 0;
+}
+
+int wav_set_normalized_planar(struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, const float *const *channels)
+{
+    const int format = wav_sample_format(wav);
+    if (format == SAMPLE_FORMAT_UNSUPPORTED || wav->channels > WAV_PLANAR_MAX_CHANNELS)
+        return -1;
+    char *data_p = get_range_data(wav, first_frame, num_frames);
+    if (!data_p)
+        return -1;
+    if (wav->stats)
+        wav_stats_remove_range(wav, first_frame, num_frames);
+    wav_encode_planar(format, channels, 0, wav->channels, data_p, num_frames);
+    if (wav->stats)
+        wav_stats_add_range(wav, first_frame, num_frames);
+    return 0;
+}
+
+// Samples re-encoded at a time by wav_convert_in_place
+#define CONVERT_BLOCK_SAMPLES 1024
+
+// Re-encodes num_samples samples from src to dst through a float block. When src and dst are the same buffer
+// the conversion runs front to back if the destination samples are not larger and back to front otherwise,
+// so that no source sample is overwritten before it has been decoded.
+static void reencode_samples(int src_format, unsigned src_bytes, const char *src, int dst_format, unsigned dst_bytes,
+                             char *dst, size_t num_samples)
+{
+    float block[CONVERT_BLOCK_SAMPLES];
+    const int back_to_front = src == dst && dst_bytes > src_bytes;
+    for (size_t done = 0; done < num_samples;)
+    {
+        const size_t n = num_samples - done < CONVERT_BLOCK_SAMPLES ? num_samples - done : CONVERT_BLOCK_SAMPLES;
+        const size_t first = back_to_front ? num_samples - done - n : done;
+        wav_decode_samples(src_format, src + first * src_bytes, block, n);
+        wav_encode_samples(dst_format, block, dst + first * dst_bytes, n);
+        done += n;
+    }
+}
+
+int wav_convert_in_place(struct wav_file *wav, unsigned bit_depth, int is_float)
+{
+    struct wav_file target = *wav;
+    target.bit_depth = bit_depth;
+    target.is_float = is_float;
+    const int src_format = wav_sample_format(wav);
+    const int dst_format = wav_sample_format(&target);
+    if (!wav->data || src_format == SAMPLE_FORMAT_UNSUPPORTED || dst_format == SAMPLE_FORMAT_UNSUPPORTED)
+        return -1;
+    if (src_format == dst_format)
+        return 0;
+    const unsigned src_bytes = wav->bit_depth / 8, dst_bytes = bit_depth / 8;
+    const size_t num_samples = (size_t)wav->num_frames * wav->channels;
+    const size_t num_bytes = num_samples * dst_bytes;
+    if (num_samples > SIZE_MAX / dst_bytes)
+        return -1;
+    if (!wav->release && dst_bytes > src_bytes)
+    {
+        // malloc'd data is grown in place by realloc when possible. Empty data keeps a byte, realloc to 0 bytes
+        // may free the buffer and return NULL.
+        char *data = (char *)realloc(wav->data, num_bytes ? num_bytes : 1);
+        if (!data)
+            return -1;
+        wav->data = data;
+        reencode_samples(src_format, src_bytes, data, dst_format, dst_bytes, data, num_samples);
+    }
+    else if (dst_bytes <= src_bytes && !is_read_only_mapping(wav) && wav->release != release_borrowed)
+    {
+        reencode_samples(src_format, src_bytes, wav->data, dst_format, dst_bytes, wav->data, num_samples);
+        if (!wav->release && num_bytes)
+        {
+            // Give the unused end back, failing to shrink is harmless
+            char *data = (char *)realloc(wav->data, num_bytes);
+            if (data)
+                wav->data = data;
+        }
+    }
+    else
+    {
+        // Buffers that can't be resized are replaced: a new one from the same allocator, or from malloc
+        // for mappings, caller-owned memory and other externally released data
+        const struct wav_allocator *allocator = wav->release == release_allocated ? (const struct wav_allocator *)wav->release_ctx : NULL;
+        char *data = (char *)wav_alloc(allocator, num_bytes ? num_bytes : 1);
+        if (!data)
+            return -1;
+        reencode_samples(src_format, src_bytes, wav->data, dst_format, dst_bytes, data, num_samples);
+        struct wav_stats *stats = wav->stats;
+        free_wav_file(wav);
+        set_allocated_data(wav, data, allocator);
+        wav->stats = stats;
+    }
+    wav->num_bytes = num_bytes;
+    wav->bit_depth = bit_depth;
+    wav->is_float = is_float;
+    // The samples have been quantized again
+    if (wav->stats)
+        wav_compute_stats(wav, wav->stats);
+    return 0;
+}
+
+#define WAV_READER_DEFAULT_BLOCK_FRAMES 4096
+#define WAV_PREFETCH_DEFAULT_BLOCKS 8
+// Blocks read ahead are at least this large, so that the hand-off between the threads stays cheap
+#define WAV_PREFETCH_MIN_BLOCK_BYTES 65536
+
+// Ring of blocks filled by the read-ahead thread of a reader. The blocks head ... head + count - 1 are
+// filled and owned by the consumer, the rest by the I/O thread.
+struct wav_prefetch
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    // Signaled when a block has been filled or the end of the data has been reached
+    pthread_cond_t filled;
+    // Signaled when a block has been consumed, or a seek or stop is requested
+    pthread_cond_t emptied;
+    // Serializes file access between the I/O thread and wav_reader_read_chunk
+    pthread_mutex_t io_lock;
+    unsigned num_blocks;
+    // Frames per block, at least block_frames of the reader
+    unsigned frames_per_block;
+    unsigned block_bytes;
+    char *blocks;
+    unsigned *block_frames;
+    unsigned head;
+    unsigned count;
+    // Frames of the head block already consumed
+    unsigned offset;
+    // Frame index of the next block read by the I/O thread
+    unsigned long long next_frame;
+    // Incremented on seek so that a block read for the old position is discarded
+    unsigned generation;
+    int seek_requested;
+    // The file position must be set before the next read, e.g. after reading a chunk
+    int io_seek_pending;
+    int end;
+    int error;
+    int stop;
+    struct wav_prefetch_stats stats;
+};
+
+struct wav_reader
+{
+    FILE *f;
+    struct wav_file format;
+    struct wav_chunk_index index;
+    unsigned long long data_offset;
+    unsigned long long position;
+    // Set when the file position doesn't match position, e.g. after reading a chunk
+    int seek_pending;
+    int sample_format;
+    unsigned bytes_per_frame;
+    unsigned block_frames;
+    char *block;
+    struct wav_prefetch *prefetch;
+};
+
+int wav_reader_open(struct wav_reader **reader, const char *file_name, struct wav_file_custom_header_data *chdr, unsigned block_frames)
+{
+    *reader = NULL;
+    struct wav_reader *r = (struct wav_reader *)calloc(1, sizeof(struct wav_reader));
+    if (!r)
+        return -1;
+    r->f = fopen(file_name, "rb");
+    if (!r->f)
+    {
+        free(r);
+        return -1;
+    }
+    struct wav_source src = file_source(r->f);
+    if (read_wav_header(&src, &r->format, &r->index, chdr, NULL))
+    {
+        wav_reader_close(r);
+        return -1;
+    }
+    r->data_offset = get_data_offset(&r->index);
+    r->seek_pending = 1;
+    r->sample_format = wav_sample_format(&r->format);
+    r->bytes_per_frame = r->format.bit_depth / 8 * r->format.channels;
+    r->block_frames = block_frames ? block_frames : WAV_READER_DEFAULT_BLOCK_FRAMES;
+    *reader = r;
+    return 0;
+}
+
+const struct wav_file *wav_reader_format(const struct wav_reader *reader)
+{
+    return &reader->format;
+}
+
+static unsigned long long monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *prefetch_thread(void *ctx)
+{
+    struct wav_reader *r = (struct wav_reader *)ctx;
+    struct wav_prefetch *p = r->prefetch;
+    pthread_mutex_lock(&p->lock);
+    for (;;)
+    {
+        while (!p->stop && !p->seek_requested && (p->count == p->num_blocks || p->end))
+            pthread_cond_wait(&p->emptied, &p->lock);
+        if (p->stop)
+            break;
+        // The consumer has already emptied the ring on seek
+        const int seek = p->seek_requested;
+        p->seek_requested = 0;
+        const unsigned slot = (p->head + p->count) % p->num_blocks;
+        const unsigned generation = p->generation;
+        const unsigned long long frame = p->next_frame;
+        const unsigned long long remaining = r->format.num_frames - frame;
+        const unsigned frames = remaining < p->frames_per_block ? (unsigned)remaining : p->frames_per_block;
+        pthread_mutex_unlock(&p->lock);
+
+        // The slot is not touched by the consumer until it's counted as filled
+        pthread_mutex_lock(&p->io_lock);
+        int err = (seek || p->io_seek_pending) && wav_fseek(r->f, r->data_offset + frame * r->bytes_per_frame, SEEK_SET);
+        p->io_seek_pending = 0;
+        const unsigned frames_read = err ? 0 : fread(p->blocks + (size_t)slot * p->block_bytes, 1, (size_t)frames * r->bytes_per_frame, r->f) / r->bytes_per_frame;
+        pthread_mutex_unlock(&p->io_lock);
+
+        pthread_mutex_lock(&p->lock);
+        if (generation != p->generation)
+            continue;
+        if (frames_read)
+        {
+            p->block_frames[slot] = frames_read;
+            p->count++;
+            p->next_frame += frames_read;
+            p->stats.blocks++;
+        }
+        // A short read ends the data like in the synchronous reader
+        if (frames_read < frames || !frames)
+            p->end = 1;
+        p->error = err;
+        pthread_cond_signal(&p->filled);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+// Copies num_frames frames from the ring to data, waiting for the I/O thread when it's empty.
+// Returns the number of frames copied or -1 on error.
+static int prefetch_read(struct wav_reader *r, char *data, unsigned num_frames)
+{
+    struct wav_prefetch *p = r->prefetch;
+    unsigned done = 0;
+    pthread_mutex_lock(&p->lock);
+    while (done < num_frames)
+    {
+        if (!p->count && !p->end)
+        {
+            const unsigned long long start = monotonic_ns();
+            while (!p->count && !p->end)
+                pthread_cond_wait(&p->filled, &p->lock);
+            p->stats.stalls++;
+            p->stats.wait_ns += monotonic_ns() - start;
+        }
+        if (!p->count)
+            break;
+        const unsigned slot = p->head, offset = p->offset;
+        const unsigned available = p->block_frames[slot] - offset;
+        const unsigned n = num_frames - done < available ? num_frames - done : available;
+        // The head block is owned by the consumer while it's counted
+        pthread_mutex_unlock(&p->lock);
+        memcpy(data + (size_t)done * r->bytes_per_frame, p->blocks + (size_t)slot * p->block_bytes + (size_t)offset * r->bytes_per_frame,
+               (size_t)n * r->bytes_per_frame);
+        pthread_mutex_lock(&p->lock);
+        done += n;
+        p->offset += n;
+        if (p->offset == p->block_frames[slot])
+        {
+            p->head = (p->head + 1) % p->num_blocks;
+            p->count--;
+            p->offset = 0;
+            pthread_cond_signal(&p->emptied);
+        }
+    }
+    const int err = !done && p->error;
+    pthread_mutex_unlock(&p->lock);
+    r->position += done;
+    return err ? -1 : (int)done;
+}
+
+// Discards the blocks read ahead and makes the I/O thread continue from frame
+static void prefetch_seek(struct wav_reader *r, unsigned long long frame)
+{
+    struct wav_prefetch *p = r->prefetch;
+    pthread_mutex_lock(&p->lock);
+    p->generation++;
+    p->head = p->count = p->offset = 0;
+    p->next_frame = frame;
+    p->end = p->error = 0;
+    p->seek_requested = 1;
+    pthread_cond_signal(&p->emptied);
+    pthread_mutex_unlock(&p->lock);
+    r->position = frame;
+}
+
+// Stops the I/O thread and frees the ring
+static void prefetch_stop(struct wav_reader *r)
+{
+    struct wav_prefetch *p = r->prefetch;
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_signal(&p->emptied);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+    pthread_mutex_destroy(&p->lock);
+    pthread_mutex_destroy(&p->io_lock);
+    pthread_cond_destroy(&p->filled);
+    pthread_cond_destroy(&p->emptied);
+    free(p->blocks);
+    free(p->block_frames);
+    free(p);
+    r->prefetch = NULL;
+}
+
+int wav_reader_prefetch(struct wav_reader *reader, unsigned num_blocks)
+{
+    if (reader->prefetch || !reader->bytes_per_frame)
+        return -1;
+    struct wav_prefetch *p = (struct wav_prefetch *)calloc(1, sizeof(struct wav_prefetch));
+    if (!p)
+        return -1;
+    p->num_blocks = num_blocks ? num_blocks : WAV_PREFETCH_DEFAULT_BLOCKS;
+    p->frames_per_block = reader->block_frames;
+    if (p->frames_per_block < WAV_PREFETCH_MIN_BLOCK_BYTES / reader->bytes_per_frame)
+        p->frames_per_block = WAV_PREFETCH_MIN_BLOCK_BYTES / reader->bytes_per_frame;
+    p->block_bytes = p->frames_per_block * reader->bytes_per_frame;
+    p->blocks = (char *)malloc((size_t)p->num_blocks * p->block_bytes);
+    p->block_frames = (unsigned *)malloc(p->num_blocks * sizeof(unsigned));
+    p->next_frame = reader->position;
+    p->io_seek_pending = 1;
+    if (!p->blocks || !p->block_frames)
+    {
+        free(p->blocks);
+        free(p->block_frames);
+        free(p);
+        return -1;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_mutex_init(&p->io_lock, NULL);
+    pthread_cond_init(&p->filled, NULL);
+    pthread_cond_init(&p->emptied, NULL);
+    reader->prefetch = p;
+    if (pthread_create(&p->thread, NULL, prefetch_thread, reader))
+    {
+        pthread_mutex_destroy(&p->lock);
+        pthread_mutex_destroy(&p->io_lock);
+        pthread_cond_destroy(&p->filled);
+        pthread_cond_destroy(&p->emptied);
+        free(p->blocks);
+        free(p->block_frames);
+        free(p);
+        reader->prefetch = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int wav_reader_prefetch_stats(struct wav_reader *reader, struct wav_prefetch_stats *stats)
+{
+    struct wav_prefetch *p = reader->prefetch;
+    if (!p)
+        return -1;
+    pthread_mutex_lock(&p->lock);
+    *stats = p->stats;
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+int wav_reader_read_raw(struct wav_reader *reader, char *data, unsigned num_frames)
+{
+    if (reader->prefetch)
+        return prefetch_read(reader, data, num_frames);
+    if (reader->seek_pending && wav_reader_seek(reader, reader->position))
+        return -1;
+    const unsigned long long remaining = reader->format.num_frames - reader->position;
+    if (num_frames > remaining)
+        num_frames = remaining;
+    const unsigned frames_read = fread(data, 1, (size_t)num_frames * reader->bytes_per_frame, reader->f) / reader->bytes_per_frame;
+    reader->position += frames_read;
+    return frames_read;
+}
+
+// Reads num_frames frames block by block converting them to interleaved value, or to the planar channel arrays
+// if value is NULL
+static int reader_read_converted(struct wav_reader *reader, float *value, float *const *channels, unsigned num_frames)
+{
+    if (reader->sample_format == SAMPLE_FORMAT_UNSUPPORTED)
+        return -1;
+    if (!reader->block)
+    {
+        // Allocated on first use so that readers used only for the metadata don't allocate anything
+        reader->block = (char *)malloc((size_t)reader->block_frames * reader->bytes_per_frame);
+        if (!reader->block)
+            return -1;
+    }
+    unsigned done = 0;
+    while (done < num_frames)
+    {
+        const unsigned block_frames = num_frames - done < reader->block_frames ? num_frames - done : reader->block_frames;
+        const int frames_read = wav_reader_read_raw(reader, reader->block, block_frames);
+        if (frames_read < 0)
+            return -1;
+        if (value)
+            wav_decode_samples(reader->sample_format, reader->block, value + (size_t)done * reader->format.channels,
+                               (size_t)frames_read * reader->format.channels);
+        else
+            wav_decode_planar(reader->sample_format, reader->block, reader->format.channels, channels, done, frames_read);
+        done += frames_read;
+        if ((unsigned)frames_read < block_frames)
+            break;
+    }
+    return done;
+}
+
+int wav_reader_read(struct wav_reader *reader, float *value, unsigned num_frames)
+{
+    return reader_read_converted(reader, value, NULL, num_frames);
+}
+
+int wav_reader_read_planar(struct wav_reader *reader, float *const *channels, unsigned num_frames)
+{
+    if (reader->format.channels > WAV_PLANAR_MAX_CHANNELS)
+        return -1;
+    return reader_read_converted(reader, NULL, channels, num_frames);
+}
+
+int wav_reader_seek(struct wav_reader *reader, unsigned long long frame)
+{
+    if (frame > reader->format.num_frames)
+        return -1;
+    if (reader->prefetch)
+    {
+        prefetch_seek(reader, frame);
+        return 0;
+    }
+    if (wav_fseek(reader->f, reader->data_offset + frame * reader->bytes_per_frame, SEEK_SET))
+        return -1;
+    reader->position = frame;
+    reader->seek_pending = 0;
+    return 0;
+}
+
+unsigned long long wav_reader_position(const struct wav_reader *reader)
+{
+    return reader->position;
+}
+
+const struct wav_chunk_index *wav_reader_chunks(const struct wav_reader *reader)
+{
+    return &reader->index;
+}
+
+int wav_reader_read_chunk(struct wav_reader *reader, struct wav_file_custom_header_data *chdr)
+{
+    const struct wav_chunk_info *chunk = find_chunk(&reader->index, chdr->header_name);
+    if (!chunk)
+        return -1;
+    struct wav_source src = file_source(reader->f);
+    if (reader->prefetch)
+    {
+        // The I/O thread restores its file position before its next read
+        pthread_mutex_lock(&reader->prefetch->io_lock);
+        const int err = read_chunk(&src, chunk, chdr, NULL);
+        reader->prefetch->io_seek_pending = 1;
+        pthread_mutex_unlock(&reader->prefetch->io_lock);
+        return err;
+    }
+    reader->seek_pending = 1;
+    return read_chunk(&src, chunk, chdr, NULL);
+}
+
+int wav_reader_close(struct wav_reader *reader)
+{
+    if (!reader)
+        return -1;
+    if (reader->prefetch)
+        prefetch_stop(reader);
+    if (reader->f)
+        fclose(reader->f);
+    wav_free_chunk_index(&reader->index);
+    free(reader->block);
+    free(reader);
+    return 0;
+}
+
+struct wav_writer
+{
+    FILE *f;
+    struct wav_file format;
+    long long data_size_offset;
+    int force_rf64;
+    int sample_format;
+    unsigned bytes_per_frame;
+    unsigned block_frames;
+    char *block;
+    int error;
+};
+
+int wav_writer_open(struct wav_writer **writer, const char *file_name, const struct wav_file *format,
+                    const struct wav_file_custom_header_data *chdr, unsigned block_frames, int flags)
+{
+    *writer = NULL;
+    if (!format->channels || format->bit_depth < 8)
+        return -1;
+    struct wav_writer *w = (struct wav_writer *)calloc(1, sizeof(struct wav_writer));
+    if (!w)
+        return -1;
+    w->f = fopen(file_name, "wb");
+    if (!w->f)
+    {
+        free(w);
+        return -1;
+    }
+    w->format = *format;
+    w->format.data = NULL;
+    w->format.num_bytes = 0;
+    w->format.num_frames = 0;
+    w->format.release = NULL;
+    w->format.release_ctx = NULL;
+    w->format.stats = NULL;
+    w->sample_format = wav_sample_format(&w->format);
+    w->bytes_per_frame = w->format.bit_depth / 8 * w->format.channels;
+    w->block_frames = block_frames ? block_frames : WAV_READER_DEFAULT_BLOCK_FRAMES;
+    // The sizes are written as zero and patched in wav_writer_close. The final size is not known yet,
+    // so space is reserved for converting the header to RF64.
+    w->force_rf64 = flags & WAV_WRITE_RF64;
+    const int header_err = write_wav_header(w->f, &w->format, 0, chdr, HEADER_RIFF_RESERVE_DS64);
+    w->data_size_offset = wav_ftell(w->f) - sizeof(unsigned);
+    if (header_err || ferror(w->f))
+    {
+        wav_writer_close(w);
+        return -1;
+    }
+    *writer = w;
+    return 0;
+}
+
+int wav_writer_write_raw(struct wav_writer *writer, const char *data, unsigned num_frames)
+{
+    const size_t num_bytes = (size_t)num_frames * writer->bytes_per_frame;
+    if (writer->error)
+        return -1;
+    if (fwrite(data, 1, num_bytes, writer->f) != num_bytes)
+    {
+        writer->error = 1;
+        return -1;
+    }
+    writer->format.num_bytes += num_bytes;
+    writer->format.num_frames += num_frames;
+    return 0;
+}
+
+// Converts num_frames frames from interleaved value, or from the planar channel arrays if value is NULL,
+// and writes them block by block
+static int writer_write_converted(struct wav_writer *writer, const float *value, const float *const *channels, unsigned num_frames)
+{
+    if (writer->sample_format == SAMPLE_FORMAT_UNSUPPORTED)
+        return -1;
+    if (!writer->block)
+    {
+        writer->block = (char *)malloc((size_t)writer->block_frames * writer->bytes_per_frame);
+        if (!writer->block)
+            return -1;
+    }
+    unsigned done = 0;
+    while (done < num_frames)
+    {
+        const unsigned block_frames = num_frames - done < writer->block_frames ? num_frames - done : writer->block_frames;
+        if (value)
+            wav_encode_samples(writer->sample_format, value + (size_t)done * writer->format.channels, writer->block,
+                               (size_t)block_frames * writer->format.channels);
+        else
+            wav_encode_planar(writer->sample_format, channels, done, writer->format.channels, writer->block, block_frames);
+        if (wav_writer_write_raw(writer, writer->block, block_frames))
+            return -1;
+        done += block_frames;
+    }
     return 0;
 }
+
+int wav_writer_write(struct wav_writer *writer, const float *value, unsigned num_frames)
+{
+    return writer_write_converted(writer, value, NULL, num_frames);
+}
+
+int wav_writer_write_planar(struct wav_writer *writer, const float *const *channels, unsigned num_frames)
+{
+    if (writer->format.channels > WAV_PLANAR_MAX_CHANNELS)
+        return -1;
+    return writer_write_converted(writer, NULL, channels, num_frames);
+}
+
+const struct wav_file *wav_writer_format(const struct wav_writer *writer)
+{
+    return &writer->format;
+}
+
+int wav_writer_close(struct wav_writer *writer)
+{
+    if (!writer)
+        return -1;
+    int err = writer->error;
+    if (writer->f)
+    {
+        if (!err && writer->data_size_offset > 0)
+        {
+            const unsigned long long riff_size = wav_ftell(writer->f) - 8;
+            if (writer->force_rf64 || riff_size > RIFF_MAX_SIZE)
+            {
+                // Replace the reserved JUNK chunk with ds64 and mark the 32 bit sizes as unused
+                const unsigned unused_size = RIFF_MAX_SIZE;
+                err = wav_fseek(writer->f, 0, SEEK_SET) ||
+                      fwrite("RF64", 1, 4, writer->f) != 4 ||
+                      fwrite(&unused_size, sizeof(unsigned), 1, writer->f) != 1 ||
+                      wav_fseek(writer->f, 12, SEEK_SET) ||
+                      fwrite("ds64", 1, 4, writer->f) != 4 ||
+                      wav_fseek(writer->f, 4, SEEK_CUR);
+                if (!err)
+                {
+                    char ds64[DS64_SIZE];
+                    put_ds64_data(ds64, riff_size, writer->format.num_bytes, writer->format.num_frames);
+                    err = fwrite(ds64, 1, DS64_SIZE, writer->f) != DS64_SIZE ||
+                          wav_fseek(writer->f, writer->data_size_offset, SEEK_SET) ||
+                          fwrite(&unused_size, sizeof(unsigned), 1, writer->f) != 1;
+                }
+            }
+            else
+            {
+                const unsigned riff_size32 = riff_size;
+                const unsigned data_size32 = writer->format.num_bytes;
+                err = wav_fseek(writer->f, 4, SEEK_SET) ||
+                      fwrite(&riff_size32, sizeof(unsigned), 1, writer->f) != 1 ||
+                      wav_fseek(writer->f, writer->data_size_offset, SEEK_SET) ||
+                      fwrite(&data_size32, sizeof(unsigned), 1, writer->f) != 1;
+            }
+        }
+        if (fclose(writer->f))
+            err = 1;
+    }
+    free(writer->block);
+    free(writer);
+    return err ? -1 : 0;
+}
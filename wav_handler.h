@@ -1,15 +1,27 @@
 #ifndef WAV_HANDLER_H
 #define WAV_HANDLER_H
 
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+struct wav_stats;
+
 /**
  * @brief Data container for a RIFF file 
+ *
+ * The fields release, release_ctx and stats are read by free_wav_file and the set functions, so they must be
+ * zero in a wave file filled in by hand. init_wav_file initializes all fields for data allocated by the caller.
  */
 struct wav_file
 {
    /**
-    * @brief Total number of bytes in data
+    * @brief Total number of bytes in data. 64 bits wide because RF64 files may exceed 4 GiB.
     */
-   unsigned num_bytes;
+   unsigned long long num_bytes;
    /**
     * @brief Number of channels
     */
@@ -21,7 +33,7 @@ struct wav_file
     * 
     * num_frames = num_bytes / (channels * byte_per_sample)
     */
-   unsigned num_frames;
+   unsigned long long num_frames;
    /**
     * @brief Sample rate in Hz
     */
@@ -38,6 +50,20 @@ struct wav_file
     * @brief The data as a binary blob. Length in num_bytes.
     */
    char *data;
+   /**
+    * @brief Function used by free_wav_file to release data, or NULL if data was allocated with malloc.
+    * Set by the functions that initialize the wave file.
+    */
+   void (*release)(void *ctx, char *data);
+   /**
+    * @brief Context pointer passed to release.
+    */
+   void *release_ctx;
+   /**
+    * @brief Statistics kept up to date by the set functions, or NULL. Set with wav_track_stats,
+    * NULL after the functions that initialize the wave file.
+    */
+   struct wav_stats *stats;
 };
 
 /**
@@ -60,27 +86,159 @@ struct wav_file_custom_header_data
    char *data;
 };
 
+/**
+ * @brief Location of a chunk in a RIFF file.
+ */
+struct wav_chunk_info
+{
+   /**
+    * @brief The chunk id (four characters + terminating 0).
+    */
+   char id[5];
+   /**
+    * @brief Offset of the chunk contents from the beginning of the file in bytes.
+    */
+   unsigned long long offset;
+   /**
+    * @brief Size of the chunk contents in bytes.
+    */
+   unsigned long long size;
+};
+
+/**
+ * @brief Index of all chunks in a RIFF file in file order. Built in a single pass when a file is opened.
+ */
+struct wav_chunk_index
+{
+   /**
+    * @brief Number of chunks.
+    */
+   unsigned num_chunks;
+   /**
+    * @brief The chunks, length in num_chunks.
+    */
+   struct wav_chunk_info *chunks;
+};
+
+/**
+ * @brief Memory allocator used for the sample data and custom header data by the *_alloc functions.
+ */
+struct wav_allocator
+{
+   /**
+    * @brief Allocate size bytes. Returns NULL on failure.
+    */
+   void *(*alloc)(void *ctx, size_t size);
+   /**
+    * @brief Free memory allocated with alloc.
+    */
+   void (*free)(void *ctx, void *ptr);
+   /**
+    * @brief Context pointer passed to alloc and free.
+    */
+   void *ctx;
+};
+
+/**
+ * @brief Free a chunk index.
+ *
+ * Returns 0 on success.
+ */
+int wav_free_chunk_index(struct wav_chunk_index *index);
+
 /**
  * @brief Read wav file without custom header information. See read_wav_file_chdr for more information.
  */
 int read_wav_file(const char *file_name, struct wav_file *wav);
 
 /**
- * @brief Read wav file and populate the wave file given as parameter.
+ * @brief Read wav file and populate the wave file given as parameter. Both RIFF and RF64/BW64 files are supported.
  * 
  * Parameter chdr contains an array of wav_file_custom_header_data. The list must be terminated
  * by an instance where header_name field is empty (i.e. header_name[] = {0}).
  * The list tells the file reader what custom headers should be read.
  * The fields num_bytes and data in list items will be populated if the custom header is found.
  * The logic assumes that data is set to NULL on init.
+ *
+ * The file is indexed in a single pass, so only the headers listed in chdr and the data are read.
  * 
  * Returns 0 on success.
  */
 int read_wav_file_chdr(const char *file_name, struct wav_file *wav, struct wav_file_custom_header_data *chdr);
 
 /**
- * @brief Free allocated wave file. Files allocated using read_wav_file(_chdr) and create_wav_file must
- * be freed using this function after use.
+ * @brief Read wav file like read_wav_file_chdr, but allocate the data and the custom header data using allocator
+ * instead of malloc. If allocator is NULL malloc is used.
+ *
+ * The allocator must stay valid until the file is freed: free_wav_file releases the data with allocator->free.
+ * The custom header data must be released by the caller with allocator->free.
+ *
+ * Returns 0 on success.
+ */
+int read_wav_file_alloc(const char *file_name, struct wav_file *wav, struct wav_file_custom_header_data *chdr,
+                        const struct wav_allocator *allocator);
+
+/**
+ * @brief Flag for read_wav_file_mmap: map the file read-only and shared between processes.
+ */
+#define WAV_MMAP_READ_ONLY 1
+
+/**
+ * @brief Read wav file by memory mapping it instead of copying the data chunk to an allocated buffer.
+ * The data field points straight into the mapping at the data chunk offset and the pages are loaded
+ * on demand. The mapping is released by free_wav_file. Custom headers are read as in read_wav_file_chdr.
+ *
+ * By default the mapping is private: the data can be modified but the changes are not written to the file.
+ * If flags contains WAV_MMAP_READ_ONLY the mapping is read-only and shared, so several processes mapping
+ * the same file share the same pages. Modifying the data (e.g. with wav_set_normalized) is not allowed
+ * in this mode.
+ *
+ * Only supported on POSIX systems; returns an error on other platforms.
+ *
+ * Returns 0 on success.
+ */
+int read_wav_file_mmap(const char *file_name, struct wav_file *wav, struct wav_file_custom_header_data *chdr, int flags);
+
+/**
+ * @brief Flag for read_wav_memory: point the data field into the caller's buffer instead of copying it.
+ */
+#define WAV_MEMORY_ZERO_COPY 1
+
+/**
+ * @brief Parse a complete wave file from the size bytes in buffer, e.g. a payload received over the network,
+ * without going through the file system. Custom headers are read as in read_wav_file_chdr. All formats
+ * accepted by read_wav_file are supported, but the data chunk must be complete.
+ *
+ * By default the data is copied to a buffer allocated with malloc. If flags contains WAV_MEMORY_ZERO_COPY
+ * the data field points into buffer, which must then outlive the wave file and is not released by
+ * free_wav_file. The samples may only be modified in this mode if buffer is writable. wav_convert_in_place
+ * never writes to the buffer.
+ *
+ * Returns 0 on success, or -1 if the buffer doesn't contain a valid wave file.
+ */
+int read_wav_memory(const void *buffer, size_t size, struct wav_file *wav, struct wav_file_custom_header_data *chdr, int flags);
+
+/**
+ * @brief Read only the format of a wav file. All fields of wav except data are populated, data is set to NULL
+ * and no sample data is read. Custom headers listed in chdr are read as in read_wav_file_chdr and can be NULL.
+ * The wav file does not need to be freed unless custom headers were read, in which case their data must be freed.
+ *
+ * Returns 0 on success.
+ */
+int wav_probe(const char *file_name, struct wav_file *wav, struct wav_file_custom_header_data *chdr);
+
+/**
+ * @brief Probe num_files files concurrently using wav_probe. The format of file_names[i] is stored to wavs[i] and
+ * the return value of wav_probe to results[i] if results is not NULL. The files are probed on num_threads threads,
+ * or on as many threads as there are processors if num_threads is 0.
+ *
+ * Returns 0 if all the files were probed successfully.
+ */
+int wav_probe_batch(const char *const *file_names, unsigned num_files, struct wav_file *wavs, int *results, unsigned num_threads);
+
+/**
+ * @brief Free allocated wave file. Files allocated using read_wav_file(_chdr), read_wav_file_mmap,
+ * read_wav_memory and create_wav_file must be freed using this function after use.
  * 
  * Returns 0 on success.
  */
@@ -103,13 +261,124 @@ int write_wav_file(const char *file_name, const struct wav_file *wav);
  */
 int write_wav_file_chdr(const char *file_name, const struct wav_file *wav, const struct wav_file_custom_header_data *chdr);
 
+/**
+ * @brief Flag for write_wav_file_ex and wav_writer_open: write an RF64 file even if the data would
+ * fit into a RIFF file.
+ */
+#define WAV_WRITE_RF64 1
+
+/**
+ * @brief Flag for write_wav_file_ex: build the whole header including the custom headers in one buffer
+ * and write it together with the data in a single writev call on a file descriptor, instead of going
+ * through stdio. Fewer and larger writes help on networked file systems. Ignored where writev is not
+ * available and by wav_writer_open.
+ */
+#define WAV_WRITE_VECTORED 2
+
+/**
+ * @brief Flag for write_wav_file_ex: like WAV_WRITE_VECTORED, but data larger than 1 MiB is written with
+ * O_DIRECT in aligned 1 MiB blocks, bypassing the page cache. The unaligned end of the file is written
+ * normally. Falls back to WAV_WRITE_VECTORED where direct I/O is not supported by the system or the
+ * file system. Ignored by wav_writer_open.
+ */
+#define WAV_WRITE_DIRECT 4
+
+/**
+ * @brief Writes wav to file like write_wav_file_chdr, with flags controlling how the file is written.
+ *
+ * Files whose RIFF size exceeds 4 GiB are always written in RF64 format, with the 64 bit sizes
+ * in a ds64 chunk. WAV_WRITE_RF64 forces the RF64 format also for smaller files.
+ *
+ * Returns 0 on success.
+ */
+int write_wav_file_ex(const char *file_name, const struct wav_file *wav, const struct wav_file_custom_header_data *chdr, int flags);
+
+/**
+ * @brief Serialize wav with the custom headers in chdr (see write_wav_file_chdr) into buffer, which holds
+ * capacity bytes. The size of the serialized file is stored to size even if it doesn't fit, so the buffer
+ * can be sized with a first call with capacity 0. Of the flags only WAV_WRITE_RF64 has an effect.
+ *
+ * Returns 0 on success, or -1 if the file doesn't fit into buffer or wav has no data.
+ */
+int write_wav_memory(const struct wav_file *wav, const struct wav_file_custom_header_data *chdr, int flags, char *buffer,
+                     size_t capacity, size_t *size);
+
+/**
+ * @brief Serialize wav like write_wav_memory into *buffer, a buffer allocated with malloc or NULL, of
+ * *capacity bytes. The buffer is grown with realloc if needed and *capacity updated, so reusing the same
+ * buffer for many files allocates only when a file is larger than all the previous ones. The buffer must be
+ * freed by the caller with free.
+ *
+ * Returns 0 on success.
+ */
+int write_wav_memory_alloc(const struct wav_file *wav, const struct wav_file_custom_header_data *chdr, int flags, char **buffer,
+                           size_t *capacity, size_t *size);
+
 /**
  * @brief Creates an all-zeroes wave file with the provided length in n-channel samples, number of channels,
  * bit depth (bits) and sample rate (Hz).
  * 
  * Returns 0 on success.
  */
-int create_wav_file(struct wav_file *wav, unsigned num_frames, unsigned channels, unsigned bit_depth, unsigned sample_rate);
+int create_wav_file(struct wav_file *wav, unsigned long long num_frames, unsigned channels, unsigned bit_depth, unsigned sample_rate);
+
+/**
+ * @brief Creates an all-zeroes wave file like create_wav_file, but allocates the data using allocator instead of
+ * malloc. If allocator is NULL malloc is used. The allocator must stay valid until the file is freed.
+ *
+ * Returns 0 on success.
+ */
+int create_wav_file_alloc(struct wav_file *wav, unsigned long long num_frames, unsigned channels, unsigned bit_depth,
+                          unsigned sample_rate, const struct wav_allocator *allocator);
+
+/**
+ * @brief Initializes all fields of wav for data of num_frames n-channel samples in the given format, which the
+ * caller allocated with malloc. free_wav_file frees data with free. Use this instead of filling in the fields
+ * by hand, so that the fields for the allocator and the statistics are cleared.
+ *
+ * Returns 0 on success.
+ */
+int init_wav_file(struct wav_file *wav, char *data, unsigned long long num_frames, unsigned channels, unsigned bit_depth,
+                  unsigned sample_rate, int is_float);
+
+/**
+ * @brief An arena allocator that hands out memory from large blocks and releases it all at once. Allocating
+ * from an arena costs a pointer increment and freeing is a no-op, so loading and discarding many files
+ * has next to no allocator overhead. An arena must only be used by one thread at a time; use one arena
+ * per thread in multithreaded jobs.
+ */
+struct wav_arena;
+
+/**
+ * @brief Create an arena that allocates memory from the system in blocks of block_size bytes
+ * (0 for the default of 1 MiB). Allocations larger than half a block get a block of their own.
+ * All allocations are aligned to 64 bytes.
+ *
+ * Returns 0 on success.
+ */
+int wav_arena_create(struct wav_arena **arena, size_t block_size);
+
+/**
+ * @brief Get the allocator that allocates from the arena, for use with the *_alloc functions.
+ * The allocator is valid until the arena is destroyed.
+ */
+const struct wav_allocator *wav_arena_allocator(struct wav_arena *arena);
+
+/**
+ * @brief Release all memory allocated from the arena at once. The blocks are kept for reuse, except the
+ * ones of large allocations. Files allocated from the arena must not be used after this, and calling
+ * free_wav_file for them is not needed.
+ *
+ * Returns 0 on success.
+ */
+int wav_arena_reset(struct wav_arena *arena);
+
+/**
+ * @brief Release all memory allocated from the arena and the arena itself.
+ *
+ * Returns 0 on success.
+ */
+int wav_arena_destroy(struct wav_arena *arena);
 
 /**
  * @brief Get an n-channel sample into value pointer from index sample_idx. The sample is normalized to
@@ -124,7 +393,7 @@ int create_wav_file(struct wav_file *wav, unsigned num_frames, unsigned channels
  * 
  * Returns 0 on success.
  */
-int wav_get_normalized(const struct wav_file *wav, unsigned sample_idx, float *value);
+int wav_get_normalized(const struct wav_file *wav, unsigned long long sample_idx, float *value);
 
 /**
  * @brief Set an n-channel sample from value pointer to index sample_idx. The sample should be in range
@@ -135,6 +404,968 @@ int wav_get_normalized(const struct wav_file *wav, unsigned sample_idx, float *v
  * 
  * Returns 0 on success.
  */
-int wav_set_normalized(struct wav_file *wav, unsigned sample_idx, float *value);
+int wav_set_normalized(struct wav_file *wav, unsigned long long sample_idx, float *value);
+
+/**
+ * @brief Get num_frames n-channel samples starting from index first_frame into value pointer. The samples are
+ * normalized to the range -1.0f ... 1.0f and stored interleaved, so value must contain at least
+ * num_frames * channels elements.
+ *
+ * The sample format is resolved once per call, which makes this considerably faster than calling
+ * wav_get_normalized for each frame. The results are identical to wav_get_normalized.
+ *
+ * Same format restrictions apply as in wav_get_normalized. Unsupported formats are reported as errors.
+ *
+ * Returns 0 on success.
+ */
+int wav_get_normalized_range(const struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, float *value);
+
+/**
+ * @brief Set num_frames n-channel samples starting from index first_frame from interleaved value pointer.
+ * Samples outside of the range -1.0f ... 1.0f are clipped. The value pointer must contain at least
+ * num_frames * channels elements.
+ *
+ * The results are identical to calling wav_set_normalized for each frame.
+ *
+ * Same format restrictions apply as in wav_get_normalized_range.
+ *
+ * Returns 0 on success.
+ */
+int wav_set_normalized_range(struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, const float *value);
+
+/**
+ * @brief A task run by an executor. task_idx is between 0 and num_tasks - 1.
+ */
+typedef void (*wav_task_fn)(void *ctx, unsigned long long task_idx);
+
+/**
+ * @brief Executor for running the tasks of the parallel functions on a caller-supplied thread pool.
+ */
+struct wav_executor
+{
+   /**
+    * @brief Run task(task_ctx, i) for every i in 0 ... num_tasks - 1 and return when all of them have finished.
+    * The tasks are independent of each other and can run in any order and on any threads.
+    * Returns 0 on success.
+    */
+   int (*run)(void *ctx, unsigned long long num_tasks, wav_task_fn task, void *task_ctx);
+   /**
+    * @brief Context pointer passed to run.
+    */
+   void *ctx;
+};
+
+/**
+ * @brief Like wav_get_normalized_range, but the frame range is split into cache-sized blocks that are converted
+ * in parallel. The blocks are run with executor, or on num_threads threads (0 for one per processor) of the
+ * library's thread pool, whose threads are started once and reused by later calls, if executor is NULL.
+ * The results are identical to wav_get_normalized_range.
+ *
+ * Parallel conversion pays off for large ranges (megabytes of data); smaller ranges are converted in the
+ * calling thread.
+ *
+ * Returns 0 on success.
+ */
+int wav_get_normalized_range_parallel(const struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, float *value,
+                                      unsigned num_threads, const struct wav_executor *executor);
+
+/**
+ * @brief Like wav_set_normalized_range, but the conversion is run in parallel as in wav_get_normalized_range_parallel.
+ * The results are identical to wav_set_normalized_range.
+ *
+ * Returns 0 on success.
+ */
+int wav_set_normalized_range_parallel(struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, const float *value,
+                                      unsigned num_threads, const struct wav_executor *executor);
+
+/**
+ * @brief Maximum number of channels supported by the planar functions.
+ */
+#define WAV_PLANAR_MAX_CHANNELS 16
+
+/**
+ * @brief Get num_frames n-channel samples starting from index first_frame into planar (deinterleaved) channel
+ * arrays: the samples of channel c are stored to channels[c][0] ... channels[c][num_frames - 1]. There must be
+ * a pointer for each channel of wav. The format conversion and deinterleaving are done in the same pass.
+ *
+ * The values are identical to the ones returned by wav_get_normalized_range.
+ *
+ * Same format restrictions apply as in wav_get_normalized_range and the number of channels must be at most
+ * WAV_PLANAR_MAX_CHANNELS.
+ *
+ * Returns 0 on success.
+ */
+int wav_get_normalized_planar(const struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, float *const *channels);
+
+/**
+ * @brief Set num_frames n-channel samples starting from index first_frame from planar (deinterleaved) channel
+ * arrays: the samples of channel c are read from channels[c][0] ... channels[c][num_frames - 1].
+ * Samples outside of the range -1.0f ... 1.0f are clipped.
+ *
+ * The results are identical to calling wav_set_normalized_range with the interleaved samples.
+ *
+ * Same format restrictions apply as in wav_get_normalized_planar.
+ *
+ * Returns 0 on success.
+ */
+int wav_set_normalized_planar(struct wav_file *wav, unsigned long long first_frame, unsigned num_frames, const float *const *channels);
+
+/**
+ * @brief Re-encode the data of wav to a new sample format without a second full-size buffer, updating
+ * num_bytes, bit_depth and is_float. The samples are converted through normalized floats, so values are
+ * clipped and rounded like with wav_set_normalized_range.
+ *
+ * When the new format is not larger the data is converted front to back in the same buffer. When it's larger,
+ * data allocated with malloc is grown with realloc and converted back to front. Other data that can't be
+ * resized is converted into a new buffer from the same allocator, or from malloc for memory mappings, and the
+ * old buffer is released. Read-only mappings always get a new buffer.
+ *
+ * Returns 0 on success. On failure wav is left unchanged.
+ */
+int wav_convert_in_place(struct wav_file *wav, unsigned bit_depth, int is_float);
+
+/**
+ * @brief Maximum number of channels of the statistics functions.
+ */
+#define WAV_STATS_MAX_CHANNELS 16
+
+/**
+ * @brief Id of the chunk the statistics are stored in by wav_stats_chunks.
+ */
+#define WAV_STATS_CHUNK_ID "whst"
+
+/**
+ * @brief Statistics of one channel in normalized sample values.
+ */
+struct wav_channel_stats
+{
+   /**
+    * @brief Largest absolute sample value.
+    */
+   float peak;
+   /**
+    * @brief Frame index of the first sample with the peak value.
+    */
+   unsigned long long peak_frame;
+   /**
+    * @brief Sum of the samples, see wav_stats_dc_offset.
+    */
+   double sum;
+   /**
+    * @brief Sum of the squared samples, see wav_stats_rms.
+    */
+   double sum_squares;
+   /**
+    * @brief Set if the peak sample has been overwritten by a smaller value since the statistics were
+    * computed, so peak is only an upper bound. See wav_refresh_stats.
+    */
+   int peak_stale;
+};
+
+/**
+ * @brief Per-channel peak, RMS and DC offset statistics of a wave file.
+ */
+struct wav_stats
+{
+   /**
+    * @brief Number of channels.
+    */
+   unsigned channels;
+   /**
+    * @brief Number of frames the statistics cover.
+    */
+   unsigned long long num_frames;
+   /**
+    * @brief The statistics of each channel, length in channels.
+    */
+   struct wav_channel_stats channel[WAV_STATS_MAX_CHANNELS];
+};
+
+/**
+ * @brief Compute the statistics of all samples of wav in one pass. The samples are decoded block by block
+ * and each channel is accumulated with SIMD instructions when available.
+ *
+ * Returns 0 on success.
+ */
+int wav_compute_stats(const struct wav_file *wav, struct wav_stats *stats);
+
+/**
+ * @brief Returns the RMS level of a channel.
+ */
+double wav_stats_rms(const struct wav_stats *stats, unsigned channel);
+
+/**
+ * @brief Returns the DC offset (mean sample value) of a channel.
+ */
+double wav_stats_dc_offset(const struct wav_stats *stats, unsigned channel);
+
+/**
+ * @brief Compute the statistics of wav into stats and keep them up to date incrementally as frames are written
+ * with wav_set_normalized, wav_set_normalized_range(_parallel) and wav_set_normalized_planar. Each written range
+ * is decoded before and after writing to update the sums, which thereby accumulate rounding errors and are only
+ * approximate after many writes; wav_compute_stats sums them anew. The caller owns stats, which must stay valid
+ * until tracking is stopped by calling this function with stats NULL or the file is freed.
+ *
+ * Returns 0 on success.
+ */
+int wav_track_stats(struct wav_file *wav, struct wav_stats *stats);
+
+/**
+ * @brief Recompute the tracked statistics of wav if a peak has become stale. No-op otherwise.
+ *
+ * Returns 0 on success, or -1 if no statistics are tracked.
+ */
+int wav_refresh_stats(struct wav_file *wav);
+
+/**
+ * @brief Store stats of wav to a PEAK chunk in chdr[0] and to a WAV_STATS_CHUNK_ID chunk in chdr[1],
+ * and terminate the list in chdr[2], so that chdr can be passed to write_wav_file_chdr. The chunk data
+ * is allocated with malloc and must be freed by the caller.
+ *
+ * The statistics chunk also records the sample format, the frame and byte counts of the data and a hash of
+ * the data. Reading the statistics back only checks the format and the counts, unless WAV_STATS_VERIFY_DATA
+ * is given, so statistics must not be copied to a file whose data has changed; write_wav_file_stats and
+ * WaveFile::write_file leave out such stale chunks.
+ *
+ * Returns 0 on success, or -1 if a peak is stale or stats don't match wav.
+ */
+int wav_stats_chunks(const struct wav_file *wav, const struct wav_stats *stats, struct wav_file_custom_header_data *chdr);
+
+/**
+ * @brief Flag for wav_stats_from_chunk and wav_read_stats_ex: also check the hash of the data stored in the
+ * statistics chunk, which detects data changed by other programs but reads all data.
+ */
+#define WAV_STATS_VERIFY_DATA 1
+
+/**
+ * @brief Read the statistics of the loaded file wav from chunk, a WAV_STATS_CHUNK_ID chunk read with
+ * read_wav_file_chdr. Without WAV_STATS_VERIFY_DATA in flags the data isn't accessed.
+ *
+ * Returns 0 on success, or -1 if the chunk is invalid or doesn't match the data.
+ */
+int wav_stats_from_chunk(const struct wav_file *wav, const struct wav_file_custom_header_data *chunk, struct wav_stats *stats, int flags);
+
+/**
+ * @brief Read the statistics stored in file file_name. Only the headers and the statistics chunk are read,
+ * which are checked against the format and the frame and byte counts of the data. See wav_read_stats_ex.
+ *
+ * Returns 0 on success, or -1 if the file has no valid statistics chunk, in which case the statistics
+ * must be computed with wav_compute_stats.
+ */
+int wav_read_stats(const char *file_name, struct wav_stats *stats);
+
+/**
+ * @brief Read the statistics stored in file file_name like wav_read_stats. With WAV_STATS_VERIFY_DATA in
+ * flags the data is also read, without decoding it, to check its hash.
+ *
+ * Returns 0 on success, or -1 if the file has no valid statistics chunk.
+ */
+int wav_read_stats_ex(const char *file_name, struct wav_stats *stats, int flags);
+
+/**
+ * @brief Write wav to file like write_wav_file_ex, so that the statistics chunks in the file are never stale.
+ * If wav tracks its statistics, they are stored in place of any PEAK and statistics chunks in chdr. Otherwise
+ * a statistics chunk in chdr, as loaded with the file, is checked against the data with WAV_STATS_VERIFY_DATA,
+ * and it and the PEAK chunk are left out if it doesn't match.
+ *
+ * Returns 0 on success.
+ */
+int write_wav_file_stats(const char *file_name, const struct wav_file *wav, const struct wav_file_custom_header_data *chdr, int flags);
+
+/**
+ * @brief Frames per bucket of the finest level of a waveform overview. Each further level has 16 times
+ * larger buckets: 256, 4096, 65536, ... frames.
+ */
+#define WAV_OVERVIEW_BUCKET_FRAMES 256
+
+/**
+ * @brief Maximum number of levels of a waveform overview. Levels are added as the overview grows until
+ * one bucket covers all frames, but there are always at least three (256, 4096 and 65536 frames per bucket).
+ */
+#define WAV_OVERVIEW_MAX_LEVELS 12
+
+/**
+ * @brief Id of the chunk created by wav_overview_chunk.
+ */
+#define WAV_OVERVIEW_CHUNK_ID "wovw"
+
+/**
+ * @brief Multi-resolution min/max summary (pyramid) of the samples of each channel, for drawing waveforms
+ * at any zoom level without scanning the samples. Opaque, see wav_overview_create.
+ */
+struct wav_overview;
+
+/**
+ * @brief Create an empty overview of channels channels (at most WAV_PLANAR_MAX_CHANNELS), filled with
+ * wav_overview_add. The overview must be freed with wav_overview_free.
+ *
+ * Returns 0 on success.
+ */
+int wav_overview_create(struct wav_overview **overview, unsigned channels);
+
+/**
+ * @brief Append num_frames frames from planar channel arrays to an overview created with wav_overview_create.
+ * Only the buckets are kept in memory, so the overview can be built block by block from a stream.
+ *
+ * Returns 0 on success, or -1 for overviews loaded with wav_overview_load or wav_overview_from_chunk.
+ */
+int wav_overview_add(struct wav_overview *overview, const float *const *channels, unsigned num_frames);
+
+/**
+ * @brief Build the overview of the file file_name by reading it with the streaming reader, so that the file
+ * is never in memory as a whole.
+ *
+ * Returns 0 on success.
+ */
+int wav_overview_build(struct wav_overview **overview, const char *file_name);
+
+/**
+ * @brief Build the overview of a loaded wave file.
+ *
+ * Returns 0 on success.
+ */
+int wav_overview_from_wav(struct wav_overview **overview, const struct wav_file *wav);
+
+/**
+ * @brief Returns the number of frames covered by the overview.
+ */
+unsigned long long wav_overview_frames(const struct wav_overview *overview);
+
+/**
+ * @brief Returns the number of channels of the overview.
+ */
+unsigned wav_overview_channels(const struct wav_overview *overview);
+
+/**
+ * @brief Get the minimum and maximum sample value of channel in frames first_frame ... end_frame - 1 split
+ * into width pixels, which are stored to min[0 ... width - 1] and max[0 ... width - 1]. Each pixel covers
+ * an equal part of the range, at least one frame.
+ *
+ * The range of each pixel is rounded outward to WAV_OVERVIEW_BUCKET_FRAMES frame boundaries, so when a pixel
+ * covers fewer frames than that, the samples should be read instead. Each pixel is answered from the
+ * coarsest levels that fit, in time logarithmic in the length of its range.
+ *
+ * Returns 0 on success.
+ */
+int wav_overview_query(const struct wav_overview *overview, unsigned channel, unsigned long long first_frame,
+                       unsigned long long end_frame, unsigned width, float *min, float *max);
+
+/**
+ * @brief Store the overview to a WAV_OVERVIEW_CHUNK_ID chunk in chdr, to be written with write_wav_file_chdr.
+ * The chunk data is allocated with malloc and must be freed by the caller.
+ *
+ * Returns 0 on success.
+ */
+int wav_overview_chunk(const struct wav_overview *overview, struct wav_file_custom_header_data *chdr);
+
+/**
+ * @brief Create an overview from a chunk stored by wav_overview_chunk. The chunk data is copied.
+ *
+ * Returns 0 on success, or -1 if the chunk is not a valid overview.
+ */
+int wav_overview_from_chunk(struct wav_overview **overview, const struct wav_file_custom_header_data *chunk);
+
+/**
+ * @brief Write the overview to a sidecar file, in the same format as the chunk.
+ *
+ * Returns 0 on success.
+ */
+int wav_overview_save(const struct wav_overview *overview, const char *file_name);
+
+/**
+ * @brief Load an overview from a sidecar file written with wav_overview_save. The file is memory mapped where
+ * supported, so only the buckets touched by queries are read.
+ *
+ * Returns 0 on success, or -1 if the file is not a valid overview.
+ */
+int wav_overview_load(struct wav_overview **overview, const char *file_name);
+
+/**
+ * @brief Free an overview. Returns 0 on success.
+ */
+int wav_overview_free(struct wav_overview *overview);
+
+/**
+ * @brief A streaming reader that reads the data chunk block by block instead of loading it
+ * to memory at once. Opaque, see wav_reader_open.
+ */
+struct wav_reader;
+
+/**
+ * @brief Open a streaming reader. The RIFF and fmt headers are parsed as in read_wav_file_chdr but the data
+ * chunk is not loaded. Instead the frames are pulled with wav_reader_read (or wav_reader_read_raw).
+ * The reader's memory use is bounded by block_frames regardless of the file size.
+ *
+ * Parameter chdr works as in read_wav_file_chdr.
+ * Parameter block_frames is the number of frames converted at a time by wav_reader_read. If 0, a default
+ * value is used.
+ *
+ * The reader must be closed with wav_reader_close after use.
+ *
+ * Returns 0 on success.
+ */
+int wav_reader_open(struct wav_reader **reader, const char *file_name, struct wav_file_custom_header_data *chdr, unsigned block_frames);
+
+/**
+ * @brief Get the format of the file opened by the reader. All fields except data are populated.
+ * The data field is always NULL.
+ */
+const struct wav_file *wav_reader_format(const struct wav_reader *reader);
+
+/**
+ * @brief Read at most num_frames n-channel samples from the current position into value pointer. The samples
+ * are normalized as in wav_get_normalized_range and stored interleaved, so value must contain at least
+ * num_frames * channels elements.
+ *
+ * Returns the number of frames read, which is less than num_frames only at the end of the data.
+ * Returns -1 on error.
+ */
+int wav_reader_read(struct wav_reader *reader, float *value, unsigned num_frames);
+
+/**
+ * @brief Read at most num_frames n-channel samples from the current position into planar channel arrays
+ * like wav_get_normalized_planar. Each channel array must contain at least num_frames elements.
+ *
+ * Returns the number of frames read, which is less than num_frames only at the end of the data.
+ * Returns -1 on error.
+ */
+int wav_reader_read_planar(struct wav_reader *reader, float *const *channels, unsigned num_frames);
+
+/**
+ * @brief Read at most num_frames n-channel samples from the current position into data pointer as is,
+ * without conversion. The data pointer must contain at least num_frames * channels * bit_depth / 8 bytes.
+ *
+ * Returns the number of frames read, which is less than num_frames only at the end of the data.
+ * Returns -1 on error.
+ */
+int wav_reader_read_raw(struct wav_reader *reader, char *data, unsigned num_frames);
+
+/**
+ * @brief Move the read position to the frame index frame.
+ *
+ * Returns 0 on success.
+ */
+int wav_reader_seek(struct wav_reader *reader, unsigned long long frame);
+
+/**
+ * @brief Returns the current read position as a frame index.
+ */
+unsigned long long wav_reader_position(const struct wav_reader *reader);
+
+/**
+ * @brief Get the index of all chunks in the file opened by the reader. The index is built when the reader
+ * is opened and is valid until the reader is closed.
+ */
+const struct wav_chunk_index *wav_reader_chunks(const struct wav_reader *reader);
+
+/**
+ * @brief Read a chunk of the file opened by the reader. The chunk is looked up by chdr->header_name,
+ * and the fields num_bytes and data of chdr are populated like in read_wav_file_chdr. The data must be
+ * freed by the caller. This is how any chunk can be fetched on demand after opening the file, for example
+ * when only metadata is needed.
+ *
+ * The read position of the reader is not affected.
+ *
+ * Returns 0 on success or -1 if the chunk is not found or can't be read.
+ */
+int wav_reader_read_chunk(struct wav_reader *reader, struct wav_file_custom_header_data *chdr);
+
+/**
+ * @brief Read-ahead statistics of a reader, see wav_reader_prefetch_stats.
+ */
+struct wav_prefetch_stats
+{
+   /**
+    * @brief Blocks read by the I/O thread.
+    */
+   unsigned long long blocks;
+   /**
+    * @brief Reads that had to wait for the I/O thread because no block was ready.
+    */
+   unsigned long long stalls;
+   /**
+    * @brief Total time spent waiting in those reads in nanoseconds.
+    */
+   unsigned long long wait_ns;
+};
+
+/**
+ * @brief Enable read-ahead for sequential streaming reads. A background I/O thread keeps up to num_blocks
+ * blocks of block_frames raw frames (see wav_reader_open) read ahead of the current position, so that
+ * the reads of the reader only copy and convert data that is already in memory. If num_blocks is 0,
+ * a default value is used.
+ *
+ * wav_reader_seek discards the blocks read ahead and wav_reader_read_chunk pauses the I/O thread while
+ * it reads the chunk. The thread is stopped by wav_reader_close. The reader must not be used from more
+ * than one thread at a time.
+ *
+ * Returns 0 on success or -1 if read-ahead is already enabled or the thread can't be started.
+ */
+int wav_reader_prefetch(struct wav_reader *reader, unsigned num_blocks);
+
+/**
+ * @brief Get the read-ahead statistics of a reader. A high number of stalls means that the storage
+ * can't keep up with the consumer, and a few stalls after a seek are expected.
+ *
+ * Returns 0 on success or -1 if read-ahead is not enabled.
+ */
+int wav_reader_prefetch_stats(struct wav_reader *reader, struct wav_prefetch_stats *stats);
+
+/**
+ * @brief Close the reader and free all its resources.
+ *
+ * Returns 0 on success.
+ */
+int wav_reader_close(struct wav_reader *reader);
+
+/**
+ * @brief A streaming writer that writes the data chunk incrementally. Opaque, see wav_writer_open.
+ */
+struct wav_writer;
+
+/**
+ * @brief Open a streaming writer. The headers are written immediately and the frames are appended with
+ * wav_writer_write (or wav_writer_write_raw). The RIFF and data chunk sizes are patched when the writer
+ * is closed, so the whole data never needs to be in memory.
+ *
+ * The fields channels, sample_rate, bit_depth and is_float of format define the format of the file.
+ * Other fields are ignored.
+ * Parameter chdr works as in write_wav_file_chdr.
+ * Parameter block_frames is the number of frames converted at a time by wav_writer_write. If 0, a default
+ * value is used.
+ * Parameter flags works as in write_wav_file_ex. A JUNK chunk is reserved in the header so that the file can
+ * be converted to RF64 on close if the data grows past 4 GiB.
+ *
+ * The writer must be closed with wav_writer_close, otherwise the file is left incomplete.
+ *
+ * Returns 0 on success.
+ */
+int wav_writer_open(struct wav_writer **writer, const char *file_name, const struct wav_file *format,
+                    const struct wav_file_custom_header_data *chdr, unsigned block_frames, int flags);
+
+/**
+ * @brief Append num_frames n-channel samples from interleaved value pointer. Samples outside of the
+ * range -1.0f ... 1.0f are clipped. The value pointer must contain at least num_frames * channels elements.
+ *
+ * Same format restrictions apply as in wav_set_normalized_range.
+ *
+ * Returns 0 on success.
+ */
+int wav_writer_write(struct wav_writer *writer, const float *value, unsigned num_frames);
+
+/**
+ * @brief Append num_frames n-channel samples from planar channel arrays like wav_set_normalized_planar.
+ * Each channel array must contain at least num_frames elements.
+ *
+ * Returns 0 on success.
+ */
+int wav_writer_write_planar(struct wav_writer *writer, const float *const *channels, unsigned num_frames);
+
+/**
+ * @brief Append num_frames n-channel samples from data pointer as is, without conversion. The data pointer
+ * must contain at least num_frames * channels * bit_depth / 8 bytes.
+ *
+ * Returns 0 on success.
+ */
+int wav_writer_write_raw(struct wav_writer *writer, const char *data, unsigned num_frames);
+
+/**
+ * @brief Get the format of the file being written. The fields num_bytes and num_frames tell how much
+ * has been written so far. The data field is always NULL.
+ */
+const struct wav_file *wav_writer_format(const struct wav_writer *writer);
+
+/**
+ * @brief Patch the RIFF and data chunk sizes, close the file and free all resources of the writer.
+ *
+ * Returns 0 on success. If any write has failed, the file is closed and -1 is returned.
+ */
+int wav_writer_close(struct wav_writer *writer);
+
+/**
+ * @brief Maximum number of filter phases of a resampler, which is out_rate / gcd(in_rate, out_rate).
+ * Covers all conversions between the common rates 8000 ... 192000 Hz.
+ */
+#define WAV_RESAMPLE_MAX_PHASES 4096
+
+/**
+ * @brief Polyphase sample rate converter with a Kaiser-windowed sinc filter. Opaque, see wav_resampler_create.
+ */
+struct wav_resampler;
+
+/**
+ * @brief Create a resampler converting channels channels (at most WAV_PLANAR_MAX_CHANNELS) from in_rate to
+ * out_rate. The filter coefficients of every phase are computed once here. When downsampling the cutoff is
+ * lowered to the output Nyquist frequency, so the filter also acts as an anti-aliasing filter.
+ * The resampler must be freed with wav_resampler_free.
+ *
+ * Returns 0 on success, or -1 if a rate is 0 or the rates need more than WAV_RESAMPLE_MAX_PHASES phases.
+ */
+int wav_resampler_create(struct wav_resampler **resampler, unsigned channels, unsigned in_rate, unsigned out_rate);
+
+/**
+ * @brief Returns the number of output frames for in_frames input frames, ceil(in_frames * out_rate / in_rate).
+ */
+unsigned long long wav_resampler_output_frames(const struct wav_resampler *resampler, unsigned long long in_frames);
+
+/**
+ * @brief Feed in_frames interleaved input frames and write at most max_frames interleaved output frames to
+ * out. Input is buffered until the filter has enough of it, and output frames that don't fit are kept for the
+ * next call, which may pass no input (in_frames 0) to only drain them.
+ *
+ * Returns the number of frames written to out, or -1 on error or after wav_resampler_flush.
+ */
+int wav_resampler_process(struct wav_resampler *resampler, const float *in, unsigned in_frames, float *out, unsigned max_frames);
+
+/**
+ * @brief End the input and write at most max_frames of the remaining output frames to out. Call until it
+ * returns 0, after which the total output is exactly wav_resampler_output_frames of the total input.
+ *
+ * Returns the number of frames written to out.
+ */
+int wav_resampler_flush(struct wav_resampler *resampler, float *out, unsigned max_frames);
+
+/**
+ * @brief Read from reader and write at most max_frames resampled interleaved frames to out, as a streaming
+ * stage on top of the reader. The channels of the reader must match the resampler. The end of the file
+ * flushes the resampler.
+ *
+ * Returns the number of frames written, which is less than max_frames only at the end of the file, or -1 on
+ * error.
+ */
+int wav_resampler_read(struct wav_resampler *resampler, struct wav_reader *reader, float *out, unsigned max_frames);
+
+/**
+ * @brief Discard the buffered input and pending output to start a new stream with the same rates.
+ */
+void wav_resampler_reset(struct wav_resampler *resampler);
+
+/**
+ * @brief Free a resampler. Returns 0 on success.
+ */
+int wav_resampler_free(struct wav_resampler *resampler);
+
+/**
+ * @brief Resample the whole wave file in to sample_rate into a new wave file out in the same sample format.
+ * out is allocated like with create_wav_file and must be freed with free_wav_file.
+ *
+ * Same format restrictions apply as in wav_get_normalized_range.
+ *
+ * Returns 0 on success.
+ */
+int wav_resample(const struct wav_file *in, struct wav_file *out, unsigned sample_rate);
+
+/**
+ * @brief A source of wav_mix: a file with its gain and position in the mix.
+ */
+struct wav_mix_source
+{
+   /**
+    * @brief Name of the file.
+    */
+   const char *file_name;
+   /**
+    * @brief Gain at the first frame of the source.
+    */
+   float gain;
+   /**
+    * @brief Gain reached linearly after ramp_frames frames and kept until the end. Ignored if ramp_frames is 0.
+    */
+   float end_gain;
+   /**
+    * @brief Length of the gain ramp in frames, 0 for a constant gain.
+    */
+   unsigned long long ramp_frames;
+   /**
+    * @brief Frame of the output at which the source starts.
+    */
+   unsigned long long offset;
+};
+
+/**
+ * @brief Mix num_sources files into a new file out_file_name. The sources are streamed block by block with
+ * wav_reader, multiplied by their gain and summed into a float bus, which is encoded once per block into the
+ * format of the output with wav_writer, so memory use doesn't grow with the length of the files. The bus
+ * is clipped only when it's encoded. The output is as long as the source that ends last.
+ *
+ * The fields channels, sample_rate, bit_depth and is_float of format define the format of the output file.
+ * Every source must have the sample rate of the output, and either its number of channels or one channel,
+ * which is mixed to all channels.
+ *
+ * For many sources the sources are split into groups summed into separate buses, which are then added
+ * together. The buses are summed on num_threads threads (0 for one thread per processor) that are started
+ * once for the whole mix. The groups depend only on the number of sources, so the output is the same for
+ * any number of threads.
+ *
+ * Returns 0 on success.
+ */
+int wav_mix(const struct wav_mix_source *sources, unsigned num_sources, const char *out_file_name,
+            const struct wav_file *format, unsigned num_threads);
+
+/**
+ * @brief Budget of the process-wide block cache in bytes until changed with wav_cache_set_budget.
+ */
+#define WAV_CACHE_DEFAULT_BUDGET (256u << 20)
+
+/**
+ * @brief Cache of decoded blocks of wave files shared by all files opened with wav_cache_file_open.
+ * Opaque, see wav_cache_create.
+ *
+ * Blocks are keyed by the identity of the file (device, inode, size and modification time where available)
+ * and the block index, so the same file opened by different handles or paths shares its blocks, and a
+ * file that is rewritten is read again. The cache is split into shards, each with its own lock and least
+ * recently used list, so that concurrent readers rarely contend. The cache is thread safe.
+ */
+struct wav_cache;
+
+/**
+ * @brief Counters of a cache, see wav_cache_get_stats.
+ */
+struct wav_cache_stats
+{
+   /**
+    * @brief Block lookups served from the cache.
+    */
+   unsigned long long hits;
+   /**
+    * @brief Block lookups that decoded the block from the file.
+    */
+   unsigned long long misses;
+   /**
+    * @brief Blocks evicted to stay within the budget.
+    */
+   unsigned long long evictions;
+   /**
+    * @brief Blocks in the cache.
+    */
+   unsigned long long blocks;
+   /**
+    * @brief Decoded sample data in the cache in bytes.
+    */
+   unsigned long long bytes;
+};
+
+/**
+ * @brief Create a cache holding at most budget_bytes bytes of decoded samples. Parameter block_frames is the
+ * number of frames per block (0 for 4096) and num_shards the number of shards (0 for 16). Each shard holds
+ * at most budget_bytes / num_shards bytes, so a block larger than that is never cached.
+ * The cache must be freed with wav_cache_free after all its files are closed.
+ *
+ * Returns 0 on success.
+ */
+int wav_cache_create(struct wav_cache **cache, size_t budget_bytes, unsigned block_frames, unsigned num_shards);
+
+/**
+ * @brief Returns the process-wide cache, which is created with WAV_CACHE_DEFAULT_BUDGET on first use and
+ * never freed, or NULL if it can't be created.
+ */
+struct wav_cache *wav_cache_global(void);
+
+/**
+ * @brief Change the budget of a cache. Blocks are evicted as needed on the next insertion into each shard.
+ */
+void wav_cache_set_budget(struct wav_cache *cache, size_t budget_bytes);
+
+/**
+ * @brief Get the counters of a cache.
+ */
+void wav_cache_get_stats(struct wav_cache *cache, struct wav_cache_stats *stats);
+
+/**
+ * @brief Free a cache and all its blocks. Returns 0 on success.
+ */
+int wav_cache_free(struct wav_cache *cache);
+
+/**
+ * @brief A file read through a cache. Opaque, see wav_cache_file_open.
+ */
+struct wav_cache_file;
+
+/**
+ * @brief Open a file for reading through cache, or through the process-wide cache if cache is NULL.
+ * Only the headers are read here. Blocks are decoded on demand when they are not in the cache.
+ * A handle must not be used from more than one thread at a time, but any number of handles may share the
+ * cache. The handle must be closed with wav_cache_file_close.
+ *
+ * Returns 0 on success.
+ */
+int wav_cache_file_open(struct wav_cache_file **file, struct wav_cache *cache, const char *file_name);
+
+/**
+ * @brief Get the format of the file. All fields except data are populated. The data field is always NULL.
+ */
+const struct wav_file *wav_cache_file_format(const struct wav_cache_file *file);
+
+/**
+ * @brief Read at most num_frames n-channel samples starting at frame index frame into value pointer. The
+ * samples are normalized and interleaved as in wav_get_normalized_range, so value must contain at least
+ * num_frames * channels elements. Any range may be read in any order.
+ *
+ * Returns the number of frames read, which is less than num_frames only at the end of the data.
+ * Returns -1 on error or if frame is past the end of the data.
+ */
+int wav_cache_file_read(struct wav_cache_file *file, unsigned long long frame, unsigned num_frames, float *value);
+
+/**
+ * @brief Close a file. Its blocks stay in the cache. Returns 0 on success.
+ */
+int wav_cache_file_close(struct wav_cache_file *file);
+
+/**
+ * @brief Playback engine streaming many simultaneous voices from disk. Opaque, see wav_player_create.
+ *
+ * The first head_frames frames of every sample (file) are preloaded by wav_player_load, and the rest is
+ * streamed into a ring buffer per voice by a pool of disk worker threads. The ring buffers are single
+ * producer single consumer queues synchronized with atomic indices only, so wav_player_start,
+ * wav_player_stop and wav_player_render never lock, allocate or do I/O and can be called from a realtime
+ * audio thread. These three functions must be called from one thread at a time, typically the audio thread.
+ */
+struct wav_player;
+
+/**
+ * @brief Configuration of a player, see wav_player_create. Fields that are 0 use a default value.
+ */
+struct wav_player_config
+{
+   /**
+    * @brief Maximum number of voices playing at once, at most 65536 (default 64).
+    */
+   unsigned max_voices;
+   /**
+    * @brief Maximum number of samples loaded with wav_player_load (default 256).
+    */
+   unsigned max_samples;
+   /**
+    * @brief Frames of each sample preloaded to memory, which covers the latency of starting to stream
+    * (default 32768).
+    */
+   unsigned head_frames;
+   /**
+    * @brief Capacity of the ring buffer of each voice in frames (default 32768).
+    */
+   unsigned ring_frames;
+   /**
+    * @brief Frames read from disk at a time by the workers, at most ring_frames (default 4096).
+    */
+   unsigned block_frames;
+   /**
+    * @brief Number of disk worker threads (default 2).
+    */
+   unsigned num_workers;
+};
+
+/**
+ * @brief Counters of a player, see wav_player_get_stats.
+ */
+struct wav_player_stats
+{
+   /**
+    * @brief Voices currently playing.
+    */
+   unsigned voices;
+   /**
+    * @brief Frames rendered as silence because the ring buffer of a voice was empty.
+    */
+   unsigned long long underrun_frames;
+   /**
+    * @brief Blocks read from disk by the workers.
+    */
+   unsigned long long blocks;
+};
+
+/**
+ * @brief Create a player and start its disk workers. Parameter config may be NULL for the default
+ * configuration. The memory of all voices is allocated here, about
+ * max_voices * ring_frames * 2 * sizeof(float) bytes for the ring buffers.
+ * The player must be freed with wav_player_free.
+ *
+ * Returns 0 on success.
+ */
+int wav_player_create(struct wav_player **player, const struct wav_player_config *config);
+
+/**
+ * @brief Load a sample: parse the file and preload its head. The rest of the file is streamed by the voices
+ * playing it. Samples are rendered to stereo: mono samples are played on both channels, and only the
+ * first two channels of samples with more channels are played. The sample rate is not converted,
+ * so samples should be at the output rate (see wav_resample). Not realtime safe, and must not be
+ * called from more than one thread at a time.
+ *
+ * Returns the id of the sample, or -1 if the file can't be read, it has more than WAV_PLANAR_MAX_CHANNELS
+ * channels or max_samples samples are already loaded.
+ */
+int wav_player_load(struct wav_player *player, const char *file_name);
+
+/**
+ * @brief Start a voice playing sample from the beginning with gain. Realtime safe.
+ *
+ * Returns a handle of the voice for wav_player_stop, or -1 if sample is invalid or no voice is free.
+ * A voice is free again once its disk worker has released its file after it stopped.
+ */
+int wav_player_start(struct wav_player *player, int sample, float gain);
+
+/**
+ * @brief Stop a voice started by wav_player_start. Realtime safe.
+ *
+ * Returns 0 on success or -1 if the voice has already stopped.
+ */
+int wav_player_stop(struct wav_player *player, int voice);
+
+/**
+ * @brief Render num_frames interleaved stereo frames of all playing voices mixed to out, which must
+ * contain at least num_frames * 2 elements. Voices stop at the end of their sample. A voice whose ring
+ * buffer runs empty renders silence and continues where it left off when its data arrives, which is
+ * counted in underrun_frames. Realtime safe.
+ *
+ * Returns the number of voices still playing.
+ */
+int wav_player_render(struct wav_player *player, float *out, unsigned num_frames);
+
+/**
+ * @brief Get the counters of a player. May be called from any thread.
+ */
+void wav_player_get_stats(const struct wav_player *player, struct wav_player_stats *stats);
+
+/**
+ * @brief Stop the disk workers and free the player with all its samples and voices. Returns 0 on success.
+ */
+int wav_player_free(struct wav_player *player);
+
+/**
+ * @brief Select the conversion kernels automatically based on the CPU features.
+ */
+#define WAV_ISA_AUTO -1
+/**
+ * @brief Portable scalar conversion kernels.
+ */
+#define WAV_ISA_SCALAR 0
+/**
+ * @brief SSE2 conversion kernels (x86 only).
+ */
+#define WAV_ISA_SSE2 1
+/**
+ * @brief AVX2 conversion kernels (x86 only).
+ */
+#define WAV_ISA_AVX2 2
+
+/**
+ * @brief Select the instruction set used by the bulk conversion functions (e.g. wav_get_normalized_range).
+ * Parameter isa is one of the WAV_ISA_* constants. The best supported instruction set is selected
+ * automatically when the library is loaded, so this is mainly useful for testing and benchmarking.
+ * All instruction sets produce bit-exact results.
+ *
+ * Must not be called while conversions are running in other threads.
+ *
+ * Returns 0 on success or -1 if the instruction set is not supported by the CPU.
+ */
+int wav_set_conversion_isa(int isa);
+
+/**
+ * @brief Returns the WAV_ISA_* constant of the instruction set currently used by the bulk conversion functions.
+ */
+int wav_get_conversion_isa(void);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -1,12 +1,17 @@
 #pragma once
 #include <string>
 #include <stdexcept>
+#include <algorithm>
 #include <map>
+#include <memory>
 #include <tuple>
 #include <vector>
+#include <utility>
+#include <type_traits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cstdint>
 #include "wav_handler.h"
 
 namespace wav_handler
@@ -26,42 +31,72 @@ namespace wav_handler
         float ch1;
     };
 
-    class WaveFile
+    /**
+     * @brief Format of a wave file as returned by WaveFile::probe
+     */
+    struct WaveInfo
     {
-        wav_file wav;
-        std::map<std::string, std::string> custom_header_data;
+        /**
+         * @brief Length in n-channel samples
+         */
+        unsigned long long length;
+        /**
+         * @brief Number of channels
+         */
+        unsigned channels;
+        /**
+         * @brief Sample rate (Hz)
+         */
+        unsigned sample_rate;
+        /**
+         * @brief Bit depth in bits
+         */
+        unsigned bit_depth;
+        /**
+         * @brief True if floating point format is used
+         */
+        bool is_float;
+        /**
+         * @brief False if the file could not be probed, in which case the other fields are zero
+         */
+        bool valid;
+    };
 
-        WaveFile(const WaveFile &) = delete;
-        WaveFile &operator=(const WaveFile &) = delete;
-        WaveFile(WaveFile &&) = delete;
-        WaveFile &operator=(WaveFile &&) = delete;
+    namespace detail
+    {
+        /**
+         * @brief wav_file release function that calls the Deleter stored in ctx and deletes it.
+         */
+        template <typename Deleter>
+        void release_with_deleter(void *ctx, char *data)
+        {
+            auto deleter = static_cast<Deleter *>(ctx);
+            (*deleter)(data);
+            delete deleter;
+        }
 
-    public:
-        WaveFile()
+        inline double clip_normalized(double val)
         {
-            memset(&wav, 0, sizeof(wav_file));
+            return val > 1 ? 1 : (val < -1 ? -1 : val);
         }
 
-        ~WaveFile()
+        inline WaveInfo to_wave_info(const wav_file &wav, bool valid)
         {
-            if (wav.data)
-            {
-                free_wav_file(&wav);
-            }
+            if (!valid)
+                return {0, 0, 0, 0, false, false};
+            return {wav.num_frames, wav.channels, wav.sample_rate, wav.bit_depth, wav.is_float != 0, true};
         }
 
         /**
-         * @brief Load a wave file.
-         *
-         * Throws exception if data is already initialized or there's an error while reading the file.
-         *
-         * @param fname The filename.
-         * @param custom_headers Custom header names to be loaded.
+         * @brief Builds the custom header list for the C API, calls reader with it and stores
+         * the headers that were found to custom_header_data. The header data is released with
+         * allocator, or free if allocator is nullptr. Returns the return value of reader.
          */
-        void load_file(const std::string &fname, const std::vector<std::string> &custom_headers = {})
+        template <typename Reader>
+        int read_custom_headers(const std::vector<std::string> &custom_headers,
+                                std::map<std::string, std::string> &custom_header_data, Reader reader,
+                                const wav_allocator *allocator = nullptr)
         {
-            if (wav.data)
-                throw std::runtime_error("file already loaded");
             std::vector<wav_file_custom_header_data> chdr_array;
             int i = 0;
             for (auto &hdr : custom_headers)
@@ -73,167 +108,2081 @@ namespace wav_handler
                 i++;
             }
             chdr_array.push_back({{0}, 0, nullptr});
-            const auto err = read_wav_file_chdr(fname.c_str(), &wav, chdr_array.data());
+            const auto err = reader(chdr_array.data());
             for (auto &hdr : chdr_array)
             {
                 if (hdr.data)
                     custom_header_data[hdr.header_name] = std::string(hdr.data, hdr.num_bytes);
-                free(hdr.data);
+                if (allocator)
+                    allocator->free(allocator->ctx, hdr.data);
+                else
+                    free(hdr.data);
             }
-            if (err)
-                throw std::runtime_error("Error loading file" + fname);
-            if (wav.channels > 16)
-                throw std::range_error("Number of channels must be max 16");
+            return err;
         }
 
         /**
-         * @brief Write the wave data to a file.
-         *
-         * Throws exception if data hasn't been initialized or there's an error while writing the file.
-         *
-         * @param fname The file name.
-         * @param custom_headers Custom headers to be saved as a map where the key is the custom header
-         * name and the value is the custom header value.
+         * @brief Builds the custom header list for the C API from the map. The list points to the
+         * strings in the map, so the map must outlive it.
          */
-        void write_file(const std::string &fname, const std::map<std::string, std::string> custom_headers = {}) const
+        inline std::vector<wav_file_custom_header_data> to_custom_header_list(const std::map<std::string, std::string> &custom_headers)
         {
-            if (!wav.data)
-                throw std::runtime_error("no file loaded");
-
             std::vector<wav_file_custom_header_data> chdr_array;
-            int i = 0;
             for (auto &hdr : custom_headers)
             {
                 chdr_array.push_back({});
-                chdr_array[i].data = static_cast<char *>(calloc(hdr.second.size(), 1));
-                memcpy(chdr_array[i].data, hdr.second.data(), hdr.second.size());
-                strcpy(chdr_array[i].header_name, hdr.first.substr(0, 4).c_str());
-                chdr_array[i].num_bytes = hdr.second.size();
-                i++;
+                strcpy(chdr_array.back().header_name, hdr.first.substr(0, 4).c_str());
+                chdr_array.back().num_bytes = hdr.second.size();
+                // The header data is only read by the write functions
+                chdr_array.back().data = const_cast<char *>(hdr.second.data());
             }
             chdr_array.push_back({{0}, 0, nullptr});
-            int err = write_wav_file_chdr(fname.c_str(), &wav, chdr_array.data());
-            for (auto &hdr : chdr_array)
+            return chdr_array;
+        }
+
+        /**
+         * @brief Returns the chunk ids of the index in file order.
+         */
+        inline std::vector<std::string> chunk_ids(const wav_chunk_index *index)
+        {
+            std::vector<std::string> ids;
+            for (unsigned i = 0; i < index->num_chunks; i++)
+                ids.push_back(index->chunks[i].id);
+            return ids;
+        }
+
+        /**
+         * @brief Reads chunk name using the reader and stores it to custom_header_data.
+         * Returns false if the chunk is not found.
+         */
+        inline bool read_chunk(wav_reader *reader, const std::string &name,
+                               std::map<std::string, std::string> &custom_header_data)
+        {
+            wav_file_custom_header_data chdr = {{0}, 0, nullptr};
+            strncpy(chdr.header_name, name.c_str(), 4);
+            if (wav_reader_read_chunk(reader, &chdr))
+                return false;
+            custom_header_data[chdr.header_name] = std::string(chdr.data, chdr.num_bytes);
+            free(chdr.data);
+            return true;
+        }
+
+        /**
+         * @brief Opens fname with a reader for accessing its chunk index, calls func with the reader
+         * and returns its return value. Throws runtime_error if the file can't be opened.
+         */
+        template <typename Func>
+        auto with_chunk_reader(const std::string &fname, Func func) -> decltype(func(nullptr))
+        {
+            wav_reader *reader = nullptr;
+            if (fname.empty() || wav_reader_open(&reader, fname.c_str(), nullptr, 0))
+                throw std::runtime_error("Error opening file" + fname);
+            try
             {
-                free(hdr.data);
+                auto result = func(reader);
+                wav_reader_close(reader);
+                return result;
             }
-            if (err)
-                throw std::runtime_error("Error writing file" + fname);
+            catch (...)
+            {
+                wav_reader_close(reader);
+                throw;
+            }
+        }
+    }
+
+    /*
+        Sample formats for WaveView. Each format has the bit depth and float flag of the format
+        as constants and decode/encode functions that convert one sample from/to a normalized float.
+        The results are bit-exact with wav_get_normalized and wav_set_normalized. The integer
+        decoders multiply with the reciprocal of the scale in double precision, which rounds to the
+        same float as the float division used by the C functions for every possible input.
+    */
+
+    /**
+     * @brief 8-bit unsigned integer samples
+     */
+    struct Pcm8
+    {
+        static constexpr unsigned bit_depth = 8;
+        static constexpr bool is_float = false;
+        static constexpr double scale = 0xFF;
+
+        static float decode(const char *p)
+        {
+            const float val = static_cast<float>(static_cast<unsigned char>(*p) * (1.0 / scale));
+            return val * 2 - 1;
+        }
+
+        static void encode(char *p, float value)
+        {
+            *p = static_cast<char>(static_cast<unsigned char>((detail::clip_normalized(value) + 1) / 2 * scale));
+        }
+    };
+
+    /**
+     * @brief 16-bit signed integer samples
+     */
+    struct Pcm16
+    {
+        static constexpr unsigned bit_depth = 16;
+        static constexpr bool is_float = false;
+        static constexpr double scale = 0x8000 - 1;
+
+        static float decode(const char *p)
+        {
+            short s;
+            memcpy(&s, p, sizeof(s));
+            return static_cast<float>(s * (1.0 / scale));
+        }
+
+        static void encode(char *p, float value)
+        {
+            const short s = static_cast<short>(detail::clip_normalized(value) * scale);
+            memcpy(p, &s, sizeof(s));
+        }
+    };
+
+    /**
+     * @brief 24-bit signed integer samples
+     */
+    struct Pcm24
+    {
+        static constexpr unsigned bit_depth = 24;
+        static constexpr bool is_float = false;
+        static constexpr double scale = 0x800000 - 1;
+
+        static float decode(const char *p)
+        {
+            const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+            const int val32b = u[0] | (u[1] << 8) | (static_cast<signed char>(u[2]) * 0x10000);
+            return static_cast<float>(val32b * (1.0 / scale));
+        }
+
+        static void encode(char *p, float value)
+        {
+            const int val32b = static_cast<int>(detail::clip_normalized(value) * scale);
+            p[0] = static_cast<char>(val32b);
+            p[1] = static_cast<char>(val32b >> 8);
+            p[2] = static_cast<char>(val32b >> 16);
+        }
+    };
+
+    /**
+     * @brief 32-bit signed integer samples
+     */
+    struct Pcm32
+    {
+        static constexpr unsigned bit_depth = 32;
+        static constexpr bool is_float = false;
+        static constexpr double scale = 0x80000000 - 1;
+
+        static float decode(const char *p)
+        {
+            int s;
+            memcpy(&s, p, sizeof(s));
+            // The C functions divide by scale converted to float, which is exactly 2^31
+            return static_cast<float>(s) * (1.0f / 2147483648.0f);
+        }
+
+        static void encode(char *p, float value)
+        {
+            const int s = static_cast<int>(detail::clip_normalized(value) * scale);
+            memcpy(p, &s, sizeof(s));
+        }
+    };
+
+    /**
+     * @brief 32-bit floating point samples
+     */
+    struct Float32
+    {
+        static constexpr unsigned bit_depth = 32;
+        static constexpr bool is_float = true;
+
+        static float decode(const char *p)
+        {
+            float f;
+            memcpy(&f, p, sizeof(f));
+            return f;
         }
 
+        static void encode(char *p, float value)
+        {
+            const float f = static_cast<float>(detail::clip_normalized(value));
+            memcpy(p, &f, sizeof(f));
+        }
+    };
+
+    /**
+     * @brief 64-bit floating point samples
+     */
+    struct Float64
+    {
+        static constexpr unsigned bit_depth = 64;
+        static constexpr bool is_float = true;
+
+        static float decode(const char *p)
+        {
+            double d;
+            memcpy(&d, p, sizeof(d));
+            return static_cast<float>(d);
+        }
+
+        static void encode(char *p, float value)
+        {
+            const double d = detail::clip_normalized(value);
+            memcpy(p, &d, sizeof(d));
+        }
+    };
+
+    /**
+     * @brief A typed view to interleaved sample data with the sample format and channel count fixed at
+     * compile time, so that the accessors compile down to plain loads, stores and multiplies. If Channels
+     * is 0, the channel count is given at run time. Format is one of Pcm8, Pcm16, Pcm24, Pcm32, Float32
+     * and Float64.
+     *
+     * The accessors don't check the indices. The view doesn't own the data.
+     */
+    template <typename Format, unsigned Channels>
+    class WaveView
+    {
+        char *data;
+        unsigned long long frames;
+        unsigned num_channels;
+
+        const char *sample_ptr(unsigned long long frame, unsigned channel) const
+        {
+            return data + (frame * get_channels() + channel) * bytes_per_sample;
+        }
+
+    public:
         /**
-         * @brief Create an empty all-zeroes wave file.
-         *
-         * @param length Length in mono/stereo samples
-         * @param stereo True if stereo, false if mono
-         * @param bit_depth Bit depth in bits. See wav_get_normalized documentation for list of supported formats.
-         * @param sample_rate Sample rate (Hz)
-         * @param is_float True if floating point format is used
+         * @brief Size of one sample in bytes
+         */
+        static constexpr unsigned bytes_per_sample = Format::bit_depth / 8;
+
+        /**
+         * @brief Create a view to num_frames frames of data. The channels parameter is only used if
+         * Channels is 0.
          */
-        void create(unsigned length, bool stereo, unsigned bit_depth, unsigned sample_rate, bool is_float)
+        WaveView(char *data, unsigned long long num_frames, unsigned channels = Channels)
+            : data(data), frames(num_frames), num_channels(Channels ? Channels : channels)
         {
-            if (wav.data)
-                throw std::runtime_error("file already loaded");
-            auto err = create_wav_file(&wav, length, stereo ? 2 : 1, bit_depth, sample_rate);
-            if (err)
-                throw std::runtime_error("Error creating wav file");
-            wav.is_float = is_float;
         }
 
         /**
-         * @brief Get a custom header by name. Throws an invalid_argument exception if
-         * header is not found. Returns the header value as string.
+         * @brief Get the length in n-channel samples.
          */
-        std::string get_header(const std::string &name) const
+        unsigned long long get_length() const
         {
-            auto data = custom_header_data.find(name);
-            if (data == custom_header_data.end())
-                throw std::invalid_argument("Header not found: " + name);
-            return data->second;
+            return frames;
         }
 
         /**
-         * @brief Get the length of data in mono/stereo samples.
-         * Throws runtime_error if data is not initialized.
+         * @brief Get the number of channels.
          */
-        unsigned get_length() const
+        unsigned get_channels() const
         {
-            if (!wav.data)
-                throw std::runtime_error("no file loaded");
-            return wav.num_frames;
+            return Channels ? Channels : num_channels;
         }
 
         /**
-         * @brief Get a mono sample from index idx. If the data is in stereo, returns the sample from channel 0.
-         * Throws runtime_error if data is not initialized or if getting the sample fails.
+         * @brief Get the sample of channel at frame index frame normalized to -1.0f ... 1.0f.
          */
-        float get_sample(unsigned idx) const
+        float get(unsigned long long frame, unsigned channel) const
         {
-            if (!wav.data)
-                throw std::runtime_error("no file loaded");
-            float sample_buf[16];
-            int err = wav_get_normalized(&wav, idx, sample_buf);
-            if (err)
-                throw std::runtime_error("error while getting sample at index " + std::to_string(idx));
-            return sample_buf[0];
+            return Format::decode(sample_ptr(frame, channel));
         }
 
         /**
-         * @brief Get a stereo sample from index idx. If the data is in mono, the contents of the second channel
-         * will be same as the first channel.
-         * Throws runtime_error if data is not initialized or if getting the sample fails.
+         * @brief Set the sample of channel at frame index frame. The value is clipped to -1.0f ... 1.0f.
          */
-        StereoSample get_sample_stereo(unsigned idx) const
+        void set(unsigned long long frame, unsigned channel, float value)
+        {
+            Format::encode(const_cast<char *>(sample_ptr(frame, channel)), value);
+        }
+    };
+
+    namespace detail
+    {
+        template <bool ReadOnly, typename View>
+        typename std::conditional<ReadOnly, const View &, View &>::type view_arg(View &view)
+        {
+            return view;
+        }
+
+        /**
+         * @brief Calls func with a WaveView of Format to the data of wav. The channel count is a
+         * compile time constant for mono and stereo data. If ReadOnly is true the view is passed as const.
+         */
+        template <typename Format, bool ReadOnly, typename Func>
+        decltype(auto) call_with_view(const wav_file &wav, Func &func)
         {
-            if (!wav.data)
-                throw std::runtime_error("no file loaded");
-            float sample_buf[16];
-            int err = wav_get_normalized(&wav, idx, sample_buf);
-            if (err)
-                throw std::runtime_error("error while getting sample at index " + std::to_string(idx));
             if (wav.channels == 1)
-                sample_buf[1] = sample_buf[0];
-            return {sample_buf[0], sample_buf[1]};
+            {
+                WaveView<Format, 1> view(wav.data, wav.num_frames);
+                return func(view_arg<ReadOnly>(view));
+            }
+            if (wav.channels == 2)
+            {
+                WaveView<Format, 2> view(wav.data, wav.num_frames);
+                return func(view_arg<ReadOnly>(view));
+            }
+            WaveView<Format, 0> view(wav.data, wav.num_frames, wav.channels);
+            return func(view_arg<ReadOnly>(view));
         }
 
         /**
-         * @brief Set a mono sample at index idx. If the data is in stereo, sets both channels to the sample.
-         * Throws runtime_error if data is not initialized or if setting the sample fails.
+         * @brief Selects the WaveView matching the format of wav and calls func with it.
+         * Throws invalid_argument if the format is not supported.
          */
-        void set_sample(unsigned idx, float value)
+        template <bool ReadOnly, typename Func>
+        decltype(auto) dispatch_view(const wav_file &wav, Func &func)
         {
-            if (!wav.data)
-                throw std::runtime_error("no file loaded");
-            float sample_buf[2] = {value, value};
-            int err = wav_set_normalized(&wav, idx, sample_buf);
-            if (err)
-                throw std::runtime_error("error while setting sample at index " + std::to_string(idx));
+            switch (wav.is_float ? -static_cast<int>(wav.bit_depth) : static_cast<int>(wav.bit_depth))
+            {
+            case 8:
+                return call_with_view<Pcm8, ReadOnly>(wav, func);
+            case 16:
+                return call_with_view<Pcm16, ReadOnly>(wav, func);
+            case 24:
+                return call_with_view<Pcm24, ReadOnly>(wav, func);
+            case 32:
+                return call_with_view<Pcm32, ReadOnly>(wav, func);
+            case -32:
+                return call_with_view<Float32, ReadOnly>(wav, func);
+            case -64:
+                return call_with_view<Float64, ReadOnly>(wav, func);
+            }
+            throw std::invalid_argument("unsupported sample format");
+        }
+    }
+
+    /**
+     * @brief Planar (deinterleaved) float sample buffer with one array per channel. Each channel array
+     * starts at a 64-byte boundary so that the arrays don't share cache lines.
+     */
+    class PlanarBuffer
+    {
+        static constexpr size_t alignment = 64 / sizeof(float);
+
+        std::vector<float> storage;
+        std::vector<float *> pointers;
+        size_t frames;
+
+        // Allocates all-zeroes storage and points the channel arrays into it
+        void allocate(unsigned channels)
+        {
+            const size_t stride = (frames + alignment - 1) / alignment * alignment;
+            storage.assign(stride * channels + alignment, 0.0f);
+            const size_t misalignment = reinterpret_cast<uintptr_t>(storage.data()) / sizeof(float) % alignment;
+            float *first = storage.data() + (misalignment ? alignment - misalignment : 0);
+            pointers.clear();
+            for (unsigned c = 0; c < channels; c++)
+                pointers.push_back(first + c * stride);
         }
 
+    public:
         /**
-         * @brief Set a stereo sample at index idx. If the data is in mono, only data from channel 0 is used.
-         * Throws runtime_error if data is not initialized or if setting the sample fails.
+         * @brief Create an all-zeroes buffer of num_frames samples for each of the channels.
+         * Throws range_error if channels is not 1...WAV_PLANAR_MAX_CHANNELS.
          */
-        void set_sample_stereo(unsigned idx, const StereoSample &value)
+        PlanarBuffer(unsigned channels, size_t num_frames) : frames(num_frames)
         {
-            if (!wav.data)
-                throw std::runtime_error("no file loaded");
-            float sample_buf[2] = {value.ch0, value.ch1};
-            int err = wav_set_normalized(&wav, idx, sample_buf);
-            if (err)
-                throw std::runtime_error("error while setting sample at index " + std::to_string(idx));
+            if (!channels || channels > WAV_PLANAR_MAX_CHANNELS)
+                throw std::range_error("Number of channels must be 1..." + std::to_string(WAV_PLANAR_MAX_CHANNELS));
+            allocate(channels);
         }
 
         /**
-         * @brief Returns true if the data is in stereo.
-         * Throws runtime_error if data is not initialized.
+         * @brief Copy the samples into new storage. The channel arrays of the copy point into its own storage.
          */
-        bool is_stereo() const
+        PlanarBuffer(const PlanarBuffer &other) : frames(other.frames)
         {
-            if (!wav.data)
-                throw std::runtime_error("no file loaded");
-            return wav.channels > 1;
+            allocate(other.get_channels());
+            for (unsigned c = 0; c < get_channels(); c++)
+                std::copy(other.channel(c), other.channel(c) + frames, channel(c));
+        }
+
+        /**
+         * @brief Copy the samples into new storage. The channel arrays of the copy point into its own storage.
+         */
+        PlanarBuffer &operator=(const PlanarBuffer &other)
+        {
+            if (this != &other)
+                *this = PlanarBuffer(other);
+            return *this;
+        }
+
+        // Moving the vectors keeps their heap arrays, so the channel pointers stay valid
+        PlanarBuffer(PlanarBuffer &&other) noexcept = default;
+        PlanarBuffer &operator=(PlanarBuffer &&other) noexcept = default;
+
+        /**
+         * @brief Get the samples of channel c.
+         */
+        float *channel(unsigned c)
+        {
+            return pointers[c];
+        }
+
+        /**
+         * @brief Get the samples of channel c.
+         */
+        const float *channel(unsigned c) const
+        {
+            return pointers[c];
+        }
+
+        /**
+         * @brief Get the channel array pointers for the C API.
+         */
+        float *const *data()
+        {
+            return pointers.data();
+        }
+
+        /**
+         * @brief Get the channel array pointers for the C API.
+         */
+        const float *const *data() const
+        {
+            return pointers.data();
+        }
+
+        /**
+         * @brief Get the number of channels.
+         */
+        unsigned get_channels() const
+        {
+            return pointers.size();
+        }
+
+        /**
+         * @brief Get the length of each channel array in samples.
+         */
+        size_t get_length() const
+        {
+            return frames;
+        }
+    };
+
+    namespace detail
+    {
+        inline void check_planar_buffer(const PlanarBuffer &buffer, unsigned channels, unsigned count)
+        {
+            if (buffer.get_channels() != channels || buffer.get_length() < count)
+                throw std::invalid_argument("planar buffer does not match the data");
+        }
+    }
+
+    /**
+     * @brief Arena allocator for loading many files with next to no allocator overhead. Pass allocator()
+     * to WaveFile::load_file or WaveFile::create. All the memory is released at once by reset or when the
+     * arena is destroyed, so the WaveFiles using the arena must be destroyed before that. See wav_arena_create.
+     * An arena must only be used by one thread at a time.
+     */
+    class WaveArena
+    {
+        wav_arena *arena = nullptr;
+
+        WaveArena(const WaveArena &) = delete;
+        WaveArena &operator=(const WaveArena &) = delete;
+
+    public:
+        /**
+         * @brief Create an arena that allocates memory in blocks of block_size bytes (0 for the default).
+         * Throws runtime_error if the arena can't be created.
+         */
+        explicit WaveArena(size_t block_size = 0)
+        {
+            if (wav_arena_create(&arena, block_size))
+                throw std::runtime_error("Error creating arena");
+        }
+
+        ~WaveArena()
+        {
+            wav_arena_destroy(arena);
+        }
+
+        /**
+         * @brief Get the allocator of the arena.
+         */
+        const wav_allocator *allocator() const
+        {
+            return wav_arena_allocator(arena);
+        }
+
+        /**
+         * @brief Release all memory allocated from the arena. The WaveFiles using the arena must be
+         * destroyed before calling this.
+         */
+        void reset()
+        {
+            wav_arena_reset(arena);
+        }
+    };
+
+    class WaveFile
+    {
+        wav_file wav;
+        mutable std::map<std::string, std::string> custom_header_data;
+        std::string file_name;
+        bool read_only = false;
+        // Statistics tracked by the C functions through wav.stats, see track_stats
+        std::unique_ptr<wav_stats> tracked_stats;
+
+        WaveFile(const WaveFile &) = delete;
+        WaveFile &operator=(const WaveFile &) = delete;
+
+        void set_format(size_t num_bytes, unsigned channels, unsigned bit_depth, unsigned sample_rate, bool is_float)
+        {
+            const unsigned bytes_per_frame = bit_depth / 8 * channels;
+            if (!channels || channels > 16)
+                throw std::range_error("Number of channels must be 1...16");
+            if (bit_depth < 8 || num_bytes % bytes_per_frame)
+                throw std::invalid_argument("Data size must be a multiple of the frame size");
+            wav.num_bytes = num_bytes;
+            wav.num_frames = num_bytes / bytes_per_frame;
+            wav.channels = channels;
+            wav.bit_depth = bit_depth;
+            wav.sample_rate = sample_rate;
+            wav.is_float = is_float;
+        }
+
+        template <typename Reader>
+        void read_with_headers(const std::string &fname, const std::vector<std::string> &custom_headers, Reader reader,
+                               const wav_allocator *allocator = nullptr)
+        {
+            if (wav.data)
+                throw std::runtime_error("file already loaded");
+            const auto err = detail::read_custom_headers(custom_headers, custom_header_data, reader, allocator);
+            if (err)
+                throw std::runtime_error("Error loading file" + fname);
+            if (wav.channels > 16)
+                throw std::range_error("Number of channels must be max 16");
+            file_name = fname;
+        }
+
+        void check_writable() const
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            if (read_only)
+                throw std::runtime_error("file is mapped read-only");
+        }
+
+        // Builds the custom header list for the C API, adding the tracked statistics, and calls writer with it.
+        // Statistics chunks loaded with the file that no longer match the data are left out. Returns the return
+        // value of writer.
+        template <typename Writer>
+        int write_with_headers(const std::map<std::string, std::string> &custom_headers, Writer writer) const
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            auto chdr_array = detail::to_custom_header_list(custom_headers);
+            const auto is_stats_chunk = [](const wav_file_custom_header_data &hdr)
+            { return !strcmp(hdr.header_name, "PEAK") || !strcmp(hdr.header_name, WAV_STATS_CHUNK_ID); };
+            bool drop_stats = wav.stats != nullptr;
+            for (const auto &hdr : chdr_array)
+            {
+                wav_stats stored;
+                if (!drop_stats && !strcmp(hdr.header_name, WAV_STATS_CHUNK_ID) && wav_stats_from_chunk(&wav, &hdr, &stored, WAV_STATS_VERIFY_DATA))
+                    drop_stats = true;
+            }
+            if (drop_stats)
+                chdr_array.erase(std::remove_if(chdr_array.begin(), chdr_array.end(), is_stats_chunk), chdr_array.end());
+            wav_file_custom_header_data stats_chunks[3];
+            if (wav.stats)
+            {
+                // Stale peaks are recomputed here, the tracked statistics are refreshed by get_stats
+                wav_stats fresh;
+                if (wav_stats_chunks(&wav, wav.stats, stats_chunks) &&
+                    (wav_compute_stats(&wav, &fresh) || wav_stats_chunks(&wav, &fresh, stats_chunks)))
+                    throw std::runtime_error("Error storing statistics");
+                chdr_array.insert(chdr_array.end() - 1, stats_chunks, stats_chunks + 2);
+            }
+            const int err = writer(chdr_array.data());
+            if (wav.stats)
+            {
+                free(stats_chunks[0].data);
+                free(stats_chunks[1].data);
+            }
+            return err;
+        }
+
+    public:
+        WaveFile()
+        {
+            memset(&wav, 0, sizeof(wav_file));
+        }
+
+        /**
+         * @brief Adopt a buffer containing samples in the given format without copying it. The deleter is
+         * called with data when the WaveFile is destroyed, e.g. free for a malloc'd buffer, or a lambda
+         * that unmaps a mapped region.
+         *
+         * Throws range_error or invalid_argument if the format is invalid or num_bytes is not a multiple
+         * of the frame size, in which case the buffer is not adopted and the deleter is not called.
+         *
+         * @param data The sample data. Must not be NULL.
+         * @param num_bytes Size of data in bytes.
+         * @param channels Number of channels
+         * @param bit_depth Bit depth in bits. See wav_get_normalized documentation for list of supported formats.
+         * @param sample_rate Sample rate (Hz)
+         * @param is_float True if floating point format is used
+         * @param deleter Function object called with data to release it.
+         */
+        template <typename Deleter>
+        WaveFile(char *data, size_t num_bytes, unsigned channels, unsigned bit_depth, unsigned sample_rate, bool is_float,
+                 Deleter deleter) : WaveFile()
+        {
+            set_format(num_bytes, channels, bit_depth, sample_rate, is_float);
+            wav.release_ctx = new Deleter(std::move(deleter));
+            wav.release = detail::release_with_deleter<Deleter>;
+            wav.data = data;
+        }
+
+        /**
+         * @brief Adopt the contents of a vector containing samples in the given format without copying it.
+         * The vector is moved from only if the format is valid.
+         *
+         * Throws range_error or invalid_argument if the format is invalid or the vector size is not a
+         * multiple of the frame size.
+         */
+        WaveFile(std::vector<char> &&data, unsigned channels, unsigned bit_depth, unsigned sample_rate, bool is_float)
+            : WaveFile()
+        {
+            set_format(data.size(), channels, bit_depth, sample_rate, is_float);
+            // The buffer of the vector stays in place when the vector is moved into the deleter
+            char *ptr = data.data();
+            auto owner = [buffer = std::move(data)](char *) {};
+            wav.release_ctx = new decltype(owner)(std::move(owner));
+            wav.release = detail::release_with_deleter<decltype(owner)>;
+            wav.data = ptr;
+        }
+
+        /**
+         * @brief Create a WaveFile that uses a caller-owned buffer without copying it or taking ownership.
+         * The buffer must outlive the returned WaveFile.
+         *
+         * Throws range_error or invalid_argument if the format is invalid or num_bytes is not a multiple
+         * of the frame size.
+         */
+        static WaveFile borrow(char *data, size_t num_bytes, unsigned channels, unsigned bit_depth, unsigned sample_rate, bool is_float)
+        {
+            return WaveFile(data, num_bytes, channels, bit_depth, sample_rate, is_float, [](char *) {});
+        }
+
+        /**
+         * @brief Create a read-only WaveFile that uses a caller-owned buffer without copying it or taking
+         * ownership. The buffer must outlive the returned WaveFile. The set functions throw for this file.
+         *
+         * Throws range_error or invalid_argument if the format is invalid or num_bytes is not a multiple
+         * of the frame size.
+         */
+        static WaveFile borrow(const char *data, size_t num_bytes, unsigned channels, unsigned bit_depth, unsigned sample_rate, bool is_float)
+        {
+            // The data is never modified through a read-only WaveFile
+            WaveFile f = borrow(const_cast<char *>(data), num_bytes, channels, bit_depth, sample_rate, is_float);
+            f.read_only = true;
+            return f;
+        }
+
+        /**
+         * @brief Move the data and headers of other into a new WaveFile. other is left empty.
+         */
+        WaveFile(WaveFile &&other) noexcept
+            : wav(other.wav), custom_header_data(std::move(other.custom_header_data)),
+              file_name(std::move(other.file_name)), read_only(other.read_only),
+              tracked_stats(std::move(other.tracked_stats))
+        {
+            memset(&other.wav, 0, sizeof(wav_file));
+            other.read_only = false;
+        }
+
+        /**
+         * @brief Free the current data and move the data and headers of other into this WaveFile.
+         * other is left empty.
+         */
+        WaveFile &operator=(WaveFile &&other) noexcept
+        {
+            if (this != &other)
+            {
+                if (wav.data)
+                    free_wav_file(&wav);
+                wav = other.wav;
+                custom_header_data = std::move(other.custom_header_data);
+                file_name = std::move(other.file_name);
+                read_only = other.read_only;
+                tracked_stats = std::move(other.tracked_stats);
+                memset(&other.wav, 0, sizeof(wav_file));
+                other.read_only = false;
+            }
+            return *this;
+        }
+
+        ~WaveFile()
+        {
+            if (wav.data)
+            {
+                free_wav_file(&wav);
+            }
+        }
+
+        /**
+         * @brief Load a wave file.
+         *
+         * Throws exception if data is already initialized or there's an error while reading the file.
+         *
+         * @param fname The filename.
+         * @param custom_headers Custom header names to be loaded.
+         * @param allocator Allocator for the data, e.g. WaveArena::allocator(), or nullptr for malloc.
+         * Must stay valid as long as the data is loaded. See read_wav_file_alloc.
+         */
+        void load_file(const std::string &fname, const std::vector<std::string> &custom_headers = {},
+                       const wav_allocator *allocator = nullptr)
+        {
+            read_with_headers(fname, custom_headers, [&](wav_file_custom_header_data *chdr)
+                              { return read_wav_file_alloc(fname.c_str(), &wav, chdr, allocator); },
+                              allocator);
+        }
+
+        /**
+         * @brief Load a wave file by memory mapping it. The samples are loaded on demand from the
+         * mapping instead of being read to memory up front. See read_wav_file_mmap.
+         *
+         * Throws exception if data is already initialized or there's an error while mapping the file.
+         *
+         * @param fname The filename.
+         * @param custom_headers Custom header names to be loaded.
+         * @param read_only If true the mapping is shared with other processes mapping the same file
+         * and the samples cannot be modified.
+         */
+        void map_file(const std::string &fname, const std::vector<std::string> &custom_headers = {}, bool read_only = false)
+        {
+            read_with_headers(fname, custom_headers, [&](wav_file_custom_header_data *chdr)
+                              { return read_wav_file_mmap(fname.c_str(), &wav, chdr, read_only ? WAV_MMAP_READ_ONLY : 0); });
+            this->read_only = read_only;
+        }
+
+        /**
+         * @brief Load a wave file from a memory buffer, e.g. a payload received over the network. See
+         * read_wav_memory. Headers not listed in custom_headers can't be read later with get_header.
+         *
+         * Throws exception if data is already initialized or the buffer doesn't contain a valid wave file.
+         *
+         * @param data The contents of the wave file.
+         * @param size Size of data in bytes.
+         * @param custom_headers Custom header names to be loaded.
+         * @param zero_copy If true the samples are not copied but used from data, which must then outlive the
+         * WaveFile. The samples can't be modified in this mode.
+         */
+        void load_memory(const void *data, size_t size, const std::vector<std::string> &custom_headers = {}, bool zero_copy = false)
+        {
+            read_with_headers("", custom_headers, [&](wav_file_custom_header_data *chdr)
+                              { return read_wav_memory(data, size, &wav, chdr, zero_copy ? WAV_MEMORY_ZERO_COPY : 0); });
+            read_only = zero_copy;
+        }
+
+        /**
+         * @brief Read only the format of a wave file without reading any sample data. See wav_probe.
+         * Throws runtime_error if the file can't be probed.
+         */
+        static WaveInfo probe(const std::string &fname)
+        {
+            wav_file wav;
+            if (wav_probe(fname.c_str(), &wav, nullptr))
+                throw std::runtime_error("Error probing file" + fname);
+            return detail::to_wave_info(wav, true);
+        }
+
+        /**
+         * @brief Probe the files concurrently on num_threads threads (0 for one thread per processor).
+         * See wav_probe_batch. The results are in the same order as fnames; files that could not be
+         * probed have valid set to false.
+         */
+        static std::vector<WaveInfo> probe(const std::vector<std::string> &fnames, unsigned num_threads = 0)
+        {
+            std::vector<const char *> names;
+            for (auto &fname : fnames)
+                names.push_back(fname.c_str());
+            std::vector<wav_file> wavs(fnames.size());
+            std::vector<int> results(fnames.size(), -1);
+            wav_probe_batch(names.data(), names.size(), wavs.data(), results.data(), num_threads);
+            std::vector<WaveInfo> infos;
+            for (size_t i = 0; i < fnames.size(); i++)
+                infos.push_back(detail::to_wave_info(wavs[i], !results[i]));
+            return infos;
+        }
+
+        /**
+         * @brief Write the wave data to a file.
+         *
+         * Throws exception if data hasn't been initialized or there's an error while writing the file.
+         *
+         * @param fname The file name.
+         * @param custom_headers Custom headers to be saved as a map where the key is the custom header
+         * name and the value is the custom header value.
+         * @param rf64 If true, the file is written in RF64 format even if it's smaller than 4 GiB. Larger files
+         * are always written in RF64 format.
+         */
+        void write_file(const std::string &fname, const std::map<std::string, std::string> &custom_headers = {}, bool rf64 = false) const
+        {
+            if (write_with_headers(custom_headers, [&](const wav_file_custom_header_data *chdr)
+                                   { return write_wav_file_ex(fname.c_str(), &wav, chdr, rf64 ? WAV_WRITE_RF64 : 0); }))
+                throw std::runtime_error("Error writing file" + fname);
+        }
+
+        /**
+         * @brief Serialize the wave data like write_file into buffer, which holds capacity bytes. Nothing is
+         * written if the file doesn't fit. See write_wav_memory.
+         *
+         * Throws exception if data hasn't been initialized.
+         *
+         * Returns the size of the serialized file, which is larger than capacity if it didn't fit.
+         */
+        size_t write_memory(char *buffer, size_t capacity, const std::map<std::string, std::string> &custom_headers = {},
+                            bool rf64 = false) const
+        {
+            size_t size = 0;
+            const int err = write_with_headers(custom_headers, [&](const wav_file_custom_header_data *chdr)
+                                               { return write_wav_memory(&wav, chdr, rf64 ? WAV_WRITE_RF64 : 0, buffer, capacity, &size); });
+            if (err && size <= capacity)
+                throw std::runtime_error("Error serializing wave data");
+            return size;
+        }
+
+        /**
+         * @brief Serialize the wave data like write_file into buffer, which is resized to the size of the file.
+         * Reusing the same buffer avoids allocations once its capacity is large enough.
+         *
+         * Throws exception if data hasn't been initialized.
+         */
+        void write_memory(std::vector<char> &buffer, const std::map<std::string, std::string> &custom_headers = {},
+                          bool rf64 = false) const
+        {
+            buffer.resize(buffer.capacity());
+            const size_t size = write_memory(buffer.data(), buffer.size(), custom_headers, rf64);
+            if (size > buffer.size())
+            {
+                buffer.resize(size);
+                write_memory(buffer.data(), buffer.size(), custom_headers, rf64);
+            }
+            buffer.resize(size);
+        }
+
+        /**
+         * @brief Compute the per-channel peak, RMS and DC offset statistics of the data in one pass,
+         * or return the tracked statistics if track_stats is enabled.
+         * Throws runtime_error if data is not initialized or the format is not supported.
+         */
+        wav_stats get_stats()
+        {
+            if (wav.stats)
+            {
+                wav_refresh_stats(&wav);
+                return *wav.stats;
+            }
+            wav_stats stats;
+            if (wav_compute_stats(&wav, &stats))
+                throw std::runtime_error("error while computing statistics");
+            return stats;
+        }
+
+        /**
+         * @brief Keep the statistics up to date as samples are set, so get_stats doesn't need to decode the
+         * data. When enabled, write_file also stores them in a PEAK chunk and a statistics chunk, which
+         * read_stats reads back.
+         * Throws runtime_error if data is not initialized or the format is not supported.
+         */
+        void track_stats(bool enable)
+        {
+            if (!enable)
+            {
+                wav.stats = nullptr;
+                tracked_stats.reset();
+                return;
+            }
+            if (!tracked_stats)
+                tracked_stats.reset(new wav_stats());
+            if (wav_track_stats(&wav, tracked_stats.get()))
+            {
+                tracked_stats.reset();
+                throw std::runtime_error("error while computing statistics");
+            }
+        }
+
+        /**
+         * @brief Read the statistics stored by write_file from file fname without reading the samples.
+         * With verify_data the samples are read to check the hash stored with the statistics, which also
+         * rejects statistics of data changed by other programs. Returns false if the file has no valid statistics.
+         */
+        static bool read_stats(const std::string &fname, wav_stats &stats, bool verify_data = false)
+        {
+            return !wav_read_stats_ex(fname.c_str(), &stats, verify_data ? WAV_STATS_VERIFY_DATA : 0);
+        }
+
+        /**
+         * @brief Create an empty all-zeroes wave file.
+         *
+         * @param length Length in mono/stereo samples
+         * @param stereo True if stereo, false if mono
+         * @param bit_depth Bit depth in bits. See wav_get_normalized documentation for list of supported formats.
+         * @param sample_rate Sample rate (Hz)
+         * @param is_float True if floating point format is used
+         * @param allocator Allocator for the data, or nullptr for malloc. Must stay valid as long as the
+         * data is in use.
+         */
+        void create(unsigned long long length, bool stereo, unsigned bit_depth, unsigned sample_rate, bool is_float,
+                    const wav_allocator *allocator = nullptr)
+        {
+            if (wav.data)
+                throw std::runtime_error("file already loaded");
+            auto err = create_wav_file_alloc(&wav, length, stereo ? 2 : 1, bit_depth, sample_rate, allocator);
+            if (err)
+                throw std::runtime_error("Error creating wav file");
+            wav.is_float = is_float;
+        }
+
+        /**
+         * @brief Get a custom header by name. Headers that were not listed when loading the file are
+         * read from the file on first access. Throws an invalid_argument exception if
+         * header is not found. Returns the header value as string.
+         */
+        std::string get_header(const std::string &name) const
+        {
+            auto data = custom_header_data.find(name);
+            if (data != custom_header_data.end())
+                return data->second;
+            if (file_name.empty() ||
+                !detail::with_chunk_reader(file_name, [&](wav_reader *reader)
+                                           { return detail::read_chunk(reader, name, custom_header_data); }))
+                throw std::invalid_argument("Header not found: " + name);
+            return custom_header_data[name];
+        }
+
+        /**
+         * @brief Get the ids of all chunks in the loaded file in file order.
+         * Throws runtime_error if the data was not loaded from a file.
+         */
+        std::vector<std::string> get_chunks() const
+        {
+            return detail::with_chunk_reader(file_name, [](wav_reader *reader)
+                                             { return detail::chunk_ids(wav_reader_chunks(reader)); });
+        }
+
+        /**
+         * @brief Get the length of data in mono/stereo samples.
+         * Throws runtime_error if data is not initialized.
+         */
+        unsigned long long get_length() const
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            return wav.num_frames;
+        }
+
+        /**
+         * @brief Get a mono sample from index idx. If the data is in stereo, returns the sample from channel 0.
+         * Throws runtime_error if data is not initialized or if getting the sample fails.
+         */
+        float get_sample(unsigned long long idx) const
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            float sample_buf[16];
+            int err = wav_get_normalized(&wav, idx, sample_buf);
+            if (err)
+                throw std::runtime_error("error while getting sample at index " + std::to_string(idx));
+            return sample_buf[0];
+        }
+
+        /**
+         * @brief Get a stereo sample from index idx. If the data is in mono, the contents of the second channel
+         * will be same as the first channel.
+         * Throws runtime_error if data is not initialized or if getting the sample fails.
+         */
+        StereoSample get_sample_stereo(unsigned long long idx) const
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            float sample_buf[16];
+            int err = wav_get_normalized(&wav, idx, sample_buf);
+            if (err)
+                throw std::runtime_error("error while getting sample at index " + std::to_string(idx));
+            if (wav.channels == 1)
+                sample_buf[1] = sample_buf[0];
+            return {sample_buf[0], sample_buf[1]};
+        }
+
+        /**
+         * @brief Set a mono sample at index idx. If the data is in stereo, sets both channels to the sample.
+         * Throws runtime_error if data is not initialized, is mapped read-only or if setting the sample fails.
+         */
+        void set_sample(unsigned long long idx, float value)
+        {
+            check_writable();
+            float sample_buf[2] = {value, value};
+            int err = wav_set_normalized(&wav, idx, sample_buf);
+            if (err)
+                throw std::runtime_error("error while setting sample at index " + std::to_string(idx));
+        }
+
+        /**
+         * @brief Set a stereo sample at index idx. If the data is in mono, only data from channel 0 is used.
+         * Throws runtime_error if data is not initialized, is mapped read-only or if setting the sample fails.
+         */
+        void set_sample_stereo(unsigned long long idx, const StereoSample &value)
+        {
+            check_writable();
+            float sample_buf[2] = {value.ch0, value.ch1};
+            int err = wav_set_normalized(&wav, idx, sample_buf);
+            if (err)
+                throw std::runtime_error("error while setting sample at index " + std::to_string(idx));
+        }
+
+        /**
+         * @brief Get count n-channel samples starting from index first as interleaved floats into out.
+         * The out buffer must hold at least count * channels elements.
+         * Throws runtime_error if data is not initialized or if the range is invalid.
+         */
+        void get_samples(unsigned long long first, unsigned count, float *out) const
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            int err = wav_get_normalized_range(&wav, first, count, out);
+            if (err)
+                throw std::runtime_error("error while getting samples at index " + std::to_string(first));
+        }
+
+        /**
+         * @brief Get count n-channel samples starting from index first as interleaved floats.
+         * Throws runtime_error if data is not initialized or if the range is invalid.
+         */
+        std::vector<float> get_samples(unsigned long long first, unsigned count) const
+        {
+            std::vector<float> out(static_cast<size_t>(count) * get_channels());
+            get_samples(first, count, out.data());
+            return out;
+        }
+
+        /**
+         * @brief Set count n-channel samples starting from index first from interleaved floats in values.
+         * The values buffer must hold at least count * channels elements. Values are clipped to -1.0f ... 1.0f.
+         * Throws runtime_error if data is not initialized, is mapped read-only or if the range is invalid.
+         */
+        void set_samples(unsigned long long first, unsigned count, const float *values)
+        {
+            check_writable();
+            int err = wav_set_normalized_range(&wav, first, count, values);
+            if (err)
+                throw std::runtime_error("error while setting samples at index " + std::to_string(first));
+        }
+
+        /**
+         * @brief Set n-channel samples starting from index first from interleaved floats in values.
+         * Throws runtime_error if data is not initialized, if the range is invalid or if the size of
+         * values is not a multiple of the channel count.
+         */
+        void set_samples(unsigned long long first, const std::vector<float> &values)
+        {
+            const unsigned channels = get_channels();
+            if (values.size() % channels)
+                throw std::invalid_argument("number of values must be a multiple of channel count");
+            set_samples(first, static_cast<unsigned>(values.size() / channels), values.data());
+        }
+
+        /**
+         * @brief Get count n-channel samples starting from index first as interleaved floats into out, converting
+         * in parallel. The conversion runs on executor, or on num_threads internal threads (0 for one per processor)
+         * if executor is nullptr. See wav_get_normalized_range_parallel. The out buffer must hold at least
+         * count * channels elements.
+         * Throws runtime_error if data is not initialized or if the range is invalid.
+         */
+        void get_samples_parallel(unsigned long long first, unsigned count, float *out, unsigned num_threads = 0,
+                                  const wav_executor *executor = nullptr) const
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            if (wav_get_normalized_range_parallel(&wav, first, count, out, num_threads, executor))
+                throw std::runtime_error("error while getting samples at index " + std::to_string(first));
+        }
+
+        /**
+         * @brief Set count n-channel samples starting from index first from interleaved floats in values, converting
+         * in parallel as in get_samples_parallel. Values are clipped to -1.0f ... 1.0f.
+         * Throws runtime_error if data is not initialized, is mapped read-only or if the range is invalid.
+         */
+        void set_samples_parallel(unsigned long long first, unsigned count, const float *values, unsigned num_threads = 0,
+                                  const wav_executor *executor = nullptr)
+        {
+            check_writable();
+            if (wav_set_normalized_range_parallel(&wav, first, count, values, num_threads, executor))
+                throw std::runtime_error("error while setting samples at index " + std::to_string(first));
+        }
+
+        /**
+         * @brief Get count n-channel samples starting from index first into the planar buffer out. The buffer must
+         * have the same number of channels as the data and hold at least count samples per channel.
+         * Throws runtime_error if data is not initialized or if the range is invalid, or invalid_argument if the
+         * buffer doesn't match the data.
+         */
+        void get_planar(unsigned long long first, unsigned count, PlanarBuffer &out) const
+        {
+            detail::check_planar_buffer(out, get_channels(), count);
+            if (wav_get_normalized_planar(&wav, first, count, out.data()))
+                throw std::runtime_error("error while getting samples at index " + std::to_string(first));
+        }
+
+        /**
+         * @brief Get count n-channel samples starting from index first as a planar buffer.
+         * Throws runtime_error if data is not initialized or if the range is invalid.
+         */
+        PlanarBuffer get_planar(unsigned long long first, unsigned count) const
+        {
+            PlanarBuffer out(get_channels(), count);
+            get_planar(first, count, out);
+            return out;
+        }
+
+        /**
+         * @brief Set count n-channel samples starting from index first from the planar buffer values. The buffer must
+         * have the same number of channels as the data and hold at least count samples per channel.
+         * Values are clipped to -1.0f ... 1.0f.
+         * Throws runtime_error if data is not initialized, is mapped read-only or if the range is invalid,
+         * or invalid_argument if the buffer doesn't match the data.
+         */
+        void set_planar(unsigned long long first, unsigned count, const PlanarBuffer &values)
+        {
+            check_writable();
+            detail::check_planar_buffer(values, get_channels(), count);
+            if (wav_set_normalized_planar(&wav, first, count, values.data()))
+                throw std::runtime_error("error while setting samples at index " + std::to_string(first));
+        }
+
+        /**
+         * @brief Re-encode the data to another bit depth or between integer and float samples, without
+         * a second full-size buffer when the data is owned by the library (see wav_convert_in_place).
+         * Views obtained before the call are invalidated.
+         * Throws runtime_error if data is not initialized or is read-only, or invalid_argument if the
+         * format is not supported.
+         */
+        void convert(unsigned bit_depth, bool is_float)
+        {
+            check_writable();
+            if (!(is_float ? bit_depth == 32 || bit_depth == 64 : bit_depth == 8 || bit_depth == 16 || bit_depth == 24 || bit_depth == 32))
+                throw std::invalid_argument("unsupported sample format");
+            if (wav_convert_in_place(&wav, bit_depth, is_float))
+                throw std::runtime_error("error while converting samples");
+        }
+
+        /**
+         * @brief Resample the data to sample_rate into a new buffer in the same sample format (see wav_resample).
+         * The old data is released, so this also works on read-only mappings. Views obtained before the call
+         * are invalidated and tracked statistics are recomputed.
+         * Throws runtime_error if data is not initialized, or invalid_argument if the rates or the format
+         * are not supported.
+         */
+        void resample(unsigned sample_rate)
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            wav_file out;
+            if (wav_resample(&wav, &out, sample_rate))
+                throw std::invalid_argument("cannot resample to " + std::to_string(sample_rate) + " Hz");
+            wav_stats *stats = wav.stats;
+            free_wav_file(&wav);
+            wav = out;
+            read_only = false;
+            if (stats)
+            {
+                wav.stats = stats;
+                wav_compute_stats(&wav, stats);
+            }
+        }
+
+        /**
+         * @brief Get the sample rate (Hz).
+         * Throws runtime_error if data is not initialized.
+         */
+        unsigned get_sample_rate() const
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            return wav.sample_rate;
+        }
+
+        /**
+         * @brief Get the number of channels.
+         * Throws runtime_error if data is not initialized.
+         */
+        unsigned get_channels() const
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            return wav.channels;
+        }
+
+        /**
+         * @brief Get a typed view to the data, e.g. view<Pcm16, 2>(). Channels can be 0 for any channel count.
+         * Throws runtime_error if data is not initialized or is mapped read-only, or invalid_argument if
+         * the data is not in the requested format.
+         */
+        template <typename Format, unsigned Channels>
+        WaveView<Format, Channels> view()
+        {
+            check_writable();
+            if (wav.bit_depth != Format::bit_depth || (wav.is_float != 0) != Format::is_float ||
+                (Channels && wav.channels != Channels))
+                throw std::invalid_argument("view format does not match the data");
+            return WaveView<Format, Channels>(wav.data, wav.num_frames, wav.channels);
+        }
+
+        /**
+         * @brief Select the WaveView matching the format of the data once and call func with it. func must be
+         * callable with a reference to any WaveView, e.g. a generic lambda, and is instantiated for every format
+         * with 1, 2 and 0 (any) channels. Returns the return value of func.
+         * Throws runtime_error if data is not initialized or is mapped read-only, or invalid_argument if the
+         * format is not supported.
+         */
+        template <typename Func>
+        decltype(auto) with_view(Func func)
+        {
+            check_writable();
+            return detail::dispatch_view<false>(wav, func);
+        }
+
+        /**
+         * @brief Like with_view but func is called with a const WaveView, so it can also be used for
+         * read-only data.
+         * Throws runtime_error if data is not initialized or invalid_argument if the format is not supported.
+         */
+        template <typename Func>
+        decltype(auto) with_view(Func func) const
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            return detail::dispatch_view<true>(wav, func);
+        }
+
+        /**
+         * @brief Returns true if the data is in stereo.
+         * Throws runtime_error if data is not initialized.
+         */
+        bool is_stereo() const
+        {
+            if (!wav.data)
+                throw std::runtime_error("no file loaded");
+            return wav.channels > 1;
+        }
+    };
+
+
+    /**
+     * @brief Streaming reader that pulls the samples from the file block by block, so that the whole
+     * data chunk is never held in memory. See wav_reader_open.
+     */
+    class WaveReader
+    {
+        wav_reader *reader = nullptr;
+        mutable std::map<std::string, std::string> custom_header_data;
+
+        WaveReader(const WaveReader &) = delete;
+        WaveReader &operator=(const WaveReader &) = delete;
+
+    public:
+        /**
+         * @brief Move the open file of other into a new WaveReader. other can only be destroyed afterwards.
+         */
+        WaveReader(WaveReader &&other) noexcept
+            : reader(other.reader), custom_header_data(std::move(other.custom_header_data))
+        {
+            other.reader = nullptr;
+        }
+
+        /**
+         * @brief Close the current file and move the open file of other into this WaveReader.
+         * other can only be destroyed afterwards.
+         */
+        WaveReader &operator=(WaveReader &&other) noexcept
+        {
+            if (this != &other)
+            {
+                wav_reader_close(reader);
+                reader = other.reader;
+                custom_header_data = std::move(other.custom_header_data);
+                other.reader = nullptr;
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Open a file for streaming.
+         *
+         * Throws runtime_error if there's an error while opening the file.
+         *
+         * @param fname The filename.
+         * @param custom_headers Custom header names to be loaded.
+         * @param block_frames Number of frames converted at a time, 0 for the default.
+         */
+        WaveReader(const std::string &fname, const std::vector<std::string> &custom_headers = {}, unsigned block_frames = 0)
+        {
+            const auto err = detail::read_custom_headers(custom_headers, custom_header_data, [&](wav_file_custom_header_data *chdr)
+                                                         { return wav_reader_open(&reader, fname.c_str(), chdr, block_frames); });
+            if (err)
+                throw std::runtime_error("Error opening file" + fname);
+        }
+
+        ~WaveReader()
+        {
+            wav_reader_close(reader);
+        }
+
+        /**
+         * @brief Read at most count n-channel samples as interleaved floats into out. The out buffer
+         * must hold at least count * channels elements.
+         * Returns the number of frames read, which is less than count only at the end of the data.
+         * Throws runtime_error on read error.
+         */
+        unsigned read(float *out, unsigned count)
+        {
+            const int frames = wav_reader_read(reader, out, count);
+            if (frames < 0)
+                throw std::runtime_error("error while reading samples");
+            return frames;
+        }
+
+        /**
+         * @brief Read at most count n-channel samples as interleaved floats. The returned vector
+         * is shorter than count * channels only at the end of the data.
+         * Throws runtime_error on read error.
+         */
+        std::vector<float> read(unsigned count)
+        {
+            std::vector<float> out(static_cast<size_t>(count) * get_channels());
+            out.resize(static_cast<size_t>(read(out.data(), count)) * get_channels());
+            return out;
+        }
+
+        /**
+         * @brief Read at most count n-channel samples into the planar buffer out. The buffer must have the same
+         * number of channels as the file and hold at least count samples per channel.
+         * Returns the number of frames read, which is less than count only at the end of the data.
+         * Throws runtime_error on read error or invalid_argument if the buffer doesn't match the file.
+         */
+        unsigned read_planar(PlanarBuffer &out, unsigned count)
+        {
+            detail::check_planar_buffer(out, get_channels(), count);
+            const int frames = wav_reader_read_planar(reader, out.data(), count);
+            if (frames < 0)
+                throw std::runtime_error("error while reading samples");
+            return frames;
+        }
+
+        /**
+         * @brief Move the read position to frame index idx.
+         * Throws out_of_range if idx is past the end of the data.
+         */
+        void seek(unsigned long long idx)
+        {
+            if (wav_reader_seek(reader, idx))
+                throw std::out_of_range("cannot seek to index " + std::to_string(idx));
+        }
+
+        /**
+         * @brief Get the current read position as frame index.
+         */
+        unsigned long long get_position() const
+        {
+            return wav_reader_position(reader);
+        }
+
+        /**
+         * @brief Enable read-ahead of up to num_blocks blocks on a background I/O thread, 0 for the default.
+         * See wav_reader_prefetch.
+         * Throws runtime_error if read-ahead is already enabled or the thread can't be started.
+         */
+        void prefetch(unsigned num_blocks = 0)
+        {
+            if (wav_reader_prefetch(reader, num_blocks))
+                throw std::runtime_error("cannot enable read-ahead");
+        }
+
+        /**
+         * @brief Get the read-ahead statistics. Throws runtime_error if read-ahead is not enabled.
+         */
+        wav_prefetch_stats get_prefetch_stats() const
+        {
+            wav_prefetch_stats stats;
+            if (wav_reader_prefetch_stats(reader, &stats))
+                throw std::runtime_error("read-ahead is not enabled");
+            return stats;
+        }
+
+        /**
+         * @brief Get a custom header by name. Headers that were not listed when opening the file are
+         * read from the file on first access. Throws an invalid_argument exception if
+         * header is not found. Returns the header value as string.
+         */
+        std::string get_header(const std::string &name) const
+        {
+            auto data = custom_header_data.find(name);
+            if (data != custom_header_data.end())
+                return data->second;
+            if (!detail::read_chunk(reader, name, custom_header_data))
+                throw std::invalid_argument("Header not found: " + name);
+            return custom_header_data[name];
+        }
+
+        /**
+         * @brief Get the ids of all chunks in the file in file order.
+         */
+        std::vector<std::string> get_chunks() const
+        {
+            return detail::chunk_ids(wav_reader_chunks(reader));
+        }
+
+        /**
+         * @brief Get the length of data in n-channel samples.
+         */
+        unsigned long long get_length() const
+        {
+            return wav_reader_format(reader)->num_frames;
+        }
+
+        /**
+         * @brief Get the number of channels.
+         */
+        unsigned get_channels() const
+        {
+            return wav_reader_format(reader)->channels;
+        }
+
+        /**
+         * @brief Get the sample rate in Hz.
+         */
+        unsigned get_sample_rate() const
+        {
+            return wav_reader_format(reader)->sample_rate;
+        }
+
+        /**
+         * @brief Get the bit depth in bits.
+         */
+        unsigned get_bit_depth() const
+        {
+            return wav_reader_format(reader)->bit_depth;
+        }
+
+        /**
+         * @brief Returns true if the samples are in floating point format.
+         */
+        bool is_float() const
+        {
+            return wav_reader_format(reader)->is_float;
+        }
+    };
+
+
+    /**
+     * @brief Streaming writer that appends samples to a file block by block, so that the whole data
+     * never needs to be held in memory. The chunk sizes are patched in close. See wav_writer_open.
+     */
+    class WaveWriter
+    {
+        wav_writer *writer = nullptr;
+
+        WaveWriter(const WaveWriter &) = delete;
+        WaveWriter &operator=(const WaveWriter &) = delete;
+
+    public:
+        /**
+         * @brief Move the open file of other into a new WaveWriter. other is left closed.
+         */
+        WaveWriter(WaveWriter &&other) noexcept : writer(other.writer)
+        {
+            other.writer = nullptr;
+        }
+
+        /**
+         * @brief Close the current file, ignoring errors, and move the open file of other into this WaveWriter.
+         * other is left closed.
+         */
+        WaveWriter &operator=(WaveWriter &&other) noexcept
+        {
+            if (this != &other)
+            {
+                wav_writer_close(writer);
+                writer = other.writer;
+                other.writer = nullptr;
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Create a file for streaming.
+         *
+         * Throws runtime_error if there's an error while creating the file.
+         *
+         * @param fname The file name.
+         * @param channels Number of channels
+         * @param bit_depth Bit depth in bits. See wav_get_normalized documentation for list of supported formats.
+         * @param sample_rate Sample rate (Hz)
+         * @param is_float True if floating point format is used
+         * @param custom_headers Custom headers to be saved as a map where the key is the custom header
+         * name and the value is the custom header value.
+         * @param block_frames Number of frames converted at a time, 0 for the default.
+         * @param rf64 If true, the file is written in RF64 format even if it's smaller than 4 GiB. Larger files
+         * are always written in RF64 format.
+         */
+        WaveWriter(const std::string &fname, unsigned channels, unsigned bit_depth, unsigned sample_rate, bool is_float,
+                   const std::map<std::string, std::string> &custom_headers = {}, unsigned block_frames = 0, bool rf64 = false)
+        {
+            wav_file format;
+            memset(&format, 0, sizeof(wav_file));
+            format.channels = channels;
+            format.bit_depth = bit_depth;
+            format.sample_rate = sample_rate;
+            format.is_float = is_float;
+            auto chdr_array = detail::to_custom_header_list(custom_headers);
+            if (wav_writer_open(&writer, fname.c_str(), &format, chdr_array.data(), block_frames, rf64 ? WAV_WRITE_RF64 : 0))
+                throw std::runtime_error("Error creating file" + fname);
+        }
+
+        /**
+         * @brief Closes the file if close has not been called. Errors are ignored; call close to detect them.
+         */
+        ~WaveWriter()
+        {
+            wav_writer_close(writer);
+        }
+
+        /**
+         * @brief Append count n-channel samples from interleaved floats in values. The values buffer must
+         * hold at least count * channels elements. Values are clipped to -1.0f ... 1.0f.
+         * Throws runtime_error if the file is closed or writing fails.
+         */
+        void write(const float *values, unsigned count)
+        {
+            if (!writer)
+                throw std::runtime_error("file closed");
+            if (wav_writer_write(writer, values, count))
+                throw std::runtime_error("error while writing samples");
+        }
+
+        /**
+         * @brief Append n-channel samples from interleaved floats in values.
+         * Throws runtime_error if the file is closed or writing fails, or invalid_argument if the size of
+         * values is not a multiple of the channel count.
+         */
+        void write(const std::vector<float> &values)
+        {
+            const unsigned channels = get_channels();
+            if (values.size() % channels)
+                throw std::invalid_argument("number of values must be a multiple of channel count");
+            write(values.data(), static_cast<unsigned>(values.size() / channels));
+        }
+
+        /**
+         * @brief Append count n-channel samples from the planar buffer values. The buffer must have the same
+         * number of channels as the file and hold at least count samples per channel.
+         * Values are clipped to -1.0f ... 1.0f.
+         * Throws runtime_error if the file is closed or writing fails, or invalid_argument if the buffer
+         * doesn't match the file.
+         */
+        void write_planar(const PlanarBuffer &values, unsigned count)
+        {
+            detail::check_planar_buffer(values, get_channels(), count);
+            if (wav_writer_write_planar(writer, values.data(), count))
+                throw std::runtime_error("error while writing samples");
+        }
+
+        /**
+         * @brief Patch the chunk sizes and close the file.
+         * Throws runtime_error if the file is already closed or if any write has failed.
+         */
+        void close()
+        {
+            if (!writer)
+                throw std::runtime_error("file closed");
+            const int err = wav_writer_close(writer);
+            writer = nullptr;
+            if (err)
+                throw std::runtime_error("error while closing file");
+        }
+
+        /**
+         * @brief Get the number of n-channel samples written so far.
+         * Throws runtime_error if the file is closed.
+         */
+        unsigned long long get_length() const
+        {
+            if (!writer)
+                throw std::runtime_error("file closed");
+            return wav_writer_format(writer)->num_frames;
+        }
+
+        /**
+         * @brief Get the number of channels.
+         * Throws runtime_error if the file is closed.
+         */
+        unsigned get_channels() const
+        {
+            if (!writer)
+                throw std::runtime_error("file closed");
+            return wav_writer_format(writer)->channels;
+        }
+    };
+
+    /**
+     * @brief Multi-resolution min/max summary of a wave file for drawing waveforms at any zoom level.
+     * See wav_overview_create.
+     */
+    class WaveOverview
+    {
+        wav_overview *overview = nullptr;
+
+        WaveOverview(const WaveOverview &) = delete;
+        WaveOverview &operator=(const WaveOverview &) = delete;
+
+        explicit WaveOverview(wav_overview *overview) : overview(overview) {}
+
+    public:
+        WaveOverview(WaveOverview &&other) noexcept : overview(other.overview)
+        {
+            other.overview = nullptr;
+        }
+
+        WaveOverview &operator=(WaveOverview &&other) noexcept
+        {
+            if (this != &other)
+            {
+                if (overview)
+                    wav_overview_free(overview);
+                overview = other.overview;
+                other.overview = nullptr;
+            }
+            return *this;
+        }
+
+        ~WaveOverview()
+        {
+            if (overview)
+                wav_overview_free(overview);
+        }
+
+        /**
+         * @brief Build the overview of file fname with the streaming reader.
+         * Throws runtime_error if the file can't be read.
+         */
+        static WaveOverview build(const std::string &fname)
+        {
+            wav_overview *overview;
+            if (wav_overview_build(&overview, fname.c_str()))
+                throw std::runtime_error("Error building overview of file" + fname);
+            return WaveOverview(overview);
+        }
+
+        /**
+         * @brief Load an overview from a sidecar file written with save.
+         * Throws runtime_error if the file is not a valid overview.
+         */
+        static WaveOverview load(const std::string &fname)
+        {
+            wav_overview *overview;
+            if (wav_overview_load(&overview, fname.c_str()))
+                throw std::runtime_error("Error loading overview" + fname);
+            return WaveOverview(overview);
+        }
+
+        /**
+         * @brief Create an overview from the contents of a chunk returned by to_chunk, e.g. from
+         * WaveFile::get_header(WAV_OVERVIEW_CHUNK_ID). Throws invalid_argument if the chunk is not a valid overview.
+         */
+        static WaveOverview from_chunk(const std::string &chunk)
+        {
+            wav_overview *overview;
+            wav_file_custom_header_data chdr = {WAV_OVERVIEW_CHUNK_ID, static_cast<unsigned>(chunk.size()),
+                                                const_cast<char *>(chunk.data())};
+            if (wav_overview_from_chunk(&overview, &chdr))
+                throw std::invalid_argument("invalid overview chunk");
+            return WaveOverview(overview);
+        }
+
+        /**
+         * @brief Write the overview to a sidecar file. Throws runtime_error if the file can't be written.
+         */
+        void save(const std::string &fname) const
+        {
+            if (wav_overview_save(overview, fname.c_str()))
+                throw std::runtime_error("Error writing file" + fname);
+        }
+
+        /**
+         * @brief Get the overview as the contents of a WAV_OVERVIEW_CHUNK_ID chunk for the custom headers
+         * of WaveFile::write_file.
+         */
+        std::string to_chunk() const
+        {
+            wav_file_custom_header_data chdr;
+            if (wav_overview_chunk(overview, &chdr))
+                throw std::runtime_error("Error storing overview");
+            std::string chunk(chdr.data, chdr.num_bytes);
+            free(chdr.data);
+            return chunk;
+        }
+
+        /**
+         * @brief Get the (min, max) pairs of channel in frames first ... end - 1 split into width pixels.
+         * See wav_overview_query. Throws out_of_range if the range or channel is invalid.
+         */
+        std::vector<std::pair<float, float>> query(unsigned channel, unsigned long long first, unsigned long long end,
+                                                   unsigned width) const
+        {
+            std::vector<float> min(width), max(width);
+            if (wav_overview_query(overview, channel, first, end, width, min.data(), max.data()))
+                throw std::out_of_range("invalid overview range");
+            std::vector<std::pair<float, float>> pixels(width);
+            for (unsigned p = 0; p < width; p++)
+                pixels[p] = {min[p], max[p]};
+            return pixels;
+        }
+
+        /**
+         * @brief Get the number of n-channel samples covered by the overview.
+         */
+        unsigned long long get_length() const
+        {
+            return wav_overview_frames(overview);
+        }
+
+        /**
+         * @brief Get the number of channels.
+         */
+        unsigned get_channels() const
+        {
+            return wav_overview_channels(overview);
+        }
+    };
+
+    /**
+     * @brief A source of mix: a file with its gain and position in the mix. See wav_mix_source.
+     */
+    struct MixSource
+    {
+        /**
+         * @brief Name of the file
+         */
+        std::string fname;
+        /**
+         * @brief Gain at the first frame of the source
+         */
+        float gain = 1.0f;
+        /**
+         * @brief Gain reached linearly after ramp_frames frames, ignored if ramp_frames is 0
+         */
+        float end_gain = 1.0f;
+        /**
+         * @brief Length of the gain ramp in frames, 0 for a constant gain
+         */
+        unsigned long long ramp_frames = 0;
+        /**
+         * @brief Frame of the output at which the source starts
+         */
+        unsigned long long offset = 0;
+    };
+
+    /**
+     * @brief Mix the sources block by block into a new file fname with the given format, summing on
+     * num_threads threads (0 for one thread per processor) for many sources. See wav_mix.
+     * Throws runtime_error if a source can't be read or doesn't match the format, or the file can't be written.
+     */
+    inline void mix(const std::vector<MixSource> &sources, const std::string &fname, unsigned channels, unsigned bit_depth,
+                    unsigned sample_rate, bool is_float, unsigned num_threads = 0)
+    {
+        std::vector<wav_mix_source> c_sources;
+        for (const auto &source : sources)
+            c_sources.push_back({source.fname.c_str(), source.gain, source.end_gain, source.ramp_frames, source.offset});
+        wav_file format = {};
+        format.channels = channels;
+        format.bit_depth = bit_depth;
+        format.sample_rate = sample_rate;
+        format.is_float = is_float;
+        if (wav_mix(c_sources.data(), c_sources.size(), fname.c_str(), &format, num_threads))
+            throw std::runtime_error("Error mixing to file" + fname);
+    }
+
+    /**
+     * @brief Thread safe LRU cache of decoded blocks shared by WaveCacheFile instances. See wav_cache_create.
+     */
+    class WaveCache
+    {
+        wav_cache *cache = nullptr;
+        // The process-wide cache is not freed
+        bool owned = true;
+
+        WaveCache(const WaveCache &) = delete;
+        WaveCache &operator=(const WaveCache &) = delete;
+
+        explicit WaveCache(wav_cache *cache) : cache(cache), owned(false) {}
+
+    public:
+        /**
+         * @brief Create a cache of at most budget_bytes bytes of decoded samples. Parameters that are 0 use a
+         * default value. Throws runtime_error if the cache can't be created.
+         */
+        explicit WaveCache(size_t budget_bytes, unsigned block_frames = 0, unsigned num_shards = 0)
+        {
+            if (wav_cache_create(&cache, budget_bytes, block_frames, num_shards))
+                throw std::runtime_error("Error creating cache");
+        }
+
+        WaveCache(WaveCache &&other) noexcept : cache(other.cache), owned(other.owned)
+        {
+            other.cache = nullptr;
+        }
+
+        WaveCache &operator=(WaveCache &&other) noexcept
+        {
+            if (this != &other)
+            {
+                if (cache && owned)
+                    wav_cache_free(cache);
+                cache = other.cache;
+                owned = other.owned;
+                other.cache = nullptr;
+            }
+            return *this;
+        }
+
+        ~WaveCache()
+        {
+            if (cache && owned)
+                wav_cache_free(cache);
+        }
+
+        /**
+         * @brief Get the process-wide cache. Throws runtime_error if it can't be created.
+         */
+        static WaveCache &global()
+        {
+            static WaveCache instance(wav_cache_global());
+            if (!instance.cache)
+                throw std::runtime_error("Error creating cache");
+            return instance;
+        }
+
+        /**
+         * @brief Change the memory budget in bytes.
+         */
+        void set_budget(size_t budget_bytes)
+        {
+            wav_cache_set_budget(cache, budget_bytes);
+        }
+
+        /**
+         * @brief Get the hit, miss and eviction counters and the current size of the cache.
+         */
+        wav_cache_stats get_stats() const
+        {
+            wav_cache_stats stats;
+            wav_cache_get_stats(cache, &stats);
+            return stats;
+        }
+
+        /**
+         * @brief Get the underlying cache.
+         */
+        wav_cache *get() const
+        {
+            return cache;
+        }
+    };
+
+    /**
+     * @brief Random access to a file through a WaveCache instead of loading the whole file. Each instance
+     * must be used from one thread at a time. See wav_cache_file_open.
+     */
+    class WaveCacheFile
+    {
+        wav_cache_file *file = nullptr;
+
+        WaveCacheFile(const WaveCacheFile &) = delete;
+        WaveCacheFile &operator=(const WaveCacheFile &) = delete;
+
+    public:
+        /**
+         * @brief Open a file reading through cache, the process-wide cache by default.
+         * Throws runtime_error if the file can't be opened.
+         */
+        explicit WaveCacheFile(const std::string &fname, WaveCache &cache = WaveCache::global())
+        {
+            if (wav_cache_file_open(&file, cache.get(), fname.c_str()))
+                throw std::runtime_error("Error opening file" + fname);
+        }
+
+        WaveCacheFile(WaveCacheFile &&other) noexcept : file(other.file)
+        {
+            other.file = nullptr;
+        }
+
+        WaveCacheFile &operator=(WaveCacheFile &&other) noexcept
+        {
+            if (this != &other)
+            {
+                wav_cache_file_close(file);
+                file = other.file;
+                other.file = nullptr;
+            }
+            return *this;
+        }
+
+        ~WaveCacheFile()
+        {
+            wav_cache_file_close(file);
+        }
+
+        /**
+         * @brief Get count n-channel samples starting from index first as interleaved floats into out.
+         * The out buffer must hold at least count * channels elements.
+         * Throws runtime_error on read error or if the range is invalid.
+         */
+        void get_samples(unsigned long long first, unsigned count, float *out)
+        {
+            if (first + count > get_length() || wav_cache_file_read(file, first, count, out) != static_cast<int>(count))
+                throw std::runtime_error("error while getting samples at index " + std::to_string(first));
+        }
+
+        /**
+         * @brief Get count n-channel samples starting from index first as interleaved floats.
+         * Throws runtime_error on read error or if the range is invalid.
+         */
+        std::vector<float> get_samples(unsigned long long first, unsigned count)
+        {
+            std::vector<float> out(static_cast<size_t>(count) * get_channels());
+            get_samples(first, count, out.data());
+            return out;
+        }
+
+        /**
+         * @brief Get the length of data in n-channel samples.
+         */
+        unsigned long long get_length() const
+        {
+            return wav_cache_file_format(file)->num_frames;
+        }
+
+        /**
+         * @brief Get the number of channels.
+         */
+        unsigned get_channels() const
+        {
+            return wav_cache_file_format(file)->channels;
+        }
+
+        /**
+         * @brief Get the sample rate in Hz.
+         */
+        unsigned get_sample_rate() const
+        {
+            return wav_cache_file_format(file)->sample_rate;
+        }
+    };
+
+    /**
+     * @brief Disk-streaming playback engine for many simultaneous voices. start, stop and render are
+     * realtime safe and must be called from one thread at a time. See wav_player_create.
+     */
+    class WavePlayer
+    {
+        wav_player *player = nullptr;
+
+        WavePlayer(const WavePlayer &) = delete;
+        WavePlayer &operator=(const WavePlayer &) = delete;
+
+    public:
+        /**
+         * @brief Create a player and start its disk workers. Fields of config that are 0 use a default value.
+         * Throws runtime_error if the player can't be created.
+         */
+        explicit WavePlayer(const wav_player_config &config = {})
+        {
+            if (wav_player_create(&player, &config))
+                throw std::runtime_error("Error creating player");
+        }
+
+        WavePlayer(WavePlayer &&other) noexcept : player(other.player)
+        {
+            other.player = nullptr;
+        }
+
+        WavePlayer &operator=(WavePlayer &&other) noexcept
+        {
+            if (this != &other)
+            {
+                if (player)
+                    wav_player_free(player);
+                player = other.player;
+                other.player = nullptr;
+            }
+            return *this;
+        }
+
+        ~WavePlayer()
+        {
+            if (player)
+                wav_player_free(player);
+        }
+
+        /**
+         * @brief Load a sample and preload its head. Not realtime safe.
+         * Throws runtime_error if the file can't be loaded. Returns the id of the sample.
+         */
+        int load(const std::string &fname)
+        {
+            const int sample = wav_player_load(player, fname.c_str());
+            if (sample < 0)
+                throw std::runtime_error("Error loading sample" + fname);
+            return sample;
+        }
+
+        /**
+         * @brief Start a voice playing sample with gain. Returns a handle of the voice, or -1 if sample
+         * is invalid or no voice is free.
+         */
+        int start(int sample, float gain = 1.0f) noexcept
+        {
+            return wav_player_start(player, sample, gain);
+        }
+
+        /**
+         * @brief Stop a voice. Returns false if the voice has already stopped.
+         */
+        bool stop(int voice) noexcept
+        {
+            return !wav_player_stop(player, voice);
+        }
+
+        /**
+         * @brief Render num_frames interleaved stereo frames of all playing voices to out, which must hold
+         * num_frames * 2 elements. Returns the number of voices still playing.
+         */
+        unsigned render(float *out, unsigned num_frames) noexcept
+        {
+            return wav_player_render(player, out, num_frames);
+        }
+
+        /**
+         * @brief Get the counters of the player.
+         */
+        wav_player_stats get_stats() const
+        {
+            wav_player_stats stats;
+            wav_player_get_stats(player, &stats);
+            return stats;
         }
     };
 
-}
\ No newline at end of file
+}
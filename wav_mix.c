@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "wav_handler.h"
+#include "wav_convert.h"
+#include "wav_pool.h"
+
+// Frames mixed at a time
+#define MIX_BLOCK_FRAMES 16384
+// Sources summed into a bus at least, so that small mixes stay on one thread
+#define MIX_MIN_SOURCES_PER_GROUP 8
+// Buses at most, which bounds the memory of the buses for many sources
+#define MIX_MAX_GROUPS 32
+
+struct wav_mix_input
+{
+    const struct wav_mix_source *source;
+    struct wav_reader *reader;
+    unsigned channels;
+    unsigned long long num_frames;
+};
+
+struct wav_mix_job
+{
+    struct wav_mix_input *inputs;
+    unsigned num_inputs;
+    unsigned channels;
+    unsigned num_groups;
+    // Output frames of the current block
+    unsigned long long start;
+    unsigned frames;
+    // Bus, read block and expanded mono block of every group
+    float *buffers;
+    int error;
+
+    // The worker threads live for the whole mix and are woken for each block
+    pthread_mutex_t lock;
+    pthread_cond_t block_ready;
+    pthread_cond_t block_done;
+    unsigned long long block;
+    unsigned busy_workers;
+    int stop;
+    // Next group of the current block to be summed
+    unsigned next_group;
+};
+
+static float *group_buffer(const struct wav_mix_job *job, unsigned long long group, unsigned idx)
+{
+    return job->buffers + ((size_t)group * 3 + idx) * MIX_BLOCK_FRAMES * job->channels;
+}
+
+// Reads the frames of input in the current block and adds them to bus. Returns 0 on success.
+static int mix_input(struct wav_mix_job *job, const struct wav_mix_input *input, float *bus, float *block, float *expanded)
+{
+    const struct wav_mix_source *s = input->source;
+    const unsigned long long first = job->start > s->offset ? job->start : s->offset;
+    const unsigned long long end = job->start + job->frames < s->offset + input->num_frames ? job->start + job->frames
+                                                                                             : s->offset + input->num_frames;
+    if (first >= end)
+        return 0;
+    const unsigned n = end - first;
+    // The blocks are consecutive, so the reader is always at the first frame needed
+    if (wav_reader_read(input->reader, block, n) != (int)n)
+        return -1;
+    const float *x = block;
+    if (input->channels != job->channels)
+    {
+        for (unsigned i = 0; i < n; i++)
+            for (unsigned c = 0; c < job->channels; c++)
+                expanded[(size_t)i * job->channels + c] = block[i];
+        x = expanded;
+    }
+    float *dst = bus + (first - job->start) * job->channels;
+    const unsigned long long frame = first - s->offset;
+    unsigned ramp = 0;
+    if (frame < s->ramp_frames)
+    {
+        ramp = s->ramp_frames - frame < n ? s->ramp_frames - frame : n;
+        const float step = (s->end_gain - s->gain) / s->ramp_frames;
+        wav_mix_add_ramp(dst, x, ramp, job->channels, s->gain + step * frame, step);
+    }
+    if (ramp < n)
+        wav_mix_add(dst + (size_t)ramp * job->channels, x + (size_t)ramp * job->channels, (size_t)(n - ramp) * job->channels,
+                    s->ramp_frames ? s->end_gain : s->gain);
+    return 0;
+}
+
+// Sums the inputs of a group into the bus of the group
+static void mix_group(struct wav_mix_job *job, unsigned group)
+{
+    float *bus = group_buffer(job, group, 0);
+    memset(bus, 0, sizeof(float) * job->frames * job->channels);
+    const unsigned begin = (unsigned long long)group * job->num_inputs / job->num_groups;
+    const unsigned end = (unsigned long long)(group + 1) * job->num_inputs / job->num_groups;
+    for (unsigned i = begin; i < end; i++)
+    {
+        if (mix_input(job, &job->inputs[i], bus, group_buffer(job, group, 1), group_buffer(job, group, 2)))
+            __atomic_store_n(&job->error, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Sums the groups of the current block that no other thread has taken
+static void mix_groups(struct wav_mix_job *job)
+{
+    unsigned group;
+    while ((group = __atomic_fetch_add(&job->next_group, 1, __ATOMIC_RELAXED)) < job->num_groups)
+        mix_group(job, group);
+}
+
+static void *mix_worker(void *ctx)
+{
+    struct wav_mix_job *job = (struct wav_mix_job *)ctx;
+    unsigned long long done = 0;
+    pthread_mutex_lock(&job->lock);
+    for (;;)
+    {
+        while (!job->stop && job->block == done)
+            pthread_cond_wait(&job->block_ready, &job->lock);
+        if (job->stop)
+            break;
+        done = job->block;
+        pthread_mutex_unlock(&job->lock);
+        mix_groups(job);
+        pthread_mutex_lock(&job->lock);
+        if (!--job->busy_workers)
+            pthread_cond_signal(&job->block_done);
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+// Sums all groups of the current block on the workers and the calling thread
+static void mix_block(struct wav_mix_job *job, unsigned num_workers)
+{
+    job->next_group = 0;
+    if (num_workers)
+    {
+        pthread_mutex_lock(&job->lock);
+        job->block++;
+        job->busy_workers = num_workers;
+        pthread_cond_broadcast(&job->block_ready);
+        pthread_mutex_unlock(&job->lock);
+    }
+    mix_groups(job);
+    if (num_workers)
+    {
+        pthread_mutex_lock(&job->lock);
+        while (job->busy_workers)
+            pthread_cond_wait(&job->block_done, &job->lock);
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+int wav_mix(const struct wav_mix_source *sources, unsigned num_sources, const char *out_file_name,
+            const struct wav_file *format, unsigned num_threads)
+{
+    if (!format->channels)
+        return -1;
+    struct wav_mix_job job;
+    memset(&job, 0, sizeof(job));
+    job.channels = format->channels;
+    job.inputs = (struct wav_mix_input *)calloc(num_sources ? num_sources : 1, sizeof(struct wav_mix_input));
+    int err = !job.inputs;
+    unsigned long long length = 0;
+    for (unsigned i = 0; !err && i < num_sources; i++)
+    {
+        struct wav_mix_input *input = &job.inputs[i];
+        input->source = &sources[i];
+        err = wav_reader_open(&input->reader, sources[i].file_name, NULL, MIX_BLOCK_FRAMES);
+        job.num_inputs += !err;
+        if (err)
+            break;
+        const struct wav_file *f = wav_reader_format(input->reader);
+        input->channels = f->channels;
+        input->num_frames = f->num_frames;
+        err = f->sample_rate != format->sample_rate || (f->channels != format->channels && f->channels != 1);
+        if (sources[i].offset + f->num_frames > length)
+            length = sources[i].offset + f->num_frames;
+    }
+    // The groups depend only on the sources, so the order of the sums and thereby the output is the same
+    // for any number of threads
+    job.num_groups = (num_sources + MIX_MIN_SOURCES_PER_GROUP - 1) / MIX_MIN_SOURCES_PER_GROUP;
+    if (job.num_groups > MIX_MAX_GROUPS)
+        job.num_groups = MIX_MAX_GROUPS;
+    if (!job.num_groups)
+        job.num_groups = 1;
+    if (!num_threads)
+        num_threads = wav_default_num_threads();
+    if (num_threads > job.num_groups)
+        num_threads = job.num_groups;
+    if (!err)
+    {
+        job.buffers = (float *)malloc(sizeof(float) * 3 * job.num_groups * MIX_BLOCK_FRAMES * job.channels);
+        err = !job.buffers;
+    }
+    struct wav_writer *writer = NULL;
+    err = err || wav_writer_open(&writer, out_file_name, format, NULL, MIX_BLOCK_FRAMES, 0);
+
+    pthread_t *workers = NULL;
+    unsigned num_workers = 0;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.block_ready, NULL);
+    pthread_cond_init(&job.block_done, NULL);
+    if (!err && num_threads > 1)
+    {
+        // Groups of workers that failed to start are summed by the others
+        workers = (pthread_t *)malloc(sizeof(pthread_t) * (num_threads - 1));
+        while (workers && num_workers < num_threads - 1 && !pthread_create(&workers[num_workers], NULL, mix_worker, &job))
+            num_workers++;
+    }
+    for (job.start = 0; !err && job.start < length; job.start += job.frames)
+    {
+        job.frames = length - job.start < MIX_BLOCK_FRAMES ? length - job.start : MIX_BLOCK_FRAMES;
+        mix_block(&job, num_workers);
+        err = job.error;
+        float *bus = group_buffer(&job, 0, 0);
+        for (unsigned g = 1; !err && g < job.num_groups; g++)
+            wav_mix_add(bus, group_buffer(&job, g, 0), (size_t)job.frames * job.channels, 1.0f);
+        err = err || wav_writer_write(writer, bus, job.frames);
+    }
+    pthread_mutex_lock(&job.lock);
+    job.stop = 1;
+    pthread_cond_broadcast(&job.block_ready);
+    pthread_mutex_unlock(&job.lock);
+    for (unsigned i = 0; i < num_workers; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    pthread_cond_destroy(&job.block_done);
+    pthread_cond_destroy(&job.block_ready);
+    pthread_mutex_destroy(&job.lock);
+
+    if (writer && wav_writer_close(writer))
+        err = 1;
+    for (unsigned i = 0; i < job.num_inputs; i++)
+        wav_reader_close(job.inputs[i].reader);
+    free(job.inputs);
+    free(job.buffers);
+    return err ? -1 : 0;
+}
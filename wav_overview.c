@@ -0,0 +1,436 @@
+// 64 bit file offsets on 32 bit POSIX systems
+#define _FILE_OFFSET_BITS 64
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "wav_handler.h"
+#include "wav_convert.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define WAV_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Buckets of a level per bucket of the next level
+#define OVERVIEW_FANOUT 16
+#define OVERVIEW_FANOUT_BITS 4
+#define OVERVIEW_MIN_LEVELS 3
+#define OVERVIEW_MAGIC "WOVR"
+#define OVERVIEW_VERSION 1
+// Magic, version, channels, number of levels and number of frames
+#define OVERVIEW_HEADER_SIZE 24
+// Frames read at a time by wav_overview_build and decoded at a time by wav_overview_from_wav
+#define OVERVIEW_BLOCK_FRAMES 16384
+
+struct wav_overview
+{
+    unsigned channels;
+    unsigned num_levels;
+    unsigned long long num_frames;
+    // The min and max of each channel in each bucket: levels[level][(bucket * channels + channel) * 2] is the
+    // min and the next element the max. Level l has buckets of WAV_OVERVIEW_BUCKET_FRAMES * 16^l frames.
+    float *levels[WAV_OVERVIEW_MAX_LEVELS];
+    unsigned long long num_buckets[WAV_OVERVIEW_MAX_LEVELS];
+    unsigned long long capacity[WAV_OVERVIEW_MAX_LEVELS];
+    // Serialized overview the levels point into when loaded: a copy of a chunk or a mapped sidecar file
+    char *buffer;
+    size_t mapping_length;
+};
+
+int wav_overview_create(struct wav_overview **overview, unsigned channels)
+{
+    *overview = NULL;
+    if (!channels || channels > WAV_PLANAR_MAX_CHANNELS)
+        return -1;
+    struct wav_overview *o = (struct wav_overview *)calloc(1, sizeof(struct wav_overview));
+    if (!o)
+        return -1;
+    o->channels = channels;
+    o->num_levels = OVERVIEW_MIN_LEVELS;
+    *overview = o;
+    return 0;
+}
+
+int wav_overview_free(struct wav_overview *overview)
+{
+    if (!overview)
+        return -1;
+    if (overview->buffer)
+    {
+#ifdef WAV_HAVE_MMAP
+        if (overview->mapping_length)
+            munmap(overview->buffer, overview->mapping_length);
+        else
+#endif
+            free(overview->buffer);
+    }
+    else
+    {
+        for (unsigned l = 0; l < overview->num_levels; l++)
+            free(overview->levels[l]);
+    }
+    free(overview);
+    return 0;
+}
+
+// Appends bucket idx to level, initialized to an empty range. The buckets of a level are appended in order.
+static int append_bucket(struct wav_overview *o, unsigned level)
+{
+    const size_t values_per_bucket = 2 * o->channels;
+    if (o->num_buckets[level] == o->capacity[level])
+    {
+        const unsigned long long capacity = o->capacity[level] ? 2 * o->capacity[level] : 64;
+        float *buckets = (float *)realloc(o->levels[level], capacity * values_per_bucket * sizeof(float));
+        if (!buckets)
+            return -1;
+        o->levels[level] = buckets;
+        o->capacity[level] = capacity;
+    }
+    float *bucket = o->levels[level] + o->num_buckets[level] * values_per_bucket;
+    for (unsigned c = 0; c < o->channels; c++)
+    {
+        bucket[2 * c] = FLT_MAX;
+        bucket[2 * c + 1] = -FLT_MAX;
+    }
+    o->num_buckets[level]++;
+    return 0;
+}
+
+// Starts the level 0 bucket of frame o->num_frames and the buckets of the other levels containing it.
+// A level is added on top when the top level gets its second bucket, so one bucket always covers everything.
+static int start_bucket(struct wav_overview *o)
+{
+    const unsigned long long bucket = o->num_frames / WAV_OVERVIEW_BUCKET_FRAMES;
+    for (unsigned l = 0; l < o->num_levels; l++)
+    {
+        if ((bucket >> (OVERVIEW_FANOUT_BITS * l)) == o->num_buckets[l] && append_bucket(o, l))
+            return -1;
+    }
+    const unsigned top = o->num_levels - 1;
+    if (o->num_buckets[top] == 2 && o->num_levels < WAV_OVERVIEW_MAX_LEVELS)
+    {
+        if (append_bucket(o, top + 1))
+            return -1;
+        memcpy(o->levels[top + 1], o->levels[top], 2 * o->channels * sizeof(float));
+        o->num_levels++;
+    }
+    return 0;
+}
+
+int wav_overview_add(struct wav_overview *overview, const float *const *channels, unsigned num_frames)
+{
+    struct wav_overview *o = overview;
+    if (o->buffer)
+        return -1;
+    for (unsigned done = 0; done < num_frames;)
+    {
+        const unsigned in_bucket = o->num_frames % WAV_OVERVIEW_BUCKET_FRAMES;
+        const unsigned n = num_frames - done < WAV_OVERVIEW_BUCKET_FRAMES - in_bucket ? num_frames - done : WAV_OVERVIEW_BUCKET_FRAMES - in_bucket;
+        if (!in_bucket && start_bucket(o))
+            return -1;
+        const unsigned long long bucket = o->num_frames / WAV_OVERVIEW_BUCKET_FRAMES;
+        for (unsigned c = 0; c < o->channels; c++)
+        {
+            float min = FLT_MAX, max = -FLT_MAX;
+            wav_min_max(channels[c] + done, n, &min, &max);
+            for (unsigned l = 0; l < o->num_levels; l++)
+            {
+                float *b = o->levels[l] + ((bucket >> (OVERVIEW_FANOUT_BITS * l)) * o->channels + c) * 2;
+                b[0] = min < b[0] ? min : b[0];
+                b[1] = max > b[1] ? max : b[1];
+            }
+        }
+        o->num_frames += n;
+        done += n;
+    }
+    return 0;
+}
+
+int wav_overview_build(struct wav_overview **overview, const char *file_name)
+{
+    struct wav_reader *reader;
+    *overview = NULL;
+    if (wav_reader_open(&reader, file_name, NULL, OVERVIEW_BLOCK_FRAMES))
+        return -1;
+    const unsigned channels = wav_reader_format(reader)->channels;
+    float *block = NULL;
+    float *planar[WAV_PLANAR_MAX_CHANNELS];
+    int err = wav_overview_create(overview, channels);
+    if (!err)
+    {
+        block = (float *)malloc(sizeof(float) * OVERVIEW_BLOCK_FRAMES * channels);
+        err = !block;
+    }
+    if (!err)
+    {
+        for (unsigned c = 0; c < channels; c++)
+            planar[c] = block + (size_t)c * OVERVIEW_BLOCK_FRAMES;
+        int frames;
+        while (!err && (frames = wav_reader_read_planar(reader, planar, OVERVIEW_BLOCK_FRAMES)) > 0)
+            err = wav_overview_add(*overview, (const float *const *)planar, frames);
+        err = err || frames < 0;
+    }
+    free(block);
+    wav_reader_close(reader);
+    if (err && *overview)
+    {
+        wav_overview_free(*overview);
+        *overview = NULL;
+    }
+    return err ? -1 : 0;
+}
+
+int wav_overview_from_wav(struct wav_overview **overview, const struct wav_file *wav)
+{
+    *overview = NULL;
+    if (wav_overview_create(overview, wav->channels))
+        return -1;
+    float *block = (float *)malloc(sizeof(float) * OVERVIEW_BLOCK_FRAMES * wav->channels);
+    float *planar[WAV_PLANAR_MAX_CHANNELS];
+    int err = !block;
+    for (unsigned c = 0; !err && c < wav->channels; c++)
+        planar[c] = block + (size_t)c * OVERVIEW_BLOCK_FRAMES;
+    for (unsigned long long done = 0; !err && done < wav->num_frames; done += OVERVIEW_BLOCK_FRAMES)
+    {
+        const unsigned n = wav->num_frames - done < OVERVIEW_BLOCK_FRAMES ? wav->num_frames - done : OVERVIEW_BLOCK_FRAMES;
+        err = wav_get_normalized_planar(wav, done, n, planar) || wav_overview_add(*overview, (const float *const *)planar, n);
+    }
+    free(block);
+    if (err)
+    {
+        wav_overview_free(*overview);
+        *overview = NULL;
+    }
+    return err ? -1 : 0;
+}
+
+unsigned long long wav_overview_frames(const struct wav_overview *overview)
+{
+    return overview->num_frames;
+}
+
+unsigned wav_overview_channels(const struct wav_overview *overview)
+{
+    return overview->channels;
+}
+
+// Min and max of channel over level 0 buckets lo ... hi - 1. Unaligned buckets at both ends are merged
+// at each level and the aligned middle part is passed on to the next level.
+static void bucket_range_min_max(const struct wav_overview *o, unsigned channel, unsigned long long lo, unsigned long long hi,
+                                 float *min, float *max)
+{
+    float range_min = FLT_MAX, range_max = -FLT_MAX;
+    for (unsigned l = 0; lo < hi; l++, lo >>= OVERVIEW_FANOUT_BITS, hi >>= OVERVIEW_FANOUT_BITS)
+    {
+        const int top = l == o->num_levels - 1;
+        const float *buckets = o->levels[l] + channel * 2;
+        const size_t stride = 2 * o->channels;
+        for (; lo < hi && (top || lo % OVERVIEW_FANOUT); lo++)
+        {
+            range_min = buckets[lo * stride] < range_min ? buckets[lo * stride] : range_min;
+            range_max = buckets[lo * stride + 1] > range_max ? buckets[lo * stride + 1] : range_max;
+        }
+        for (; lo < hi && hi % OVERVIEW_FANOUT; hi--)
+        {
+            range_min = buckets[(hi - 1) * stride] < range_min ? buckets[(hi - 1) * stride] : range_min;
+            range_max = buckets[(hi - 1) * stride + 1] > range_max ? buckets[(hi - 1) * stride + 1] : range_max;
+        }
+    }
+    *min = range_min;
+    *max = range_max;
+}
+
+int wav_overview_query(const struct wav_overview *overview, unsigned channel, unsigned long long first_frame,
+                       unsigned long long end_frame, unsigned width, float *min, float *max)
+{
+    if (channel >= overview->channels || first_frame >= end_frame || end_frame > overview->num_frames || !width)
+        return -1;
+    const unsigned long long length = end_frame - first_frame;
+    for (unsigned p = 0; p < width; p++)
+    {
+        unsigned long long start = first_frame + length * p / width;
+        unsigned long long end = first_frame + length * (p + 1) / width;
+        // Zoomed in beyond one frame per pixel
+        if (start >= end_frame)
+            start = end_frame - 1;
+        if (end <= start)
+            end = start + 1;
+        bucket_range_min_max(overview, channel, start / WAV_OVERVIEW_BUCKET_FRAMES,
+                             (end + WAV_OVERVIEW_BUCKET_FRAMES - 1) / WAV_OVERVIEW_BUCKET_FRAMES, &min[p], &max[p]);
+    }
+    return 0;
+}
+
+// Number of buckets of level for num_frames frames
+static unsigned long long level_buckets(unsigned long long num_frames, unsigned level)
+{
+    const unsigned long long bucket_frames = (unsigned long long)WAV_OVERVIEW_BUCKET_FRAMES << (OVERVIEW_FANOUT_BITS * level);
+    return (num_frames + bucket_frames - 1) / bucket_frames;
+}
+
+static size_t serialized_size(const struct wav_overview *o)
+{
+    size_t size = OVERVIEW_HEADER_SIZE;
+    for (unsigned l = 0; l < o->num_levels; l++)
+        size += o->num_buckets[l] * 2 * o->channels * sizeof(float);
+    return size;
+}
+
+// Stores the header followed by the levels from finest to coarsest
+static void serialize(const struct wav_overview *o, char *buf)
+{
+    const unsigned version = OVERVIEW_VERSION;
+    memcpy(buf, OVERVIEW_MAGIC, 4);
+    memcpy(buf + 4, &version, 4);
+    memcpy(buf + 8, &o->channels, 4);
+    memcpy(buf + 12, &o->num_levels, 4);
+    memcpy(buf + 16, &o->num_frames, 8);
+    buf += OVERVIEW_HEADER_SIZE;
+    for (unsigned l = 0; l < o->num_levels; l++)
+    {
+        const size_t num_bytes = o->num_buckets[l] * 2 * o->channels * sizeof(float);
+        memcpy(buf, o->levels[l], num_bytes);
+        buf += num_bytes;
+    }
+}
+
+// Points the levels of o into a serialized overview of num_bytes bytes, which must be 4 byte aligned
+static int parse(struct wav_overview *o, char *buf, size_t num_bytes)
+{
+    unsigned version;
+    if (num_bytes < OVERVIEW_HEADER_SIZE || memcmp(buf, OVERVIEW_MAGIC, 4))
+        return -1;
+    memcpy(&version, buf + 4, 4);
+    memcpy(&o->channels, buf + 8, 4);
+    memcpy(&o->num_levels, buf + 12, 4);
+    memcpy(&o->num_frames, buf + 16, 8);
+    if (version != OVERVIEW_VERSION || !o->channels || o->channels > WAV_PLANAR_MAX_CHANNELS ||
+        o->num_levels < OVERVIEW_MIN_LEVELS || o->num_levels > WAV_OVERVIEW_MAX_LEVELS)
+        return -1;
+    size_t offset = OVERVIEW_HEADER_SIZE;
+    for (unsigned l = 0; l < o->num_levels; l++)
+    {
+        o->num_buckets[l] = o->capacity[l] = level_buckets(o->num_frames, l);
+        const unsigned long long level_bytes = o->num_buckets[l] * 2 * o->channels * sizeof(float);
+        if (level_bytes > num_bytes - offset)
+            return -1;
+        o->levels[l] = (float *)(buf + offset);
+        offset += level_bytes;
+    }
+    // Queries rely on the top level having at most one bucket unless the level count is at the maximum
+    if (offset != num_bytes || (o->num_buckets[o->num_levels - 1] > 1 && o->num_levels < WAV_OVERVIEW_MAX_LEVELS))
+        return -1;
+    return 0;
+}
+
+int wav_overview_chunk(const struct wav_overview *overview, struct wav_file_custom_header_data *chdr)
+{
+    const size_t size = serialized_size(overview);
+    if (size > 0xFFFFFFFFu)
+        return -1;
+    chdr->data = (char *)malloc(size);
+    if (!chdr->data)
+        return -1;
+    serialize(overview, chdr->data);
+    memcpy(chdr->header_name, WAV_OVERVIEW_CHUNK_ID, 5);
+    chdr->num_bytes = size;
+    return 0;
+}
+
+int wav_overview_from_chunk(struct wav_overview **overview, const struct wav_file_custom_header_data *chunk)
+{
+    *overview = NULL;
+    if (strcmp(chunk->header_name, WAV_OVERVIEW_CHUNK_ID) || !chunk->data)
+        return -1;
+    struct wav_overview *o = (struct wav_overview *)calloc(1, sizeof(struct wav_overview));
+    // Copied to be independent of the chunk and for the alignment of the floats
+    char *buf = (char *)malloc(chunk->num_bytes ? chunk->num_bytes : 1);
+    if (!o || !buf || (memcpy(buf, chunk->data, chunk->num_bytes), parse(o, buf, chunk->num_bytes)))
+    {
+        free(o);
+        free(buf);
+        return -1;
+    }
+    o->buffer = buf;
+    *overview = o;
+    return 0;
+}
+
+int wav_overview_save(const struct wav_overview *overview, const char *file_name)
+{
+    const size_t size = serialized_size(overview);
+    char *buf = (char *)malloc(size);
+    if (!buf)
+        return -1;
+    serialize(overview, buf);
+    FILE *f = fopen(file_name, "wb");
+    const size_t written = f ? fwrite(buf, 1, size, f) : 0;
+    free(buf);
+    if (!f || fclose(f) || written != size)
+        return -1;
+    return 0;
+}
+
+#ifdef WAV_HAVE_MMAP
+
+int wav_overview_load(struct wav_overview **overview, const char *file_name)
+{
+    *overview = NULL;
+    struct stat st;
+    const int fd = open(file_name, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) || st.st_size < OVERVIEW_HEADER_SIZE || (unsigned long long)st.st_size > SIZE_MAX)
+    {
+        close(fd);
+        return -1;
+    }
+    const size_t length = st.st_size;
+    void *mapping = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return -1;
+    struct wav_overview *o = (struct wav_overview *)calloc(1, sizeof(struct wav_overview));
+    // The levels are only read through a loaded overview
+    if (!o || parse(o, (char *)mapping, length))
+    {
+        free(o);
+        munmap(mapping, length);
+        return -1;
+    }
+    o->buffer = (char *)mapping;
+    o->mapping_length = length;
+    *overview = o;
+    return 0;
+}
+
+#else
+
+int wav_overview_load(struct wav_overview **overview, const char *file_name)
+{
+    *overview = NULL;
+    FILE *f = fopen(file_name, "rb");
+    if (!f)
+        return -1;
+    struct wav_file_custom_header_data chunk = {WAV_OVERVIEW_CHUNK_ID, 0, NULL};
+    long size = fseek(f, 0, SEEK_END) ? -1 : ftell(f);
+    if (size > 0 && size <= 0xFFFFFFFFl && !fseek(f, 0, SEEK_SET))
+    {
+        chunk.num_bytes = size;
+        chunk.data = (char *)malloc(size);
+        if (chunk.data && fread(chunk.data, 1, size, f) != (size_t)size)
+            chunk.num_bytes = 0;
+    }
+    fclose(f);
+    const int err = chunk.num_bytes ? wav_overview_from_chunk(overview, &chunk) : -1;
+    free(chunk.data);
+    return err;
+}
+
+#endif
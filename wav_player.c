@@ -0,0 +1,423 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "wav_handler.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define PLAYER_DEFAULT_MAX_VOICES 64
+#define PLAYER_DEFAULT_MAX_SAMPLES 256
+#define PLAYER_DEFAULT_HEAD_FRAMES 32768
+#define PLAYER_DEFAULT_RING_FRAMES 32768
+#define PLAYER_DEFAULT_BLOCK_FRAMES 4096
+#define PLAYER_DEFAULT_NUM_WORKERS 2
+#define PLAYER_MAX_VOICES 65536
+// How long an idle worker sleeps before polling its voices again
+#define PLAYER_IDLE_SLEEP_US 1000
+
+// Handshake between the realtime thread and the disk worker of a voice. The realtime thread only
+// starts a voice in VOICE_IDLE and the worker only touches the voice's file in the other states.
+enum
+{
+    VOICE_IDLE,
+    // Set by the realtime thread, the worker opens the file and continues with VOICE_STREAM
+    VOICE_START,
+    VOICE_STREAM,
+    // Set by the realtime thread, the worker closes the file and continues with VOICE_IDLE
+    VOICE_STOP,
+};
+
+struct wav_player_sample
+{
+    char *file_name;
+    unsigned long long num_frames;
+    // Preloaded stereo frames
+    float *head;
+    unsigned head_frames;
+};
+
+struct wav_player_voice
+{
+    // Owned by the realtime thread
+    const struct wav_player_sample *sample;
+    unsigned long long position;
+    float gain;
+    unsigned generation;
+    int playing;
+
+    int state;
+    // Set by the worker when the file can't be read, which ends the voice
+    int failed;
+    // Frames written to and read from the ring since the voice started. Each is written by one side only.
+    unsigned long long written;
+    unsigned long long read;
+    // Stereo frames following the head of the sample
+    float *ring;
+
+    // Owned by the worker
+    struct wav_reader *reader;
+    // Keeps voices of different workers on separate cache lines
+    char padding[64];
+};
+
+struct wav_player_worker
+{
+    struct wav_player *player;
+    pthread_t thread;
+    unsigned idx;
+    // Interleaved block read from a file
+    float *block;
+};
+
+struct wav_player
+{
+    struct wav_player_config config;
+    struct wav_player_sample *samples;
+    unsigned num_samples;
+    struct wav_player_voice *voices;
+    // Indices of the playing voices, owned by the realtime thread
+    unsigned *active;
+    unsigned num_active;
+    struct wav_player_worker *workers;
+    unsigned num_started;
+    int stop;
+    unsigned long long underrun_frames;
+    unsigned long long blocks;
+};
+
+static void sleep_us(unsigned us)
+{
+#ifdef _WIN32
+    Sleep((us + 999) / 1000);
+#else
+    struct timespec ts = {0, us * 1000L};
+    nanosleep(&ts, NULL);
+#endif
+}
+
+// Copies the first two channels of frames, or one channel to both
+static void to_stereo(const float *in, unsigned channels, float *out, unsigned num_frames)
+{
+    for (unsigned i = 0; i < num_frames; i++)
+    {
+        out[2 * i] = in[(size_t)i * channels];
+        out[2 * i + 1] = in[(size_t)i * channels + (channels > 1)];
+    }
+}
+
+// Reads the next block of the voice's file into its ring if there is room. Returns 1 if a block was read.
+static int fill_voice(struct wav_player *p, struct wav_player_voice *v, float *block)
+{
+    const unsigned long long stream_frames = v->sample->num_frames - v->sample->head_frames;
+    const unsigned long long written = __atomic_load_n(&v->written, __ATOMIC_RELAXED);
+    const unsigned long long space = p->config.ring_frames - (written - __atomic_load_n(&v->read, __ATOMIC_ACQUIRE));
+    const unsigned long long remaining = stream_frames - written;
+    const unsigned frames = remaining < p->config.block_frames ? (unsigned)remaining : p->config.block_frames;
+    if (!frames || space < frames)
+        return 0;
+    const int n = wav_reader_read(v->reader, block, frames);
+    if (n <= 0)
+    {
+        __atomic_store_n(&v->failed, 1, __ATOMIC_RELEASE);
+        return 0;
+    }
+    const unsigned channels = wav_reader_format(v->reader)->channels;
+    const unsigned start = written % p->config.ring_frames;
+    const unsigned first = p->config.ring_frames - start < (unsigned)n ? p->config.ring_frames - start : (unsigned)n;
+    to_stereo(block, channels, v->ring + 2 * (size_t)start, first);
+    to_stereo(block + (size_t)first * channels, channels, v->ring, n - first);
+    __atomic_store_n(&v->written, written + n, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&p->blocks, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// Serves the voices idx, idx + num_workers, ... until the player is freed
+static void *player_worker(void *arg)
+{
+    struct wav_player_worker *w = (struct wav_player_worker *)arg;
+    struct wav_player *p = w->player;
+    while (!__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE))
+    {
+        int busy = 0;
+        for (unsigned i = w->idx; i < p->config.max_voices; i += p->config.num_workers)
+        {
+            struct wav_player_voice *v = &p->voices[i];
+            int state = __atomic_load_n(&v->state, __ATOMIC_ACQUIRE);
+            if (state == VOICE_START)
+            {
+                if (wav_reader_open(&v->reader, v->sample->file_name, NULL, p->config.block_frames) ||
+                    wav_reader_seek(v->reader, v->sample->head_frames))
+                {
+                    wav_reader_close(v->reader);
+                    v->reader = NULL;
+                    __atomic_store_n(&v->failed, 1, __ATOMIC_RELEASE);
+                }
+                // The realtime thread may have stopped the voice meanwhile, which is handled on the next pass
+                int expected = VOICE_START;
+                state = __atomic_compare_exchange_n(&v->state, &expected, VOICE_STREAM, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+                            ? VOICE_STREAM
+                            : expected;
+                busy = 1;
+            }
+            else if (state == VOICE_STOP)
+            {
+                wav_reader_close(v->reader);
+                v->reader = NULL;
+                __atomic_store_n(&v->state, VOICE_IDLE, __ATOMIC_RELEASE);
+            }
+            if (state == VOICE_STREAM && v->reader)
+                busy |= fill_voice(p, v, w->block);
+        }
+        if (!busy)
+            sleep_us(PLAYER_IDLE_SLEEP_US);
+    }
+    return NULL;
+}
+
+static void stop_workers(struct wav_player *p)
+{
+    __atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+    for (unsigned i = 0; i < p->num_started; i++)
+        pthread_join(p->workers[i].thread, NULL);
+    p->num_started = 0;
+}
+
+int wav_player_free(struct wav_player *player)
+{
+    struct wav_player *p = player;
+    if (!p)
+        return -1;
+    stop_workers(p);
+    for (unsigned i = 0; p->voices && i < p->config.max_voices; i++)
+    {
+        wav_reader_close(p->voices[i].reader);
+        free(p->voices[i].ring);
+    }
+    for (unsigned i = 0; p->workers && i < p->config.num_workers; i++)
+        free(p->workers[i].block);
+    for (unsigned i = 0; i < p->num_samples; i++)
+    {
+        free(p->samples[i].file_name);
+        free(p->samples[i].head);
+    }
+    free(p->samples);
+    free(p->voices);
+    free(p->active);
+    free(p->workers);
+    free(p);
+    return 0;
+}
+
+int wav_player_create(struct wav_player **player, const struct wav_player_config *config)
+{
+    *player = NULL;
+    struct wav_player *p = (struct wav_player *)calloc(1, sizeof(struct wav_player));
+    if (!p)
+        return -1;
+    if (config)
+        p->config = *config;
+    struct wav_player_config *c = &p->config;
+    c->max_voices = c->max_voices ? c->max_voices : PLAYER_DEFAULT_MAX_VOICES;
+    c->max_samples = c->max_samples ? c->max_samples : PLAYER_DEFAULT_MAX_SAMPLES;
+    c->head_frames = c->head_frames ? c->head_frames : PLAYER_DEFAULT_HEAD_FRAMES;
+    c->ring_frames = c->ring_frames ? c->ring_frames : PLAYER_DEFAULT_RING_FRAMES;
+    c->block_frames = c->block_frames ? c->block_frames : PLAYER_DEFAULT_BLOCK_FRAMES;
+    c->num_workers = c->num_workers ? c->num_workers : PLAYER_DEFAULT_NUM_WORKERS;
+    if (c->max_voices > PLAYER_MAX_VOICES || c->block_frames > c->ring_frames)
+    {
+        free(p);
+        return -1;
+    }
+    if (c->num_workers > c->max_voices)
+        c->num_workers = c->max_voices;
+    p->samples = (struct wav_player_sample *)calloc(c->max_samples, sizeof(struct wav_player_sample));
+    p->voices = (struct wav_player_voice *)calloc(c->max_voices, sizeof(struct wav_player_voice));
+    p->active = (unsigned *)malloc(c->max_voices * sizeof(unsigned));
+    p->workers = (struct wav_player_worker *)calloc(c->num_workers, sizeof(struct wav_player_worker));
+    int err = !p->samples || !p->voices || !p->active || !p->workers;
+    for (unsigned i = 0; !err && i < c->max_voices; i++)
+        err = !(p->voices[i].ring = (float *)malloc(sizeof(float) * 2 * c->ring_frames));
+    for (unsigned i = 0; !err && i < c->num_workers; i++)
+    {
+        p->workers[i].player = p;
+        p->workers[i].idx = i;
+        err = !(p->workers[i].block = (float *)malloc(sizeof(float) * WAV_PLANAR_MAX_CHANNELS * c->block_frames));
+    }
+    while (!err && p->num_started < c->num_workers)
+    {
+        err = pthread_create(&p->workers[p->num_started].thread, NULL, player_worker, &p->workers[p->num_started]);
+        p->num_started += !err;
+    }
+    if (err)
+    {
+        wav_player_free(p);
+        return -1;
+    }
+    *player = p;
+    return 0;
+}
+
+int wav_player_load(struct wav_player *player, const char *file_name)
+{
+    struct wav_player *p = player;
+    if (p->num_samples == p->config.max_samples)
+        return -1;
+    struct wav_reader *reader;
+    if (wav_reader_open(&reader, file_name, NULL, 0))
+        return -1;
+    const struct wav_file *format = wav_reader_format(reader);
+    struct wav_player_sample *s = &p->samples[p->num_samples];
+    s->num_frames = format->num_frames;
+    s->head_frames = format->num_frames < p->config.head_frames ? (unsigned)format->num_frames : p->config.head_frames;
+    const size_t name_length = strlen(file_name) + 1;
+    float *frames = (float *)malloc(sizeof(float) * format->channels * (s->head_frames ? s->head_frames : 1));
+    s->head = (float *)malloc(sizeof(float) * 2 * (s->head_frames ? s->head_frames : 1));
+    s->file_name = (char *)malloc(name_length);
+    int err = format->channels > WAV_PLANAR_MAX_CHANNELS || !frames || !s->head || !s->file_name ||
+              wav_reader_read(reader, frames, s->head_frames) != (int)s->head_frames;
+    if (!err)
+    {
+        to_stereo(frames, format->channels, s->head, s->head_frames);
+        memcpy(s->file_name, file_name, name_length);
+    }
+    free(frames);
+    wav_reader_close(reader);
+    if (err)
+    {
+        free(s->head);
+        free(s->file_name);
+        memset(s, 0, sizeof(struct wav_player_sample));
+        return -1;
+    }
+    // Publishes the sample to the realtime thread
+    __atomic_store_n(&p->num_samples, p->num_samples + 1, __ATOMIC_RELEASE);
+    return p->num_samples - 1;
+}
+
+int wav_player_start(struct wav_player *player, int sample, float gain)
+{
+    struct wav_player *p = player;
+    if (sample < 0 || (unsigned)sample >= __atomic_load_n(&p->num_samples, __ATOMIC_ACQUIRE))
+        return -1;
+    for (unsigned i = 0; i < p->config.max_voices; i++)
+    {
+        struct wav_player_voice *v = &p->voices[i];
+        if (v->playing || __atomic_load_n(&v->state, __ATOMIC_ACQUIRE) != VOICE_IDLE)
+            continue;
+        v->sample = &p->samples[sample];
+        v->position = 0;
+        v->gain = gain;
+        v->generation = (v->generation + 1) & 0x7fff;
+        v->playing = 1;
+        // The worker doesn't touch an idle voice, so its side of the ring can be reset here
+        __atomic_store_n(&v->written, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&v->read, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&v->failed, 0, __ATOMIC_RELAXED);
+        // Samples that fit in the head are played without the worker
+        if (v->sample->num_frames > v->sample->head_frames)
+            __atomic_store_n(&v->state, VOICE_START, __ATOMIC_RELEASE);
+        p->active[p->num_active] = i;
+        __atomic_store_n(&p->num_active, p->num_active + 1, __ATOMIC_RELAXED);
+        return (int)(v->generation << 16 | i);
+    }
+    return -1;
+}
+
+// Removes the voice at index a of the active voices and hands its file back to the worker
+static void end_voice(struct wav_player *p, unsigned a)
+{
+    struct wav_player_voice *v = &p->voices[p->active[a]];
+    v->playing = 0;
+    p->active[a] = p->active[p->num_active - 1];
+    __atomic_store_n(&p->num_active, p->num_active - 1, __ATOMIC_RELAXED);
+    if (v->sample->num_frames > v->sample->head_frames)
+        __atomic_store_n(&v->state, VOICE_STOP, __ATOMIC_RELEASE);
+}
+
+int wav_player_stop(struct wav_player *player, int voice)
+{
+    struct wav_player *p = player;
+    const unsigned idx = (unsigned)voice & 0xffff;
+    if (voice < 0 || idx >= p->config.max_voices || !p->voices[idx].playing ||
+        p->voices[idx].generation != (unsigned)voice >> 16)
+        return -1;
+    for (unsigned a = 0; a < p->num_active; a++)
+    {
+        if (p->active[a] == idx)
+        {
+            end_voice(p, a);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void mix(float *out, const float *in, unsigned num_frames, float gain)
+{
+    for (unsigned i = 0; i < 2 * num_frames; i++)
+        out[i] += gain * in[i];
+}
+
+// Mixes num_frames frames of the voice to out. Returns 1 when the voice has ended.
+static int render_voice(struct wav_player *p, struct wav_player_voice *v, float *out, unsigned num_frames)
+{
+    const struct wav_player_sample *s = v->sample;
+    unsigned done = 0;
+    while (done < num_frames && v->position < s->num_frames)
+    {
+        unsigned n = num_frames - done;
+        if (v->position < s->head_frames)
+        {
+            if (n > s->head_frames - v->position)
+                n = s->head_frames - v->position;
+            mix(out + 2 * (size_t)done, s->head + 2 * v->position, n, v->gain);
+        }
+        else
+        {
+            const unsigned long long read = v->position - s->head_frames;
+            const unsigned long long available = __atomic_load_n(&v->written, __ATOMIC_ACQUIRE) - read;
+            if (!available)
+            {
+                if (__atomic_load_n(&v->failed, __ATOMIC_ACQUIRE))
+                    return 1;
+                __atomic_fetch_add(&p->underrun_frames, num_frames - done, __ATOMIC_RELAXED);
+                return 0;
+            }
+            const unsigned start = read % p->config.ring_frames;
+            if (n > available)
+                n = available;
+            if (n > p->config.ring_frames - start)
+                n = p->config.ring_frames - start;
+            mix(out + 2 * (size_t)done, v->ring + 2 * (size_t)start, n, v->gain);
+            // Hands the frames back to the worker
+            __atomic_store_n(&v->read, read + n, __ATOMIC_RELEASE);
+        }
+        v->position += n;
+        done += n;
+    }
+    return v->position == s->num_frames;
+}
+
+int wav_player_render(struct wav_player *player, float *out, unsigned num_frames)
+{
+    struct wav_player *p = player;
+    memset(out, 0, sizeof(float) * 2 * num_frames);
+    for (unsigned a = p->num_active; a-- > 0;)
+    {
+        if (render_voice(p, &p->voices[p->active[a]], out, num_frames))
+            end_voice(p, a);
+    }
+    return p->num_active;
+}
+
+void wav_player_get_stats(const struct wav_player *player, struct wav_player_stats *stats)
+{
+    const struct wav_player *p = player;
+    stats->voices = __atomic_load_n(&p->num_active, __ATOMIC_RELAXED);
+    stats->underrun_frames = __atomic_load_n(&p->underrun_frames, __ATOMIC_RELAXED);
+    stats->blocks = __atomic_load_n(&p->blocks, __ATOMIC_RELAXED);
+}
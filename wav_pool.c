@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include "wav_pool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// The remaining task indices [next, end) of a thread. Padded to a cache line so that
+// the threads don't slow each other down by writing to the same line.
+struct wav_pool_range
+{
+    pthread_mutex_t lock;
+    unsigned long long next;
+    unsigned long long end;
+    char padding[64];
+};
+
+struct wav_pool_job
+{
+    wav_task_fn task;
+    void *ctx;
+    unsigned num_threads;
+    struct wav_pool_range *ranges;
+    // Next thread index to be taken by a worker, the caller works as thread 0
+    unsigned next_thread;
+    // Workers that took a thread index and haven't finished it
+    unsigned busy_workers;
+    // Jobs that still have thread indices to take
+    struct wav_pool_job *next;
+};
+
+// Worker threads started on demand by wav_parallel_for and kept for the rest of the process. Concurrent
+// and nested calls share the workers: an idle worker takes the next thread index of any job that has one
+// left, and waits on work_ready otherwise, so a call only pays for waking them.
+struct wav_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t job_done;
+    struct wav_pool_job *jobs;
+    unsigned num_workers;
+};
+
+static struct wav_pool pool;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+unsigned wav_default_num_threads(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const long n = info.dwNumberOfProcessors;
+#else
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return n > 0 ? (unsigned)n : 1;
+}
+
+// Takes the next task from the front of range. Returns 0 if the range is empty.
+static int pop_task(struct wav_pool_range *range, unsigned long long *task_idx)
+{
+    pthread_mutex_lock(&range->lock);
+    const int found = range->next < range->end;
+    if (found)
+        *task_idx = range->next++;
+    pthread_mutex_unlock(&range->lock);
+    return found;
+}
+
+// Moves the back half of the range of another thread to the range of thread idx.
+// Returns 0 if there was nothing left to steal.
+static int steal_tasks(struct wav_pool_job *job, unsigned idx)
+{
+    for (unsigned i = 1; i < job->num_threads; i++)
+    {
+        struct wav_pool_range *victim = &job->ranges[(idx + i) % job->num_threads];
+        pthread_mutex_lock(&victim->lock);
+        const unsigned long long remaining = victim->end - victim->next;
+        if (!remaining)
+        {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        const unsigned long long end = victim->end;
+        victim->end -= (remaining + 1) / 2;
+        const unsigned long long next = victim->end;
+        pthread_mutex_unlock(&victim->lock);
+        struct wav_pool_range *own = &job->ranges[idx];
+        pthread_mutex_lock(&own->lock);
+        own->next = next;
+        own->end = end;
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+    return 0;
+}
+
+// Runs the tasks of thread idx of job, stealing from the other threads when its own range is done
+static void run_tasks(struct wav_pool_job *job, unsigned idx)
+{
+    unsigned long long task_idx;
+    do
+    {
+        while (pop_task(&job->ranges[idx], &task_idx))
+            job->task(job->ctx, task_idx);
+    } while (steal_tasks(job, idx));
+}
+
+static void init_pool(void)
+{
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.work_ready, NULL);
+    pthread_cond_init(&pool.job_done, NULL);
+}
+
+// Removes job from the jobs that have thread indices left. Called with the pool locked.
+static void unlink_job(struct wav_pool_job *job)
+{
+    struct wav_pool_job **p = &pool.jobs;
+    while (*p && *p != job)
+        p = &(*p)->next;
+    if (*p)
+        *p = job->next;
+}
+
+static void *pool_worker(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&pool.lock);
+    for (;;)
+    {
+        struct wav_pool_job *job = pool.jobs;
+        if (!job)
+        {
+            pthread_cond_wait(&pool.work_ready, &pool.lock);
+            continue;
+        }
+        const unsigned idx = job->next_thread++;
+        if (job->next_thread == job->num_threads)
+            unlink_job(job);
+        job->busy_workers++;
+        pthread_mutex_unlock(&pool.lock);
+        run_tasks(job, idx);
+        pthread_mutex_lock(&pool.lock);
+        if (!--job->busy_workers)
+            pthread_cond_broadcast(&pool.job_done);
+    }
+    return NULL;
+}
+
+int wav_parallel_for(unsigned num_threads, unsigned long long num_tasks, wav_task_fn task, void *ctx)
+{
+    if (!num_threads)
+        num_threads = wav_default_num_threads();
+    if (num_threads > num_tasks)
+        num_threads = num_tasks;
+    if (num_threads <= 1)
+    {
+        for (unsigned long long i = 0; i < num_tasks; i++)
+            task(ctx, i);
+        return 0;
+    }
+    pthread_once(&pool_once, init_pool);
+    struct wav_pool_range *ranges = (struct wav_pool_range *)malloc(num_threads * sizeof(struct wav_pool_range));
+    if (!ranges)
+        return -1;
+    struct wav_pool_job job = {task, ctx, num_threads, ranges, 1, 0, NULL};
+    for (unsigned i = 0; i < num_threads; i++)
+    {
+        pthread_mutex_init(&ranges[i].lock, NULL);
+        ranges[i].next = num_tasks * i / num_threads;
+        ranges[i].end = num_tasks * (i + 1) / num_threads;
+    }
+    pthread_mutex_lock(&pool.lock);
+    // Workers are shared, so only as many are started as one call needs
+    while (pool.num_workers < num_threads - 1)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, pool_worker, NULL))
+            break;
+        pthread_detach(thread);
+        pool.num_workers++;
+    }
+    job.next = pool.jobs;
+    pool.jobs = &job;
+    pthread_cond_broadcast(&pool.work_ready);
+    pthread_mutex_unlock(&pool.lock);
+
+    // The calling thread works as thread 0, so the call finishes even if no worker is free. Thread indices
+    // that no worker took leave their ranges to be stolen.
+    run_tasks(&job, 0);
+    pthread_mutex_lock(&pool.lock);
+    unlink_job(&job);
+    while (job.busy_workers)
+        pthread_cond_wait(&pool.job_done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+    for (unsigned i = 0; i < num_threads; i++)
+        pthread_mutex_destroy(&ranges[i].lock);
+    free(ranges);
+    return 0;
+}
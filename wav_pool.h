@@ -0,0 +1,42 @@
+#ifndef WAV_POOL_H
+#define WAV_POOL_H
+
+/*
+    Internal thread pool used by the batch and parallel functions of the library.
+    Not part of the public API.
+*/
+
+#include "wav_handler.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Returns the number of online processors, at least 1.
+ */
+unsigned wav_default_num_threads(void);
+
+/**
+ * @brief Run task for every task index 0 ... num_tasks - 1 using num_threads threads (0 for
+ * wav_default_num_threads). The calling thread takes part in the work.
+ *
+ * The other threads are workers of a process-wide pool, which are started when a call first needs them and
+ * then wait for the next call, so a call doesn't pay for starting threads. Concurrent calls and calls made
+ * from a task share the workers; a call that gets no free worker runs all its tasks on the calling thread.
+ *
+ * The task indices are split into contiguous ranges, one per thread, which the threads run front to back.
+ * A thread that runs out of work steals the back half of the range of another thread, so uneven task
+ * durations are balanced without the threads contending on shared state in the common case.
+ * Returns when all tasks have finished.
+ *
+ * Returns 0 on success or -1 if memory for the threads can't be allocated, in which case no task has been run.
+ */
+int wav_parallel_for(unsigned num_threads, unsigned long long num_tasks, wav_task_fn task, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,318 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wav_handler.h"
+#include "wav_convert.h"
+
+// Zero crossings of the sinc on each side of the center at the input rate when upsampling
+#define RESAMPLE_ZERO_CROSSINGS 32
+// Kaiser window shape, about 90 dB stopband attenuation
+#define RESAMPLE_KAISER_BETA 9.0
+// Cutoff relative to the lower Nyquist frequency, leaving room for the transition band
+#define RESAMPLE_CUTOFF 0.95
+// Filter lengths are padded with zeros to a multiple of the vector width
+#define RESAMPLE_TAP_ALIGN 8
+// Frames read at a time by wav_resampler_read and converted at a time by wav_resample
+#define RESAMPLE_BLOCK_FRAMES 4096
+
+struct wav_resampler
+{
+    unsigned channels;
+    // Output frame n is at input position n * down / up
+    unsigned up;
+    unsigned down;
+    unsigned taps;
+    // The filter of each phase starts half - 1 frames before the input frame preceding the output position
+    unsigned half;
+    // up filters of taps coefficients
+    float *filters;
+    // Buffered input of each channel, starting with half - 1 frames of silence before the first frame
+    float *history[WAV_PLANAR_MAX_CHANNELS];
+    size_t length;
+    size_t capacity;
+    // Index in history of the input frame preceding the next output position, and the fraction in 1 / up frames
+    size_t position;
+    unsigned phase;
+    unsigned long long frames_in;
+    unsigned long long frames_out;
+    int flushed;
+    // Interleaved input block of wav_resampler_read
+    float *block;
+};
+
+static unsigned gcd(unsigned a, unsigned b)
+{
+    while (b)
+    {
+        const unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Modified Bessel function of the first kind of order 0
+static double bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+    for (int k = 1; k < 50 && term > sum * 1e-17; k++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Coefficients of every phase, each normalized to unity gain at DC
+static void design_filters(struct wav_resampler *r, double cutoff)
+{
+    const double i0_beta = bessel_i0(RESAMPLE_KAISER_BETA);
+    for (unsigned p = 0; p < r->up; p++)
+    {
+        float *h = r->filters + (size_t)p * r->taps;
+        double sum = 0;
+        for (unsigned k = 0; k < r->taps; k++)
+        {
+            // Distance of the input frame from the output position
+            const double d = (double)k - (r->half - 1) - (double)p / r->up;
+            const double x = d / r->half;
+            double c = 0;
+            if (k < 2 * r->half && x > -1 && x < 1)
+            {
+                const double w = bessel_i0(RESAMPLE_KAISER_BETA * sqrt(1 - x * x)) / i0_beta;
+                c = d == 0 ? cutoff : sin(M_PI * cutoff * d) / (M_PI * d);
+                c *= w;
+            }
+            h[k] = c;
+            sum += c;
+        }
+        for (unsigned k = 0; k < r->taps; k++)
+            h[k] /= sum;
+    }
+}
+
+int wav_resampler_create(struct wav_resampler **resampler, unsigned channels, unsigned in_rate, unsigned out_rate)
+{
+    *resampler = NULL;
+    if (!channels || channels > WAV_PLANAR_MAX_CHANNELS || !in_rate || !out_rate)
+        return -1;
+    const unsigned g = gcd(in_rate, out_rate);
+    if (out_rate / g > WAV_RESAMPLE_MAX_PHASES)
+        return -1;
+    struct wav_resampler *r = (struct wav_resampler *)calloc(1, sizeof(struct wav_resampler));
+    if (!r)
+        return -1;
+    r->channels = channels;
+    r->up = out_rate / g;
+    r->down = in_rate / g;
+    // The filter is stretched by down / up when downsampling to cut off at the output Nyquist frequency
+    const double cutoff = RESAMPLE_CUTOFF * (r->up < r->down ? (double)r->up / r->down : 1.0);
+    r->half = (unsigned)ceil(RESAMPLE_ZERO_CROSSINGS * RESAMPLE_CUTOFF / cutoff);
+    r->taps = (2 * r->half + RESAMPLE_TAP_ALIGN - 1) / RESAMPLE_TAP_ALIGN * RESAMPLE_TAP_ALIGN;
+    r->filters = (float *)malloc(sizeof(float) * r->up * r->taps);
+    if (!r->filters)
+    {
+        free(r);
+        return -1;
+    }
+    design_filters(r, cutoff);
+    wav_resampler_reset(r);
+    *resampler = r;
+    return 0;
+}
+
+unsigned long long wav_resampler_output_frames(const struct wav_resampler *resampler, unsigned long long in_frames)
+{
+    const unsigned long long whole = in_frames / resampler->down, rest = in_frames % resampler->down;
+    // Split so that in_frames * up can't overflow
+    return whole * resampler->up + (rest * resampler->up + resampler->down - 1) / resampler->down;
+}
+
+void wav_resampler_reset(struct wav_resampler *resampler)
+{
+    struct wav_resampler *r = resampler;
+    r->length = r->half - 1;
+    for (unsigned c = 0; c < r->channels && r->capacity; c++)
+        memset(r->history[c], 0, sizeof(float) * r->length);
+    r->position = r->half - 1;
+    r->phase = 0;
+    r->frames_in = r->frames_out = 0;
+    r->flushed = 0;
+}
+
+int wav_resampler_free(struct wav_resampler *resampler)
+{
+    if (!resampler)
+        return -1;
+    for (unsigned c = 0; c < resampler->channels; c++)
+        free(resampler->history[c]);
+    free(resampler->filters);
+    free(resampler->block);
+    free(resampler);
+    return 0;
+}
+
+// Drops the frames no longer needed by the filter and makes room for num_frames more.
+// Returns 0 on success.
+static int reserve_history(struct wav_resampler *r, size_t num_frames)
+{
+    // The first frame used by the next output
+    const size_t start = r->position - (r->half - 1);
+    if (start && r->capacity)
+    {
+        for (unsigned c = 0; c < r->channels; c++)
+            memmove(r->history[c], r->history[c] + start, sizeof(float) * (r->length - start));
+        r->length -= start;
+        r->position -= start;
+    }
+    if (r->length + num_frames <= r->capacity)
+        return 0;
+    size_t capacity = r->capacity ? r->capacity : 2 * r->taps;
+    while (capacity < r->length + num_frames)
+        capacity *= 2;
+    for (unsigned c = 0; c < r->channels; c++)
+    {
+        float *history = (float *)realloc(r->history[c], sizeof(float) * capacity);
+        if (!history)
+            return -1;
+        // The silence before the first frame
+        if (!r->capacity)
+            memset(history, 0, sizeof(float) * r->length);
+        r->history[c] = history;
+    }
+    r->capacity = capacity;
+    return 0;
+}
+
+// Writes the output frames the buffered input is sufficient for, up to max_frames and the total output
+static int produce(struct wav_resampler *r, float *out, unsigned max_frames)
+{
+    const unsigned long long total = wav_resampler_output_frames(r, r->frames_in);
+    unsigned n = 0;
+    while (n < max_frames && r->frames_out < total && r->position - (r->half - 1) + r->taps <= r->length)
+    {
+        const float *h = r->filters + (size_t)r->phase * r->taps;
+        const size_t start = r->position - (r->half - 1);
+        for (unsigned c = 0; c < r->channels; c++)
+            out[(size_t)n * r->channels + c] = wav_dot(h, r->history[c] + start, r->taps);
+        r->phase += r->down;
+        r->position += r->phase / r->up;
+        r->phase %= r->up;
+        r->frames_out++;
+        n++;
+    }
+    return n;
+}
+
+int wav_resampler_process(struct wav_resampler *resampler, const float *in, unsigned in_frames, float *out, unsigned max_frames)
+{
+    struct wav_resampler *r = resampler;
+    if (r->flushed || (in_frames && reserve_history(r, in_frames)))
+        return -1;
+    // Deinterleaved into the history of each channel
+    for (unsigned c = 0; c < r->channels; c++)
+    {
+        float *dst = r->history[c] + r->length;
+        for (unsigned i = 0; i < in_frames; i++)
+            dst[i] = in[(size_t)i * r->channels + c];
+    }
+    r->length += in_frames;
+    r->frames_in += in_frames;
+    return produce(r, out, max_frames);
+}
+
+int wav_resampler_flush(struct wav_resampler *resampler, float *out, unsigned max_frames)
+{
+    struct wav_resampler *r = resampler;
+    if (!r->flushed)
+    {
+        // Silence after the last frame lets the filter reach the last output position
+        if (reserve_history(r, r->taps))
+            return -1;
+        for (unsigned c = 0; c < r->channels; c++)
+            memset(r->history[c] + r->length, 0, sizeof(float) * r->taps);
+        r->length += r->taps;
+        r->flushed = 1;
+    }
+    return produce(r, out, max_frames);
+}
+
+int wav_resampler_read(struct wav_resampler *resampler, struct wav_reader *reader, float *out, unsigned max_frames)
+{
+    struct wav_resampler *r = resampler;
+    if (wav_reader_format(reader)->channels != r->channels)
+        return -1;
+    if (!r->block)
+    {
+        r->block = (float *)malloc(sizeof(float) * RESAMPLE_BLOCK_FRAMES * r->channels);
+        if (!r->block)
+            return -1;
+    }
+    unsigned done = 0;
+    while (done < max_frames)
+    {
+        float *dst = out + (size_t)done * r->channels;
+        int n;
+        if (r->flushed)
+        {
+            n = wav_resampler_flush(r, dst, max_frames - done);
+            if (n <= 0)
+                return n < 0 ? -1 : (int)done;
+        }
+        else
+        {
+            // Pending output first, so that the buffered input doesn't grow
+            n = wav_resampler_process(r, NULL, 0, dst, max_frames - done);
+            if (!n)
+            {
+                const int frames = wav_reader_read(reader, r->block, RESAMPLE_BLOCK_FRAMES);
+                if (frames < 0)
+                    return -1;
+                n = frames ? wav_resampler_process(r, r->block, frames, dst, max_frames - done)
+                           : wav_resampler_flush(r, dst, max_frames - done);
+                if (n < 0)
+                    return -1;
+            }
+        }
+        done += n;
+    }
+    return done;
+}
+
+int wav_resample(const struct wav_file *in, struct wav_file *out, unsigned sample_rate)
+{
+    struct wav_resampler *r;
+    if (wav_resampler_create(&r, in->channels, in->sample_rate, sample_rate))
+        return -1;
+    const unsigned long long out_frames = wav_resampler_output_frames(r, in->num_frames);
+    // One input block gives at most this many output frames
+    const unsigned out_block_frames = wav_resampler_output_frames(r, RESAMPLE_BLOCK_FRAMES) + 1;
+    float *in_block = (float *)malloc(sizeof(float) * RESAMPLE_BLOCK_FRAMES * in->channels);
+    float *out_block = (float *)malloc(sizeof(float) * out_block_frames * in->channels);
+    int err = !in_block || !out_block || create_wav_file(out, out_frames, in->channels, in->bit_depth, sample_rate);
+    if (!err)
+    {
+        out->is_float = in->is_float;
+        unsigned long long written = 0;
+        for (unsigned long long done = 0; !err && done < in->num_frames; done += RESAMPLE_BLOCK_FRAMES)
+        {
+            const unsigned n = in->num_frames - done < RESAMPLE_BLOCK_FRAMES ? in->num_frames - done : RESAMPLE_BLOCK_FRAMES;
+            err = wav_get_normalized_range(in, done, n, in_block);
+            const int frames = err ? -1 : wav_resampler_process(r, in_block, n, out_block, out_block_frames);
+            err = frames < 0 || (frames && wav_set_normalized_range(out, written, frames, out_block));
+            written += frames;
+        }
+        int frames;
+        while (!err && (frames = wav_resampler_flush(r, out_block, out_block_frames)) > 0)
+        {
+            err = wav_set_normalized_range(out, written, frames, out_block);
+            written += frames;
+        }
+        if (err)
+            free_wav_file(out);
+    }
+    free(in_block);
+    free(out_block);
+    wav_resampler_free(r);
+    return err ? -1 : 0;
+}
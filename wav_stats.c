@@ -0,0 +1,356 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "wav_handler.h"
+#include "wav_convert.h"
+#include "wav_stats.h"
+
+// Samples decoded at a time, split over the channels. 32 KiB of floats stays in the L1 cache.
+#define STATS_BLOCK_SAMPLES 8192
+// Frames read at a time by wav_read_stats_ex to hash the data, a multiple of 8 as data_hash requires
+#define STATS_HASH_BLOCK_FRAMES 8192
+#define STATS_CHUNK_VERSION 3
+// Version, channels, frame count, bit depth, float flag, data size in bytes and hash of the data
+#define STATS_CHUNK_HEADER_SIZE 40
+// Peak, peak frame, sum and sum of squares
+#define STATS_CHUNK_CHANNEL_SIZE 28
+
+typedef void (*stats_block_func)(struct wav_stats *stats, float *const *channels, unsigned long long first_frame, size_t num_frames);
+
+// Decodes frames first_frame ... first_frame + num_frames - 1 of wav block by block into planar channel arrays
+// and passes each block to func
+static void for_each_block(const struct wav_file *wav, int format, unsigned long long first_frame, unsigned long long num_frames,
+                           struct wav_stats *stats, stats_block_func func)
+{
+    float block[STATS_BLOCK_SAMPLES];
+    float *channels[WAV_STATS_MAX_CHANNELS];
+    const size_t block_frames = STATS_BLOCK_SAMPLES / wav->channels;
+    const size_t bytes_per_frame = (size_t)wav->bit_depth / 8 * wav->channels;
+    for (unsigned c = 0; c < wav->channels; c++)
+        channels[c] = block + c * block_frames;
+    for (unsigned long long done = 0; done < num_frames; done += block_frames)
+    {
+        const size_t n = num_frames - done < block_frames ? num_frames - done : block_frames;
+        wav_decode_planar(format, wav->data + (first_frame + done) * bytes_per_frame, wav->channels, channels, 0, n);
+        func(stats, channels, first_frame + done, n);
+    }
+}
+
+static void add_block(struct wav_stats *stats, float *const *channels, unsigned long long first_frame, size_t num_frames)
+{
+    for (unsigned c = 0; c < stats->channels; c++)
+    {
+        struct wav_channel_stats *ch = &stats->channel[c];
+        const float *x = channels[c];
+        float max_abs = 0;
+        wav_accumulate_stats(x, num_frames, &max_abs, &ch->sum, &ch->sum_squares);
+        // A stale peak is an upper bound of the other samples, so reaching it gives the exact peak again
+        if (max_abs > ch->peak || (ch->peak_stale && max_abs >= ch->peak))
+        {
+            size_t i = 0;
+            while (i + 1 < num_frames && x[i] != max_abs && x[i] != -max_abs)
+                i++;
+            ch->peak = max_abs;
+            ch->peak_frame = first_frame + i;
+            ch->peak_stale = 0;
+        }
+    }
+}
+
+static void remove_block(struct wav_stats *stats, float *const *channels, unsigned long long first_frame, size_t num_frames)
+{
+    for (unsigned c = 0; c < stats->channels; c++)
+    {
+        struct wav_channel_stats *ch = &stats->channel[c];
+        float max_abs = 0;
+        double sum = 0, sum_squares = 0;
+        wav_accumulate_stats(channels[c], num_frames, &max_abs, &sum, &sum_squares);
+        ch->sum -= sum;
+        ch->sum_squares -= sum_squares;
+        if (ch->peak_frame >= first_frame && ch->peak_frame - first_frame < num_frames)
+            ch->peak_stale = 1;
+    }
+}
+
+// Returns the SAMPLE_FORMAT_* constant of wav, or SAMPLE_FORMAT_UNSUPPORTED if it has no statistics support
+static int stats_sample_format(const struct wav_file *wav)
+{
+    if (!wav->data || !wav->channels || wav->channels > WAV_STATS_MAX_CHANNELS)
+        return SAMPLE_FORMAT_UNSUPPORTED;
+    return wav_sample_format(wav);
+}
+
+int wav_compute_stats(const struct wav_file *wav, struct wav_stats *stats)
+{
+    const int format = stats_sample_format(wav);
+    if (format == SAMPLE_FORMAT_UNSUPPORTED)
+        return -1;
+    memset(stats, 0, sizeof(struct wav_stats));
+    stats->channels = wav->channels;
+    stats->num_frames = wav->num_frames;
+    for_each_block(wav, format, 0, wav->num_frames, stats, add_block);
+    return 0;
+}
+
+double wav_stats_rms(const struct wav_stats *stats, unsigned channel)
+{
+    // Removing and adding samples can leave a tiny negative rounding error in an all-zero channel
+    const double sum_squares = stats->channel[channel].sum_squares;
+    return stats->num_frames && sum_squares > 0 ? sqrt(sum_squares / stats->num_frames) : 0;
+}
+
+double wav_stats_dc_offset(const struct wav_stats *stats, unsigned channel)
+{
+    return stats->num_frames ? stats->channel[channel].sum / stats->num_frames : 0;
+}
+
+int wav_track_stats(struct wav_file *wav, struct wav_stats *stats)
+{
+    if (stats && wav_compute_stats(wav, stats))
+        return -1;
+    wav->stats = stats;
+    return 0;
+}
+
+int wav_refresh_stats(struct wav_file *wav)
+{
+    if (!wav->stats)
+        return -1;
+    for (unsigned c = 0; c < wav->stats->channels; c++)
+    {
+        if (wav->stats->channel[c].peak_stale)
+            return wav_compute_stats(wav, wav->stats);
+    }
+    return 0;
+}
+
+void wav_stats_remove_range(struct wav_file *wav, unsigned long long first_frame, unsigned long long num_frames)
+{
+    const int format = stats_sample_format(wav);
+    if (format != SAMPLE_FORMAT_UNSUPPORTED)
+        for_each_block(wav, format, first_frame, num_frames, wav->stats, remove_block);
+}
+
+void wav_stats_add_range(struct wav_file *wav, unsigned long long first_frame, unsigned long long num_frames)
+{
+    const int format = stats_sample_format(wav);
+    if (format != SAMPLE_FORMAT_UNSUPPORTED)
+        for_each_block(wav, format, first_frame, num_frames, wav->stats, add_block);
+}
+
+#define DATA_HASH_SEED 0xCBF29CE484222325ull
+
+// Hash of num_bytes bytes of data, continuing from hash. Mixes 8 bytes at a time, so that hashing keeps up
+// with reading; data hashed in parts gives the same hash if all but the last part are a multiple of 8 bytes.
+static uint64_t data_hash(uint64_t hash, const char *data, size_t num_bytes)
+{
+    size_t i = 0;
+    for (; i + 8 <= num_bytes; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < num_bytes; i++)
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+static uint64_t wav_data_hash(const struct wav_file *wav)
+{
+    return data_hash(DATA_HASH_SEED, wav->data, wav->num_bytes);
+}
+
+static const char *get_bytes(const char *p, void *dst, size_t num_bytes)
+{
+    memcpy(dst, p, num_bytes);
+    return p + num_bytes;
+}
+
+static char *put_bytes(char *p, const void *src, size_t num_bytes)
+{
+    memcpy(p, src, num_bytes);
+    return p + num_bytes;
+}
+
+// Parses a statistics chunk and checks that it belongs to data in format, and to data with the hash
+// data_hash unless it is NULL
+static int parse_stats_chunk(const struct wav_file_custom_header_data *chunk, const struct wav_file *format, const uint64_t *data_hash,
+                             struct wav_stats *stats)
+{
+    unsigned version, channels, bit_depth, is_float;
+    unsigned long long num_frames, num_bytes;
+    uint64_t stored_hash;
+    if (strcmp(chunk->header_name, WAV_STATS_CHUNK_ID) || !chunk->data || chunk->num_bytes < STATS_CHUNK_HEADER_SIZE)
+        return -1;
+    const char *p = chunk->data;
+    p = get_bytes(p, &version, 4);
+    p = get_bytes(p, &channels, 4);
+    p = get_bytes(p, &num_frames, 8);
+    p = get_bytes(p, &bit_depth, 4);
+    p = get_bytes(p, &is_float, 4);
+    p = get_bytes(p, &num_bytes, 8);
+    p = get_bytes(p, &stored_hash, 8);
+    if (version != STATS_CHUNK_VERSION || channels != format->channels || channels > WAV_STATS_MAX_CHANNELS ||
+        chunk->num_bytes != STATS_CHUNK_HEADER_SIZE + channels * STATS_CHUNK_CHANNEL_SIZE || num_frames != format->num_frames ||
+        bit_depth != format->bit_depth || is_float != (unsigned)format->is_float || num_bytes != format->num_bytes ||
+        (data_hash && stored_hash != *data_hash))
+        return -1;
+    memset(stats, 0, sizeof(struct wav_stats));
+    stats->channels = channels;
+    stats->num_frames = num_frames;
+    for (unsigned c = 0; c < channels; c++)
+    {
+        p = get_bytes(p, &stats->channel[c].peak, 4);
+        p = get_bytes(p, &stats->channel[c].peak_frame, 8);
+        p = get_bytes(p, &stats->channel[c].sum, 8);
+        p = get_bytes(p, &stats->channel[c].sum_squares, 8);
+    }
+    return 0;
+}
+
+int wav_stats_chunks(const struct wav_file *wav, const struct wav_stats *stats, struct wav_file_custom_header_data *chdr)
+{
+    if (stats_sample_format(wav) == SAMPLE_FORMAT_UNSUPPORTED || stats->channels != wav->channels || stats->num_frames != wav->num_frames)
+        return -1;
+    for (unsigned c = 0; c < stats->channels; c++)
+    {
+        if (stats->channel[c].peak_stale)
+            return -1;
+    }
+    const unsigned peak_size = 8 + 8 * stats->channels;
+    const unsigned stats_size = STATS_CHUNK_HEADER_SIZE + STATS_CHUNK_CHANNEL_SIZE * stats->channels;
+    char *peak_data = (char *)malloc(peak_size);
+    char *stats_data = (char *)malloc(stats_size);
+    if (!peak_data || !stats_data)
+    {
+        free(peak_data);
+        free(stats_data);
+        return -1;
+    }
+
+    // PEAK chunk as specified in EBU Tech 3285 supplement 3: version, timestamp, then value and position per channel
+    const unsigned peak_version = 1, timestamp = (unsigned)time(NULL);
+    char *p = peak_data;
+    p = put_bytes(p, &peak_version, 4);
+    p = put_bytes(p, &timestamp, 4);
+    for (unsigned c = 0; c < stats->channels; c++)
+    {
+        const unsigned long long frame = stats->channel[c].peak_frame;
+        const unsigned position = frame > 0xFFFFFFFFull ? 0xFFFFFFFFu : (unsigned)frame;
+        p = put_bytes(p, &stats->channel[c].peak, 4);
+        p = put_bytes(p, &position, 4);
+    }
+
+    const unsigned version = STATS_CHUNK_VERSION, is_float = wav->is_float;
+    const uint64_t hash = wav_data_hash(wav);
+    p = stats_data;
+    p = put_bytes(p, &version, 4);
+    p = put_bytes(p, &stats->channels, 4);
+    p = put_bytes(p, &stats->num_frames, 8);
+    p = put_bytes(p, &wav->bit_depth, 4);
+    p = put_bytes(p, &is_float, 4);
+    p = put_bytes(p, &wav->num_bytes, 8);
+    p = put_bytes(p, &hash, 8);
+    for (unsigned c = 0; c < stats->channels; c++)
+    {
+        p = put_bytes(p, &stats->channel[c].peak, 4);
+        p = put_bytes(p, &stats->channel[c].peak_frame, 8);
+        p = put_bytes(p, &stats->channel[c].sum, 8);
+        p = put_bytes(p, &stats->channel[c].sum_squares, 8);
+    }
+
+    memcpy(chdr[0].header_name, "PEAK", 5);
+    chdr[0].num_bytes = peak_size;
+    chdr[0].data = peak_data;
+    memcpy(chdr[1].header_name, WAV_STATS_CHUNK_ID, 5);
+    chdr[1].num_bytes = stats_size;
+    chdr[1].data = stats_data;
+    memset(&chdr[2], 0, sizeof(struct wav_file_custom_header_data));
+    return 0;
+}
+
+int wav_stats_from_chunk(const struct wav_file *wav, const struct wav_file_custom_header_data *chunk, struct wav_stats *stats, int flags)
+{
+    if (stats_sample_format(wav) == SAMPLE_FORMAT_UNSUPPORTED)
+        return -1;
+    const uint64_t hash = flags & WAV_STATS_VERIFY_DATA ? wav_data_hash(wav) : 0;
+    return parse_stats_chunk(chunk, wav, flags & WAV_STATS_VERIFY_DATA ? &hash : NULL, stats);
+}
+
+int wav_read_stats(const char *file_name, struct wav_stats *stats)
+{
+    return wav_read_stats_ex(file_name, stats, 0);
+}
+
+int wav_read_stats_ex(const char *file_name, struct wav_stats *stats, int flags)
+{
+    struct wav_reader *reader;
+    if (wav_reader_open(&reader, file_name, NULL, 0))
+        return -1;
+    const struct wav_file *format = wav_reader_format(reader);
+    struct wav_file_custom_header_data chunk = {WAV_STATS_CHUNK_ID, 0, NULL};
+    const size_t bytes_per_frame = (size_t)format->bit_depth / 8 * format->channels;
+    const int verify = flags & WAV_STATS_VERIFY_DATA;
+    char *block = verify ? (char *)malloc(bytes_per_frame * STATS_HASH_BLOCK_FRAMES + 1) : NULL;
+    int err = (verify && !block) || wav_reader_read_chunk(reader, &chunk);
+    // The data is only read when the hash is checked, raw, which is still much cheaper than decoding it
+    uint64_t hash = DATA_HASH_SEED;
+    for (unsigned long long frame = 0; verify && !err && frame < format->num_frames; frame += STATS_HASH_BLOCK_FRAMES)
+    {
+        const unsigned frames = format->num_frames - frame < STATS_HASH_BLOCK_FRAMES ? format->num_frames - frame : STATS_HASH_BLOCK_FRAMES;
+        err = wav_reader_read_raw(reader, block, frames) != (int)frames;
+        hash = data_hash(hash, block, frames * bytes_per_frame);
+    }
+    if (!err)
+        err = parse_stats_chunk(&chunk, format, verify ? &hash : NULL, stats);
+    free(block);
+    free(chunk.data);
+    wav_reader_close(reader);
+    return err ? -1 : 0;
+}
+
+int write_wav_file_stats(const char *file_name, const struct wav_file *wav, const struct wav_file_custom_header_data *chdr, int flags)
+{
+    unsigned num_headers = 0;
+    while (chdr && chdr[num_headers].header_name[0])
+        num_headers++;
+    // Stored statistics that no longer match the data are left out, the tracked ones replace them
+    int drop_stats = wav->stats != NULL;
+    for (unsigned i = 0; !drop_stats && i < num_headers; i++)
+    {
+        struct wav_stats stored;
+        drop_stats = !strcmp(chdr[i].header_name, WAV_STATS_CHUNK_ID) && wav_stats_from_chunk(wav, &chdr[i], &stored, WAV_STATS_VERIFY_DATA);
+    }
+    struct wav_file_custom_header_data *list =
+        (struct wav_file_custom_header_data *)malloc(sizeof(struct wav_file_custom_header_data) * (num_headers + 3));
+    if (!list)
+        return -1;
+    unsigned n = 0;
+    for (unsigned i = 0; i < num_headers; i++)
+    {
+        if (!drop_stats || (strcmp(chdr[i].header_name, "PEAK") && strcmp(chdr[i].header_name, WAV_STATS_CHUNK_ID)))
+            list[n++] = chdr[i];
+    }
+    memset(&list[n], 0, sizeof(struct wav_file_custom_header_data));
+    int err = 0;
+    if (wav->stats)
+    {
+        // Stale peaks are recomputed, the tracked statistics are left as they are
+        struct wav_stats fresh;
+        err = wav_stats_chunks(wav, wav->stats, list + n) &&
+              (wav_compute_stats(wav, &fresh) || wav_stats_chunks(wav, &fresh, list + n));
+    }
+    if (!err)
+        err = write_wav_file_ex(file_name, wav, list, flags);
+    if (wav->stats && list[n].header_name[0])
+    {
+        free(list[n].data);
+        free(list[n + 1].data);
+    }
+    free(list);
+    return err ? -1 : 0;
+}
@@ -0,0 +1,32 @@
+#ifndef WAV_STATS_H
+#define WAV_STATS_H
+
+/*
+    Internal hooks of the incremental statistics, called by the set functions of the library.
+    Not part of the public API.
+*/
+
+#include "wav_handler.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Remove frames first_frame ... first_frame + num_frames - 1 from the statistics tracked for wav.
+ * Called before the frames are overwritten. The range must be valid.
+ */
+void wav_stats_remove_range(struct wav_file *wav, unsigned long long first_frame, unsigned long long num_frames);
+
+/**
+ * @brief Add frames first_frame ... first_frame + num_frames - 1 to the statistics tracked for wav.
+ * Called after the frames have been written. The range must be valid.
+ */
+void wav_stats_add_range(struct wav_file *wav, unsigned long long first_frame, unsigned long long num_frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif